@@ -20,8 +20,14 @@
 #include "DirectXPackedVector.h"
 #include "ScreenGrab.h"
 
+#include "Animation.h"
+#include "AnimationBatch.h"
+#include "AnimationCompression.h"
+#include "BonePaletteCache.h"
+
 #include <wrl/client.h>
 
+#include <stdio.h>
 #include <wincodec.h>
 
 using namespace DirectX;
@@ -31,7 +37,26 @@ using Microsoft::WRL::ComPtr;
 // Build for LH vs. RH coords
 #define LH_COORDS
 
-struct aligned_deleter { void operator()(void* p) { _aligned_free(p); } };
+// Time the CPU animation runtime at startup (results go to the debug output)
+//#define BENCHMARK_ANIMATION
+
+// Draw a crowd of soldiers whose poses are evaluated on worker threads
+//#define USE_CROWD
+
+// Play a compressed copy of the soldier's clip
+//#define USE_COMPRESSED_CLIP
+
+// Sets one mesh's palette on the effects of its parts
+static void SetMeshBoneTransforms( BonePaletteCache& paletteCache, const Model& model, size_t mesh, _In_reads_(count) const XMMATRIX* bones, size_t count )
+{
+    auto& parts = model.meshes[ mesh ]->meshParts;
+    for( auto it = parts.cbegin(); it != parts.cend(); ++it )
+    {
+        auto skinnedEffect = dynamic_cast<IEffectSkinning*>( ( *it )->effect.get() );
+        if ( skinnedEffect )
+            paletteCache.SetBoneTransforms( skinnedEffect, bones, count );
+    }
+}
 
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
@@ -145,7 +170,7 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
 #endif
 
     std::unique_ptr<XMMATRIX[], aligned_deleter> bones(
-        reinterpret_cast<XMMATRIX*>( _aligned_malloc( sizeof(XMMATRIX) * SkinnedEffect::MaxBones, 16 ) ) );
+        reinterpret_cast<XMMATRIX*>( AlignedAlloc( sizeof(XMMATRIX) * SkinnedEffect::MaxBones, 16 ) ) );
 
     XMMATRIX id = XMMatrixIdentity();
     for( size_t j=0; j < SkinnedEffect::MaxBones; ++j )
@@ -153,6 +178,9 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
         bones[ j ] = id;
     }
 
+    // Every palette goes through the cache, so effects are only written when a palette changes
+    BonePaletteCache paletteCache;
+
     // VS 2012 CMO
     auto teapot = Model::CreateFromCMO( device.Get(), L"teapot.cmo", fx, ccw, false );
 
@@ -161,6 +189,55 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
 
     auto soldier = Model::CreateFromSDKMESH( device.Get(), L"soldier.sdkmesh", fx, !ccw, false );
 
+    // The soldier's frame hierarchy, and the clip that animates it
+    Skeleton soldierSkeleton;
+    if (FAILED(hr = LoadSkeletonFromSDKMESH( L"soldier.sdkmesh", soldierSkeleton )))
+        return 1;
+
+    AnimationClip soldierClip;
+    if (FAILED(hr = LoadAnimationClipFromSDKMESH_ANIM( L"soldier.sdkmesh_anim", soldierClip )))
+        return 1;
+
+#ifdef USE_COMPRESSED_CLIP
+    // Compressed here at load, as there is no file format for compressed clips
+    CompressedAnimationClip soldierCompressedClip;
+    if ( !CompressAnimationClip( soldierClip, AnimationCompressionSettings(), soldierCompressedClip ) )
+        return 1;
+
+    const AnimationClipBase& soldierPlayback = soldierCompressedClip;
+#else
+    const AnimationClipBase& soldierPlayback = soldierClip;
+#endif
+
+    AnimationInstance soldierAnim( soldierSkeleton, soldierPlayback );
+
+#ifdef BENCHMARK_ANIMATION
+    BenchmarkAnimation( soldierSkeleton, soldierClip, 1, 10000 );
+    BenchmarkAnimation( soldierSkeleton, soldierClip, 100, 100 );
+    BenchmarkAnimationBatch( soldierSkeleton, soldierClip, 256, 100 );
+
+    {
+        CompressedAnimationClip compressedClip;
+        if ( CompressAnimationClip( soldierClip, AnimationCompressionSettings(), compressedClip ) )
+        {
+            BenchmarkAnimationCompression( soldierSkeleton, soldierClip, compressedClip, 10000 );
+            BenchmarkAnimation( soldierSkeleton, compressedClip, 100, 100 );
+        }
+    }
+#endif
+
+#ifdef USE_CROWD
+    const size_t crowdColumns = 8;
+    const size_t crowdRows = 4;
+
+    // Each row plays in step, so the palette cache uploads a row's palettes once
+    AnimationBatch crowd( SkinnedEffect::MaxBones );
+    for( size_t j = 0; j < crowdColumns * crowdRows; ++j )
+    {
+        crowd.Add( soldierSkeleton, soldierPlayback, soldierPlayback.GetDuration() * float( j / crowdColumns ) / float( crowdRows ) );
+    }
+#endif
+
     bool quit = false;
 
     D3D11_VIEWPORT vp = { 0, 0, (float)client.right, (float)client.bottom, 0, 1 };
@@ -198,6 +275,13 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
         
         float time = (float)(counter.QuadPart - start.QuadPart) / (float)freq.QuadPart;
 
+        paletteCache.ResetStats();
+
+#ifdef USE_CROWD
+        // Evaluated while the rest of the scene is drawn
+        crowd.Begin( time );
+#endif
+
         context->ClearRenderTargetView(backBuffer.Get(), Colors::CornflowerBlue);
         context->ClearDepthStencilView(depthStencil.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1, 0);
 
@@ -248,7 +332,7 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
         {
             auto skinnedEffect = dynamic_cast<IEffectSkinning*>( effect );
             if ( skinnedEffect )
-                skinnedEffect->ResetBoneTransforms();
+                paletteCache.ResetBoneTransforms( skinnedEffect );
         });
         local = XMMatrixMultiply( XMMatrixScaling( 0.01f, 0.01f, 0.01f ), XMMatrixTranslation( -2.f, row0, 0.f ) );
         teapot->Draw( context.Get(), states, local, view, projection );
@@ -257,7 +341,7 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
         {
             auto skinnedEffect = dynamic_cast<IEffectSkinning*>( effect );
             if ( skinnedEffect )
-                skinnedEffect->SetBoneTransforms(bones.get(), SkinnedEffect::MaxBones);
+                paletteCache.SetBoneTransforms( skinnedEffect, bones.get(), SkinnedEffect::MaxBones );
         });
         local = XMMatrixMultiply( XMMatrixScaling( 0.01f, 0.01f, 0.01f ), XMMatrixTranslation( -2.f, row1, 0.f ) );
         teapot->Draw( context.Get(), states, local, view, projection );
@@ -267,27 +351,54 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
         {
             auto skinnedEffect = dynamic_cast<IEffectSkinning*>( effect );
             if ( skinnedEffect )
-                skinnedEffect->ResetBoneTransforms();
+                paletteCache.ResetBoneTransforms( skinnedEffect );
         });
         local = XMMatrixMultiply( XMMatrixScaling( 2.f, 2.f, 2.f ), XMMatrixTranslation( 2.f, row0, 0.f ) );
         local = XMMatrixMultiply( world, local );
         soldier->Draw( context.Get(), states, local, view, projection );
 
-        soldier->UpdateEffects([&](IEffect* effect)
+        // Each mesh gets its own palette, as its blend indices refer to its own frame influences.
+        // The soldier's meshes use different materials, so no effect is shared between them.
+        soldierAnim.Update( time );
+        for( size_t j = 0; j < soldier->meshes.size() && j < soldierSkeleton.GetMeshCount(); ++j )
         {
-            auto skinnedEffect = dynamic_cast<IEffectSkinning*>( effect );
-            if ( skinnedEffect )
-                skinnedEffect->SetBoneTransforms(bones.get(), SkinnedEffect::MaxBones);
-        });
+            size_t count = soldierAnim.GetSkinTransforms( j, bones.get(), SkinnedEffect::MaxBones );
+            SetMeshBoneTransforms( paletteCache, *soldier, j, bones.get(), count );
+        }
         local = XMMatrixMultiply( XMMatrixScaling( 2.f, 2.f, 2.f ), XMMatrixTranslation( 2.f, row1, 0.f ) );
         local = XMMatrixMultiply( world, local );
         soldier->Draw( context.Get(), states, local, view, projection );
 
+#ifdef USE_CROWD
+        crowd.Wait();
+        for( size_t c = 0; c < crowd.GetInstanceCount(); ++c )
+        {
+            for( size_t j = 0; j < soldier->meshes.size() && j < soldierSkeleton.GetMeshCount(); ++j )
+            {
+                size_t count;
+                auto palette = crowd.GetSkinTransforms( c, j, count );
+                SetMeshBoneTransforms( paletteCache, *soldier, j, palette, count );
+            }
+
+            float x = -3.5f + float( c % crowdColumns );
+            float z = -3.f - 1.5f * float( c / crowdColumns );
+            local = XMMatrixMultiply( XMMatrixScaling( 2.f, 2.f, 2.f ), XMMatrixTranslation( x, row2, z ) );
+            local = XMMatrixMultiply( world, local );
+            soldier->Draw( context.Get(), states, local, view, projection );
+        }
+#endif
+
         swapChain->Present(1, 0);
         ++frame;
 
         if ( frame == 10 )
         {
+            auto& ps = paletteCache.GetStats();
+            char paletteBuff[ 256 ] = {};
+            sprintf_s( paletteBuff, "Bone palettes: %Iu of %Iu sets uploaded, %Iu of %Iu matrices written, %Iu bytes uploaded\n",
+                       ps.uploads, ps.requests, ps.matricesWritten, ps.matricesRequested, ps.bytesUploaded );
+            OutputDebugStringA( paletteBuff );
+
             ComPtr<ID3D11Texture2D> backBufferTex;
             hr = swapChain->GetBuffer( 0, __uuidof( ID3D11Texture2D ), ( LPVOID* )&backBufferTex);
             if ( SUCCEEDED(hr) )
@@ -0,0 +1,667 @@
+//--------------------------------------------------------------------------------------
+// File: Animation.cpp
+//
+// CPU skeletal animation for SDKMESH models and .sdkmesh_anim clips
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include "Animation.h"
+
+#include "../ModelTest/BenchmarkTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include "PlatformHelpers.h"
+#endif
+
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+// SDKMESH and SDKMESH_ANIM version 101 file layout. Only the parts that describe the
+// frame hierarchy are declared here; pointer fields are stored as 64-bit offsets.
+//--------------------------------------------------------------------------------------
+namespace
+{
+    const uint32_t SDKMESH_FILE_VERSION = 101;
+
+    const size_t MAX_VERTEX_STREAMS = 16;
+    const size_t MAX_FRAME_NAME = 100;
+    const size_t MAX_MESH_NAME = 100;
+
+    const uint32_t INVALID_FRAME = uint32_t( -1 );
+
+    #pragma pack(push,8)
+
+    struct SDKMESH_HEADER
+    {
+        uint32_t    Version;
+        uint8_t     IsBigEndian;
+        uint64_t    HeaderSize;
+        uint64_t    NonBufferDataSize;
+        uint64_t    BufferDataSize;
+
+        uint32_t    NumVertexBuffers;
+        uint32_t    NumIndexBuffers;
+        uint32_t    NumMeshes;
+        uint32_t    NumTotalSubsets;
+        uint32_t    NumFrames;
+        uint32_t    NumMaterials;
+
+        uint64_t    VertexStreamHeadersOffset;
+        uint64_t    IndexStreamHeadersOffset;
+        uint64_t    MeshDataOffset;
+        uint64_t    SubsetDataOffset;
+        uint64_t    FrameDataOffset;
+        uint64_t    MaterialDataOffset;
+    };
+
+    struct SDKMESH_MESH
+    {
+        char        Name[ MAX_MESH_NAME ];
+        uint8_t     NumVertexBuffers;
+        uint32_t    VertexBuffers[ MAX_VERTEX_STREAMS ];
+        uint32_t    IndexBuffer;
+        uint32_t    NumSubsets;
+        uint32_t    NumFrameInfluences;
+
+        XMFLOAT3    BoundingBoxCenter;
+        XMFLOAT3    BoundingBoxExtents;
+
+        uint64_t    SubsetOffset;
+        uint64_t    FrameInfluenceOffset;
+    };
+
+    struct SDKMESH_FRAME
+    {
+        char        Name[ MAX_FRAME_NAME ];
+        uint32_t    Mesh;
+        uint32_t    ParentFrame;
+        uint32_t    ChildFrame;
+        uint32_t    SiblingFrame;
+        XMFLOAT4X4  Matrix;
+        uint32_t    AnimationDataIndex;
+    };
+
+    struct SDKANIMATION_FILE_HEADER
+    {
+        uint32_t    Version;
+        uint8_t     IsBigEndian;
+        uint32_t    FrameTransformType;
+        uint32_t    NumFrames;
+        uint32_t    NumAnimationKeys;
+        uint32_t    AnimationFPS;
+        uint64_t    AnimationDataSize;
+        uint64_t    AnimationDataOffset;
+    };
+
+    struct SDKANIMATION_DATA
+    {
+        XMFLOAT3    Translation;
+        XMFLOAT4    Orientation;
+        XMFLOAT3    Scaling;
+    };
+
+    struct SDKANIMATION_FRAME_DATA
+    {
+        char        FrameName[ MAX_FRAME_NAME ];
+        uint64_t    DataOffset;         // From the end of the file header
+    };
+
+    #pragma pack(pop)
+
+    static_assert( sizeof(SDKMESH_HEADER) == 104, "SDKMESH header size mismatch" );
+    static_assert( sizeof(SDKMESH_MESH) == 224, "SDKMESH mesh size mismatch" );
+    static_assert( sizeof(SDKMESH_FRAME) == 184, "SDKMESH frame size mismatch" );
+    static_assert( sizeof(SDKANIMATION_FILE_HEADER) == 40, "SDKANIMATION header size mismatch" );
+    static_assert( sizeof(SDKANIMATION_DATA) == 40, "SDKANIMATION data size mismatch" );
+    static_assert( sizeof(SDKANIMATION_FRAME_DATA) == 112, "SDKANIMATION frame data size mismatch" );
+}
+
+
+//--------------------------------------------------------------------------------------
+// True if 'count' elements of 'elementSize' bytes at 'offset' fit below 'limit'
+static bool IsRangeValid( uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t limit )
+{
+    if ( offset > limit )
+        return false;
+
+    return ( count <= ( limit - offset ) / elementSize );
+}
+
+template<typename T>
+static const T* GetArray( const uint8_t* data, uint64_t offset, uint64_t count, uint64_t limit )
+{
+    if ( !IsRangeValid( offset, count, sizeof(T), limit ) )
+        return nullptr;
+
+    return reinterpret_cast<const T*>( data + offset );
+}
+
+// Names in these files are fixed-size and need not be terminated
+static std::string GetName( const char* name, size_t maxLength )
+{
+    return std::string( name, strnlen( name, maxLength ) );
+}
+
+// Through stdio, so it builds everywhere; the wide-path overload below uses Win32
+static bool ReadEntireFile( const char* fileName, std::unique_ptr<uint8_t[]>& data, size_t& dataSize )
+{
+    FILE* file = nullptr;
+#ifdef _WIN32
+    if ( fopen_s( &file, fileName, "rb" ) )
+        file = nullptr;
+#else
+    file = fopen( fileName, "rb" );
+#endif
+    if ( !file )
+        return false;
+
+    std::unique_ptr<FILE, int(*)(FILE*)> scopedFile( file, fclose );
+
+    if ( fseek( file, 0, SEEK_END ) )
+        return false;
+
+    long fileSize = ftell( file );
+    if ( fileSize < 0 || fseek( file, 0, SEEK_SET ) )
+        return false;
+
+    dataSize = static_cast<size_t>( fileSize );
+    data.reset( new uint8_t[ dataSize ] );
+
+    return ( fread( data.get(), 1, dataSize, file ) == dataSize );
+}
+
+#ifdef _WIN32
+static HRESULT ReadEntireFile( _In_z_ const wchar_t* szFileName, std::unique_ptr<uint8_t[]>& data, size_t& dataSize )
+{
+    ScopedHandle hFile( safe_handle( CreateFileW( szFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr ) ) );
+    if ( !hFile )
+        return HRESULT_FROM_WIN32( GetLastError() );
+
+    LARGE_INTEGER fileSize = {};
+    if ( !GetFileSizeEx( hFile.get(), &fileSize ) )
+        return HRESULT_FROM_WIN32( GetLastError() );
+
+    if ( fileSize.QuadPart > UINT32_MAX )
+        return HRESULT_FROM_WIN32( ERROR_FILE_TOO_LARGE );
+
+    dataSize = static_cast<size_t>( fileSize.QuadPart );
+    data.reset( new uint8_t[ dataSize ] );
+
+    DWORD bytesRead = 0;
+    if ( !ReadFile( hFile.get(), data.get(), static_cast<DWORD>( dataSize ), &bytesRead, nullptr ) )
+        return HRESULT_FROM_WIN32( GetLastError() );
+
+    if ( bytesRead != dataSize )
+        return E_FAIL;
+
+    return S_OK;
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Skeleton
+//--------------------------------------------------------------------------------------
+
+uint32_t Skeleton::FindBone( const char* name ) const
+{
+    for( size_t j = 0; j < m_names.size(); ++j )
+    {
+        if ( m_names[ j ] == name )
+            return static_cast<uint32_t>( j );
+    }
+
+    return NO_BONE;
+}
+
+
+//--------------------------------------------------------------------------------------
+void Skeleton::CopyBindPose( XMMATRIX* localTransforms ) const
+{
+    for( size_t j = 0; j < m_bindPose.size(); ++j )
+    {
+        localTransforms[ j ] = XMLoadFloat4x4( &m_bindPose[ j ] );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void Skeleton::ComputeWorldTransforms( const XMMATRIX* localTransforms, XMMATRIX* worldTransforms ) const
+{
+    // Parents come first, so one pass sees every parent finished
+    for( size_t j = 0; j < m_parents.size(); ++j )
+    {
+        uint32_t    parent = m_parents[ j ];
+        if ( parent == NO_BONE )
+            worldTransforms[ j ] = localTransforms[ j ];
+        else
+            worldTransforms[ j ] = XMMatrixMultiply( localTransforms[ j ], worldTransforms[ parent ] );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t Skeleton::ComputeSkinTransforms( size_t mesh, const XMMATRIX* worldTransforms, XMMATRIX* bones, size_t maxBones ) const
+{
+    auto& influences = m_meshInfluences[ mesh ];
+
+    size_t count = std::min( influences.size(), maxBones );
+    for( size_t j = 0; j < count; ++j )
+    {
+        uint32_t    bone = influences[ j ];
+        bones[ j ] = XMMatrixMultiply( XMLoadFloat4x4( &m_invBindPose[ bone ] ), worldTransforms[ bone ] );
+    }
+
+    return count;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool LoadSkeletonFromSDKMESH( const char* fileName, Skeleton& skeleton )
+{
+    std::unique_ptr<uint8_t[]> data;
+    size_t dataSize = 0;
+
+    if ( !fileName || !ReadEntireFile( fileName, data, dataSize ) )
+        return false;
+
+    return LoadSkeletonFromSDKMESH( data.get(), dataSize, skeleton );
+}
+
+#ifdef _WIN32
+HRESULT LoadSkeletonFromSDKMESH( _In_z_ const wchar_t* szFileName, Skeleton& skeleton )
+{
+    std::unique_ptr<uint8_t[]> data;
+    size_t dataSize = 0;
+
+    HRESULT hr = ReadEntireFile( szFileName, data, dataSize );
+    if ( FAILED(hr) )
+        return hr;
+
+    return LoadSkeletonFromSDKMESH( data.get(), dataSize, skeleton ) ? S_OK : E_FAIL;
+}
+#endif
+
+bool LoadSkeletonFromSDKMESH( const uint8_t* meshData, size_t dataSize, Skeleton& skeleton )
+{
+    if ( !meshData )
+        return false;
+
+    if ( dataSize < sizeof(SDKMESH_HEADER) )
+        return false;
+
+    auto header = reinterpret_cast<const SDKMESH_HEADER*>( meshData );
+    if ( header->Version != SDKMESH_FILE_VERSION || header->IsBigEndian )
+        return false;
+
+    // Only the non-buffer part of the file holds the headers
+    uint64_t limit = std::min<uint64_t>( dataSize, header->HeaderSize + header->NonBufferDataSize );
+
+    auto frames = GetArray<SDKMESH_FRAME>( meshData, header->FrameDataOffset, header->NumFrames, limit );
+    auto meshes = GetArray<SDKMESH_MESH>( meshData, header->MeshDataOffset, header->NumMeshes, limit );
+    if ( !frames || !meshes || !header->NumFrames )
+        return false;
+
+    const size_t frameCount = header->NumFrames;
+
+    // Order the frames breadth first from the roots, so that parents come first
+    std::vector<std::vector<uint32_t>> children( frameCount );
+    std::vector<uint32_t> order;
+    order.reserve( frameCount );
+
+    for( size_t j = 0; j < frameCount; ++j )
+    {
+        uint32_t    parent = frames[ j ].ParentFrame;
+        if ( parent == INVALID_FRAME )
+            order.push_back( static_cast<uint32_t>( j ) );
+        else if ( parent >= frameCount || parent == j )
+            return false;
+        else
+            children[ parent ].push_back( static_cast<uint32_t>( j ) );
+    }
+
+    for( size_t j = 0; j < order.size(); ++j )
+    {
+        auto& c = children[ order[ j ] ];
+        order.insert( order.end(), c.begin(), c.end() );
+    }
+
+    // Frames left out are in a cycle
+    if ( order.size() != frameCount )
+        return false;
+
+    std::vector<uint32_t> frameToBone( frameCount );
+    for( size_t j = 0; j < frameCount; ++j )
+    {
+        frameToBone[ order[ j ] ] = static_cast<uint32_t>( j );
+    }
+
+    skeleton.m_names.resize( frameCount );
+    skeleton.m_parents.resize( frameCount );
+    skeleton.m_bindPose.resize( frameCount );
+    skeleton.m_invBindPose.resize( frameCount );
+
+    std::unique_ptr<XMMATRIX[], aligned_deleter> world(
+        reinterpret_cast<XMMATRIX*>( AlignedAlloc( sizeof(XMMATRIX) * frameCount, 16 ) ) );
+    if ( !world )
+        return false;
+
+    for( size_t j = 0; j < frameCount; ++j )
+    {
+        auto& frame = frames[ order[ j ] ];
+
+        skeleton.m_names[ j ] = GetName( frame.Name, MAX_FRAME_NAME );
+        skeleton.m_parents[ j ] = ( frame.ParentFrame == INVALID_FRAME ) ? Skeleton::NO_BONE : frameToBone[ frame.ParentFrame ];
+        skeleton.m_bindPose[ j ] = frame.Matrix;
+
+        XMMATRIX local = XMLoadFloat4x4( &frame.Matrix );
+        world[ j ] = ( skeleton.m_parents[ j ] == Skeleton::NO_BONE ) ? local : XMMatrixMultiply( local, world[ skeleton.m_parents[ j ] ] );
+
+        XMStoreFloat4x4( &skeleton.m_invBindPose[ j ], XMMatrixInverse( nullptr, world[ j ] ) );
+    }
+
+    skeleton.m_meshInfluences.resize( header->NumMeshes );
+    for( size_t j = 0; j < header->NumMeshes; ++j )
+    {
+        auto& mesh = meshes[ j ];
+        auto& influences = skeleton.m_meshInfluences[ j ];
+
+        influences.clear();
+
+        if ( !mesh.NumFrameInfluences )
+            continue;
+
+        auto frameInfluences = GetArray<uint32_t>( meshData, mesh.FrameInfluenceOffset, mesh.NumFrameInfluences, limit );
+        if ( !frameInfluences )
+            return false;
+
+        influences.resize( mesh.NumFrameInfluences );
+        for( size_t k = 0; k < mesh.NumFrameInfluences; ++k )
+        {
+            if ( frameInfluences[ k ] >= frameCount )
+                return false;
+
+            influences[ k ] = frameToBone[ frameInfluences[ k ] ];
+        }
+    }
+
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// AnimationClipBase
+//--------------------------------------------------------------------------------------
+
+float AnimationClipBase::GetDuration() const
+{
+    if ( m_keyCount < 2 || !m_framesPerSecond )
+        return 0.f;
+
+    return float( m_keyCount - 1 ) / float( m_framesPerSecond );
+}
+
+
+//--------------------------------------------------------------------------------------
+std::vector<uint32_t> AnimationClipBase::Bind( const Skeleton& skeleton ) const
+{
+    std::vector<uint32_t> trackBones( m_trackNames.size() );
+
+    for( size_t j = 0; j < m_trackNames.size(); ++j )
+    {
+        trackBones[ j ] = skeleton.FindBone( m_trackNames[ j ].c_str() );
+    }
+
+    return trackBones;
+}
+
+
+//--------------------------------------------------------------------------------------
+void AnimationClipBase::FindKey( float time, size_t& key, float& t ) const
+{
+    key = 0;
+    t = 0.f;
+
+    float duration = GetDuration();
+    if ( duration > 0.f )
+    {
+        time = fmodf( time, duration );
+        if ( time < 0.f )
+            time += duration;
+
+        float keyTime = time * float( m_framesPerSecond );
+
+        key = std::min( static_cast<size_t>( keyTime ), m_keyCount - 2 );
+        t = std::min( keyTime - float( key ), 1.f );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// AnimationClip
+//--------------------------------------------------------------------------------------
+
+void AnimationClip::Sample( float time, const uint32_t* trackBones, XMMATRIX* localTransforms ) const
+{
+    if ( !m_keyCount )
+        return;
+
+    const size_t trackCount = m_trackNames.size();
+
+    size_t key;
+    float t;
+    FindKey( time, key, t );
+
+    const Key* keys0 = GetKeys( key );
+    const Key* keys1 = ( m_keyCount > 1 ) ? GetKeys( key + 1 ) : keys0;
+
+    XMVECTOR vt = XMVectorReplicate( t );
+
+    for( size_t j = 0; j < trackCount; ++j )
+    {
+        uint32_t    bone = trackBones[ j ];
+        if ( bone == Skeleton::NO_BONE )
+            continue;
+
+        auto& k0 = keys0[ j ];
+        auto& k1 = keys1[ j ];
+
+        // XMQuaternionSlerpV takes the shorter arc, and the keys were normalized at load
+        XMVECTOR rotation = XMQuaternionSlerpV( XMLoadFloat4( &k0.rotation ), XMLoadFloat4( &k1.rotation ), vt );
+        XMVECTOR translation = XMVectorLerpV( XMLoadFloat3( &k0.translation ), XMLoadFloat3( &k1.translation ), vt );
+        XMVECTOR scale = XMVectorLerpV( XMLoadFloat3( &k0.scale ), XMLoadFloat3( &k1.scale ), vt );
+
+        localTransforms[ bone ] = XMMatrixAffineTransformation( scale, g_XMZero, rotation, translation );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+bool LoadAnimationClipFromSDKMESH_ANIM( const char* fileName, AnimationClip& clip )
+{
+    std::unique_ptr<uint8_t[]> data;
+    size_t dataSize = 0;
+
+    if ( !fileName || !ReadEntireFile( fileName, data, dataSize ) )
+        return false;
+
+    return LoadAnimationClipFromSDKMESH_ANIM( data.get(), dataSize, clip );
+}
+
+#ifdef _WIN32
+HRESULT LoadAnimationClipFromSDKMESH_ANIM( _In_z_ const wchar_t* szFileName, AnimationClip& clip )
+{
+    std::unique_ptr<uint8_t[]> data;
+    size_t dataSize = 0;
+
+    HRESULT hr = ReadEntireFile( szFileName, data, dataSize );
+    if ( FAILED(hr) )
+        return hr;
+
+    return LoadAnimationClipFromSDKMESH_ANIM( data.get(), dataSize, clip ) ? S_OK : E_FAIL;
+}
+#endif
+
+bool LoadAnimationClipFromSDKMESH_ANIM( const uint8_t* animData, size_t dataSize, AnimationClip& clip )
+{
+    if ( !animData )
+        return false;
+
+    if ( dataSize < sizeof(SDKANIMATION_FILE_HEADER) )
+        return false;
+
+    auto header = reinterpret_cast<const SDKANIMATION_FILE_HEADER*>( animData );
+    if ( header->Version != SDKMESH_FILE_VERSION || header->IsBigEndian || !header->NumAnimationKeys || !header->AnimationFPS )
+        return false;
+
+    auto frames = GetArray<SDKANIMATION_FRAME_DATA>( animData, header->AnimationDataOffset, header->NumFrames, dataSize );
+    if ( !frames )
+        return false;
+
+    const size_t trackCount = header->NumFrames;
+    const size_t keyCount = header->NumAnimationKeys;
+
+    clip.m_trackNames.resize( trackCount );
+    clip.m_keys.resize( trackCount * keyCount );
+    clip.m_keyCount = keyCount;
+    clip.m_framesPerSecond = header->AnimationFPS;
+
+    for( size_t j = 0; j < trackCount; ++j )
+    {
+        clip.m_trackNames[ j ] = GetName( frames[ j ].FrameName, MAX_FRAME_NAME );
+
+        if ( frames[ j ].DataOffset > UINT64_MAX - sizeof(SDKANIMATION_FILE_HEADER) )
+            return false;
+
+        auto data = GetArray<SDKANIMATION_DATA>( animData, frames[ j ].DataOffset + sizeof(SDKANIMATION_FILE_HEADER), keyCount, dataSize );
+        if ( !data )
+            return false;
+
+        // Stored track-major in the file; transposed here to key-major
+        for( size_t k = 0; k < keyCount; ++k )
+        {
+            auto& key = clip.m_keys[ k * trackCount + j ];
+
+            XMVECTOR q = XMLoadFloat4( &data[ k ].Orientation );
+            if ( XMVector4Equal( q, g_XMZero ) )
+                q = XMQuaternionIdentity();
+
+            XMStoreFloat4( &key.rotation, XMQuaternionNormalize( q ) );
+            key.translation = data[ k ].Translation;
+            key.scale = data[ k ].Scaling;
+        }
+    }
+
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// AnimationInstance
+//--------------------------------------------------------------------------------------
+
+AnimationInstance::AnimationInstance( const Skeleton& skeleton, const AnimationClipBase& clip ) :
+    m_skeleton( skeleton ),
+    m_clip( clip ),
+    m_trackBones( clip.Bind( skeleton ) )
+{
+    size_t boneCount = skeleton.GetBoneCount();
+    if ( !boneCount )
+        throw std::invalid_argument("Skeleton has no bones");
+
+    // Cache-line aligned, so instances updated on different threads never share a line
+    m_localTransforms.reset( reinterpret_cast<XMMATRIX*>( AlignedAlloc( sizeof(XMMATRIX) * boneCount, 64 ) ) );
+    m_worldTransforms.reset( reinterpret_cast<XMMATRIX*>( AlignedAlloc( sizeof(XMMATRIX) * boneCount, 64 ) ) );
+    if ( !m_localTransforms || !m_worldTransforms )
+        throw std::bad_alloc();
+
+    // Bones without a track keep their bind pose from here on
+    skeleton.CopyBindPose( m_localTransforms.get() );
+    skeleton.ComputeWorldTransforms( m_localTransforms.get(), m_worldTransforms.get() );
+}
+
+
+//--------------------------------------------------------------------------------------
+void AnimationInstance::Update( float time )
+{
+    m_clip.Sample( time, m_trackBones.data(), m_localTransforms.get() );
+    m_skeleton.ComputeWorldTransforms( m_localTransforms.get(), m_worldTransforms.get() );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+void BenchmarkAnimation( const Skeleton& skeleton, const AnimationClipBase& clip, size_t instances, size_t iterations )
+{
+    if ( !instances || !iterations )
+        return;
+
+    std::vector<std::unique_ptr<AnimationInstance>> characters;
+    characters.reserve( instances );
+    for( size_t j = 0; j < instances; ++j )
+    {
+        characters.emplace_back( new AnimationInstance( skeleton, clip ) );
+    }
+
+    size_t maxInfluences = 0;
+    for( size_t j = 0; j < skeleton.GetMeshCount(); ++j )
+    {
+        maxInfluences = std::max( maxInfluences, skeleton.GetMeshInfluences( j ).size() );
+    }
+
+    std::unique_ptr<XMMATRIX[], aligned_deleter> bones(
+        reinterpret_cast<XMMATRIX*>( AlignedAlloc( sizeof(XMMATRIX) * std::max<size_t>( maxInfluences, 1 ), 16 ) ) );
+
+    // Characters are spread through the clip so they do not all read the same keys
+    const float step = 1.f / 60.f;
+    const float spread = clip.GetDuration() / float( instances );
+
+    size_t skinMatrices = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for( size_t i = 0; i < iterations; ++i )
+    {
+        for( size_t j = 0; j < instances; ++j )
+        {
+            auto& character = *characters[ j ];
+
+            character.Update( float( i ) * step + float( j ) * spread );
+
+            for( size_t mesh = 0; mesh < skeleton.GetMeshCount(); ++mesh )
+            {
+                skinMatrices += character.GetSkinTransforms( mesh, bones.get(), maxInfluences );
+            }
+        }
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>( stop - start ).count();
+
+    double poses = double( instances ) * double( iterations );
+    double bonesEvaluated = poses * double( skeleton.GetBoneCount() );
+
+    typedef unsigned long long ull;
+    BenchmarkTrace( "Animation: %llu bones (%llu tracks, %llu keys at %u fps), %llu characters x %llu updates\n",
+                    ull( skeleton.GetBoneCount() ), ull( clip.GetTrackCount() ), ull( clip.GetKeyCount() ), clip.GetFramesPerSecond(), ull( instances ), ull( iterations ) );
+    BenchmarkTrace( "    %8.3f us per character, %.2f M bones/s, %.2f M skin matrices/s on one core\n",
+                    seconds * 1000000.0 / poses, bonesEvaluated / seconds / 1000000.0, double( skinMatrices ) / seconds / 1000000.0 );
+}
@@ -0,0 +1,215 @@
+//--------------------------------------------------------------------------------------
+// File: Animation.h
+//
+// CPU skeletal animation for SDKMESH models and .sdkmesh_anim clips
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#endif
+
+// 'alignment' is a power of two, at least sizeof(void*); null when out of memory
+inline void* AlignedAlloc( size_t size, size_t alignment )
+{
+#ifdef _WIN32
+    return _aligned_malloc( size, alignment );
+#else
+    void* p = nullptr;
+    return ( posix_memalign( &p, alignment, size ) == 0 ) ? p : nullptr;
+#endif
+}
+
+inline void AlignedFree( void* p )
+{
+#ifdef _WIN32
+    _aligned_free( p );
+#else
+    free( p );
+#endif
+}
+
+struct aligned_deleter { void operator()(void* p) { AlignedFree(p); } };
+
+// The frame hierarchy of an SDKMESH, with the frames each mesh's blend indices refer to.
+// Bones are stored so that every parent comes before its children.
+class Skeleton
+{
+public:
+    static const uint32_t NO_BONE = uint32_t( -1 );
+
+    Skeleton() {}
+
+    Skeleton( const Skeleton& ) = delete;
+    Skeleton& operator=( const Skeleton& ) = delete;
+
+    size_t GetBoneCount() const { return m_parents.size(); }
+    uint32_t GetParent( size_t bone ) const { return m_parents[ bone ]; }
+    const std::string& GetBoneName( size_t bone ) const { return m_names[ bone ]; }
+    uint32_t FindBone( const char* name ) const;
+
+    // Palette slot n of mesh 'mesh' is bone GetMeshInfluences( mesh )[ n ]
+    size_t GetMeshCount() const { return m_meshInfluences.size(); }
+    const std::vector<uint32_t>& GetMeshInfluences( size_t mesh ) const { return m_meshInfluences[ mesh ]; }
+
+    // Fills 'localTransforms' with each bone's transform relative to its parent in the bind pose
+    void CopyBindPose( DirectX::XMMATRIX* localTransforms ) const;
+
+    // Walks the hierarchy, turning transforms relative to each parent into model space
+    void ComputeWorldTransforms( const DirectX::XMMATRIX* localTransforms, DirectX::XMMATRIX* worldTransforms ) const;
+
+    // Writes the matrices IEffectSkinning::SetBoneTransforms takes for 'mesh': the inverse
+    // bind pose of each influence times its model-space transform. Returns the number
+    // written, at most 'maxBones'.
+    size_t ComputeSkinTransforms( size_t mesh, const DirectX::XMMATRIX* worldTransforms, DirectX::XMMATRIX* bones, size_t maxBones ) const;
+
+private:
+    friend bool LoadSkeletonFromSDKMESH( const uint8_t* meshData, size_t dataSize, Skeleton& skeleton );
+
+    std::vector<std::string>                                m_names;
+    std::vector<uint32_t>                                   m_parents;
+    std::vector<DirectX::XMFLOAT4X4>                        m_bindPose;         // Relative to the parent
+    std::vector<DirectX::XMFLOAT4X4>                        m_invBindPose;      // Inverse of the model-space bind pose
+    std::vector<std::vector<uint32_t>>                      m_meshInfluences;
+};
+
+// False if the file cannot be read or is not a valid SDKMESH
+bool LoadSkeletonFromSDKMESH( const char* fileName, Skeleton& skeleton );
+bool LoadSkeletonFromSDKMESH( const uint8_t* meshData, size_t dataSize, Skeleton& skeleton );
+
+#ifdef _WIN32
+// Wide paths, read through Win32, failing with the system's error
+HRESULT LoadSkeletonFromSDKMESH( _In_z_ const wchar_t* szFileName, Skeleton& skeleton );
+#endif
+
+
+// Tracks keyed at a fixed rate, whatever the keys are stored as. AnimationInstance and
+// AnimationBatch play any clip through this, so compressed clips play like raw ones.
+class AnimationClipBase
+{
+public:
+    virtual ~AnimationClipBase() {}
+
+    size_t GetTrackCount() const { return m_trackNames.size(); }
+    const std::string& GetTrackName( size_t track ) const { return m_trackNames[ track ]; }
+    size_t GetKeyCount() const { return m_keyCount; }
+    uint32_t GetFramesPerSecond() const { return m_framesPerSecond; }
+
+    // Time from the first key to the last; playback loops over this
+    float GetDuration() const;
+
+    // The bone each track drives, or Skeleton::NO_BONE for tracks naming no bone
+    std::vector<uint32_t> Bind( const Skeleton& skeleton ) const;
+
+    // Interpolates every track at 'time' seconds, wrapped into the clip, and writes the
+    // transform relative to the parent of each bone in 'trackBones'. Other bones are left
+    // alone, so 'localTransforms' should start from Skeleton::CopyBindPose.
+    virtual void Sample( float time, const uint32_t* trackBones, DirectX::XMMATRIX* localTransforms ) const = 0;
+
+protected:
+    AnimationClipBase() : m_keyCount( 0 ), m_framesPerSecond( 0 ) {}
+
+    AnimationClipBase( const AnimationClipBase& ) = delete;
+    AnimationClipBase& operator=( const AnimationClipBase& ) = delete;
+
+    // Wraps 'time' into the clip and finds the key before it and how far it is towards
+    // the next, from 0 to 1. With fewer than two keys that is always key 0.
+    void FindKey( float time, size_t& key, float& t ) const;
+
+    std::vector<std::string>    m_trackNames;
+    size_t                      m_keyCount;
+    uint32_t                    m_framesPerSecond;
+};
+
+
+// Keyframes sampled at a fixed rate, one track per animated frame
+class AnimationClip : public AnimationClipBase
+{
+public:
+    struct Key
+    {
+        DirectX::XMFLOAT4       rotation;
+        DirectX::XMFLOAT3       translation;
+        DirectX::XMFLOAT3       scale;
+    };
+
+    AnimationClip() {}
+
+    AnimationClip( const AnimationClip& ) = delete;
+    AnimationClip& operator=( const AnimationClip& ) = delete;
+
+    virtual void Sample( float time, const uint32_t* trackBones, DirectX::XMMATRIX* localTransforms ) const override;
+
+    // Key 'key' of every track, in track order
+    const Key* GetKeys( size_t key ) const { return m_keys.data() + key * m_trackNames.size(); }
+
+private:
+    friend bool LoadAnimationClipFromSDKMESH_ANIM( const uint8_t* animData, size_t dataSize, AnimationClip& clip );
+
+    std::vector<Key>            m_keys;             // Key-major, so one sample reads two runs of memory
+};
+
+// False if the file cannot be read or is not a valid SDKMESH_ANIM
+bool LoadAnimationClipFromSDKMESH_ANIM( const char* fileName, AnimationClip& clip );
+bool LoadAnimationClipFromSDKMESH_ANIM( const uint8_t* animData, size_t dataSize, AnimationClip& clip );
+
+#ifdef _WIN32
+// Wide paths, read through Win32, failing with the system's error
+HRESULT LoadAnimationClipFromSDKMESH_ANIM( _In_z_ const wchar_t* szFileName, AnimationClip& clip );
+#endif
+
+
+// One character playing one clip, with the scratch space a pose needs
+class AnimationInstance
+{
+public:
+    AnimationInstance( const Skeleton& skeleton, const AnimationClipBase& clip );
+
+    AnimationInstance( const AnimationInstance& ) = delete;
+    AnimationInstance& operator=( const AnimationInstance& ) = delete;
+
+    // Samples the clip at 'time' seconds and walks the hierarchy
+    void Update( float time );
+
+    // Skin matrices for one mesh of the skeleton, from the last Update
+    size_t GetSkinTransforms( size_t mesh, DirectX::XMMATRIX* bones, size_t maxBones ) const
+    {
+        return m_skeleton.ComputeSkinTransforms( mesh, m_worldTransforms.get(), bones, maxBones );
+    }
+
+    const DirectX::XMMATRIX* GetWorldTransforms() const { return m_worldTransforms.get(); }
+
+    const Skeleton& GetSkeleton() const { return m_skeleton; }
+    const AnimationClipBase& GetClip() const { return m_clip; }
+
+private:
+    const Skeleton&                                         m_skeleton;
+    const AnimationClipBase&                                m_clip;
+    std::vector<uint32_t>                                   m_trackBones;
+    std::unique_ptr<DirectX::XMMATRIX[], aligned_deleter>   m_localTransforms;
+    std::unique_ptr<DirectX::XMMATRIX[], aligned_deleter>   m_worldTransforms;
+};
+
+// Times Update and GetSkinTransforms for 'instances' characters on one thread and
+// reports bones per second. Needs no device.
+void BenchmarkAnimation( const Skeleton& skeleton, const AnimationClipBase& clip, size_t instances, size_t iterations );
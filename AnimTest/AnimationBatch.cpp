@@ -0,0 +1,358 @@
+//--------------------------------------------------------------------------------------
+// File: AnimationBatch.cpp
+//
+// Evaluates many animated characters at once across a pool of threads
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include "AnimationBatch.h"
+
+#include "../ModelTest/BenchmarkTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include <stdio.h>
+
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+AnimationBatch::AnimationBatch( size_t maxBones, size_t threadCount ) :
+    m_maxBones( maxBones ),
+    m_threadCount( threadCount ),
+    m_steals( 0 ),
+    m_time( 0.f ),
+    m_running( false ),
+    m_generation( 0 ),
+    m_pending( 0 ),
+    m_exit( false )
+{
+    if ( !maxBones )
+        throw std::invalid_argument("maxBones must be at least 1");
+
+    if ( !m_threadCount )
+        m_threadCount = std::max<size_t>( std::thread::hardware_concurrency(), 1 );
+
+    m_queues.reset( new Queue[ m_threadCount ] );
+    for( size_t j = 0; j < m_threadCount; ++j )
+    {
+        m_queues[ j ].next = m_queues[ j ].end = 0;
+    }
+
+    try
+    {
+        m_threads.reserve( m_threadCount - 1 );
+        for( size_t j = 1; j < m_threadCount; ++j )
+        {
+            m_threads.emplace_back( &AnimationBatch::WorkerThread, this, j );
+        }
+    }
+    catch( ... )
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_exit = true;
+        }
+        m_start.notify_all();
+
+        for( auto it = m_threads.begin(); it != m_threads.end(); ++it )
+        {
+            it->join();
+        }
+
+        throw;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+AnimationBatch::~AnimationBatch()
+{
+    if ( m_running )
+        Wait();
+
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_exit = true;
+    }
+    m_start.notify_all();
+
+    for( auto it = m_threads.begin(); it != m_threads.end(); ++it )
+    {
+        it->join();
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t AnimationBatch::Add( const Skeleton& skeleton, const AnimationClipBase& clip, float timeOffset )
+{
+    if ( m_running )
+        throw std::logic_error("Add called during a batch");
+
+    std::unique_ptr<Instance> instance( new Instance );
+    instance->animation.reset( new AnimationInstance( skeleton, clip ) );
+    instance->timeOffset = timeOffset;
+    instance->active = true;
+    instance->current = 0;
+
+    size_t total = 0;
+    for( size_t j = 0; j < skeleton.GetMeshCount(); ++j )
+    {
+        instance->paletteOffsets.push_back( total );
+        total += std::min( skeleton.GetMeshInfluences( j ).size(), m_maxBones );
+    }
+    instance->paletteOffsets.push_back( total );
+
+    // XMMATRIX is a cache line, so 64-byte alignment puts every matrix on a line of its own
+    for( size_t k = 0; k < 2; ++k )
+    {
+        instance->palettes[ k ].reset( reinterpret_cast<XMMATRIX*>( AlignedAlloc( sizeof(XMMATRIX) * std::max<size_t>( total, 1 ), 64 ) ) );
+        if ( !instance->palettes[ k ] )
+            throw std::bad_alloc();
+
+        for( size_t j = 0; j < skeleton.GetMeshCount(); ++j )
+        {
+            instance->animation->GetSkinTransforms( j, instance->palettes[ k ].get() + instance->paletteOffsets[ j ], m_maxBones );
+        }
+    }
+
+    m_instances.emplace_back( std::move( instance ) );
+
+    return m_instances.size() - 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+void AnimationBatch::SetActive( size_t instance, bool active )
+{
+    if ( m_running )
+        throw std::logic_error("SetActive called during a batch");
+
+    m_instances[ instance ]->active = active;
+}
+
+
+//--------------------------------------------------------------------------------------
+void AnimationBatch::Begin( float time )
+{
+    if ( m_running )
+        Wait();
+
+    m_jobs.clear();
+    for( size_t j = 0; j < m_instances.size(); ++j )
+    {
+        if ( m_instances[ j ]->active )
+            m_jobs.push_back( static_cast<uint32_t>( j ) );
+    }
+
+    // Written before the workers are woken under the lock, so they see it
+    m_time = time;
+    m_steals = 0;
+
+    const size_t count = m_jobs.size();
+    for( size_t j = 0; j < m_threadCount; ++j )
+    {
+        m_queues[ j ].next = count * j / m_threadCount;
+        m_queues[ j ].end = count * ( j + 1 ) / m_threadCount;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_pending = m_threads.size();
+        ++m_generation;
+    }
+    m_start.notify_all();
+
+    m_running = true;
+}
+
+
+//--------------------------------------------------------------------------------------
+void AnimationBatch::Wait()
+{
+    if ( !m_running )
+        return;
+
+    RunJobs( 0 );
+
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_done.wait( lock, [&]() { return !m_pending; } );
+    }
+
+    for( auto it = m_jobs.cbegin(); it != m_jobs.cend(); ++it )
+    {
+        auto& instance = *m_instances[ *it ];
+        instance.current ^= 1;
+    }
+
+    m_running = false;
+}
+
+
+//--------------------------------------------------------------------------------------
+const XMMATRIX* AnimationBatch::GetSkinTransforms( size_t instance, size_t mesh, size_t& count ) const
+{
+    auto& inst = *m_instances[ instance ];
+
+    count = inst.paletteOffsets[ mesh + 1 ] - inst.paletteOffsets[ mesh ];
+
+    return inst.palettes[ inst.current ].get() + inst.paletteOffsets[ mesh ];
+}
+
+
+//--------------------------------------------------------------------------------------
+// Takes the next job of this thread's own share
+bool AnimationBatch::Pop( size_t thread, size_t& job )
+{
+    auto& queue = m_queues[ thread ];
+
+    std::lock_guard<std::mutex> lock( queue.mutex );
+
+    if ( queue.next >= queue.end )
+        return false;
+
+    job = queue.next++;
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Takes the last job of another thread's share, so the two threads work from opposite ends
+bool AnimationBatch::Steal( size_t thread, size_t& job )
+{
+    for( size_t k = 1; k < m_threadCount; ++k )
+    {
+        auto& queue = m_queues[ ( thread + k ) % m_threadCount ];
+
+        std::lock_guard<std::mutex> lock( queue.mutex );
+
+        if ( queue.next < queue.end )
+        {
+            job = --queue.end;
+            ++m_steals;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+//--------------------------------------------------------------------------------------
+void AnimationBatch::RunJobs( size_t thread )
+{
+    // No jobs are added during a batch, so once every share is empty this thread is done
+    size_t job;
+    while ( Pop( thread, job ) || Steal( thread, job ) )
+    {
+        auto& instance = *m_instances[ m_jobs[ job ] ];
+        auto& animation = *instance.animation;
+
+        animation.Update( m_time + instance.timeOffset );
+
+        XMMATRIX* palette = instance.palettes[ instance.current ^ 1 ].get();
+        for( size_t j = 0; j + 1 < instance.paletteOffsets.size(); ++j )
+        {
+            animation.GetSkinTransforms( j, palette + instance.paletteOffsets[ j ], m_maxBones );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void AnimationBatch::WorkerThread( size_t thread )
+{
+    uint64_t generation = 0;
+
+    for( ;; )
+    {
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            m_start.wait( lock, [&]() { return m_exit || m_generation != generation; } );
+
+            if ( m_exit )
+                return;
+
+            generation = m_generation;
+        }
+
+        RunJobs( thread );
+
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            if ( !--m_pending )
+                m_done.notify_one();
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+void BenchmarkAnimationBatch( const Skeleton& skeleton, const AnimationClipBase& clip, size_t instances, size_t iterations )
+{
+    if ( !instances || !iterations )
+        return;
+
+    const size_t maxThreads = std::max<size_t>( std::thread::hardware_concurrency(), 1 );
+    const float step = 1.f / 60.f;
+    const float spread = clip.GetDuration() / float( instances );
+
+    typedef unsigned long long ull;
+    BenchmarkTrace( "Animation batch: %llu characters x %llu bones, %llu updates\n", ull( instances ), ull( skeleton.GetBoneCount() ), ull( iterations ) );
+
+    size_t maxBones = 1;
+    for( size_t j = 0; j < skeleton.GetMeshCount(); ++j )
+    {
+        maxBones = std::max( maxBones, skeleton.GetMeshInfluences( j ).size() );
+    }
+
+    double baseTime = 0.0;
+
+    for( size_t threads = 1; threads <= maxThreads; ++threads )
+    {
+        AnimationBatch batch( maxBones, threads );
+        for( size_t j = 0; j < instances; ++j )
+        {
+            batch.Add( skeleton, clip, float( j ) * spread );
+        }
+
+        // Starts the workers and touches every palette before timing
+        batch.Update( 0.f );
+
+        size_t steals = 0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        for( size_t i = 0; i < iterations; ++i )
+        {
+            batch.Update( float( i ) * step );
+            steals += batch.GetStealCount();
+        }
+
+        auto stop = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>( stop - start ).count();
+
+        if ( threads == 1 )
+            baseTime = seconds;
+
+        double bones = double( instances ) * double( iterations ) * double( skeleton.GetBoneCount() );
+
+        BenchmarkTrace( "    %2llu threads: %8.3f ms per update, %7.2f M bones/s, %5.2fx, %.1f steals per update\n",
+                        ull( threads ), seconds * 1000.0 / double( iterations ), bones / seconds / 1000000.0,
+                        baseTime / seconds, double( steals ) / double( iterations ) );
+    }
+}
@@ -0,0 +1,115 @@
+//--------------------------------------------------------------------------------------
+// File: AnimationBatch.h
+//
+// Evaluates many animated characters at once across a pool of threads
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Animation.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Begin hands every active instance to the worker threads and returns; Wait joins in
+// until they are all done. Each thread starts on its own share of the instances and then
+// steals from the back of the others' shares, so a thread that is descheduled or given
+// expensive characters does not hold up the batch.
+//
+// Skin matrices are double-buffered: between Begin and Wait the workers write one set
+// while GetSkinTransforms returns the other, finished at the previous Wait, so the render
+// thread can draw while the next poses are computed. Each instance's palettes start on a
+// cache line of their own.
+class AnimationBatch
+{
+public:
+    // Palettes hold at most 'maxBones' matrices per mesh. 'threadCount' threads, including
+    // the one calling Wait; 0 uses one per core.
+    explicit AnimationBatch( size_t maxBones, size_t threadCount = 0 );
+    ~AnimationBatch();
+
+    AnimationBatch( const AnimationBatch& ) = delete;
+    AnimationBatch& operator=( const AnimationBatch& ) = delete;
+
+    size_t GetThreadCount() const { return m_threadCount; }
+
+    // Instances play 'clip' from 'timeOffset' seconds in, and start in the bind pose.
+    // Not to be called between Begin and Wait.
+    size_t Add( const Skeleton& skeleton, const AnimationClipBase& clip, float timeOffset = 0.f );
+    size_t GetInstanceCount() const { return m_instances.size(); }
+
+    // Inactive instances keep the last palettes they were given
+    void SetActive( size_t instance, bool active );
+
+    // Starts evaluating every active instance at 'time' seconds
+    void Begin( float time );
+
+    // Helps evaluate until the batch from Begin is done, then makes its palettes current
+    void Wait();
+
+    void Update( float time ) { Begin( time ); Wait(); }
+
+    // Skin matrices for one mesh of an instance, as of the last Wait
+    const DirectX::XMMATRIX* GetSkinTransforms( size_t instance, size_t mesh, size_t& count ) const;
+
+    // Instances taken from another thread's share during the last batch
+    size_t GetStealCount() const { return m_steals; }
+
+private:
+    struct Instance
+    {
+        std::unique_ptr<AnimationInstance>                      animation;
+        std::unique_ptr<DirectX::XMMATRIX[], aligned_deleter>   palettes[ 2 ];
+        std::vector<size_t>                                     paletteOffsets;     // One per mesh, then the total
+        size_t                                                  current;            // Palette set GetSkinTransforms reads
+        float                                                   timeOffset;
+        bool                                                    active;
+    };
+
+    // A range of m_jobs. Padded so the ranges of different threads never share a cache line.
+    struct Queue
+    {
+        std::mutex      mutex;
+        size_t          next;
+        size_t          end;
+        char            padding[ 64 ];
+    };
+
+    bool Pop( size_t thread, size_t& job );
+    bool Steal( size_t thread, size_t& job );
+    void RunJobs( size_t thread );
+    void WorkerThread( size_t thread );
+
+    size_t                                  m_maxBones;
+    std::vector<std::unique_ptr<Instance>>  m_instances;
+    std::vector<uint32_t>                   m_jobs;             // Active instances in the current batch
+    size_t                                  m_threadCount;
+    std::unique_ptr<Queue[]>                m_queues;
+    std::vector<std::thread>                m_threads;
+    std::atomic<size_t>                     m_steals;
+    float                                   m_time;
+    bool                                    m_running;
+
+    // The current batch, shared with the worker threads under m_mutex
+    std::mutex                              m_mutex;
+    std::condition_variable                 m_start;
+    std::condition_variable                 m_done;
+    uint64_t                                m_generation;
+    size_t                                  m_pending;
+    bool                                    m_exit;
+};
+
+// Times Update for 'instances' characters with 1 thread, then 2, and so on up to one per
+// core, and reports the speedup over one thread. Needs no device.
+void BenchmarkAnimationBatch( const Skeleton& skeleton, const AnimationClipBase& clip, size_t instances, size_t iterations );
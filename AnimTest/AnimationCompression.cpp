@@ -0,0 +1,504 @@
+//--------------------------------------------------------------------------------------
+// File: AnimationCompression.cpp
+//
+// Compressed keyframe storage for animation clips
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include "AnimationCompression.h"
+
+#include "../ModelTest/BenchmarkTrace.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <math.h>
+#include <stdio.h>
+
+using namespace DirectX;
+
+namespace
+{
+    // Smallest three: the largest component of a unit quaternion is left out, since it is
+    // the one that can be rebuilt most accurately from the unit length. Negating the
+    // quaternion to make it positive gives the same rotation, and then the other three
+    // lie within +/- 1/sqrt(2). They are stored as 15 bits each, with the index of the
+    // dropped component in the top bits of the first two.
+    const float ROTATION_RANGE = 0.707106781f;
+    const float ROTATION_STEPS = 32767.f;
+
+    const float VECTOR_STEPS = 65535.f;
+
+    void EncodeRotation( FXMVECTOR q, uint16_t* keys )
+    {
+        XMFLOAT4 value;
+        XMStoreFloat4( &value, q );
+        const float c[4] = { value.x, value.y, value.z, value.w };
+
+        size_t largest = 0;
+        for( size_t j = 1; j < 4; ++j )
+        {
+            if ( fabsf( c[ j ] ) > fabsf( c[ largest ] ) )
+                largest = j;
+        }
+
+        const float sign = ( c[ largest ] < 0.f ) ? -1.f : 1.f;
+
+        uint16_t quantized[3];
+        for( size_t j = 0, n = 0; j < 4; ++j )
+        {
+            if ( j == largest )
+                continue;
+
+            float x = ( c[ j ] * sign + ROTATION_RANGE ) * ( ROTATION_STEPS / ( 2.f * ROTATION_RANGE ) );
+            quantized[ n++ ] = static_cast<uint16_t>( std::min( std::max( x + 0.5f, 0.f ), ROTATION_STEPS ) );
+        }
+
+        keys[0] = static_cast<uint16_t>( quantized[0] | ( ( largest >> 1 ) << 15 ) );
+        keys[1] = static_cast<uint16_t>( quantized[1] | ( ( largest & 1 ) << 15 ) );
+        keys[2] = quantized[2];
+    }
+
+    XMVECTOR XM_CALLCONV DecodeRotation( const uint16_t* keys )
+    {
+        const float scale = 2.f * ROTATION_RANGE / ROTATION_STEPS;
+
+        const float a = float( keys[0] & 0x7fff ) * scale - ROTATION_RANGE;
+        const float b = float( keys[1] & 0x7fff ) * scale - ROTATION_RANGE;
+        const float d = float( keys[2] & 0x7fff ) * scale - ROTATION_RANGE;
+        const float largest = sqrtf( std::max( 1.f - a * a - b * b - d * d, 0.f ) );
+
+        switch( ( ( keys[0] >> 15 ) << 1 ) | ( keys[1] >> 15 ) )
+        {
+        case 0:     return XMVectorSet( largest, a, b, d );
+        case 1:     return XMVectorSet( a, largest, b, d );
+        case 2:     return XMVectorSet( a, b, largest, d );
+        default:    return XMVectorSet( a, b, d, largest );
+        }
+    }
+
+    // Translations and scales are stored as 16 bits per component between the smallest
+    // and largest value the channel takes
+    void EncodeVector( const XMFLOAT3& value, const XMFLOAT3& minimum, const XMFLOAT3& step, uint16_t* keys )
+    {
+        const float v[3] = { value.x - minimum.x, value.y - minimum.y, value.z - minimum.z };
+        const float s[3] = { step.x, step.y, step.z };
+
+        for( size_t j = 0; j < 3; ++j )
+        {
+            keys[ j ] = ( s[ j ] > 0.f ) ? static_cast<uint16_t>( std::min( std::max( v[ j ] / s[ j ] + 0.5f, 0.f ), VECTOR_STEPS ) ) : 0;
+        }
+    }
+
+    inline XMVECTOR XM_CALLCONV DecodeVector( const uint16_t* keys, const XMFLOAT3* range )
+    {
+        XMVECTOR v = XMVectorSet( float( keys[0] ), float( keys[1] ), float( keys[2] ), 0.f );
+        return XMVectorMultiplyAdd( v, XMLoadFloat3( &range[1] ), XMLoadFloat3( &range[0] ) );
+    }
+
+    // The angle of the rotation between two unit quaternions. Measured from the chord
+    // rather than acos of the dot product, which has no precision left for small angles.
+    float XM_CALLCONV RotationError( FXMVECTOR a, FXMVECTOR b )
+    {
+        float chord = std::min( XMVectorGetX( XMVector4Length( XMVectorSubtract( a, b ) ) ),
+                                XMVectorGetX( XMVector4Length( XMVectorAdd( a, b ) ) ) );
+        return 4.f * asinf( std::min( chord * 0.5f, 1.f ) );
+    }
+
+    float XM_CALLCONV VectorError( FXMVECTOR a, FXMVECTOR b )
+    {
+        return XMVectorGetX( XMVector3Length( XMVectorSubtract( a, b ) ) );
+    }
+
+    // Picks the smallest format that reproduces every key of a channel within 'error'
+    uint32_t ClassifyRotation( const AnimationClip& clip, size_t track, float error )
+    {
+        const size_t keyCount = clip.GetKeyCount();
+
+        XMVECTOR first = XMLoadFloat4( &clip.GetKeys( 0 )[ track ].rotation );
+        XMVECTOR last = XMLoadFloat4( &clip.GetKeys( keyCount - 1 )[ track ].rotation );
+
+        bool constant = true;
+        bool linear = true;
+        for( size_t k = 1; k < keyCount && ( constant || linear ); ++k )
+        {
+            XMVECTOR q = XMLoadFloat4( &clip.GetKeys( k )[ track ].rotation );
+
+            if ( RotationError( q, first ) > error )
+                constant = false;
+
+            XMVECTOR u = XMVectorReplicate( float( k ) / float( keyCount - 1 ) );
+            if ( RotationError( q, XMQuaternionSlerpV( first, last, u ) ) > error )
+                linear = false;
+        }
+
+        return constant ? CompressedAnimationClip::CHANNEL_CONSTANT
+                        : ( linear ? CompressedAnimationClip::CHANNEL_LINEAR : CompressedAnimationClip::CHANNEL_ANIMATED );
+    }
+
+    uint32_t ClassifyVector( const AnimationClip& clip, size_t track, XMFLOAT3 AnimationClip::Key::* member, float error )
+    {
+        const size_t keyCount = clip.GetKeyCount();
+
+        XMVECTOR first = XMLoadFloat3( &( clip.GetKeys( 0 )[ track ].*member ) );
+        XMVECTOR last = XMLoadFloat3( &( clip.GetKeys( keyCount - 1 )[ track ].*member ) );
+
+        bool constant = true;
+        bool linear = true;
+        for( size_t k = 1; k < keyCount && ( constant || linear ); ++k )
+        {
+            XMVECTOR v = XMLoadFloat3( &( clip.GetKeys( k )[ track ].*member ) );
+
+            if ( VectorError( v, first ) > error )
+                constant = false;
+
+            XMVECTOR u = XMVectorReplicate( float( k ) / float( keyCount - 1 ) );
+            if ( VectorError( v, XMVectorLerpV( first, last, u ) ) > error )
+                linear = false;
+        }
+
+        return constant ? CompressedAnimationClip::CHANNEL_CONSTANT
+                        : ( linear ? CompressedAnimationClip::CHANNEL_LINEAR : CompressedAnimationClip::CHANNEL_ANIMATED );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// CompressedAnimationClip
+//--------------------------------------------------------------------------------------
+
+XMVECTOR XM_CALLCONV CompressedAnimationClip::SampleRotation( const Channel& channel, const uint16_t* keys0, const uint16_t* keys1,
+                                                              FXMVECTOR t, FXMVECTOR u ) const
+{
+    switch( channel.format )
+    {
+    case CHANNEL_CONSTANT:
+        return XMLoadFloat4( &m_rotationValues[ channel.offset ] );
+
+    case CHANNEL_LINEAR:
+        return XMQuaternionSlerpV( XMLoadFloat4( &m_rotationValues[ channel.offset ] ), XMLoadFloat4( &m_rotationValues[ channel.offset + 1 ] ), u );
+
+    default:
+        return XMQuaternionSlerpV( DecodeRotation( keys0 + channel.offset * 3 ), DecodeRotation( keys1 + channel.offset * 3 ), t );
+    }
+}
+
+XMVECTOR XM_CALLCONV CompressedAnimationClip::SampleVector( const Channel& channel, const uint16_t* keys0, const uint16_t* keys1,
+                                                            FXMVECTOR t, FXMVECTOR u ) const
+{
+    switch( channel.format )
+    {
+    case CHANNEL_CONSTANT:
+        return XMLoadFloat3( &m_vectorValues[ channel.offset ] );
+
+    case CHANNEL_LINEAR:
+        return XMVectorLerpV( XMLoadFloat3( &m_vectorValues[ channel.offset ] ), XMLoadFloat3( &m_vectorValues[ channel.offset + 1 ] ), u );
+
+    default:
+        {
+            const XMFLOAT3* range = &m_vectorRanges[ channel.offset * 2 ];
+            return XMVectorLerpV( DecodeVector( keys0 + channel.offset * 3, range ), DecodeVector( keys1 + channel.offset * 3, range ), t );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CompressedAnimationClip::Sample( float time, const uint32_t* trackBones, XMMATRIX* localTransforms ) const
+{
+    if ( !m_keyCount )
+        return;
+
+    size_t key;
+    float t;
+    FindKey( time, key, t );
+
+    const size_t nextKey = ( m_keyCount > 1 ) ? key + 1 : key;
+
+    // Linear channels go straight to their position over the whole clip
+    float u = ( m_keyCount > 1 ) ? ( float( key ) + t ) / float( m_keyCount - 1 ) : 0.f;
+
+    XMVECTOR vt = XMVectorReplicate( t );
+    XMVECTOR vu = XMVectorReplicate( u );
+
+    const uint16_t* rotations0 = m_rotationKeys.data() + key * m_animatedRotations * 3;
+    const uint16_t* rotations1 = m_rotationKeys.data() + nextKey * m_animatedRotations * 3;
+    const uint16_t* vectors0 = m_vectorKeys.data() + key * m_animatedVectors * 3;
+    const uint16_t* vectors1 = m_vectorKeys.data() + nextKey * m_animatedVectors * 3;
+
+    for( size_t j = 0; j < m_tracks.size(); ++j )
+    {
+        uint32_t bone = trackBones[ j ];
+        if ( bone == Skeleton::NO_BONE )
+            continue;
+
+        auto& track = m_tracks[ j ];
+
+        XMVECTOR rotation = SampleRotation( track.rotation, rotations0, rotations1, vt, vu );
+        XMVECTOR translation = SampleVector( track.translation, vectors0, vectors1, vt, vu );
+        XMVECTOR scale = SampleVector( track.scale, vectors0, vectors1, vt, vu );
+
+        localTransforms[ bone ] = XMMatrixAffineTransformation( scale, g_XMZero, rotation, translation );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CompressedAnimationClip::GetKey( size_t track, size_t key, AnimationClip::Key& value ) const
+{
+    const uint16_t* rotations = m_rotationKeys.data() + key * m_animatedRotations * 3;
+    const uint16_t* vectors = m_vectorKeys.data() + key * m_animatedVectors * 3;
+
+    XMVECTOR t = g_XMZero;
+    XMVECTOR u = XMVectorReplicate( ( m_keyCount > 1 ) ? float( key ) / float( m_keyCount - 1 ) : 0.f );
+
+    auto& channels = m_tracks[ track ];
+    XMStoreFloat4( &value.rotation, SampleRotation( channels.rotation, rotations, rotations, t, u ) );
+    XMStoreFloat3( &value.translation, SampleVector( channels.translation, vectors, vectors, t, u ) );
+    XMStoreFloat3( &value.scale, SampleVector( channels.scale, vectors, vectors, t, u ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t CompressedAnimationClip::GetSizeInBytes() const
+{
+    return m_tracks.size() * sizeof(Track)
+           + m_rotationValues.size() * sizeof(XMFLOAT4)
+           + ( m_vectorValues.size() + m_vectorRanges.size() ) * sizeof(XMFLOAT3)
+           + ( m_rotationKeys.size() + m_vectorKeys.size() ) * sizeof(uint16_t);
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t CompressedAnimationClip::GetChannelCount( ChannelFormat format ) const
+{
+    size_t count = 0;
+    for( auto it = m_tracks.cbegin(); it != m_tracks.cend(); ++it )
+    {
+        count += ( it->rotation.format == uint32_t( format ) ) ? 1 : 0;
+        count += ( it->translation.format == uint32_t( format ) ) ? 1 : 0;
+        count += ( it->scale.format == uint32_t( format ) ) ? 1 : 0;
+    }
+
+    return count;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CompressAnimationClip( const AnimationClip& clip, const AnimationCompressionSettings& settings, CompressedAnimationClip& compressed )
+{
+    const size_t trackCount = clip.GetTrackCount();
+    const size_t keyCount = clip.GetKeyCount();
+
+    if ( !keyCount )
+        return false;
+
+    if ( settings.rotationError < 0.f || settings.translationError < 0.f || settings.scaleError < 0.f )
+        return false;
+
+    compressed.m_trackNames.resize( trackCount );
+    compressed.m_tracks.resize( trackCount );
+    compressed.m_rotationValues.clear();
+    compressed.m_vectorValues.clear();
+    compressed.m_vectorRanges.clear();
+    compressed.m_keyCount = keyCount;
+    compressed.m_framesPerSecond = clip.GetFramesPerSecond();
+    compressed.m_animatedRotations = 0;
+    compressed.m_animatedVectors = 0;
+
+    auto addVectorChannel = [&]( size_t track, XMFLOAT3 AnimationClip::Key::* member, float error, CompressedAnimationClip::Channel& channel )
+    {
+        const XMFLOAT3& first = clip.GetKeys( 0 )[ track ].*member;
+
+        channel.format = ClassifyVector( clip, track, member, error );
+        switch( channel.format )
+        {
+        case CompressedAnimationClip::CHANNEL_CONSTANT:
+            channel.offset = static_cast<uint32_t>( compressed.m_vectorValues.size() );
+            compressed.m_vectorValues.push_back( first );
+            break;
+
+        case CompressedAnimationClip::CHANNEL_LINEAR:
+            channel.offset = static_cast<uint32_t>( compressed.m_vectorValues.size() );
+            compressed.m_vectorValues.push_back( first );
+            compressed.m_vectorValues.push_back( clip.GetKeys( keyCount - 1 )[ track ].*member );
+            break;
+
+        default:
+            {
+                XMVECTOR minimum = XMLoadFloat3( &first );
+                XMVECTOR maximum = minimum;
+                for( size_t k = 1; k < keyCount; ++k )
+                {
+                    XMVECTOR v = XMLoadFloat3( &( clip.GetKeys( k )[ track ].*member ) );
+                    minimum = XMVectorMin( minimum, v );
+                    maximum = XMVectorMax( maximum, v );
+                }
+
+                XMFLOAT3 range[2];
+                XMStoreFloat3( &range[0], minimum );
+                XMStoreFloat3( &range[1], XMVectorScale( XMVectorSubtract( maximum, minimum ), 1.f / VECTOR_STEPS ) );
+
+                channel.offset = static_cast<uint32_t>( compressed.m_animatedVectors++ );
+                compressed.m_vectorRanges.push_back( range[0] );
+                compressed.m_vectorRanges.push_back( range[1] );
+            }
+            break;
+        }
+    };
+
+    // Formats and the values of constant and linear channels first, which gives the
+    // number of animated channels and so the stride of the key streams
+    for( size_t j = 0; j < trackCount; ++j )
+    {
+        compressed.m_trackNames[ j ] = clip.GetTrackName( j );
+
+        auto& track = compressed.m_tracks[ j ];
+
+        track.rotation.format = ClassifyRotation( clip, j, settings.rotationError );
+        switch( track.rotation.format )
+        {
+        case CompressedAnimationClip::CHANNEL_CONSTANT:
+            track.rotation.offset = static_cast<uint32_t>( compressed.m_rotationValues.size() );
+            compressed.m_rotationValues.push_back( clip.GetKeys( 0 )[ j ].rotation );
+            break;
+
+        case CompressedAnimationClip::CHANNEL_LINEAR:
+            track.rotation.offset = static_cast<uint32_t>( compressed.m_rotationValues.size() );
+            compressed.m_rotationValues.push_back( clip.GetKeys( 0 )[ j ].rotation );
+            compressed.m_rotationValues.push_back( clip.GetKeys( keyCount - 1 )[ j ].rotation );
+            break;
+
+        default:
+            track.rotation.offset = static_cast<uint32_t>( compressed.m_animatedRotations++ );
+            break;
+        }
+
+        addVectorChannel( j, &AnimationClip::Key::translation, settings.translationError, track.translation );
+        addVectorChannel( j, &AnimationClip::Key::scale, settings.scaleError, track.scale );
+    }
+
+    compressed.m_rotationKeys.resize( keyCount * compressed.m_animatedRotations * 3 );
+    compressed.m_vectorKeys.resize( keyCount * compressed.m_animatedVectors * 3 );
+
+    for( size_t k = 0; k < keyCount; ++k )
+    {
+        const AnimationClip::Key* keys = clip.GetKeys( k );
+
+        uint16_t* rotations = compressed.m_rotationKeys.data() + k * compressed.m_animatedRotations * 3;
+        uint16_t* vectors = compressed.m_vectorKeys.data() + k * compressed.m_animatedVectors * 3;
+
+        for( size_t j = 0; j < trackCount; ++j )
+        {
+            auto& track = compressed.m_tracks[ j ];
+
+            if ( track.rotation.format == CompressedAnimationClip::CHANNEL_ANIMATED )
+                EncodeRotation( XMLoadFloat4( &keys[ j ].rotation ), rotations + track.rotation.offset * 3 );
+
+            if ( track.translation.format == CompressedAnimationClip::CHANNEL_ANIMATED )
+            {
+                const XMFLOAT3* range = &compressed.m_vectorRanges[ track.translation.offset * 2 ];
+                EncodeVector( keys[ j ].translation, range[0], range[1], vectors + track.translation.offset * 3 );
+            }
+
+            if ( track.scale.format == CompressedAnimationClip::CHANNEL_ANIMATED )
+            {
+                const XMFLOAT3* range = &compressed.m_vectorRanges[ track.scale.offset * 2 ];
+                EncodeVector( keys[ j ].scale, range[0], range[1], vectors + track.scale.offset * 3 );
+            }
+        }
+    }
+
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+void BenchmarkAnimationCompression( const Skeleton& skeleton, const AnimationClip& clip, const CompressedAnimationClip& compressed, size_t iterations )
+{
+    if ( !iterations || !skeleton.GetBoneCount() )
+        return;
+
+    if ( clip.GetTrackCount() != compressed.GetTrackCount() || clip.GetKeyCount() != compressed.GetKeyCount() )
+        return;
+
+    float rotationError = 0.f;
+    float translationError = 0.f;
+    float scaleError = 0.f;
+
+    for( size_t k = 0; k < clip.GetKeyCount(); ++k )
+    {
+        const AnimationClip::Key* keys = clip.GetKeys( k );
+
+        for( size_t j = 0; j < clip.GetTrackCount(); ++j )
+        {
+            AnimationClip::Key value;
+            compressed.GetKey( j, k, value );
+
+            rotationError = std::max( rotationError, RotationError( XMLoadFloat4( &value.rotation ), XMLoadFloat4( &keys[ j ].rotation ) ) );
+            translationError = std::max( translationError, VectorError( XMLoadFloat3( &value.translation ), XMLoadFloat3( &keys[ j ].translation ) ) );
+            scaleError = std::max( scaleError, VectorError( XMLoadFloat3( &value.scale ), XMLoadFloat3( &keys[ j ].scale ) ) );
+        }
+    }
+
+    const size_t rawSize = clip.GetKeyCount() * clip.GetTrackCount() * sizeof(AnimationClip::Key);
+    const size_t compressedSize = compressed.GetSizeInBytes();
+
+    typedef unsigned long long ull;
+    BenchmarkTrace( "Animation compression: %llu tracks, %llu keys\n", ull( clip.GetTrackCount() ), ull( clip.GetKeyCount() ) );
+    BenchmarkTrace( "    %llu bytes raw, %llu bytes compressed (%.1f%%)\n",
+                    ull( rawSize ), ull( compressedSize ), 100.0 * double( compressedSize ) / double( std::max<size_t>( rawSize, 1 ) ) );
+    BenchmarkTrace( "    channels: %llu constant, %llu linear, %llu animated\n",
+                    ull( compressed.GetChannelCount( CompressedAnimationClip::CHANNEL_CONSTANT ) ),
+                    ull( compressed.GetChannelCount( CompressedAnimationClip::CHANNEL_LINEAR ) ),
+                    ull( compressed.GetChannelCount( CompressedAnimationClip::CHANNEL_ANIMATED ) ) );
+    BenchmarkTrace( "    largest key error: rotation %g radians, translation %g, scale %g\n", rotationError, translationError, scaleError );
+
+    std::vector<uint32_t> trackBones = clip.Bind( skeleton );
+    std::vector<uint32_t> compressedTrackBones = compressed.Bind( skeleton );
+
+    std::unique_ptr<XMMATRIX[], aligned_deleter> localTransforms(
+        reinterpret_cast<XMMATRIX*>( AlignedAlloc( sizeof(XMMATRIX) * skeleton.GetBoneCount(), 16 ) ) );
+    if ( !localTransforms )
+        return;
+
+    skeleton.CopyBindPose( localTransforms.get() );
+
+    // Not a whole number of keys, so every sample interpolates
+    const float step = 1.f / 97.f;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for( size_t i = 0; i < iterations; ++i )
+    {
+        clip.Sample( float( i ) * step, trackBones.data(), localTransforms.get() );
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    double rawSeconds = std::chrono::duration<double>( stop - start ).count();
+
+    start = std::chrono::steady_clock::now();
+
+    for( size_t i = 0; i < iterations; ++i )
+    {
+        compressed.Sample( float( i ) * step, compressedTrackBones.data(), localTransforms.get() );
+    }
+
+    stop = std::chrono::steady_clock::now();
+    double compressedSeconds = std::chrono::duration<double>( stop - start ).count();
+
+    BenchmarkTrace( "    Sample: %.3f us raw, %.3f us compressed (%.2fx)\n",
+                    rawSeconds * 1000000.0 / double( iterations ), compressedSeconds * 1000000.0 / double( iterations ),
+                    compressedSeconds / rawSeconds );
+}
@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// File: AnimationCompression.h
+//
+// Compressed keyframe storage for animation clips
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Animation.h"
+
+// How far a compressed channel may stray from the source keys before it is kept as
+// keyframes rather than reduced to a constant or a straight line
+struct AnimationCompressionSettings
+{
+    float   rotationError;      // Radians
+    float   translationError;   // Model units
+    float   scaleError;
+
+    AnimationCompressionSettings() : rotationError( 0.0005f ), translationError( 0.0001f ), scaleError( 0.0001f ) {}
+};
+
+// An AnimationClip with each track split into rotation, translation and scale channels.
+// A channel that does not change within the error bound is stored as one value, one that
+// moves at a constant rate as its first and last keys, and any other as a key per frame:
+// rotations as the smallest three quaternion components in 48 bits, translations and
+// scales as 16 bits per component over the channel's range.
+//
+// Clips are compressed in memory by CompressAnimationClip; there is no file format for
+// them, so a compressed clip is rebuilt from its source each time it is needed.
+class CompressedAnimationClip : public AnimationClipBase
+{
+public:
+    enum ChannelFormat
+    {
+        CHANNEL_CONSTANT = 0,
+        CHANNEL_LINEAR,
+        CHANNEL_ANIMATED,
+        CHANNEL_FORMAT_COUNT,
+    };
+
+    CompressedAnimationClip() : m_animatedRotations( 0 ), m_animatedVectors( 0 ) {}
+
+    CompressedAnimationClip( const CompressedAnimationClip& ) = delete;
+    CompressedAnimationClip& operator=( const CompressedAnimationClip& ) = delete;
+
+    virtual void Sample( float time, const uint32_t* trackBones, DirectX::XMMATRIX* localTransforms ) const override;
+
+    // Decodes one key of one track
+    void GetKey( size_t track, size_t key, AnimationClip::Key& value ) const;
+
+    // Keyframe data and the channel table; track names are not counted
+    size_t GetSizeInBytes() const;
+
+    // Rotation, translation and scale channels stored in 'format'
+    size_t GetChannelCount( ChannelFormat format ) const;
+
+private:
+    friend bool CompressAnimationClip( const AnimationClip& clip, const AnimationCompressionSettings& settings, CompressedAnimationClip& compressed );
+
+    struct Channel
+    {
+        uint32_t                        format;
+        uint32_t                        offset;     // Into the values for constant and linear channels, the key stream otherwise
+    };
+
+    struct Track
+    {
+        Channel                         rotation;
+        Channel                         translation;
+        Channel                         scale;
+    };
+
+    // 't' is how far between the keys at 'keys0' and 'keys1', 'u' how far through the clip
+    DirectX::XMVECTOR XM_CALLCONV SampleRotation( const Channel& channel, const uint16_t* keys0, const uint16_t* keys1,
+                                                  DirectX::FXMVECTOR t, DirectX::FXMVECTOR u ) const;
+    DirectX::XMVECTOR XM_CALLCONV SampleVector( const Channel& channel, const uint16_t* keys0, const uint16_t* keys1,
+                                                DirectX::FXMVECTOR t, DirectX::FXMVECTOR u ) const;
+
+    std::vector<Track>                  m_tracks;
+    std::vector<DirectX::XMFLOAT4>      m_rotationValues;   // One per constant channel, two per linear one
+    std::vector<DirectX::XMFLOAT3>      m_vectorValues;
+    std::vector<DirectX::XMFLOAT3>      m_vectorRanges;     // Minimum and step of each animated translation or scale
+    std::vector<uint16_t>               m_rotationKeys;     // Key-major, 3 per animated rotation
+    std::vector<uint16_t>               m_vectorKeys;       // Key-major, 3 per animated translation or scale
+    size_t                              m_animatedRotations;
+    size_t                              m_animatedVectors;
+};
+
+// False for a clip without keys or a negative error bound
+bool CompressAnimationClip( const AnimationClip& clip, const AnimationCompressionSettings& settings, CompressedAnimationClip& compressed );
+
+// Reports the size of 'compressed' against 'clip', the largest error of any decoded key,
+// and the time Sample takes for each. Needs no device.
+void BenchmarkAnimationCompression( const Skeleton& skeleton, const AnimationClip& clip, const CompressedAnimationClip& compressed, size_t iterations );
@@ -0,0 +1,107 @@
+//--------------------------------------------------------------------------------------
+// File: BonePaletteCache.cpp
+//
+// Skips bone palette writes that would not change what a skinned effect holds
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include "BonePaletteCache.h"
+
+#include <algorithm>
+
+#include <string.h>
+
+using namespace DirectX;
+
+namespace
+{
+    const size_t MaxBones = IEffectSkinning::MaxBones;
+
+    // SkinnedEffect keeps each bone as the three rows of a transposed 4x3 matrix, and
+    // uploads all of them whenever the palette is dirty
+    const size_t PaletteBytes = MaxBones * 3 * sizeof(XMVECTOR);
+}
+
+
+//--------------------------------------------------------------------------------------
+BonePaletteCache::BonePaletteCache()
+{
+    m_identity.reset( reinterpret_cast<XMMATRIX*>( AlignedAlloc( sizeof(XMMATRIX) * MaxBones, 16 ) ) );
+    if ( !m_identity )
+        throw std::bad_alloc();
+
+    XMMATRIX id = XMMatrixIdentity();
+    for( size_t j = 0; j < MaxBones; ++j )
+    {
+        m_identity[ j ] = id;
+    }
+
+    ResetStats();
+}
+
+
+//--------------------------------------------------------------------------------------
+void BonePaletteCache::SetBoneTransforms( _In_ IEffectSkinning* effect, _In_reads_(count) const XMMATRIX* bones, size_t count )
+{
+    if ( count > MaxBones )
+        throw std::exception("count parameter out of range");
+
+    ++m_stats.requests;
+    m_stats.matricesRequested += count;
+
+    auto& palette = m_palettes[ effect ];
+    if ( !palette.bones )
+    {
+        palette.bones.reset( reinterpret_cast<XMMATRIX*>( AlignedAlloc( sizeof(XMMATRIX) * MaxBones, 16 ) ) );
+        if ( !palette.bones )
+        {
+            m_palettes.erase( effect );
+            throw std::bad_alloc();
+        }
+
+        palette.known = 0;
+    }
+
+    // One past the last matrix that differs from what the effect holds. Slots the cache
+    // has never written could hold anything, so they always count as changed.
+    size_t dirty = count;
+    if ( count <= palette.known )
+    {
+        while ( dirty > 0 && !memcmp( &palette.bones[ dirty - 1 ], &bones[ dirty - 1 ], sizeof(XMMATRIX) ) )
+            --dirty;
+    }
+
+    if ( !dirty )
+        return;
+
+    effect->SetBoneTransforms( bones, dirty );
+
+    memcpy( palette.bones.get(), bones, sizeof(XMMATRIX) * dirty );
+    palette.known = std::max( palette.known, dirty );
+
+    ++m_stats.uploads;
+    m_stats.matricesWritten += dirty;
+    m_stats.bytesUploaded += PaletteBytes;
+}
+
+
+//--------------------------------------------------------------------------------------
+void BonePaletteCache::ResetBoneTransforms( _In_ IEffectSkinning* effect )
+{
+    SetBoneTransforms( effect, m_identity.get(), MaxBones );
+}
+
+
+//--------------------------------------------------------------------------------------
+void BonePaletteCache::ResetStats()
+{
+    memset( &m_stats, 0, sizeof(m_stats) );
+}
@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------------------------
+// File: BonePaletteCache.h
+//
+// Skips bone palette writes that would not change what a skinned effect holds
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Effects.h"
+
+#include "Animation.h"
+
+#include <map>
+
+struct BonePaletteStats
+{
+    size_t  requests;           // SetBoneTransforms and ResetBoneTransforms calls
+    size_t  uploads;            // Calls passed on to the effect
+    size_t  matricesRequested;
+    size_t  matricesWritten;    // Matrices passed on to the effects
+    size_t  bytesUploaded;      // Palette constants the effects upload again as a result
+};
+
+// Every SetBoneTransforms call marks the effect's constant buffer dirty, so it is uploaded
+// at the next Apply even when the matrices are the ones it already holds. The cache keeps a
+// copy of each effect's palette and passes a call on only when something differs, and then
+// only up to the last matrix that changed, since SetBoneTransforms always writes from slot 0.
+// Parts that share an effect and characters drawn in the same pose therefore upload their
+// palette once.
+//
+// Palettes set on an effect other than through the cache leave its copy stale; call
+// Invalidate for that effect, or Clear when effects are released.
+class BonePaletteCache
+{
+public:
+    BonePaletteCache();
+
+    BonePaletteCache( const BonePaletteCache& ) = delete;
+    BonePaletteCache& operator=( const BonePaletteCache& ) = delete;
+
+    void SetBoneTransforms( _In_ DirectX::IEffectSkinning* effect, _In_reads_(count) const DirectX::XMMATRIX* bones, size_t count );
+    void ResetBoneTransforms( _In_ DirectX::IEffectSkinning* effect );
+
+    void Invalidate( _In_ DirectX::IEffectSkinning* effect ) { m_palettes.erase( effect ); }
+    void Clear() { m_palettes.clear(); }
+
+    const BonePaletteStats& GetStats() const { return m_stats; }
+    void ResetStats();
+
+private:
+    struct Palette
+    {
+        std::unique_ptr<DirectX::XMMATRIX[], aligned_deleter>   bones;
+        size_t                                                  known;      // Leading slots whose contents are in 'bones'
+    };
+
+    std::map<DirectX::IEffectSkinning*, Palette>                m_palettes;
+    std::unique_ptr<DirectX::XMMATRIX[], aligned_deleter>       m_identity;
+    BonePaletteStats                                            m_stats;
+};
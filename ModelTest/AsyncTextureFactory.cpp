@@ -0,0 +1,283 @@
+//--------------------------------------------------------------------------------------
+// File: AsyncTextureFactory.cpp
+//
+// Effect factory that loads textures on a background thread behind a placeholder
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "AsyncTextureFactory.h"
+#include "SharedEffectFactory.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // Helper for binding a texture to whichever effect type 'effect' is
+    void SetEffectTexture( _In_ IEffect* effect, int slot, _In_opt_ ID3D11ShaderResourceView* textureView )
+    {
+        if ( slot == 0 )
+        {
+            if ( auto basic = dynamic_cast<BasicEffect*>( effect ) )
+                basic->SetTexture( textureView );
+            else if ( auto skinned = dynamic_cast<SkinnedEffect*>( effect ) )
+                skinned->SetTexture( textureView );
+            else if ( auto dual = dynamic_cast<DualTextureEffect*>( effect ) )
+                dual->SetTexture( textureView );
+            else if ( auto dgsl = dynamic_cast<DGSLEffect*>( effect ) )
+                dgsl->SetTexture( textureView );
+        }
+        else
+        {
+            if ( auto dual = dynamic_cast<DualTextureEffect*>( effect ) )
+                dual->SetTexture2( textureView );
+            else if ( auto dgsl = dynamic_cast<DGSLEffect*>( effect ) )
+                dgsl->SetTexture( 1, textureView );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+AsyncTextureFactory::AsyncTextureFactory( _In_ ID3D11Device* device, IEffectFactory& factory, _In_z_ const wchar_t* placeholder ) :
+    m_device( device ),
+    m_factory( factory ),
+    m_placeholder( placeholder ),
+    m_pending( 0 ),
+    m_failed( 0 ),
+    m_exit( false )
+{
+    if ( !device )
+        throw std::exception("Direct3D device is null");
+
+    if ( m_placeholder.empty() )
+        throw std::exception("A placeholder texture is required");
+
+    m_thread = std::thread( &AsyncTextureFactory::LoaderThread, this );
+}
+
+
+//--------------------------------------------------------------------------------------
+AsyncTextureFactory::~AsyncTextureFactory()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_exit = true;
+    }
+    m_requested.notify_all();
+
+    m_thread.join();
+}
+
+
+//--------------------------------------------------------------------------------------
+std::shared_ptr<IEffect> AsyncTextureFactory::CreateEffect( _In_ const EffectInfo& info, _In_opt_ ID3D11DeviceContext* deviceContext )
+{
+    bool texture = ( info.texture && *info.texture );
+    bool texture2 = ( info.texture2 && *info.texture2 );
+
+    EffectInfo placeholderInfo = info;
+    if ( texture )
+        placeholderInfo.texture = m_placeholder.c_str();
+    if ( texture2 )
+        placeholderInfo.texture2 = m_placeholder.c_str();
+
+    auto effect = m_factory.CreateEffect( placeholderInfo, deviceContext );
+
+    if ( effect )
+    {
+        if ( texture )
+            Request( info.texture, effect, 0 );
+        if ( texture2 )
+            Request( info.texture2, effect, 1 );
+    }
+
+    return effect;
+}
+
+
+//--------------------------------------------------------------------------------------
+void AsyncTextureFactory::CreateTexture( _In_z_ const wchar_t* name, _In_opt_ ID3D11DeviceContext* deviceContext, _Outptr_ ID3D11ShaderResourceView** textureView )
+{
+    m_factory.CreateTexture( name, deviceContext, textureView );
+}
+
+
+//--------------------------------------------------------------------------------------
+void AsyncTextureFactory::SetDirectory( _In_opt_z_ const wchar_t* path )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    m_directory = ( path ) ? path : L"";
+
+    if ( !m_directory.empty() && m_directory.back() != L'\\' )
+        m_directory += L'\\';
+}
+
+
+//--------------------------------------------------------------------------------------
+bool AsyncTextureFactory::Update()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    ApplyLoaded();
+
+    return !m_pending;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool AsyncTextureFactory::IsLoadComplete()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    return !m_pending;
+}
+
+
+//--------------------------------------------------------------------------------------
+void AsyncTextureFactory::WaitForLoads()
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+
+    m_loaded.wait( lock, [&]() { return m_completed.size() == m_pending; } );
+
+    ApplyLoaded();
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t AsyncTextureFactory::GetTextureCount()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    return m_textures.size();
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t AsyncTextureFactory::GetFailedCount()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    return m_failed;
+}
+
+
+//--------------------------------------------------------------------------------------
+void AsyncTextureFactory::Request( const std::wstring& name, const std::shared_ptr<IEffect>& effect, int slot )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    auto it = m_textures.find( name );
+    if ( it == m_textures.end() )
+    {
+        Texture texture;
+        texture.result = S_OK;
+        texture.applied = false;
+
+        it = m_textures.emplace( name, texture ).first;
+
+        m_queue.push_back( name );
+        ++m_pending;
+        m_requested.notify_one();
+    }
+
+    auto& texture = it->second;
+
+    if ( texture.applied )
+    {
+        // Already loaded, and this effect has not been handed out yet
+        if ( texture.view )
+            SetEffectTexture( effect.get(), slot, texture.view.Get() );
+    }
+    else
+    {
+        Binding binding;
+        binding.effect = effect;
+        binding.slot = slot;
+        texture.bindings.push_back( binding );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Called with m_mutex held
+void AsyncTextureFactory::ApplyLoaded()
+{
+    for( auto it = m_completed.cbegin(); it != m_completed.cend(); ++it )
+    {
+        auto& texture = m_textures[ *it ];
+
+        if ( texture.view )
+        {
+            for( auto bit = texture.bindings.cbegin(); bit != texture.bindings.cend(); ++bit )
+            {
+                auto effect = bit->effect.lock();
+                if ( effect )
+                    SetEffectTexture( effect.get(), bit->slot, texture.view.Get() );
+            }
+        }
+
+        texture.bindings.clear();
+        texture.applied = true;
+        --m_pending;
+    }
+
+    m_completed.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+void AsyncTextureFactory::LoaderThread()
+{
+    // WIC needs COM on this thread; DDS files still load if this fails
+    HRESULT hrCOM = CoInitializeEx( nullptr, COINIT_MULTITHREADED );
+
+    for( ;; )
+    {
+        std::wstring name;
+        std::wstring directory;
+
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            m_requested.wait( lock, [&]() { return m_exit || !m_queue.empty(); } );
+
+            if ( m_exit )
+                break;
+
+            name = m_queue.front();
+            m_queue.pop_front();
+            directory = m_directory;
+        }
+
+        Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> textureView;
+        HRESULT hr = LoadTextureFile( m_device.Get(), nullptr, directory, name, &textureView );
+
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+
+            auto& texture = m_textures[ name ];
+            texture.result = hr;
+            if ( SUCCEEDED(hr) )
+                texture.view = textureView;
+            else
+                ++m_failed;
+
+            m_completed.push_back( name );
+        }
+        m_loaded.notify_all();
+    }
+
+    if ( SUCCEEDED(hrCOM) )
+        CoUninitialize();
+}
@@ -0,0 +1,106 @@
+//--------------------------------------------------------------------------------------
+// File: AsyncTextureFactory.h
+//
+// Effect factory that loads textures on a background thread behind a placeholder
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Effects.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <wrl/client.h>
+
+// Effects are created by 'factory' with the placeholder texture in place of each of
+// their textures, so CreateEffect returns without reading any texture file. The real
+// textures are read on a background thread, each once however many effects use it, and
+// Update puts them into the effects. Effects are not thread-safe, so Update must be called
+// on the thread that draws with them, between draws.
+//
+// Textures are loaded without a device context, so WIC textures get no generated mips.
+// CreateTexture is passed straight to 'factory' and stays synchronous, as the caller
+// holds on to the view it returns.
+class AsyncTextureFactory : public DirectX::IEffectFactory
+{
+public:
+    // 'placeholder' is loaded by 'factory', so it uses the same directory
+    AsyncTextureFactory( _In_ ID3D11Device* device, DirectX::IEffectFactory& factory, _In_z_ const wchar_t* placeholder );
+    virtual ~AsyncTextureFactory();
+
+    AsyncTextureFactory( const AsyncTextureFactory& ) = delete;
+    AsyncTextureFactory& operator=( const AsyncTextureFactory& ) = delete;
+
+    virtual std::shared_ptr<DirectX::IEffect> CreateEffect( _In_ const EffectInfo& info, _In_opt_ ID3D11DeviceContext* deviceContext ) override;
+
+    virtual void CreateTexture( _In_z_ const wchar_t* name, _In_opt_ ID3D11DeviceContext* deviceContext, _Outptr_ ID3D11ShaderResourceView** textureView ) override;
+
+    // Directory the background thread looks in first, as EffectFactory::SetDirectory
+    void SetDirectory( _In_opt_z_ const wchar_t* path );
+
+    // Puts every texture loaded since the last call into its effects, and returns true
+    // once no texture is left to load
+    bool Update();
+
+    // True once every texture requested so far has been loaded (or failed) and applied
+    bool IsLoadComplete();
+
+    // Blocks until the background thread has read every texture requested so far, then
+    // applies them as Update does
+    void WaitForLoads();
+
+    // Textures requested, and those that failed to load and kept the placeholder
+    size_t GetTextureCount();
+    size_t GetFailedCount();
+
+private:
+    struct Binding
+    {
+        std::weak_ptr<DirectX::IEffect>     effect;
+        int                                 slot;       // 0 = texture, 1 = texture2
+    };
+
+    struct Texture
+    {
+        std::vector<Binding>                                bindings;
+        Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>    view;
+        HRESULT                                             result;
+        bool                                                applied;    // Set by Update once loaded
+    };
+
+    void Request( const std::wstring& name, const std::shared_ptr<DirectX::IEffect>& effect, int slot );
+    void ApplyLoaded();
+    void LoaderThread();
+
+    Microsoft::WRL::ComPtr<ID3D11Device>    m_device;
+    DirectX::IEffectFactory&                m_factory;
+    std::wstring                            m_placeholder;
+
+    std::mutex                              m_mutex;
+    std::condition_variable                 m_requested;
+    std::condition_variable                 m_loaded;
+    std::wstring                            m_directory;
+    std::map<std::wstring, Texture>         m_textures;
+    std::deque<std::wstring>                m_queue;
+    std::vector<std::wstring>               m_completed;        // Loaded but not yet applied
+    size_t                                  m_pending;          // Requested but not yet applied
+    size_t                                  m_failed;
+    bool                                    m_exit;
+    std::thread                             m_thread;
+};
@@ -0,0 +1,66 @@
+//--------------------------------------------------------------------------------------
+// File: BenchmarkTrace.h
+//
+// Formatted output for the benchmarks, shared by the model and animation tests
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+
+// Receives each formatted line in place of the default output
+typedef void (*BenchmarkTraceCallback)( const char* message );
+
+inline BenchmarkTraceCallback& BenchmarkTraceTarget()
+{
+    static BenchmarkTraceCallback s_callback = nullptr;
+    return s_callback;
+}
+
+// Null restores the default: the debugger output on Windows, stdout elsewhere
+inline void SetBenchmarkTraceCallback( BenchmarkTraceCallback callback )
+{
+    BenchmarkTraceTarget() = callback;
+}
+
+// Lines longer than 1023 characters are cut short
+inline void BenchmarkTrace( const char* format, ... )
+{
+    char buff[1024] = {};
+
+    va_list args;
+    va_start( args, format );
+#ifdef _WIN32
+    _vsnprintf_s( buff, _TRUNCATE, format, args );
+#else
+    vsnprintf( buff, sizeof(buff), format, args );
+#endif
+    va_end( args );
+
+    BenchmarkTraceCallback callback = BenchmarkTraceTarget();
+    if ( callback )
+    {
+        callback( buff );
+        return;
+    }
+
+#ifdef _WIN32
+    OutputDebugStringA( buff );
+#else
+    fputs( buff, stdout );
+#endif
+}
@@ -0,0 +1,240 @@
+//--------------------------------------------------------------------------------------
+// File: EffectCache.cpp
+//
+// Effect and input layout caches keyed by content rather than by name
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "EffectCache.h"
+
+#include <string.h>
+
+#include "DirectXHelpers.h"
+#include "PlatformHelpers.h"
+
+using namespace DirectX;
+
+namespace
+{
+    const uint64_t c_FNVOffsetBasis = 14695981039346656037ULL;
+    const uint64_t c_FNVPrime = 1099511628211ULL;
+
+    // FNV-1a, continuing from 'hash'
+    inline uint64_t HashBytes( _In_reads_bytes_(size) const void* data, size_t size, uint64_t hash = c_FNVOffsetBasis )
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>( data );
+        for( size_t j = 0; j < size; ++j )
+        {
+            hash ^= bytes[ j ];
+            hash *= c_FNVPrime;
+        }
+        return hash;
+    }
+
+    template<typename T>
+    inline void AppendBytes( std::vector<uint8_t>& bytes, const T& value )
+    {
+        auto ptr = reinterpret_cast<const uint8_t*>( &value );
+        bytes.insert( bytes.end(), ptr, ptr + sizeof(T) );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// CachingEffectFactory
+//--------------------------------------------------------------------------------------
+
+// Colors and scalars compare bit for bit, so that equal keys always hash equally
+bool CachingEffectFactory::Key::operator==( const Key& other ) const
+{
+    return flags == other.flags
+           && memcmp( &specularPower, &other.specularPower, sizeof(float) ) == 0
+           && memcmp( &alpha, &other.alpha, sizeof(float) ) == 0
+           && memcmp( &ambientColor, &other.ambientColor, sizeof(XMFLOAT3) ) == 0
+           && memcmp( &diffuseColor, &other.diffuseColor, sizeof(XMFLOAT3) ) == 0
+           && memcmp( &specularColor, &other.specularColor, sizeof(XMFLOAT3) ) == 0
+           && memcmp( &emissiveColor, &other.emissiveColor, sizeof(XMFLOAT3) ) == 0
+           && texture == other.texture
+           && texture2 == other.texture2;
+}
+
+size_t CachingEffectFactory::KeyHash::operator()( const Key& key ) const
+{
+    uint64_t hash = HashBytes( key.texture.c_str(), key.texture.size() * sizeof(wchar_t) );
+    hash = HashBytes( key.texture2.c_str(), key.texture2.size() * sizeof(wchar_t), hash );
+    hash = HashBytes( &key.flags, sizeof(key.flags), hash );
+    hash = HashBytes( &key.specularPower, sizeof(key.specularPower), hash );
+    hash = HashBytes( &key.alpha, sizeof(key.alpha), hash );
+    hash = HashBytes( &key.ambientColor, sizeof(key.ambientColor), hash );
+    hash = HashBytes( &key.diffuseColor, sizeof(key.diffuseColor), hash );
+    hash = HashBytes( &key.specularColor, sizeof(key.specularColor), hash );
+    hash = HashBytes( &key.emissiveColor, sizeof(key.emissiveColor), hash );
+    return static_cast<size_t>( hash );
+}
+
+
+//--------------------------------------------------------------------------------------
+std::shared_ptr<IEffect> CachingEffectFactory::CreateEffect( _In_ const EffectInfo& info, _In_opt_ ID3D11DeviceContext* deviceContext )
+{
+    Key key;
+    key.texture = ( info.texture ) ? info.texture : L"";
+    key.texture2 = ( info.texture2 ) ? info.texture2 : L"";
+    key.flags = ( info.perVertexColor ? 0x1 : 0 ) | ( info.enableSkinning ? 0x2 : 0 ) | ( info.enableDualTexture ? 0x4 : 0 );
+    key.specularPower = info.specularPower;
+    key.alpha = info.alpha;
+    key.ambientColor = info.ambientColor;
+    key.diffuseColor = info.diffuseColor;
+    key.specularColor = info.specularColor;
+    key.emissiveColor = info.emissiveColor;
+
+    // The wrapped factory need not be thread-safe, so creation also happens under the lock
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    ++m_requests;
+
+    auto it = m_effects.find( key );
+    if ( it != m_effects.end() )
+        return it->second;
+
+    // Without a name the wrapped factory creates a new effect rather than returning one
+    // it shared by name
+    EffectInfo unnamed = info;
+    unnamed.name = nullptr;
+
+    auto effect = m_factory.CreateEffect( unnamed, deviceContext );
+
+    m_effects.emplace( std::move( key ), effect );
+
+    return effect;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CachingEffectFactory::CreateTexture( _In_z_ const wchar_t* name, _In_opt_ ID3D11DeviceContext* deviceContext, _Outptr_ ID3D11ShaderResourceView** textureView )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    m_factory.CreateTexture( name, deviceContext, textureView );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CachingEffectFactory::ReleaseCache()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    m_effects.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+void CachingEffectFactory::GetStats( EffectCacheStats& stats )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    stats.effectRequests = m_requests;
+    stats.effectsCreated = m_effects.size();
+}
+
+
+//--------------------------------------------------------------------------------------
+// InputLayoutCache
+//--------------------------------------------------------------------------------------
+
+bool InputLayoutCache::Key::operator==( const Key& other ) const
+{
+    return byteCodeHash == other.byteCodeHash
+           && byteCodeLength == other.byteCodeLength
+           && decl == other.decl;
+}
+
+size_t InputLayoutCache::KeyHash::operator()( const Key& key ) const
+{
+    uint64_t hash = HashBytes( key.decl.data(), key.decl.size(), key.byteCodeHash );
+    return static_cast<size_t>( HashBytes( &key.byteCodeLength, sizeof(key.byteCodeLength), hash ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+void InputLayoutCache::CreateInputLayout( _In_ ID3D11Device* device, _In_reads_(count) const D3D11_INPUT_ELEMENT_DESC* desc, size_t count,
+                                          _In_ IEffect* effect, _Outptr_ ID3D11InputLayout** pInputLayout )
+{
+    if ( !device || !desc || !effect || !pInputLayout )
+        throw std::exception("Invalid arguments");
+
+    void const* shaderByteCode;
+    size_t byteCodeLength;
+
+    effect->GetVertexShaderBytecode( &shaderByteCode, &byteCodeLength );
+
+    Key key;
+    key.byteCodeLength = byteCodeLength;
+    key.byteCodeHash = HashBytes( shaderByteCode, byteCodeLength );
+
+    key.decl.reserve( count * ( sizeof(D3D11_INPUT_ELEMENT_DESC) + 16 ) );
+    for( size_t j = 0; j < count; ++j )
+    {
+        auto& element = desc[ j ];
+
+        const char* semantic = element.SemanticName ? element.SemanticName : "";
+        key.decl.insert( key.decl.end(), semantic, semantic + strlen( semantic ) + 1 );
+
+        AppendBytes( key.decl, element.SemanticIndex );
+        AppendBytes( key.decl, element.Format );
+        AppendBytes( key.decl, element.InputSlot );
+        AppendBytes( key.decl, element.AlignedByteOffset );
+        AppendBytes( key.decl, element.InputSlotClass );
+        AppendBytes( key.decl, element.InstanceDataStepRate );
+    }
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    ++m_requests;
+
+    auto it = m_layouts.find( key );
+    if ( it == m_layouts.end() )
+    {
+        Microsoft::WRL::ComPtr<ID3D11InputLayout> il;
+
+        ThrowIfFailed(
+            device->CreateInputLayout( desc, static_cast<UINT>( count ),
+                                       shaderByteCode, byteCodeLength,
+                                       &il )
+        );
+
+        SetDebugObjectName( il.Get(), "InputLayoutCache" );
+
+        it = m_layouts.emplace( std::move( key ), il ).first;
+    }
+
+    it->second.CopyTo( pInputLayout );
+}
+
+
+//--------------------------------------------------------------------------------------
+void InputLayoutCache::ReleaseCache()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    m_layouts.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+void InputLayoutCache::GetStats( EffectCacheStats& stats )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    stats.layoutRequests = m_requests;
+    stats.layoutsCreated = m_layouts.size();
+}
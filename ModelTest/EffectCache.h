@@ -0,0 +1,128 @@
+//--------------------------------------------------------------------------------------
+// File: EffectCache.h
+//
+// Effect and input layout caches keyed by content rather than by name
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Effects.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <wrl/client.h>
+
+struct EffectCacheStats
+{
+    size_t  effectRequests;
+    size_t  effectsCreated;
+    size_t  layoutRequests;
+    size_t  layoutsCreated;
+};
+
+// Returns one shared effect for every request with the same EffectInfo contents: flags,
+// colors, specular power, alpha and texture names. The material name is not part of the
+// key, so equal materials from different models share an effect, and differing materials
+// with the same name do not. Effects are created by 'factory', which should keep its
+// texture sharing enabled so textures are loaded once.
+//
+// Shared effects share their settings: a model whose effects are changed after loading
+// (for example with Model::UpdateEffects) changes them for every model using them.
+// Loaders see this as a plain IEffectFactory, so CMO files take the CreateEffect path
+// even when 'factory' is a DGSLEffectFactory.
+class CachingEffectFactory : public DirectX::IEffectFactory
+{
+public:
+    explicit CachingEffectFactory( DirectX::IEffectFactory& factory ) : m_factory( factory ), m_requests( 0 ) {}
+
+    CachingEffectFactory( const CachingEffectFactory& ) = delete;
+    CachingEffectFactory& operator=( const CachingEffectFactory& ) = delete;
+
+    virtual std::shared_ptr<DirectX::IEffect> CreateEffect( _In_ const EffectInfo& info, _In_opt_ ID3D11DeviceContext* deviceContext ) override;
+
+    virtual void CreateTexture( _In_z_ const wchar_t* name, _In_opt_ ID3D11DeviceContext* deviceContext, _Outptr_ ID3D11ShaderResourceView** textureView ) override;
+
+    void ReleaseCache();
+
+    // Fills in the effect counters of 'stats'
+    void GetStats( EffectCacheStats& stats );
+
+private:
+    struct Key
+    {
+        std::wstring        texture;
+        std::wstring        texture2;
+        uint32_t            flags;
+        float               specularPower;
+        float               alpha;
+        DirectX::XMFLOAT3   ambientColor;
+        DirectX::XMFLOAT3   diffuseColor;
+        DirectX::XMFLOAT3   specularColor;
+        DirectX::XMFLOAT3   emissiveColor;
+
+        bool operator==( const Key& other ) const;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()( const Key& key ) const;
+    };
+
+    DirectX::IEffectFactory&                                            m_factory;
+    std::mutex                                                          m_mutex;
+    size_t                                                              m_requests;
+    std::unordered_map<Key, std::shared_ptr<DirectX::IEffect>, KeyHash> m_effects;
+};
+
+// Returns one shared input layout for each vertex declaration and vertex shader, keyed
+// by the declaration's contents and a hash of the shader bytecode, so effects that use
+// the same shader share layouts.
+class InputLayoutCache
+{
+public:
+    InputLayoutCache() : m_requests( 0 ) {}
+
+    InputLayoutCache( const InputLayoutCache& ) = delete;
+    InputLayoutCache& operator=( const InputLayoutCache& ) = delete;
+
+    // Throws if the layout cannot be created
+    void CreateInputLayout( _In_ ID3D11Device* device, _In_reads_(count) const D3D11_INPUT_ELEMENT_DESC* desc, size_t count,
+                            _In_ DirectX::IEffect* effect, _Outptr_ ID3D11InputLayout** pInputLayout );
+
+    void ReleaseCache();
+
+    // Fills in the input layout counters of 'stats'
+    void GetStats( EffectCacheStats& stats );
+
+private:
+    struct Key
+    {
+        std::vector<uint8_t>    decl;           // Element fields, with semantic names inline
+        size_t                  byteCodeLength;
+        uint64_t                byteCodeHash;
+
+        bool operator==( const Key& other ) const;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()( const Key& key ) const;
+    };
+
+    std::mutex                                                                          m_mutex;
+    size_t                                                                              m_requests;
+    std::unordered_map<Key, Microsoft::WRL::ComPtr<ID3D11InputLayout>, KeyHash>         m_layouts;
+};
@@ -0,0 +1,172 @@
+//--------------------------------------------------------------------------------------
+// File: GeometryPool.cpp
+//
+// Suballocation of vertex and index data for many models from a few large buffers
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "GeometryPool.h"
+
+#include <algorithm>
+
+#include "DirectXHelpers.h"
+#include "PlatformHelpers.h"
+
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+GeometryPool::GeometryPool( _In_ ID3D11Device* device, _In_ ID3D11DeviceContext* context, size_t pageSize ) :
+    m_device( device ),
+    m_context( context ),
+    m_pageSize( pageSize ),
+    m_allocations( 0 )
+{
+    if ( !device || !context )
+        throw std::exception("Direct3D device and context are required");
+
+    if ( !pageSize || pageSize > UINT32_MAX )
+        throw std::exception("Invalid geometry pool page size");
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t GeometryPool::Allocate( std::vector<Page>& pages, D3D11_BIND_FLAG bindFlags, _In_reads_bytes_(sizeBytes) const void* data, size_t sizeBytes,
+                               size_t alignment, _Outptr_ ID3D11Buffer** buffer )
+{
+    if ( !data || !sizeBytes || !alignment || !buffer )
+        throw std::exception("Invalid geometry pool allocation");
+
+    // First fit; pages are only ever appended to, so earlier pages are usually full
+    Page* page = nullptr;
+    size_t offset = 0;
+    for( auto it = pages.begin(); it != pages.end(); ++it )
+    {
+        size_t start = ( ( it->used + alignment - 1 ) / alignment ) * alignment;
+        if ( start <= it->size && sizeBytes <= it->size - start )
+        {
+            page = &(*it);
+            offset = start;
+            break;
+        }
+    }
+
+    if ( !page )
+    {
+        size_t size = std::max( m_pageSize, sizeBytes );
+        if ( size > UINT32_MAX )
+            throw std::exception("Buffer too large for DirectX 11");
+
+        D3D11_BUFFER_DESC bufferDesc = {};
+
+        bufferDesc.ByteWidth = static_cast<UINT>( size );
+        bufferDesc.BindFlags = bindFlags;
+        bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+
+        Page newPage;
+        ThrowIfFailed(
+            m_device->CreateBuffer( &bufferDesc, nullptr, &newPage.buffer )
+        );
+
+        SetDebugObjectName( newPage.buffer.Get(), ( bindFlags == D3D11_BIND_VERTEX_BUFFER ) ? "GeometryPoolVB" : "GeometryPoolIB" );
+
+        newPage.size = size;
+        newPage.used = 0;
+
+        pages.push_back( newPage );
+        page = &pages.back();
+        offset = 0;
+    }
+
+    D3D11_BOX box = {};
+    box.left = static_cast<UINT>( offset );
+    box.right = static_cast<UINT>( offset + sizeBytes );
+    box.bottom = 1;
+    box.back = 1;
+
+    m_context->UpdateSubresource( page->buffer.Get(), 0, &box, data, 0, 0 );
+
+    page->used = offset + sizeBytes;
+    ++m_allocations;
+
+    *buffer = page->buffer.Get();
+    (*buffer)->AddRef();
+
+    return offset;
+}
+
+
+//--------------------------------------------------------------------------------------
+void GeometryPool::AllocateVertices( _In_reads_bytes_(sizeBytes) const void* vertices, size_t sizeBytes, uint32_t stride,
+                                     _Outptr_ ID3D11Buffer** buffer, _Out_ uint32_t* baseVertex )
+{
+    if ( !stride || ( sizeBytes % stride ) || !baseVertex )
+        throw std::exception("Invalid vertex data for geometry pool");
+
+    size_t offset = Allocate( m_vertexPages, D3D11_BIND_VERTEX_BUFFER, vertices, sizeBytes, stride, buffer );
+
+    *baseVertex = static_cast<uint32_t>( offset / stride );
+}
+
+
+//--------------------------------------------------------------------------------------
+void GeometryPool::AllocateIndices( _In_reads_bytes_(sizeBytes) const void* indices, size_t sizeBytes, DXGI_FORMAT indexFormat,
+                                    _Outptr_ ID3D11Buffer** buffer, _Out_ uint32_t* baseIndex )
+{
+    size_t indexSize;
+    switch( indexFormat )
+    {
+    case DXGI_FORMAT_R16_UINT:  indexSize = sizeof(uint16_t); break;
+    case DXGI_FORMAT_R32_UINT:  indexSize = sizeof(uint32_t); break;
+    default:
+        throw std::exception("Invalid index format for geometry pool");
+    }
+
+    if ( ( sizeBytes % indexSize ) || !baseIndex )
+        throw std::exception("Invalid index data for geometry pool");
+
+    size_t offset = Allocate( m_indexPages, D3D11_BIND_INDEX_BUFFER, indices, sizeBytes, indexSize, buffer );
+
+    *baseIndex = static_cast<uint32_t>( offset / indexSize );
+}
+
+
+//--------------------------------------------------------------------------------------
+void GeometryPool::GetStats( _Out_ GeometryPoolStats& stats ) const
+{
+    stats.vertexBuffers = m_vertexPages.size();
+    stats.indexBuffers = m_indexPages.size();
+    stats.allocations = m_allocations;
+    stats.bytesUsed = 0;
+    stats.bytesReserved = 0;
+
+    for( auto it = m_vertexPages.cbegin(); it != m_vertexPages.cend(); ++it )
+    {
+        stats.bytesUsed += it->used;
+        stats.bytesReserved += it->size;
+    }
+
+    for( auto it = m_indexPages.cbegin(); it != m_indexPages.cend(); ++it )
+    {
+        stats.bytesUsed += it->used;
+        stats.bytesReserved += it->size;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void GeometryPool::Reset()
+{
+    m_vertexPages.clear();
+    m_indexPages.clear();
+    m_allocations = 0;
+}
@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------
+// File: GeometryPool.h
+//
+// Suballocation of vertex and index data for many models from a few large buffers
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <d3d11.h>
+
+#include <vector>
+
+#include <wrl/client.h>
+
+struct GeometryPoolStats
+{
+    size_t  vertexBuffers;      // Buffers created by the pool
+    size_t  indexBuffers;
+    size_t  allocations;
+    size_t  bytesUsed;          // Including padding to vertex and index alignment
+    size_t  bytesReserved;
+};
+
+// Vertex data of any stride shares the same buffers: each range starts on a multiple of
+// its own stride, so it can be addressed with a base vertex rather than a buffer offset.
+// Index data is placed the same way and addressed with a start index. Data is copied in
+// with UpdateSubresource on the immediate context, so the pool is not thread-safe.
+class GeometryPool
+{
+public:
+    // Buffers are 'pageSize' bytes; larger requests get a buffer of their own
+    GeometryPool( _In_ ID3D11Device* device, _In_ ID3D11DeviceContext* context, size_t pageSize = 4 * 1024 * 1024 );
+
+    GeometryPool( const GeometryPool& ) = delete;
+    GeometryPool& operator=( const GeometryPool& ) = delete;
+
+    // Copies the vertices into a shared buffer and returns it with the vertex the data starts at
+    void AllocateVertices( _In_reads_bytes_(sizeBytes) const void* vertices, size_t sizeBytes, uint32_t stride,
+                           _Outptr_ ID3D11Buffer** buffer, _Out_ uint32_t* baseVertex );
+
+    // Copies the indices into a shared buffer and returns it with the index the data starts at
+    void AllocateIndices( _In_reads_bytes_(sizeBytes) const void* indices, size_t sizeBytes, DXGI_FORMAT indexFormat,
+                          _Outptr_ ID3D11Buffer** buffer, _Out_ uint32_t* baseIndex );
+
+    void GetStats( _Out_ GeometryPoolStats& stats ) const;
+
+    // Drops the pool's references; models keep the buffers they use alive
+    void Reset();
+
+private:
+    struct Page
+    {
+        Microsoft::WRL::ComPtr<ID3D11Buffer>    buffer;
+        size_t                                  size;
+        size_t                                  used;
+    };
+
+    size_t Allocate( std::vector<Page>& pages, D3D11_BIND_FLAG bindFlags, _In_reads_bytes_(sizeBytes) const void* data, size_t sizeBytes,
+                     size_t alignment, _Outptr_ ID3D11Buffer** buffer );
+
+    Microsoft::WRL::ComPtr<ID3D11Device>        m_device;
+    Microsoft::WRL::ComPtr<ID3D11DeviceContext> m_context;
+    size_t                                      m_pageSize;
+    size_t                                      m_allocations;
+    std::vector<Page>                           m_vertexPages;
+    std::vector<Page>                           m_indexPages;
+};
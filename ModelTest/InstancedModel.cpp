@@ -0,0 +1,561 @@
+//--------------------------------------------------------------------------------------
+// File: InstancedModel.cpp
+//
+// Hardware-instanced drawing of many copies of a model, one draw per part
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "InstancedModel.h"
+
+#include <algorithm>
+#include <map>
+
+#include <d3dcompiler.h>
+
+#include "DirectXHelpers.h"
+#include "PlatformHelpers.h"
+
+#pragma comment(lib,"d3dcompiler.lib")
+
+using namespace DirectX;
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // The stock effects have no instanced variants, so these shaders stand in for them.
+    // They are compiled when an InstancedModel is created.
+    const char c_InstancedModelShaders[] = R"(
+cbuffer FrameConstants : register( b0 )
+{
+    float4x4 ViewProjection;
+    float4   AmbientLightColor;
+    float4   LightDirection[ 3 ];
+    float4   LightDiffuseColor[ 3 ];
+};
+
+cbuffer MaterialConstants : register( b1 )
+{
+    float4   DiffuseColor;      // Premultiplied by alpha
+    float4   EmissiveColor;
+};
+
+Texture2D<float4> Texture : register( t0 );
+SamplerState Sampler : register( s0 );
+
+// HAS_NORMAL and HAS_TEXCOORD are defined to 0 or 1 to match the vertex declaration
+struct VSInput
+{
+    float4 Position   : SV_Position;
+#if HAS_NORMAL
+    float3 Normal     : NORMAL;
+#endif
+#if HAS_TEXCOORD
+    float2 TexCoord   : TEXCOORD0;
+#endif
+
+    // Rows of the transposed world matrix
+    float4 Transform0 : InstMatrix0;
+    float4 Transform1 : InstMatrix1;
+    float4 Transform2 : InstMatrix2;
+
+    // Rows of the transposed inverse-transpose world matrix, so normals stay
+    // perpendicular under non-uniform scale
+    float3 Normal0    : InstNormal0;
+    float3 Normal1    : InstNormal1;
+    float3 Normal2    : InstNormal2;
+};
+
+struct VSOutput
+{
+    float3 NormalWS   : TEXCOORD0;
+    float2 TexCoord   : TEXCOORD1;
+    float4 PositionPS : SV_Position;
+};
+
+struct PSInput
+{
+    float3 NormalWS   : TEXCOORD0;
+    float2 TexCoord   : TEXCOORD1;
+};
+
+VSOutput VSInstanced( VSInput vin )
+{
+    float3 positionWS = float3( dot( vin.Position, vin.Transform0 ),
+                                dot( vin.Position, vin.Transform1 ),
+                                dot( vin.Position, vin.Transform2 ) );
+
+    VSOutput vout;
+    vout.PositionPS = mul( float4( positionWS, 1 ), ViewProjection );
+#if HAS_NORMAL
+    vout.NormalWS = float3( dot( vin.Normal, vin.Normal0 ),
+                            dot( vin.Normal, vin.Normal1 ),
+                            dot( vin.Normal, vin.Normal2 ) );
+#else
+    vout.NormalWS = 0;
+#endif
+#if HAS_TEXCOORD
+    vout.TexCoord = vin.TexCoord;
+#else
+    vout.TexCoord = 0;
+#endif
+    return vout;
+}
+
+float4 PSInstanced( PSInput pin ) : SV_Target0
+{
+#if HAS_TEXCOORD
+    float4 color = Texture.Sample( Sampler, pin.TexCoord );
+#else
+    float4 color = 1;
+#endif
+
+#if HAS_NORMAL
+    float3 normal = normalize( pin.NormalWS );
+
+    float3 light = AmbientLightColor.rgb;
+
+    [unroll]
+    for( int i = 0; i < 3; ++i )
+    {
+        light += saturate( dot( normal, -LightDirection[ i ].xyz ) ) * LightDiffuseColor[ i ].rgb;
+    }
+
+    color.rgb *= DiffuseColor.rgb * light + EmissiveColor.rgb;
+#else
+    // Unlit, as the stock effects draw vertices without normals
+    color.rgb *= DiffuseColor.rgb + EmissiveColor.rgb;
+#endif
+    color.a *= DiffuseColor.a;
+    return color;
+}
+)";
+
+    struct FrameConstants
+    {
+        XMFLOAT4X4  viewProjection;
+        XMFLOAT4    ambientLightColor;
+        XMFLOAT4    lightDirection[ 3 ];
+        XMFLOAT4    lightDiffuseColor[ 3 ];
+    };
+
+    struct MaterialConstants
+    {
+        XMFLOAT4    diffuseColor;
+        XMFLOAT4    emissiveColor;
+    };
+
+    struct InstanceTransform
+    {
+        XMFLOAT4    rows[ 3 ];
+        XMFLOAT3    normalRows[ 3 ];
+    };
+
+    static_assert( ( sizeof(FrameConstants) % 16 ) == 0, "Constant buffer size must be a multiple of 16 bytes" );
+    static_assert( ( sizeof(MaterialConstants) % 16 ) == 0, "Constant buffer size must be a multiple of 16 bytes" );
+    static_assert( sizeof(InstanceTransform) == 84, "Instance data size incorrect" );
+
+    // The values IEffectLights::EnableDefaultLighting uses
+    const XMFLOAT4 c_DefaultLightDirection[ 3 ] =
+    {
+        XMFLOAT4( -0.5265408f, -0.5735765f, -0.6275069f, 0.f ),
+        XMFLOAT4(  0.7198464f,  0.3420201f,  0.6040227f, 0.f ),
+        XMFLOAT4(  0.4545195f, -0.7660444f,  0.4545195f, 0.f ),
+    };
+
+    const XMFLOAT4 c_DefaultLightDiffuse[ 3 ] =
+    {
+        XMFLOAT4( 1.0000000f, 0.9607844f, 0.8078432f, 0.f ),
+        XMFLOAT4( 0.9647059f, 0.7607844f, 0.4078432f, 0.f ),
+        XMFLOAT4( 0.3231373f, 0.3607844f, 0.3937255f, 0.f ),
+    };
+
+    const XMFLOAT4 c_DefaultAmbient( 0.05333332f, 0.09882354f, 0.1819608f, 0.f );
+
+    // Bits of a shader variant index
+    const uint32_t c_VariantNormal = 0x1;
+    const uint32_t c_VariantTexCoord = 0x2;
+}
+
+static bool HasElement( const std::vector<D3D11_INPUT_ELEMENT_DESC>& decl, _In_z_ const char* semanticName )
+{
+    return std::any_of( decl.cbegin(), decl.cend(), [&]( const D3D11_INPUT_ELEMENT_DESC& element )
+    {
+        return element.SemanticIndex == 0 && _stricmp( element.SemanticName, semanticName ) == 0;
+    } );
+}
+
+// The shader variant that reads only the optional elements 'decl' has
+static uint32_t GetShaderVariant( const std::vector<D3D11_INPUT_ELEMENT_DESC>& decl )
+{
+    uint32_t variant = 0;
+
+    if ( HasElement( decl, "NORMAL" ) )
+        variant |= c_VariantNormal;
+
+    if ( HasElement( decl, "TEXCOORD" ) )
+        variant |= c_VariantTexCoord;
+
+    return variant;
+}
+
+static void CompileShader( _In_z_ const char* entryPoint, _In_z_ const char* target, uint32_t variant, _Outptr_ ID3DBlob** code )
+{
+    const D3D_SHADER_MACRO defines[] =
+    {
+        { "HAS_NORMAL", ( variant & c_VariantNormal ) ? "1" : "0" },
+        { "HAS_TEXCOORD", ( variant & c_VariantTexCoord ) ? "1" : "0" },
+        { nullptr, nullptr },
+    };
+
+    ComPtr<ID3DBlob> errors;
+    HRESULT hr = D3DCompile( c_InstancedModelShaders, sizeof( c_InstancedModelShaders ) - 1, "InstancedModel", defines, nullptr,
+                             entryPoint, target, D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, code, &errors );
+    if ( FAILED(hr) )
+    {
+        if ( errors )
+            OutputDebugStringA( static_cast<const char*>( errors->GetBufferPointer() ) );
+
+        throw std::exception("InstancedModel shader compilation failed");
+    }
+}
+
+static void CreateConstantBuffer( _In_ ID3D11Device* device, size_t size, _In_opt_ const void* initialData, _Outptr_ ID3D11Buffer** pBuffer )
+{
+    D3D11_BUFFER_DESC bufferDesc = {};
+    bufferDesc.ByteWidth = static_cast<UINT>( size );
+    bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+    D3D11_SUBRESOURCE_DATA dataDesc = {};
+    dataDesc.pSysMem = initialData;
+
+    if ( initialData )
+    {
+        bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    }
+    else
+    {
+        bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+        bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    }
+
+    ThrowIfFailed(
+        device->CreateBuffer( &bufferDesc, initialData ? &dataDesc : nullptr, pBuffer )
+    );
+
+    SetDebugObjectName( *pBuffer, "InstancedModel" );
+}
+
+
+//--------------------------------------------------------------------------------------
+InstancedModel::InstancedModel( _In_ ID3D11Device* device, const Model& model, const ModelData& data, _In_ IEffectFactory& fxFactory,
+                                size_t maxInstancesPerDraw ) :
+    m_maxInstances( maxInstancesPerDraw ),
+    m_drawCount( 0 )
+{
+    if ( !device )
+        throw std::exception("Direct3D device is null");
+
+    if ( device->GetFeatureLevel() < D3D_FEATURE_LEVEL_9_3 )
+        throw std::exception("Instancing requires Feature Level 9.3 or later");
+
+    if ( !maxInstancesPerDraw || maxInstancesPerDraw > UINT32_MAX / sizeof(InstanceTransform) )
+        throw std::exception("Invalid instance count");
+
+    static_assert( ( c_VariantNormal | c_VariantTexCoord ) < SHADER_VARIANTS, "Too few shader variants" );
+
+    // Shaders are compiled below for the variants the parts need; the vertex shader
+    // code is kept to validate the input layouts against
+    ComPtr<ID3DBlob> vsCode[ SHADER_VARIANTS ];
+
+    CreateConstantBuffer( device, sizeof(FrameConstants), nullptr, &m_frameConstants );
+
+    // Per-instance vertex stream
+    {
+        D3D11_BUFFER_DESC bufferDesc = {};
+        bufferDesc.ByteWidth = static_cast<UINT>( sizeof(InstanceTransform) * maxInstancesPerDraw );
+        bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+        bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+        ThrowIfFailed(
+            device->CreateBuffer( &bufferDesc, nullptr, &m_instances )
+        );
+
+        SetDebugObjectName( m_instances.Get(), "InstancedModel" );
+    }
+
+    // Untextured materials sample white
+    {
+        static const uint32_t s_white = 0xFFFFFFFF;
+
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Width = desc.Height = desc.MipLevels = desc.ArraySize = 1;
+        desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        desc.SampleDesc.Count = 1;
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+        D3D11_SUBRESOURCE_DATA initData = { &s_white, sizeof(uint32_t), 0 };
+
+        ComPtr<ID3D11Texture2D> tex;
+        ThrowIfFailed(
+            device->CreateTexture2D( &desc, &initData, &tex )
+        );
+
+        ThrowIfFailed(
+            device->CreateShaderResourceView( tex.Get(), nullptr, &m_whiteTexture )
+        );
+    }
+
+    // Materials, created on first use as CreateModelFromData does
+    std::vector<ComPtr<ID3D11Buffer>> materialConstants( data.materials.size() );
+    std::vector<ComPtr<ID3D11ShaderResourceView>> textures( data.materials.size() );
+
+    // Input layouts are the model's vertex declaration plus the instance stream
+    struct Layout
+    {
+        ComPtr<ID3D11InputLayout>   inputLayout;
+        uint32_t                    shaders;
+    };
+
+    std::map<const std::vector<D3D11_INPUT_ELEMENT_DESC>*, Layout> layouts;
+
+    if ( model.meshes.size() != data.meshes.size() )
+        throw std::exception("Model was not created from this model data");
+
+    for( size_t meshIndex = 0; meshIndex < model.meshes.size(); ++meshIndex )
+    {
+        auto mesh = model.meshes[ meshIndex ].get();
+        auto& dataMesh = data.meshes[ meshIndex ];
+
+        if ( mesh->meshParts.size() != dataMesh.parts.size() )
+            throw std::exception("Model was not created from this model data");
+
+        for( size_t partIndex = 0; partIndex < mesh->meshParts.size(); ++partIndex )
+        {
+            auto part = mesh->meshParts[ partIndex ].get();
+            uint32_t material = dataMesh.parts[ partIndex ].material;
+
+            if ( material >= data.materials.size() || !part->vbDecl )
+                throw std::exception("Invalid mesh part for instancing");
+
+            auto& cb = materialConstants[ material ];
+            if ( !cb )
+            {
+                auto& mat = data.materials[ material ];
+
+                MaterialConstants constants;
+                constants.diffuseColor = XMFLOAT4( mat.diffuseColor.x * mat.alpha, mat.diffuseColor.y * mat.alpha, mat.diffuseColor.z * mat.alpha, mat.alpha );
+                constants.emissiveColor = XMFLOAT4( mat.emissiveColor.x * mat.alpha, mat.emissiveColor.y * mat.alpha, mat.emissiveColor.z * mat.alpha, 0.f );
+
+                CreateConstantBuffer( device, sizeof(MaterialConstants), &constants, &cb );
+
+                if ( !mat.texture.empty() )
+                    fxFactory.CreateTexture( mat.texture.c_str(), nullptr, &textures[ material ] );
+                else
+                    textures[ material ] = m_whiteTexture;
+            }
+
+            auto& layout = layouts[ part->vbDecl.get() ];
+            auto& il = layout.inputLayout;
+            if ( !il )
+            {
+                std::vector<D3D11_INPUT_ELEMENT_DESC> decl( *part->vbDecl );
+
+                layout.shaders = GetShaderVariant( decl );
+
+                auto& code = vsCode[ layout.shaders ];
+                if ( !code )
+                {
+                    CompileShader( "VSInstanced", "vs_4_0_level_9_3", layout.shaders, &code );
+
+                    ComPtr<ID3DBlob> psCode;
+                    CompileShader( "PSInstanced", "ps_4_0_level_9_3", layout.shaders, &psCode );
+
+                    auto& vs = m_vertexShaders[ layout.shaders ];
+                    ThrowIfFailed(
+                        device->CreateVertexShader( code->GetBufferPointer(), code->GetBufferSize(), nullptr, &vs )
+                    );
+
+                    auto& ps = m_pixelShaders[ layout.shaders ];
+                    ThrowIfFailed(
+                        device->CreatePixelShader( psCode->GetBufferPointer(), psCode->GetBufferSize(), nullptr, &ps )
+                    );
+
+                    SetDebugObjectName( vs.Get(), "InstancedModel" );
+                    SetDebugObjectName( ps.Get(), "InstancedModel" );
+                }
+
+                for( UINT j = 0; j < 3; ++j )
+                {
+                    D3D11_INPUT_ELEMENT_DESC element = { "InstMatrix", j, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 };
+                    decl.push_back( element );
+                }
+
+                for( UINT j = 0; j < 3; ++j )
+                {
+                    D3D11_INPUT_ELEMENT_DESC element = { "InstNormal", j, DXGI_FORMAT_R32G32B32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 };
+                    decl.push_back( element );
+                }
+
+                ThrowIfFailed(
+                    device->CreateInputLayout( decl.data(), static_cast<UINT>( decl.size() ),
+                                               code->GetBufferPointer(), code->GetBufferSize(), &il )
+                );
+
+                SetDebugObjectName( il.Get(), "InstancedModel" );
+            }
+
+            Part p;
+            p.part = part;
+            p.mesh = mesh;
+            p.inputLayout = il;
+            p.materialConstants = cb;
+            p.texture = textures[ material ];
+            p.shaders = layout.shaders;
+
+            m_parts.push_back( p );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void XM_CALLCONV InstancedModel::Draw( _In_ ID3D11DeviceContext* deviceContext, const CommonStates& states,
+                                       _In_reads_(count) const XMMATRIX* worlds, size_t count,
+                                       FXMMATRIX view, CXMMATRIX projection, bool wireframe )
+{
+    m_drawCount = 0;
+
+    if ( !count || m_parts.empty() )
+        return;
+
+    // State shared by every part
+    {
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        ThrowIfFailed(
+            deviceContext->Map( m_frameConstants.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped )
+        );
+
+        auto constants = static_cast<FrameConstants*>( mapped.pData );
+        XMStoreFloat4x4( &constants->viewProjection, XMMatrixTranspose( XMMatrixMultiply( view, projection ) ) );
+        constants->ambientLightColor = c_DefaultAmbient;
+        for( size_t j = 0; j < 3; ++j )
+        {
+            constants->lightDirection[ j ] = c_DefaultLightDirection[ j ];
+            constants->lightDiffuseColor[ j ] = c_DefaultLightDiffuse[ j ];
+        }
+
+        deviceContext->Unmap( m_frameConstants.Get(), 0 );
+    }
+
+    ID3D11Buffer* frameConstants = m_frameConstants.Get();
+    deviceContext->VSSetConstantBuffers( 0, 1, &frameConstants );
+    deviceContext->PSSetConstantBuffers( 0, 1, &frameConstants );
+
+    ID3D11SamplerState* sampler = states.LinearWrap();
+    deviceContext->PSSetSamplers( 0, 1, &sampler );
+
+    UINT instanceStride = sizeof(InstanceTransform);
+    UINT instanceOffset = 0;
+    ID3D11Buffer* instances = m_instances.Get();
+    deviceContext->IASetVertexBuffers( 1, 1, &instances, &instanceStride, &instanceOffset );
+
+    for( size_t first = 0; first < count; first += m_maxInstances )
+    {
+        size_t batch = std::min( m_maxInstances, count - first );
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        ThrowIfFailed(
+            deviceContext->Map( m_instances.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped )
+        );
+
+        auto transforms = static_cast<InstanceTransform*>( mapped.pData );
+        for( size_t j = 0; j < batch; ++j )
+        {
+            XMMATRIX m = XMMatrixTranspose( worlds[ first + j ] );
+            XMStoreFloat4( &transforms[ j ].rows[ 0 ], m.r[ 0 ] );
+            XMStoreFloat4( &transforms[ j ].rows[ 1 ], m.r[ 1 ] );
+            XMStoreFloat4( &transforms[ j ].rows[ 2 ], m.r[ 2 ] );
+
+            // Normals use the inverse-transpose, as the stock effects do; the shader takes its
+            // transpose, which is simply the inverse
+            XMMATRIX n = XMMatrixInverse( nullptr, worlds[ first + j ] );
+            XMStoreFloat3( &transforms[ j ].normalRows[ 0 ], n.r[ 0 ] );
+            XMStoreFloat3( &transforms[ j ].normalRows[ 1 ], n.r[ 1 ] );
+            XMStoreFloat3( &transforms[ j ].normalRows[ 2 ], n.r[ 2 ] );
+        }
+
+        deviceContext->Unmap( m_instances.Get(), 0 );
+
+        DrawParts( deviceContext, states, batch, false, wireframe );
+        DrawParts( deviceContext, states, batch, true, wireframe );
+    }
+}
+
+
+void XM_CALLCONV InstancedModel::DrawParts( _In_ ID3D11DeviceContext* deviceContext, const CommonStates& states,
+                                            size_t instanceCount, bool alpha, bool wireframe )
+{
+    uint32_t shaders = UINT32_MAX;
+
+    for( auto it = m_parts.cbegin(); it != m_parts.cend(); ++it )
+    {
+        auto part = it->part;
+        if ( part->isAlpha != alpha )
+            continue;
+
+        if ( it->shaders != shaders )
+        {
+            shaders = it->shaders;
+            deviceContext->VSSetShader( m_vertexShaders[ shaders ].Get(), nullptr, 0 );
+            deviceContext->PSSetShader( m_pixelShaders[ shaders ].Get(), nullptr, 0 );
+        }
+
+        // States as ModelMesh::PrepareForRendering chooses them
+        if ( alpha )
+        {
+            deviceContext->OMSetBlendState( it->mesh->pmalpha ? states.AlphaBlend() : states.NonPremultiplied(), nullptr, 0xFFFFFFFF );
+            deviceContext->OMSetDepthStencilState( states.DepthRead(), 0 );
+        }
+        else
+        {
+            deviceContext->OMSetBlendState( states.Opaque(), nullptr, 0xFFFFFFFF );
+            deviceContext->OMSetDepthStencilState( states.DepthDefault(), 0 );
+        }
+
+        if ( wireframe )
+            deviceContext->RSSetState( states.Wireframe() );
+        else
+            deviceContext->RSSetState( it->mesh->ccw ? states.CullCounterClockwise() : states.CullClockwise() );
+
+        ID3D11Buffer* materialConstants = it->materialConstants.Get();
+        deviceContext->PSSetConstantBuffers( 1, 1, &materialConstants );
+
+        ID3D11ShaderResourceView* texture = it->texture.Get();
+        deviceContext->PSSetShaderResources( 0, 1, &texture );
+
+        deviceContext->IASetInputLayout( it->inputLayout.Get() );
+
+        ID3D11Buffer* vertexBuffer = part->vertexBuffer.Get();
+        UINT vertexStride = part->vertexStride;
+        UINT vertexOffset = 0;
+        deviceContext->IASetVertexBuffers( 0, 1, &vertexBuffer, &vertexStride, &vertexOffset );
+
+        deviceContext->IASetIndexBuffer( part->indexBuffer.Get(), part->indexFormat, 0 );
+        deviceContext->IASetPrimitiveTopology( part->primitiveType );
+
+        deviceContext->DrawIndexedInstanced( part->indexCount, static_cast<UINT>( instanceCount ), part->startIndex, part->vertexOffset, 0 );
+        ++m_drawCount;
+    }
+}
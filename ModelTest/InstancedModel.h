@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------------
+// File: InstancedModel.h
+//
+// Hardware-instanced drawing of many copies of a model, one draw per part
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CommonStates.h"
+#include "Effects.h"
+#include "Model.h"
+
+#include "ModelData.h"
+
+#include <vector>
+
+#include <wrl/client.h>
+
+// Draws a model with its own instancing shaders in place of the model's effects: the
+// parts' vertex and index buffers are shared with the model, and each copy's world
+// matrix, with its inverse-transpose for the normals, comes from a per-instance vertex
+// stream. Lighting is the default three-light rig with diffuse and emissive material
+// colors, without specular; parts without normals are drawn unlit and parts without
+// texture coordinates untextured, each with shaders compiled for their vertex
+// declaration. Skinned parts are drawn in their bind pose. Requires Feature Level 9.3
+// or later.
+class InstancedModel
+{
+public:
+    // 'model' must have been created from 'data' by CreateModelFromData, as the parts
+    // are matched to their materials by position; textures come from 'fxFactory'
+    InstancedModel( _In_ ID3D11Device* device, const DirectX::Model& model, const ModelData& data, _In_ DirectX::IEffectFactory& fxFactory,
+                    size_t maxInstancesPerDraw = 256 );
+
+    InstancedModel( const InstancedModel& ) = delete;
+    InstancedModel& operator=( const InstancedModel& ) = delete;
+
+    // Draws 'count' copies, one DrawIndexedInstanced per part for each batch of up to
+    // maxInstancesPerDraw copies
+    void XM_CALLCONV Draw( _In_ ID3D11DeviceContext* deviceContext, const DirectX::CommonStates& states,
+                           _In_reads_(count) const DirectX::XMMATRIX* worlds, size_t count,
+                           DirectX::FXMMATRIX view, DirectX::CXMMATRIX projection, bool wireframe = false );
+
+    // Draw calls made by the most recent Draw
+    size_t GetDrawCount() const { return m_drawCount; }
+
+private:
+    struct Part
+    {
+        const DirectX::ModelMeshPart*                       part;
+        const DirectX::ModelMesh*                           mesh;
+        Microsoft::WRL::ComPtr<ID3D11InputLayout>           inputLayout;
+        Microsoft::WRL::ComPtr<ID3D11Buffer>                materialConstants;
+        Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>    texture;
+        uint32_t                                            shaders;    // Index into m_vertexShaders and m_pixelShaders
+    };
+
+    // One shader pair for each combination of optional vertex elements
+    static const size_t SHADER_VARIANTS = 4;
+
+    void XM_CALLCONV DrawParts( _In_ ID3D11DeviceContext* deviceContext, const DirectX::CommonStates& states,
+                                size_t instanceCount, bool alpha, bool wireframe );
+
+    std::vector<Part>                                   m_parts;
+    size_t                                              m_maxInstances;
+    size_t                                              m_drawCount;
+    Microsoft::WRL::ComPtr<ID3D11VertexShader>          m_vertexShaders[ SHADER_VARIANTS ];
+    Microsoft::WRL::ComPtr<ID3D11PixelShader>           m_pixelShaders[ SHADER_VARIANTS ];
+    Microsoft::WRL::ComPtr<ID3D11Buffer>                m_frameConstants;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>                m_instances;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>    m_whiteTexture;
+};
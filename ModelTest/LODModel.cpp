@@ -0,0 +1,459 @@
+//--------------------------------------------------------------------------------------
+// File: LODModel.cpp
+//
+// Chains of models at decreasing detail, drawn by their projected size on screen
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "LODModel.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+using namespace DirectX;
+
+namespace
+{
+    // Helper for counting the triangles Model::Draw would draw
+    size_t CountTriangles( const Model& model )
+    {
+        size_t triangles = 0;
+
+        for( auto mit = model.meshes.cbegin(); mit != model.meshes.cend(); ++mit )
+        {
+            for( auto pit = ( *mit )->meshParts.cbegin(); pit != ( *mit )->meshParts.cend(); ++pit )
+            {
+                auto part = pit->get();
+
+                if ( part->primitiveType == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST )
+                    triangles += part->indexCount / 3;
+                else if ( part->primitiveType == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP && part->indexCount > 2 )
+                    triangles += part->indexCount - 2;
+            }
+        }
+
+        return triangles;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void LODModel::AddLevel( std::unique_ptr<Model> model, float minScreenSize )
+{
+    if ( !model || model->meshes.empty() )
+        throw std::exception("LOD level has no meshes");
+
+    if ( !m_levels.empty() && minScreenSize >= m_levels.back().minScreenSize )
+        throw std::exception("LOD levels must have decreasing screen sizes");
+
+    if ( m_levels.empty() )
+    {
+        // Every level is measured with level 0's bounds, so selection does not jump
+        // when a coarser level's bounds differ
+        BoundingSphere sphere = model->meshes[ 0 ]->boundingSphere;
+        for( size_t j = 1; j < model->meshes.size(); ++j )
+        {
+            BoundingSphere::CreateMerged( sphere, sphere, model->meshes[ j ]->boundingSphere );
+        }
+
+        m_center = sphere.Center;
+        m_radius = sphere.Radius;
+    }
+
+    Level level;
+    level.triangles = CountTriangles( *model );
+    level.model = std::move( model );
+    level.minScreenSize = minScreenSize;
+
+    m_levels.emplace_back( std::move( level ) );
+
+    m_stats.levelDraws.resize( m_levels.size(), 0 );
+}
+
+
+//--------------------------------------------------------------------------------------
+float XM_CALLCONV LODModel::GetScreenSize( FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection ) const
+{
+    XMVECTOR center = XMVector3Transform( XMLoadFloat3( &m_center ), XMMatrixMultiply( world, view ) );
+
+    float scale = sqrtf( std::max( std::max( XMVectorGetX( XMVector3LengthSq( world.r[ 0 ] ) ),
+                                             XMVectorGetX( XMVector3LengthSq( world.r[ 1 ] ) ) ),
+                                   XMVectorGetX( XMVector3LengthSq( world.r[ 2 ] ) ) ) );
+    float radius = m_radius * scale;
+
+    XMFLOAT4X4 proj;
+    XMStoreFloat4x4( &proj, projection );
+
+    // _22 scales view-space y to clip space, where the viewport is 2 units high. An
+    // orthographic projection has no divide by depth.
+    if ( proj._34 == 0.f )
+        return radius * proj._22;
+
+    // View-space z is the distance for LH and its negation for RH
+    float distance = fabsf( XMVectorGetZ( center ) );
+    if ( distance <= radius )
+        return FLT_MAX;
+
+    return radius * proj._22 / distance;
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t XM_CALLCONV LODModel::SelectLevel( FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection ) const
+{
+    if ( m_levels.empty() )
+        return 0;
+
+    float size = GetScreenSize( world, view, projection );
+
+    for( size_t j = 0; j < m_levels.size(); ++j )
+    {
+        if ( size >= m_levels[ j ].minScreenSize )
+            return j;
+    }
+
+    return m_levels.size() - 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t XM_CALLCONV LODModel::Draw( _In_ ID3D11DeviceContext* deviceContext, const CommonStates& states,
+                                   FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection, bool wireframe )
+{
+    if ( m_levels.empty() )
+        return 0;
+
+    size_t j = SelectLevel( world, view, projection );
+
+    auto& level = m_levels[ j ];
+    level.model->Draw( deviceContext, states, world, view, projection, wireframe );
+
+    ++m_stats.draws;
+    ++m_stats.levelDraws[ j ];
+    m_stats.trianglesDrawn += level.triangles;
+    if ( m_levels[ 0 ].triangles > level.triangles )
+        m_stats.trianglesSaved += m_levels[ 0 ].triangles - level.triangles;
+
+    return j;
+}
+
+
+//--------------------------------------------------------------------------------------
+void LODModel::ResetStats()
+{
+    m_stats.draws = 0;
+    m_stats.trianglesDrawn = 0;
+    m_stats.trianglesSaved = 0;
+    std::fill( m_stats.levelDraws.begin(), m_stats.levelDraws.end(), 0 );
+}
+
+
+//--------------------------------------------------------------------------------------
+std::unique_ptr<LODModel> CreateLODModelFromFiles( _In_ ID3D11Device* d3dDevice, const ModelLoadRequest& request, SharedEffectFactory& fxFactory,
+                                                   _In_reads_(count) const float* minScreenSizes, size_t count )
+{
+    if ( !request.fileName || !minScreenSizes || !count )
+        throw std::exception("Invalid arguments");
+
+    std::wstring baseName( request.fileName );
+    std::wstring ext;
+
+    auto dot = baseName.find_last_of( L'.' );
+    auto slash = baseName.find_last_of( L"\\/" );
+    if ( dot != std::wstring::npos && ( slash == std::wstring::npos || dot > slash ) )
+    {
+        ext = baseName.substr( dot );
+        baseName.erase( dot );
+    }
+
+    // The names must outlive the requests
+    std::vector<std::wstring> names;
+    names.push_back( request.fileName );
+
+    for( size_t j = 1; j < count; ++j )
+    {
+        std::wstring name = baseName + L"_lod" + std::to_wstring( j ) + ext;
+
+        WIN32_FILE_ATTRIBUTE_DATA fileAttr = {};
+        if ( !GetFileAttributesExW( name.c_str(), GetFileExInfoStandard, &fileAttr ) )
+            break;
+
+        names.emplace_back( std::move( name ) );
+    }
+
+    std::vector<ModelLoadRequest> requests( names.size(), request );
+    for( size_t j = 0; j < names.size(); ++j )
+    {
+        requests[ j ].fileName = names[ j ].c_str();
+    }
+
+    auto models = LoadModels( d3dDevice, requests.data(), requests.size(), fxFactory );
+
+    std::unique_ptr<LODModel> lod( new LODModel );
+    for( size_t j = 0; j < models.size(); ++j )
+    {
+        lod->AddLevel( std::move( models[ j ] ), ( j + 1 < models.size() ) ? minScreenSizes[ j ] : 0.f );
+    }
+
+    return lod;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT SimplifyModelData( const ModelData& source, size_t gridCells, ModelData& result )
+{
+    result.Clear();
+
+    if ( !gridCells || gridCells > ( 1 << 20 ) )
+        return E_INVALIDARG;
+
+    const size_t vbCount = source.vertexBuffers.size();
+
+    // For each vertex buffer, the vertex each vertex is merged into, then the new index of
+    // each vertex kept
+    std::vector<std::vector<uint32_t>> representative( vbCount );
+    std::vector<std::vector<uint32_t>> remap( vbCount );
+    std::vector<std::vector<uint32_t>> kept( vbCount );
+    std::vector<std::vector<uint32_t>> indices( vbCount );
+
+    for( size_t j = 0; j < vbCount; ++j )
+    {
+        auto& vb = source.vertexBuffers[ j ];
+        if ( !vb.vbDecl || !vb.stride || vb.offset > source.blob.size() || vb.sizeBytes > source.blob.size() - vb.offset )
+            return E_FAIL;
+
+        const size_t vertexCount = vb.sizeBytes / vb.stride;
+        const uint8_t* vertices = source.Data( vb.offset );
+
+        auto& rep = representative[ j ];
+        rep.resize( vertexCount );
+
+        if ( vb.vbDecl->empty() || vb.vbDecl->front().Format != DXGI_FORMAT_R32G32B32_FLOAT || vb.vbDecl->front().AlignedByteOffset != 0
+             || vb.stride < sizeof(XMFLOAT3) )
+        {
+            // No position to cluster on, so every vertex stays
+            for( size_t v = 0; v < vertexCount; ++v )
+            {
+                rep[ v ] = static_cast<uint32_t>( v );
+            }
+        }
+        else
+        {
+            XMVECTOR vmin = g_XMFltMax;
+            XMVECTOR vmax = XMVectorNegate( g_XMFltMax );
+            for( size_t v = 0; v < vertexCount; ++v )
+            {
+                XMVECTOR p = XMLoadFloat3( reinterpret_cast<const XMFLOAT3*>( vertices + v * vb.stride ) );
+                vmin = XMVectorMin( vmin, p );
+                vmax = XMVectorMax( vmax, p );
+            }
+
+            XMFLOAT3 lo, extent;
+            XMStoreFloat3( &lo, vmin );
+            XMStoreFloat3( &extent, XMVectorSubtract( vmax, vmin ) );
+
+            float cell = std::max( std::max( extent.x, extent.y ), extent.z ) / float( gridCells );
+            float invCell = ( cell > 0.f ) ? 1.f / cell : 0.f;
+
+            std::unordered_map<uint64_t, uint32_t> cells;
+            cells.reserve( vertexCount );
+
+            for( size_t v = 0; v < vertexCount; ++v )
+            {
+                auto p = reinterpret_cast<const XMFLOAT3*>( vertices + v * vb.stride );
+
+                uint64_t x = std::min<uint64_t>( static_cast<uint64_t>( ( p->x - lo.x ) * invCell ), gridCells );
+                uint64_t y = std::min<uint64_t>( static_cast<uint64_t>( ( p->y - lo.y ) * invCell ), gridCells );
+                uint64_t z = std::min<uint64_t>( static_cast<uint64_t>( ( p->z - lo.z ) * invCell ), gridCells );
+
+                auto it = cells.emplace( ( x << 42 ) | ( y << 21 ) | z, static_cast<uint32_t>( v ) ).first;
+                rep[ v ] = it->second;
+            }
+        }
+
+        remap[ j ].assign( vertexCount, uint32_t( -1 ) );
+    }
+
+    // Parts are rewritten against one new index buffer per vertex buffer
+    result.name = source.name;
+    result.materials = source.materials;
+    result.meshes = source.meshes;
+    result.bones = source.bones;
+
+    for( auto mit = result.meshes.begin(); mit != result.meshes.end(); ++mit )
+    {
+        for( auto pit = mit->parts.begin(); pit != mit->parts.end(); ++pit )
+        {
+            if ( pit->vertexBuffer >= vbCount || pit->indexBuffer >= source.indexBuffers.size() )
+                return E_FAIL;
+
+            auto& ib = source.indexBuffers[ pit->indexBuffer ];
+            if ( ib.offset > source.blob.size() || ib.sizeBytes > source.blob.size() - ib.offset )
+                return E_FAIL;
+
+            const bool is32 = ( ib.indexFormat == DXGI_FORMAT_R32_UINT );
+            const size_t indexSize = is32 ? sizeof(uint32_t) : sizeof(uint16_t);
+            if ( pit->startIndex > ib.sizeBytes / indexSize || pit->indexCount > ib.sizeBytes / indexSize - pit->startIndex )
+                return E_FAIL;
+
+            const uint8_t* src = source.Data( ib.offset ) + pit->startIndex * indexSize;
+
+            const uint32_t vbIndex = pit->vertexBuffer;
+            auto& rep = representative[ vbIndex ];
+            auto& map = remap[ vbIndex ];
+            auto& keep = kept[ vbIndex ];
+            auto& dest = indices[ vbIndex ];
+
+            auto mapIndex = [&]( size_t k, uint32_t& out ) -> bool
+            {
+                size_t v = ( is32 ? reinterpret_cast<const uint32_t*>( src )[ k ] : reinterpret_cast<const uint16_t*>( src )[ k ] );
+                v += pit->vertexOffset;
+                if ( v >= rep.size() )
+                    return false;
+
+                uint32_t r = rep[ v ];
+                if ( map[ r ] == uint32_t( -1 ) )
+                {
+                    map[ r ] = static_cast<uint32_t>( keep.size() );
+                    keep.push_back( r );
+                }
+                out = map[ r ];
+                return true;
+            };
+
+            const size_t start = dest.size();
+
+            if ( pit->primitiveType == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST )
+            {
+                for( size_t k = 0; k + 2 < pit->indexCount; k += 3 )
+                {
+                    uint32_t tri[ 3 ];
+                    if ( !mapIndex( k, tri[ 0 ] ) || !mapIndex( k + 1, tri[ 1 ] ) || !mapIndex( k + 2, tri[ 2 ] ) )
+                        return E_FAIL;
+
+                    if ( tri[ 0 ] == tri[ 1 ] || tri[ 1 ] == tri[ 2 ] || tri[ 0 ] == tri[ 2 ] )
+                        continue;
+
+                    dest.insert( dest.end(), tri, tri + 3 );
+                }
+            }
+            else
+            {
+                // Other topologies keep every index, only merged
+                for( size_t k = 0; k < pit->indexCount; ++k )
+                {
+                    uint32_t index;
+                    if ( !mapIndex( k, index ) )
+                        return E_FAIL;
+
+                    dest.push_back( index );
+                }
+            }
+
+            pit->indexBuffer = vbIndex;
+            pit->startIndex = static_cast<uint32_t>( start );
+            pit->indexCount = static_cast<uint32_t>( dest.size() - start );
+            pit->vertexOffset = 0;
+        }
+    }
+
+    // Layout: every vertex buffer, then every index buffer. Empty buffers keep one vertex
+    // or one degenerate triangle, as Direct3D buffers cannot be empty. The placeholder
+    // vertex is a copy of vertex 0, or zeros if the source buffer has no vertices.
+    size_t blobSize = 0;
+    for( size_t j = 0; j < vbCount; ++j )
+    {
+        if ( kept[ j ].empty() )
+            kept[ j ].push_back( 0 );
+        if ( indices[ j ].empty() )
+            indices[ j ].assign( 3, 0 );
+
+        blobSize += kept[ j ].size() * source.vertexBuffers[ j ].stride;
+    }
+
+    // Index buffers start 4-byte aligned
+    blobSize = ( blobSize + 3 ) & ~size_t( 3 );
+
+    std::vector<DXGI_FORMAT> formats( vbCount );
+    for( size_t j = 0; j < vbCount; ++j )
+    {
+        formats[ j ] = ( kept[ j ].size() > 65536 ) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+        blobSize += ( indices[ j ].size() * ( ( formats[ j ] == DXGI_FORMAT_R32_UINT ) ? sizeof(uint32_t) : sizeof(uint16_t) ) + 3 ) & ~size_t( 3 );
+    }
+
+    result.blob.resize( blobSize );
+    result.vertexBuffers.resize( vbCount );
+    result.indexBuffers.resize( vbCount );
+
+    size_t offset = 0;
+    for( size_t j = 0; j < vbCount; ++j )
+    {
+        auto& srcVB = source.vertexBuffers[ j ];
+        auto& vb = result.vertexBuffers[ j ];
+
+        vb.offset = offset;
+        vb.stride = srcVB.stride;
+        vb.vertexCount = static_cast<uint32_t>( kept[ j ].size() );
+        vb.sizeBytes = kept[ j ].size() * srcVB.stride;
+        vb.vbDecl = srcVB.vbDecl;
+
+        // The blob is zero-initialized, which covers a placeholder with nothing to copy
+        if ( !srcVB.vertexCount )
+        {
+            offset += vb.sizeBytes;
+            continue;
+        }
+
+        const uint8_t* srcVertices = source.Data( srcVB.offset );
+        for( size_t v = 0; v < kept[ j ].size(); ++v )
+        {
+            memcpy( result.blob.data() + offset + v * srcVB.stride, srcVertices + kept[ j ][ v ] * srcVB.stride, srcVB.stride );
+        }
+
+        offset += vb.sizeBytes;
+    }
+
+    offset = ( offset + 3 ) & ~size_t( 3 );
+
+    for( size_t j = 0; j < vbCount; ++j )
+    {
+        auto& ib = result.indexBuffers[ j ];
+
+        ib.offset = offset;
+        ib.indexFormat = formats[ j ];
+        ib.indexCount = static_cast<uint32_t>( indices[ j ].size() );
+
+        uint8_t* dest = result.blob.data() + offset;
+        if ( formats[ j ] == DXGI_FORMAT_R32_UINT )
+        {
+            ib.sizeBytes = indices[ j ].size() * sizeof(uint32_t);
+            memcpy( dest, indices[ j ].data(), ib.sizeBytes );
+        }
+        else
+        {
+            ib.sizeBytes = indices[ j ].size() * sizeof(uint16_t);
+            for( size_t k = 0; k < indices[ j ].size(); ++k )
+            {
+                reinterpret_cast<uint16_t*>( dest )[ k ] = static_cast<uint16_t>( indices[ j ][ k ] );
+            }
+        }
+
+        offset += ( ib.sizeBytes + 3 ) & ~size_t( 3 );
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------------------------
+// File: LODModel.h
+//
+// Chains of models at decreasing detail, drawn by their projected size on screen
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CommonStates.h"
+#include "Model.h"
+
+#include "ModelBatchLoader.h"
+#include "ModelData.h"
+
+#include <memory>
+#include <vector>
+
+// Counters since the last ResetStats
+struct LODStats
+{
+    size_t                  draws;
+    size_t                  trianglesDrawn;
+    size_t                  trianglesSaved;     // Triangles level 0 would have drawn, less trianglesDrawn
+    std::vector<size_t>     levelDraws;         // Draws at each level
+};
+
+// Level 0 is the most detailed. Each level has a minimum screen size: the fraction of
+// the viewport height covered by the bounding sphere's diameter, measured with level 0's
+// bounds. A draw uses the first level whose minimum it reaches, so the minimums must
+// decrease from level to level, and the last level's minimum should be 0.
+class LODModel
+{
+public:
+    LODModel() : m_radius( 0.f ), m_stats() { m_center = DirectX::XMFLOAT3( 0.f, 0.f, 0.f ); }
+
+    LODModel( const LODModel& ) = delete;
+    LODModel& operator=( const LODModel& ) = delete;
+
+    void AddLevel( std::unique_ptr<DirectX::Model> model, float minScreenSize );
+
+    size_t GetLevelCount() const { return m_levels.size(); }
+    DirectX::Model* GetLevel( size_t level ) const { return m_levels[ level ].model.get(); }
+
+    // Fraction of the viewport height covered by the bounds of level 0
+    float XM_CALLCONV GetScreenSize( DirectX::FXMMATRIX world, DirectX::CXMMATRIX view, DirectX::CXMMATRIX projection ) const;
+
+    size_t XM_CALLCONV SelectLevel( DirectX::FXMMATRIX world, DirectX::CXMMATRIX view, DirectX::CXMMATRIX projection ) const;
+
+    // Draws the selected level with Model::Draw and returns its index
+    size_t XM_CALLCONV Draw( _In_ ID3D11DeviceContext* deviceContext, const DirectX::CommonStates& states,
+                             DirectX::FXMMATRIX world, DirectX::CXMMATRIX view, DirectX::CXMMATRIX projection, bool wireframe = false );
+
+    const LODStats& GetStats() const { return m_stats; }
+    void ResetStats();
+
+private:
+    struct Level
+    {
+        std::unique_ptr<DirectX::Model>     model;
+        float                               minScreenSize;
+        size_t                              triangles;
+    };
+
+    std::vector<Level>      m_levels;
+    DirectX::XMFLOAT3       m_center;
+    float                   m_radius;
+    LODStats                m_stats;
+};
+
+// Loads 'request' as level 0, then <name>_lod1<ext>, <name>_lod2<ext>, ... in the same
+// format for as long as the files exist, up to 'count' levels. Level n gets
+// minScreenSizes[ n ], except that the last level found gets 0. Throws on failure.
+std::unique_ptr<LODModel> CreateLODModelFromFiles( _In_ ID3D11Device* d3dDevice, const ModelLoadRequest& request, SharedEffectFactory& fxFactory,
+                                                   _In_reads_(count) const float* minScreenSizes, size_t count );
+
+// Builds a coarser copy of 'source' by vertex clustering: positions are snapped to a grid
+// with 'gridCells' cells along the longest side of each vertex buffer's bounds, each cell
+// keeps its first vertex, and triangles that collapse are dropped. Unused vertices are
+// removed. Materials, bounds and bones are copied unchanged.
+HRESULT SimplifyModelData( const ModelData& source, size_t gridCells, ModelData& result );
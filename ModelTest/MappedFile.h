@@ -0,0 +1,108 @@
+//--------------------------------------------------------------------------------------
+// File: MappedFile.h
+//
+// Read-only memory mapping of a file, either whole or through a movable view
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+
+#include <memory>
+
+#include "PlatformHelpers.h"
+
+class MappedFile
+{
+public:
+    MappedFile() : m_size(0), m_fileSize(0) {}
+
+    // Maps the whole file
+    HRESULT Open( _In_z_ const wchar_t* szFileName )
+    {
+        HRESULT hr = OpenMapping( szFileName );
+        if ( FAILED(hr) )
+            return hr;
+
+        if ( m_fileSize > SIZE_MAX )
+            return HRESULT_FROM_WIN32( ERROR_FILE_TOO_LARGE );
+
+        return MapView( 0, static_cast<size_t>( m_fileSize ) );
+    }
+
+    // Opens the file without mapping a view
+    HRESULT OpenMapping( _In_z_ const wchar_t* szFileName )
+    {
+        m_hFile.reset( DirectX::safe_handle( CreateFileW( szFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr ) ) );
+        if ( !m_hFile )
+            return HRESULT_FROM_WIN32( GetLastError() );
+
+        LARGE_INTEGER fileSize = {};
+        if ( !GetFileSizeEx( m_hFile.get(), &fileSize ) )
+            return HRESULT_FROM_WIN32( GetLastError() );
+
+        m_fileSize = static_cast<uint64_t>( fileSize.QuadPart );
+
+        // Zero-length files cannot be mapped
+        if ( !m_fileSize )
+            return S_OK;
+
+        m_hMapping.reset( CreateFileMappingW( m_hFile.get(), nullptr, PAGE_READONLY, 0, 0, nullptr ) );
+        if ( !m_hMapping )
+            return HRESULT_FROM_WIN32( GetLastError() );
+
+        return S_OK;
+    }
+
+    // Replaces the current view; 'offset' must be a multiple of the allocation granularity
+    HRESULT MapView( uint64_t offset, size_t size )
+    {
+        m_view.reset();
+        m_size = 0;
+
+        if ( !size )
+            return S_OK;
+
+        if ( offset > m_fileSize || size > m_fileSize - offset )
+            return E_INVALIDARG;
+
+        m_view.reset( MapViewOfFile( m_hMapping.get(), FILE_MAP_READ, static_cast<DWORD>( offset >> 32 ), static_cast<DWORD>( offset ), size ) );
+        if ( !m_view )
+            return HRESULT_FROM_WIN32( GetLastError() );
+
+        m_size = size;
+        return S_OK;
+    }
+
+    // Unmaps the view and releases the file so it can be opened for writing
+    void Close()
+    {
+        m_view.reset();
+        m_hMapping.reset();
+        m_hFile.reset();
+        m_size = 0;
+        m_fileSize = 0;
+    }
+
+    const char* data() const { return static_cast<const char*>( m_view.get() ); }
+    size_t size() const { return m_size; }
+    uint64_t fileSize() const { return m_fileSize; }
+
+private:
+    struct view_closer { void operator()(const void* p) { if (p) UnmapViewOfFile(p); } };
+
+    DirectX::ScopedHandle                       m_hFile;
+    DirectX::ScopedHandle                       m_hMapping;
+    std::unique_ptr<const void, view_closer>    m_view;
+    size_t                                      m_size;
+    uint64_t                                    m_fileSize;
+};
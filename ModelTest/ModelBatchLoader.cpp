@@ -0,0 +1,505 @@
+//--------------------------------------------------------------------------------------
+// File: ModelBatchLoader.cpp
+//
+// Loads a list of models on a pool of worker threads
+//
+// File reads, parsing, and vertex/index buffer creation for each model run in
+// parallel, as ID3D11Device is free-threaded. Effects come from a SharedEffectFactory,
+// which reads different textures in parallel but a texture used by several models only
+// once.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "Effects.h"
+#include "Model.h"
+
+#include "BenchmarkTrace.h"
+#include "GeometryPool.h"
+#include "ModelBatchLoader.h"
+#include "ModelData.h"
+#include "ModelLoadOBJ.h"
+#include "ModelLoadSDKMESH.h"
+#include "SharedEffectFactory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <stdio.h>
+
+#include <wrl/client.h>
+
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+static std::unique_ptr<Model> LoadModel( _In_ ID3D11Device* d3dDevice, const ModelLoadRequest& request, _In_ IEffectFactory& fxFactory )
+{
+    switch( request.format )
+    {
+    case MODEL_FORMAT_CMO:
+        return Model::CreateFromCMO( d3dDevice, request.fileName, fxFactory, request.ccw, request.pmalpha );
+
+    case MODEL_FORMAT_SDKMESH:
+        return Model::CreateFromSDKMESH( d3dDevice, request.fileName, fxFactory, request.ccw, request.pmalpha );
+
+    case MODEL_FORMAT_VBO:
+        return Model::CreateFromVBO( d3dDevice, request.fileName, nullptr, request.ccw, request.pmalpha );
+
+    case MODEL_FORMAT_OBJ:
+        return CreateModelFromOBJ( d3dDevice, nullptr, request.fileName, fxFactory, request.ccw, request.pmalpha );
+
+    case MODEL_FORMAT_SDKMESH_MAPPED:
+        return CreateModelFromSDKMESHMapped( d3dDevice, request.fileName, fxFactory, request.ccw, request.pmalpha );
+
+    default:
+        throw std::exception("Unknown model format");
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Calls work( j ) for every j < count on up to 'threads' threads, including this one.
+// If any call throws, the first exception is rethrown once all threads are done.
+template<typename Work>
+static void RunWorkers( size_t count, size_t threads, Work work )
+{
+    std::atomic<size_t> next( 0 );
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    auto worker = [&]()
+    {
+        for( ;; )
+        {
+            size_t j = next++;
+            if ( j >= count )
+                break;
+
+            try
+            {
+                work( j );
+            }
+            catch( ... )
+            {
+                std::lock_guard<std::mutex> lock( errorMutex );
+                if ( !error )
+                    error = std::current_exception();
+            }
+        }
+    };
+
+    if ( !threads )
+        threads = std::max<size_t>( std::thread::hardware_concurrency(), 1 );
+
+    threads = std::min( threads, count );
+
+    std::vector<std::thread> workers;
+    if ( threads > 1 )
+    {
+        workers.reserve( threads - 1 );
+        for( size_t j = 1; j < threads; ++j )
+        {
+            workers.emplace_back( worker );
+        }
+    }
+
+    worker();
+
+    for( auto it = workers.begin(); it != workers.end(); ++it )
+    {
+        it->join();
+    }
+
+    if ( error )
+        std::rethrow_exception( error );
+}
+
+
+//--------------------------------------------------------------------------------------
+std::vector<std::unique_ptr<Model>> LoadModels( _In_ ID3D11Device* d3dDevice, _In_reads_(count) const ModelLoadRequest* requests, size_t count,
+                                                SharedEffectFactory& fxFactory, size_t threads, _Out_opt_ ModelLoadStats* stats )
+{
+    std::vector<std::unique_ptr<Model>> models( count );
+
+    size_t textureRequests = fxFactory.GetTextureRequests();
+    size_t textureCount = fxFactory.GetTextureCount();
+
+    RunWorkers( count, threads, [&]( size_t j )
+    {
+        models[ j ] = LoadModel( d3dDevice, requests[ j ], fxFactory );
+    });
+
+    if ( stats )
+    {
+        stats->textureRequests = fxFactory.GetTextureRequests() - textureRequests;
+        stats->uniqueTextures = fxFactory.GetTextureCount() - textureCount;
+    }
+
+    return models;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT LoadModelData( const ModelLoadRequest& request, ModelData& data )
+{
+    switch( request.format )
+    {
+    case MODEL_FORMAT_CMO:
+        return LoadModelDataFromCMO( request.fileName, data );
+
+    case MODEL_FORMAT_SDKMESH:
+    case MODEL_FORMAT_SDKMESH_MAPPED:
+        return LoadModelDataFromSDKMESH( request.fileName, data );
+
+    case MODEL_FORMAT_VBO:
+        return LoadModelDataFromVBO( request.fileName, data );
+
+    case MODEL_FORMAT_OBJ:
+        return LoadModelDataFromOBJ( request.fileName, data );
+
+    default:
+        return E_INVALIDARG;
+    }
+}
+
+HRESULT LoadModelData( _In_reads_(count) const ModelLoadRequest* requests, size_t count, std::vector<ModelData>& data, size_t threads )
+{
+    data.clear();
+    data.resize( count );
+
+    std::atomic<HRESULT> result( S_OK );
+
+    RunWorkers( count, threads, [&]( size_t j )
+    {
+        HRESULT hr = LoadModelData( requests[ j ], data[ j ] );
+        if ( FAILED(hr) )
+        {
+            HRESULT expected = S_OK;
+            result.compare_exchange_strong( expected, hr );
+        }
+    });
+
+    return result;
+}
+
+
+//--------------------------------------------------------------------------------------
+std::vector<std::unique_ptr<Model>> LoadModelsPooled( _In_ ID3D11Device* d3dDevice, _In_ ID3D11DeviceContext* context,
+                                                      _In_reads_(count) const ModelLoadRequest* requests, size_t count,
+                                                      _In_ IEffectFactory& fxFactory, GeometryPool& pool, size_t threads,
+                                                      _In_opt_ InputLayoutCache* layoutCache )
+{
+    std::vector<ModelData> data;
+    HRESULT hr = LoadModelData( requests, count, data, threads );
+    if ( FAILED(hr) )
+        throw std::exception("Failed parsing model data");
+
+    // The pool copies through the immediate context, so creation stays on this thread
+    std::vector<std::unique_ptr<Model>> models;
+    models.reserve( count );
+    for( size_t j = 0; j < count; ++j )
+    {
+        models.emplace_back( CreateModelFromData( d3dDevice, data[ j ], fxFactory, requests[ j ].ccw, requests[ j ].pmalpha, context, &pool, layoutCache ) );
+    }
+
+    return models;
+}
+
+
+//--------------------------------------------------------------------------------------
+void BenchmarkModelLoads( _In_reads_(count) const ModelLoadRequest* requests, size_t count, size_t iterations )
+{
+    if ( !count || !iterations )
+        return;
+
+    // No window or swap chain is needed to create models
+    Microsoft::WRL::ComPtr<ID3D11Device> device;
+    HRESULT hr = D3D11CreateDevice( nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION, &device, nullptr, nullptr );
+    if ( FAILED(hr) )
+        hr = D3D11CreateDevice( nullptr, D3D_DRIVER_TYPE_WARP, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION, &device, nullptr, nullptr );
+
+    if ( FAILED(hr) )
+    {
+        BenchmarkTrace( "ERROR: BenchmarkModelLoads could not create a device (%08X)\n", hr );
+        return;
+    }
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency( &freq );
+
+    // Both passes use a new SharedEffectFactory, so they create the same effects and
+    // textures, differ only in threading, and neither starts with textures cached
+    double serialTime = 0.0;
+    double parallelTime = 0.0;
+    ModelLoadStats stats = {};
+
+    try
+    {
+        for( size_t iteration = 0; iteration < iterations; ++iteration )
+        {
+            LARGE_INTEGER start, stop;
+
+            {
+                SharedEffectFactory fx( device.Get() );
+
+                QueryPerformanceCounter( &start );
+
+                std::vector<std::unique_ptr<Model>> models;
+                models.reserve( count );
+                for( size_t j = 0; j < count; ++j )
+                {
+                    models.emplace_back( LoadModel( device.Get(), requests[ j ], fx ) );
+                }
+
+                QueryPerformanceCounter( &stop );
+                serialTime += double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+            }
+
+            {
+                SharedEffectFactory fx( device.Get() );
+
+                QueryPerformanceCounter( &start );
+
+                auto models = LoadModels( device.Get(), requests, count, fx, 0, &stats );
+
+                QueryPerformanceCounter( &stop );
+                parallelTime += double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+            }
+        }
+    }
+    catch( const std::exception& e )
+    {
+        BenchmarkTrace( "ERROR: BenchmarkModelLoads failed: %s\n", e.what() );
+        return;
+    }
+
+    BenchmarkTrace( "Model loads: %Iu models x %Iu iterations, %Iu threads\n", count, iterations, std::max<size_t>( std::thread::hardware_concurrency(), 1 ) );
+    BenchmarkTrace( "    serial    %8.2f ms\n", serialTime * 1000.0 / double( iterations ) );
+    BenchmarkTrace( "    parallel  %8.2f ms (%.1fx)\n", parallelTime * 1000.0 / double( iterations ), serialTime / parallelTime );
+    BenchmarkTrace( "    textures  %Iu requested, %Iu unique\n", stats.textureRequests, stats.uniqueTextures );
+}
+
+
+//--------------------------------------------------------------------------------------
+void BenchmarkModelData( _In_reads_(count) const ModelLoadRequest* requests, size_t count, size_t iterations )
+{
+    if ( !count || !iterations )
+        return;
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency( &freq );
+
+    std::vector<double> parseTimes( count );
+    std::vector<size_t> blobSizes( count );
+    std::vector<size_t> memoryUsage( count );
+    double serialTime = 0.0;
+    double parallelTime = 0.0;
+
+    for( size_t iteration = 0; iteration < iterations; ++iteration )
+    {
+        LARGE_INTEGER start, stop;
+
+        for( size_t j = 0; j < count; ++j )
+        {
+            ModelData data;
+
+            QueryPerformanceCounter( &start );
+
+            HRESULT hr = LoadModelData( requests[ j ], data );
+
+            QueryPerformanceCounter( &stop );
+
+            if ( FAILED(hr) )
+            {
+                BenchmarkTrace( "ERROR: BenchmarkModelData failed on %ls (%08X)\n", requests[ j ].fileName, hr );
+                return;
+            }
+
+            double t = double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+            parseTimes[ j ] += t;
+            serialTime += t;
+            blobSizes[ j ] = data.blob.size();
+            memoryUsage[ j ] = data.MemoryUsage();
+        }
+
+        std::vector<ModelData> data;
+
+        QueryPerformanceCounter( &start );
+
+        HRESULT hr = LoadModelData( requests, count, data );
+
+        QueryPerformanceCounter( &stop );
+        parallelTime += double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+
+        if ( FAILED(hr) )
+        {
+            BenchmarkTrace( "ERROR: BenchmarkModelData failed (%08X)\n", hr );
+            return;
+        }
+    }
+
+    BenchmarkTrace( "Model data (no device): %Iu models x %Iu iterations\n", count, iterations );
+    for( size_t j = 0; j < count; ++j )
+    {
+        double ms = parseTimes[ j ] * 1000.0 / double( iterations );
+        BenchmarkTrace( "    %-48ls %8.3f ms %8.1f MB/s %10Iu bytes held\n", requests[ j ].fileName, ms,
+                        ( ms > 0.0 ) ? double( blobSizes[ j ] ) / ( ms * 1000.0 ) : 0.0, memoryUsage[ j ] );
+    }
+    BenchmarkTrace( "    serial    %8.2f ms\n", serialTime * 1000.0 / double( iterations ) );
+    BenchmarkTrace( "    parallel  %8.2f ms (%.1fx)\n", parallelTime * 1000.0 / double( iterations ), serialTime / parallelTime );
+}
+
+
+//--------------------------------------------------------------------------------------
+namespace
+{
+    struct BufferUsage
+    {
+        size_t  buffers;        // Distinct vertex and index buffers
+        size_t  parts;
+        size_t  bufferChanges;  // Buffer switches when drawing every part in model order
+    };
+
+    BufferUsage GetBufferUsage( const std::vector<std::unique_ptr<Model>>& models )
+    {
+        BufferUsage usage = {};
+
+        std::set<ID3D11Buffer*> buffers;
+        ID3D11Buffer* vb = nullptr;
+        ID3D11Buffer* ib = nullptr;
+
+        for( auto it = models.cbegin(); it != models.cend(); ++it )
+        {
+            for( auto mit = (*it)->meshes.cbegin(); mit != (*it)->meshes.cend(); ++mit )
+            {
+                for( auto pit = (*mit)->meshParts.cbegin(); pit != (*mit)->meshParts.cend(); ++pit )
+                {
+                    auto part = pit->get();
+
+                    buffers.insert( part->vertexBuffer.Get() );
+                    buffers.insert( part->indexBuffer.Get() );
+
+                    if ( part->vertexBuffer.Get() != vb )
+                        ++usage.bufferChanges;
+                    if ( part->indexBuffer.Get() != ib )
+                        ++usage.bufferChanges;
+
+                    vb = part->vertexBuffer.Get();
+                    ib = part->indexBuffer.Get();
+                    ++usage.parts;
+                }
+            }
+        }
+
+        usage.buffers = buffers.size();
+        return usage;
+    }
+}
+
+void BenchmarkGeometryPool( _In_reads_(count) const ModelLoadRequest* requests, size_t count, size_t copies )
+{
+    if ( !count || !copies )
+        return;
+
+    Microsoft::WRL::ComPtr<ID3D11Device> device;
+    Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+    HRESULT hr = D3D11CreateDevice( nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION, &device, nullptr, &context );
+    if ( FAILED(hr) )
+        hr = D3D11CreateDevice( nullptr, D3D_DRIVER_TYPE_WARP, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION, &device, nullptr, &context );
+
+    if ( FAILED(hr) )
+    {
+        BenchmarkTrace( "ERROR: BenchmarkGeometryPool could not create a device (%08X)\n", hr );
+        return;
+    }
+
+    // Each request is loaded 'copies' times, as a scene would place the same prop many times
+    std::vector<ModelData> data;
+    hr = LoadModelData( requests, count, data );
+    if ( FAILED(hr) )
+    {
+        BenchmarkTrace( "ERROR: BenchmarkGeometryPool failed to parse (%08X)\n", hr );
+        return;
+    }
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency( &freq );
+
+    double separateTime = 0.0;
+    double pooledTime = 0.0;
+    BufferUsage separate = {};
+    BufferUsage pooled = {};
+    GeometryPoolStats poolStats = {};
+
+    try
+    {
+        LARGE_INTEGER start, stop;
+
+        {
+            EffectFactory fx( device.Get() );
+
+            QueryPerformanceCounter( &start );
+
+            std::vector<std::unique_ptr<Model>> models;
+            for( size_t copy = 0; copy < copies; ++copy )
+            {
+                for( size_t j = 0; j < count; ++j )
+                {
+                    models.emplace_back( CreateModelFromData( device.Get(), data[ j ], fx, requests[ j ].ccw, requests[ j ].pmalpha ) );
+                }
+            }
+
+            QueryPerformanceCounter( &stop );
+            separateTime = double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+
+            separate = GetBufferUsage( models );
+        }
+
+        {
+            EffectFactory fx( device.Get() );
+            GeometryPool pool( device.Get(), context.Get() );
+
+            QueryPerformanceCounter( &start );
+
+            std::vector<std::unique_ptr<Model>> models;
+            for( size_t copy = 0; copy < copies; ++copy )
+            {
+                for( size_t j = 0; j < count; ++j )
+                {
+                    models.emplace_back( CreateModelFromData( device.Get(), data[ j ], fx, requests[ j ].ccw, requests[ j ].pmalpha, context.Get(), &pool ) );
+                }
+            }
+
+            QueryPerformanceCounter( &stop );
+            pooledTime = double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+
+            pooled = GetBufferUsage( models );
+            pool.GetStats( poolStats );
+        }
+    }
+    catch( const std::exception& e )
+    {
+        BenchmarkTrace( "ERROR: BenchmarkGeometryPool failed: %s\n", e.what() );
+        return;
+    }
+
+    BenchmarkTrace( "Geometry pool: %Iu models x %Iu copies, %Iu parts\n", count, copies, separate.parts );
+    BenchmarkTrace( "    separate  %8.2f ms %6Iu buffers %6Iu buffer changes\n", separateTime * 1000.0, separate.buffers, separate.bufferChanges );
+    BenchmarkTrace( "    pooled    %8.2f ms %6Iu buffers %6Iu buffer changes\n", pooledTime * 1000.0, pooled.buffers, pooled.bufferChanges );
+    BenchmarkTrace( "    pool      %Iu VB + %Iu IB pages, %Iu allocations, %Iu of %Iu bytes used\n",
+                    poolStats.vertexBuffers, poolStats.indexBuffers, poolStats.allocations, poolStats.bytesUsed, poolStats.bytesReserved );
+}
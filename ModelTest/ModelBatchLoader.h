@@ -0,0 +1,85 @@
+//--------------------------------------------------------------------------------------
+// File: ModelBatchLoader.h
+//
+// Loads a list of models on a pool of worker threads
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Effects.h"
+#include "Model.h"
+
+#include "GeometryPool.h"
+#include "ModelData.h"
+#include "SharedEffectFactory.h"
+
+#include <memory>
+#include <vector>
+
+enum MODEL_FORMAT
+{
+    MODEL_FORMAT_CMO,
+    MODEL_FORMAT_SDKMESH,
+    MODEL_FORMAT_VBO,
+    MODEL_FORMAT_OBJ,
+    MODEL_FORMAT_SDKMESH_MAPPED,    // SDKMESH created from a mapping of the file
+};
+
+struct ModelLoadRequest
+{
+    const wchar_t*  fileName;
+    MODEL_FORMAT    format;
+    bool            ccw;
+    bool            pmalpha;
+};
+
+struct ModelLoadStats
+{
+    size_t  textureRequests;    // Texture names seen while creating effects
+    size_t  uniqueTextures;     // Textures read for them
+};
+
+// Loads every request on up to 'threads' threads (0 uses one per core) and returns
+// the models in request order. All of the threads create their effects through
+// 'fxFactory' at once, so textures are read in parallel, each only once; 'stats' counts
+// the textures this call asked for and those it read. If any load throws, the first
+// exception is rethrown once all threads are done.
+std::vector<std::unique_ptr<DirectX::Model>> LoadModels( _In_ ID3D11Device* d3dDevice, _In_reads_(count) const ModelLoadRequest* requests, size_t count,
+                                                         SharedEffectFactory& fxFactory, size_t threads = 0, _Out_opt_ ModelLoadStats* stats = nullptr );
+
+// Times LoadModels against loading the same requests one after another, on a device
+// of its own, and reports to the debug output
+void BenchmarkModelLoads( _In_reads_(count) const ModelLoadRequest* requests, size_t count, size_t iterations );
+
+// Parses a request into a ModelData without a device. MODEL_FORMAT_SDKMESH_MAPPED parses
+// the same as MODEL_FORMAT_SDKMESH.
+HRESULT LoadModelData( const ModelLoadRequest& request, ModelData& data );
+
+// Parses every request on up to 'threads' threads (0 uses one per core); returns the
+// first failure, if any
+HRESULT LoadModelData( _In_reads_(count) const ModelLoadRequest* requests, size_t count, std::vector<ModelData>& data, size_t threads = 0 );
+
+// Times LoadModelData for each request, then serial against parallel, and reports to
+// the debug output; no device is used
+void BenchmarkModelData( _In_reads_(count) const ModelLoadRequest* requests, size_t count, size_t iterations );
+
+// Parses every request on worker threads, then creates the models on this thread with
+// their vertex and index data suballocated from 'pool'. Throws on failure.
+std::vector<std::unique_ptr<DirectX::Model>> LoadModelsPooled( _In_ ID3D11Device* d3dDevice, _In_ ID3D11DeviceContext* context,
+                                                               _In_reads_(count) const ModelLoadRequest* requests, size_t count,
+                                                               _In_ DirectX::IEffectFactory& fxFactory, GeometryPool& pool, size_t threads = 0,
+                                                               _In_opt_ InputLayoutCache* layoutCache = nullptr );
+
+// Creates 'copies' of each request with a buffer per model and again from a GeometryPool,
+// on a device of its own, and reports creation time, buffer counts, and the buffer
+// changes a draw of every part in order would make
+void BenchmarkGeometryPool( _In_reads_(count) const ModelLoadRequest* requests, size_t count, size_t copies );
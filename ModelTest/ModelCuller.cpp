@@ -0,0 +1,477 @@
+//--------------------------------------------------------------------------------------
+// File: ModelCuller.cpp
+//
+// CPU frustum and occlusion culling of model meshes using their bounding volumes
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "ModelCuller.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+using namespace DirectX;
+
+namespace
+{
+    // Vertices closer than this to the eye plane are not projected
+    const float c_MinW = 1e-5f;
+}
+
+//--------------------------------------------------------------------------------------
+ModelCuller::ModelCuller( size_t depthWidth, size_t depthHeight ) :
+    m_depthWidth( depthWidth ),
+    m_depthHeight( depthHeight ),
+    m_stats()
+{
+    if ( ( depthWidth != 0 ) != ( depthHeight != 0 ) || depthWidth > 4096 || depthHeight > 4096 )
+        throw std::exception("Invalid depth buffer size");
+
+    m_depth.resize( depthWidth * depthHeight, 1.f );
+
+    XMStoreFloat4x4( &m_view, XMMatrixIdentity() );
+    XMStoreFloat4x4( &m_projection, XMMatrixIdentity() );
+    XMStoreFloat4x4( &m_viewProjection, XMMatrixIdentity() );
+    memset( m_planes, 0, sizeof(m_planes) );
+}
+
+
+//--------------------------------------------------------------------------------------
+void XM_CALLCONV ModelCuller::Begin( FXMMATRIX view, CXMMATRIX projection )
+{
+    XMMATRIX viewProjection = XMMatrixMultiply( view, projection );
+
+    XMStoreFloat4x4( &m_view, view );
+    XMStoreFloat4x4( &m_projection, projection );
+    XMStoreFloat4x4( &m_viewProjection, viewProjection );
+
+    // With row vectors, clip = v * M, so the planes are sums of the columns of M. Direct3D
+    // clips z to [0, w], so the near plane is the third column alone.
+    XMMATRIX columns = XMMatrixTranspose( viewProjection );
+
+    XMVECTOR planes[ 6 ] =
+    {
+        XMVectorAdd( columns.r[ 3 ], columns.r[ 0 ] ),         // Left
+        XMVectorSubtract( columns.r[ 3 ], columns.r[ 0 ] ),    // Right
+        XMVectorAdd( columns.r[ 3 ], columns.r[ 1 ] ),         // Bottom
+        XMVectorSubtract( columns.r[ 3 ], columns.r[ 1 ] ),    // Top
+        columns.r[ 2 ],                                         // Near
+        XMVectorSubtract( columns.r[ 3 ], columns.r[ 2 ] ),    // Far
+    };
+
+    for( size_t j = 0; j < 6; ++j )
+    {
+        XMStoreFloat4( &m_planes[ j ], XMPlaneNormalize( planes[ j ] ) );
+    }
+
+    std::fill( m_depth.begin(), m_depth.end(), 1.f );
+
+    memset( &m_stats, 0, sizeof(m_stats) );
+}
+
+
+//--------------------------------------------------------------------------------------
+void XM_CALLCONV ModelCuller::AddOccluder( const ModelData& data, FXMMATRIX world )
+{
+    if ( m_depth.empty() )
+        return;
+
+    XMMATRIX transform = XMMatrixMultiply( world, XMLoadFloat4x4( &m_viewProjection ) );
+
+    const float width = static_cast<float>( m_depthWidth );
+    const float height = static_cast<float>( m_depthHeight );
+
+    for( auto mit = data.meshes.cbegin(); mit != data.meshes.cend(); ++mit )
+    {
+        for( auto pit = mit->parts.cbegin(); pit != mit->parts.cend(); ++pit )
+        {
+            if ( pit->primitiveType != D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST || pit->isAlpha )
+                continue;
+
+            if ( pit->vertexBuffer >= data.vertexBuffers.size() || pit->indexBuffer >= data.indexBuffers.size() )
+                continue;
+
+            auto& vb = data.vertexBuffers[ pit->vertexBuffer ];
+            auto& ib = data.indexBuffers[ pit->indexBuffer ];
+
+            // Every vertex format here starts with a float3 position, but check the declaration
+            if ( !vb.vbDecl || vb.vbDecl->empty() || vb.stride < sizeof(XMFLOAT3) )
+                continue;
+
+            auto& position = vb.vbDecl->front();
+            if ( position.Format != DXGI_FORMAT_R32G32B32_FLOAT || position.AlignedByteOffset != 0 )
+                continue;
+
+            size_t indexSize = ( ib.indexFormat == DXGI_FORMAT_R32_UINT ) ? sizeof(uint32_t) : sizeof(uint16_t);
+            size_t indexCount = ib.sizeBytes / indexSize;
+            size_t vertexCount = vb.sizeBytes / vb.stride;
+
+            if ( pit->startIndex > indexCount || pit->indexCount > indexCount - pit->startIndex )
+                continue;
+
+            auto vertices = data.Data( vb.offset );
+            auto indices = data.Data( ib.offset ) + pit->startIndex * indexSize;
+
+            for( size_t t = 0; t + 2 < pit->indexCount; t += 3 )
+            {
+                XMFLOAT3 screen[ 3 ];
+                bool clipped = false;
+
+                for( size_t k = 0; k < 3; ++k )
+                {
+                    size_t index = ( indexSize == sizeof(uint32_t) )
+                                   ? reinterpret_cast<const uint32_t*>( indices )[ t + k ]
+                                   : reinterpret_cast<const uint16_t*>( indices )[ t + k ];
+                    index += pit->vertexOffset;
+
+                    if ( index >= vertexCount )
+                    {
+                        clipped = true;
+                        break;
+                    }
+
+                    XMVECTOR v = XMLoadFloat3( reinterpret_cast<const XMFLOAT3*>( vertices + index * vb.stride ) );
+                    XMVECTOR clip = XMVector3Transform( v, transform );
+
+                    // Triangles crossing the near plane are left out, which only makes the
+                    // occluders smaller
+                    float w = XMVectorGetW( clip );
+                    if ( w < c_MinW || XMVectorGetZ( clip ) < 0.f )
+                    {
+                        clipped = true;
+                        break;
+                    }
+
+                    float invW = 1.f / w;
+                    screen[ k ].x = ( XMVectorGetX( clip ) * invW * 0.5f + 0.5f ) * width;
+                    screen[ k ].y = ( 0.5f - XMVectorGetY( clip ) * invW * 0.5f ) * height;
+                    screen[ k ].z = XMVectorGetZ( clip ) * invW;
+                }
+
+                if ( clipped )
+                    continue;
+
+                float area = ( screen[ 1 ].x - screen[ 0 ].x ) * ( screen[ 2 ].y - screen[ 0 ].y )
+                           - ( screen[ 1 ].y - screen[ 0 ].y ) * ( screen[ 2 ].x - screen[ 0 ].x );
+                if ( fabsf( area ) < 1e-6f )
+                    continue;
+
+                float minX = std::min( std::min( screen[ 0 ].x, screen[ 1 ].x ), screen[ 2 ].x );
+                float maxX = std::max( std::max( screen[ 0 ].x, screen[ 1 ].x ), screen[ 2 ].x );
+                float minY = std::min( std::min( screen[ 0 ].y, screen[ 1 ].y ), screen[ 2 ].y );
+                float maxY = std::max( std::max( screen[ 0 ].y, screen[ 1 ].y ), screen[ 2 ].y );
+
+                if ( maxX < 0.f || maxY < 0.f || minX >= width || minY >= height )
+                    continue;
+
+                // Only texels the triangle covers entirely are written, so the buffer never
+                // claims an occluder where there is a gap; as the triangle is convex, those
+                // are the texels with all four corners inside it.
+                int x0 = std::max( static_cast<int>( ceilf( minX ) ), 0 );
+                int x1 = std::min( static_cast<int>( floorf( maxX ) ), static_cast<int>( m_depthWidth ) ) - 1;
+                int y0 = std::max( static_cast<int>( ceilf( minY ) ), 0 );
+                int y1 = std::min( static_cast<int>( floorf( maxY ) ), static_cast<int>( m_depthHeight ) ) - 1;
+
+                float invArea = 1.f / area;
+
+                // Barycentrics are affine in screen space: b = b(0,0) + x * dx + y * dy
+                float b0dx = ( screen[ 1 ].y - screen[ 2 ].y ) * invArea;
+                float b0dy = ( screen[ 2 ].x - screen[ 1 ].x ) * invArea;
+                float b0c = ( screen[ 1 ].x * screen[ 2 ].y - screen[ 1 ].y * screen[ 2 ].x ) * invArea;
+                float b1dx = ( screen[ 2 ].y - screen[ 0 ].y ) * invArea;
+                float b1dy = ( screen[ 0 ].x - screen[ 2 ].x ) * invArea;
+                float b1c = ( screen[ 2 ].x * screen[ 0 ].y - screen[ 2 ].y * screen[ 0 ].x ) * invArea;
+
+                // Depth at a corner, or FLT_MAX when the corner is outside the triangle
+                auto cornerDepth = [&]( float cx, float cy ) -> float
+                {
+                    float b0 = b0c + cx * b0dx + cy * b0dy;
+                    float b1 = b1c + cx * b1dx + cy * b1dy;
+                    float b2 = 1.f - b0 - b1;
+
+                    if ( b0 < 0.f || b1 < 0.f || b2 < 0.f )
+                        return FLT_MAX;
+
+                    return b0 * screen[ 0 ].z + b1 * screen[ 1 ].z + b2 * screen[ 2 ].z;
+                };
+
+                for( int y = y0; y <= y1; ++y )
+                {
+                    float* row = &m_depth[ size_t( y ) * m_depthWidth ];
+
+                    float top = cornerDepth( float( x0 ), float( y ) );
+                    float bottom = cornerDepth( float( x0 ), float( y + 1 ) );
+
+                    for( int x = x0; x <= x1; ++x )
+                    {
+                        float nextTop = cornerDepth( float( x + 1 ), float( y ) );
+                        float nextBottom = cornerDepth( float( x + 1 ), float( y + 1 ) );
+
+                        // Depth is affine too, so the farthest point of the triangle within
+                        // the texel is at one of its corners; keeping that means the texel
+                        // never holds a depth nearer than the occluder anywhere inside it
+                        float z = std::max( std::max( top, bottom ), std::max( nextTop, nextBottom ) );
+                        if ( z < row[ x ] )
+                            row[ x ] = z;
+
+                        top = nextTop;
+                        bottom = nextBottom;
+                    }
+                }
+
+                ++m_stats.occluderTriangles;
+            }
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+bool XM_CALLCONV ModelCuller::IsBoxOutside( FXMVECTOR center, FXMVECTOR axisX, FXMVECTOR axisY, GXMVECTOR axisZ ) const
+{
+    for( size_t j = 0; j < 6; ++j )
+    {
+        XMVECTOR plane = XMLoadFloat4( &m_planes[ j ] );
+
+        XMVECTOR radius = XMVectorAdd( XMVectorAdd( XMVectorAbs( XMVector3Dot( plane, axisX ) ),
+                                                    XMVectorAbs( XMVector3Dot( plane, axisY ) ) ),
+                                       XMVectorAbs( XMVector3Dot( plane, axisZ ) ) );
+
+        XMVECTOR distance = XMPlaneDotCoord( plane, center );
+
+        if ( XMVector4Less( distance, XMVectorNegate( radius ) ) )
+            return true;
+    }
+
+    return false;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool XM_CALLCONV ModelCuller::IsBoxOccluded( FXMVECTOR center, FXMVECTOR axisX, FXMVECTOR axisY, GXMVECTOR axisZ ) const
+{
+    if ( m_depth.empty() )
+        return false;
+
+    XMMATRIX viewProjection = XMLoadFloat4x4( &m_viewProjection );
+
+    const float width = static_cast<float>( m_depthWidth );
+    const float height = static_cast<float>( m_depthHeight );
+
+    float minX = FLT_MAX, maxX = -FLT_MAX;
+    float minY = FLT_MAX, maxY = -FLT_MAX;
+    float minZ = FLT_MAX;
+
+    for( size_t corner = 0; corner < 8; ++corner )
+    {
+        XMVECTOR p = center;
+        p = ( corner & 1 ) ? XMVectorAdd( p, axisX ) : XMVectorSubtract( p, axisX );
+        p = ( corner & 2 ) ? XMVectorAdd( p, axisY ) : XMVectorSubtract( p, axisY );
+        p = ( corner & 4 ) ? XMVectorAdd( p, axisZ ) : XMVectorSubtract( p, axisZ );
+
+        XMVECTOR clip = XMVector3Transform( p, viewProjection );
+
+        // A box reaching behind the near plane can't be bounded on screen
+        float w = XMVectorGetW( clip );
+        if ( w < c_MinW || XMVectorGetZ( clip ) < 0.f )
+            return false;
+
+        float invW = 1.f / w;
+        float x = ( XMVectorGetX( clip ) * invW * 0.5f + 0.5f ) * width;
+        float y = ( 0.5f - XMVectorGetY( clip ) * invW * 0.5f ) * height;
+
+        minX = std::min( minX, x );
+        maxX = std::max( maxX, x );
+        minY = std::min( minY, y );
+        maxY = std::max( maxY, y );
+        minZ = std::min( minZ, XMVectorGetZ( clip ) * invW );
+    }
+
+    int x0 = std::max( static_cast<int>( floorf( minX ) ), 0 );
+    int x1 = std::min( static_cast<int>( ceilf( maxX ) ), static_cast<int>( m_depthWidth ) - 1 );
+    int y0 = std::max( static_cast<int>( floorf( minY ) ), 0 );
+    int y1 = std::min( static_cast<int>( ceilf( maxY ) ), static_cast<int>( m_depthHeight ) - 1 );
+
+    if ( x0 > x1 || y0 > y1 )
+        return false;
+
+    for( int y = y0; y <= y1; ++y )
+    {
+        const float* row = &m_depth[ size_t( y ) * m_depthWidth ];
+
+        for( int x = x0; x <= x1; ++x )
+        {
+            if ( row[ x ] >= minZ )
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t XM_CALLCONV ModelCuller::Cull( const Model& model, FXMMATRIX world, std::vector<uint8_t>& visible )
+{
+    const size_t meshCount = model.meshes.size();
+
+    visible.assign( meshCount, 0 );
+
+    if ( !meshCount )
+        return 0;
+
+    // Spheres scale by the largest axis of the world matrix
+    float scale = sqrtf( std::max( std::max( XMVectorGetX( XMVector3LengthSq( world.r[ 0 ] ) ),
+                                             XMVectorGetX( XMVector3LengthSq( world.r[ 1 ] ) ) ),
+                                   XMVectorGetX( XMVector3LengthSq( world.r[ 2 ] ) ) ) );
+
+    // Padded to a multiple of four with spheres that are never outside
+    const size_t paddedCount = ( meshCount + 3 ) & ~size_t( 3 );
+
+    m_sphereX.assign( paddedCount, 0.f );
+    m_sphereY.assign( paddedCount, 0.f );
+    m_sphereZ.assign( paddedCount, 0.f );
+    m_sphereRadius.assign( paddedCount, FLT_MAX );
+
+    for( size_t j = 0; j < meshCount; ++j )
+    {
+        auto& sphere = model.meshes[ j ]->boundingSphere;
+
+        XMVECTOR center = XMVector3Transform( XMLoadFloat3( &sphere.Center ), world );
+
+        m_sphereX[ j ] = XMVectorGetX( center );
+        m_sphereY[ j ] = XMVectorGetY( center );
+        m_sphereZ[ j ] = XMVectorGetZ( center );
+        m_sphereRadius[ j ] = sphere.Radius * scale;
+    }
+
+    // Four spheres against each plane at once: outside when distance < -radius for any plane
+    XMVECTOR planeX[ 6 ], planeY[ 6 ], planeZ[ 6 ], planeW[ 6 ];
+    for( size_t p = 0; p < 6; ++p )
+    {
+        XMVECTOR plane = XMLoadFloat4( &m_planes[ p ] );
+        planeX[ p ] = XMVectorSplatX( plane );
+        planeY[ p ] = XMVectorSplatY( plane );
+        planeZ[ p ] = XMVectorSplatZ( plane );
+        planeW[ p ] = XMVectorSplatW( plane );
+    }
+
+    m_visible.resize( paddedCount );
+
+    for( size_t j = 0; j < paddedCount; j += 4 )
+    {
+        XMVECTOR x = XMLoadFloat4( reinterpret_cast<const XMFLOAT4*>( &m_sphereX[ j ] ) );
+        XMVECTOR y = XMLoadFloat4( reinterpret_cast<const XMFLOAT4*>( &m_sphereY[ j ] ) );
+        XMVECTOR z = XMLoadFloat4( reinterpret_cast<const XMFLOAT4*>( &m_sphereZ[ j ] ) );
+        XMVECTOR negRadius = XMVectorNegate( XMLoadFloat4( reinterpret_cast<const XMFLOAT4*>( &m_sphereRadius[ j ] ) ) );
+
+        XMVECTOR outside = XMVectorFalseInt();
+        XMVECTOR intersects = XMVectorFalseInt();
+
+        for( size_t p = 0; p < 6; ++p )
+        {
+            XMVECTOR distance = XMVectorMultiplyAdd( x, planeX[ p ],
+                                XMVectorMultiplyAdd( y, planeY[ p ],
+                                XMVectorMultiplyAdd( z, planeZ[ p ], planeW[ p ] ) ) );
+
+            outside = XMVectorOrInt( outside, XMVectorLess( distance, negRadius ) );
+            intersects = XMVectorOrInt( intersects, XMVectorLess( distance, XMVectorNegate( negRadius ) ) );
+        }
+
+        // 0 = outside, 1 = inside, 2 = crossing a plane
+        uint32_t outsideMask[ 4 ], intersectsMask[ 4 ];
+        XMStoreInt4( outsideMask, outside );
+        XMStoreInt4( intersectsMask, intersects );
+
+        for( size_t k = 0; k < 4; ++k )
+        {
+            m_visible[ j + k ] = outsideMask[ k ] ? 0 : ( intersectsMask[ k ] ? 2 : 1 );
+        }
+    }
+
+    size_t visibleCount = 0;
+
+    for( size_t j = 0; j < meshCount; ++j )
+    {
+        auto mesh = model.meshes[ j ].get();
+
+        ++m_stats.meshes;
+
+        if ( !m_visible[ j ] )
+        {
+            ++m_stats.frustumCulled;
+            continue;
+        }
+
+        // Oriented box in world space: center and half-extent axes
+        auto& box = mesh->boundingBox;
+        XMVECTOR center = XMVector3Transform( XMLoadFloat3( &box.Center ), world );
+        XMVECTOR axisX = XMVectorScale( world.r[ 0 ], box.Extents.x );
+        XMVECTOR axisY = XMVectorScale( world.r[ 1 ], box.Extents.y );
+        XMVECTOR axisZ = XMVectorScale( world.r[ 2 ], box.Extents.z );
+
+        if ( m_visible[ j ] == 2 && IsBoxOutside( center, axisX, axisY, axisZ ) )
+        {
+            ++m_stats.frustumCulled;
+            continue;
+        }
+
+        if ( IsBoxOccluded( center, axisX, axisY, axisZ ) )
+        {
+            ++m_stats.occluded;
+            continue;
+        }
+
+        visible[ j ] = 1;
+        ++visibleCount;
+        ++m_stats.visible;
+    }
+
+    return visibleCount;
+}
+
+
+//--------------------------------------------------------------------------------------
+void XM_CALLCONV ModelCuller::Draw( _In_ ID3D11DeviceContext* deviceContext, const CommonStates& states, const Model& model,
+                                    FXMMATRIX world, bool wireframe )
+{
+    std::vector<uint8_t> visible;
+    if ( !Cull( model, world, visible ) )
+        return;
+
+    XMMATRIX view = XMLoadFloat4x4( &m_view );
+    XMMATRIX projection = XMLoadFloat4x4( &m_projection );
+
+    // Opaque parts, then alpha parts, as Model::Draw does
+    for( size_t j = 0; j < model.meshes.size(); ++j )
+    {
+        if ( !visible[ j ] )
+            continue;
+
+        auto mesh = model.meshes[ j ].get();
+        mesh->PrepareForRendering( deviceContext, states, false, wireframe );
+        mesh->Draw( deviceContext, world, view, projection, false );
+    }
+
+    for( size_t j = 0; j < model.meshes.size(); ++j )
+    {
+        if ( !visible[ j ] )
+            continue;
+
+        auto mesh = model.meshes[ j ].get();
+        mesh->PrepareForRendering( deviceContext, states, true, wireframe );
+        mesh->Draw( deviceContext, world, view, projection, true );
+    }
+}
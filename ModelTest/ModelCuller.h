@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------------------------
+// File: ModelCuller.h
+//
+// CPU frustum and occlusion culling of model meshes using their bounding volumes
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CommonStates.h"
+#include "Model.h"
+
+#include "ModelData.h"
+
+#include <vector>
+
+// Counters since the last Begin
+struct ModelCullStats
+{
+    size_t  meshes;
+    size_t  visible;
+    size_t  frustumCulled;
+    size_t  occluded;
+    size_t  occluderTriangles;      // Rasterized into the depth buffer
+};
+
+// Meshes are tested against the six planes of the view-projection, four bounding spheres
+// at a time, and the meshes whose sphere crosses a plane are tested again with their
+// bounding box. The planes come from the combined matrix, so left- and right-handed
+// projections both work.
+//
+// With a depth buffer, meshes that pass are then tested against the occluders added
+// since Begin: a mesh is occluded when the nearest point of its bounding box is behind
+// the occluders at every depth buffer pixel its box covers. Occluders are triangles from
+// ModelData, as the Model's own buffers are not readable on the CPU.
+class ModelCuller
+{
+public:
+    // A 'depthWidth' x 'depthHeight' depth buffer for occlusion; zero for frustum culling only
+    explicit ModelCuller( size_t depthWidth = 0, size_t depthHeight = 0 );
+
+    // Starts a frame: sets the frustum and clears the depth buffer and counters
+    void XM_CALLCONV Begin( DirectX::FXMMATRIX view, DirectX::CXMMATRIX projection );
+
+    // Rasterizes the triangle-list parts of 'data' into the depth buffer. Add every
+    // occluder before the frame's first Cull. Rasterization is conservative: a triangle
+    // writes only the texels it covers entirely, each with its farthest depth over the
+    // texel, so a box is never reported occluded through a gap or an edge.
+    void XM_CALLCONV AddOccluder( const ModelData& data, DirectX::FXMMATRIX world );
+
+    // Sets one flag per mesh of 'model' (nonzero when visible) and returns the number visible
+    size_t XM_CALLCONV Cull( const DirectX::Model& model, DirectX::FXMMATRIX world, std::vector<uint8_t>& visible );
+
+    // Model::Draw restricted to the meshes Cull finds visible
+    void XM_CALLCONV Draw( _In_ ID3D11DeviceContext* deviceContext, const DirectX::CommonStates& states, const DirectX::Model& model,
+                           DirectX::FXMMATRIX world, bool wireframe = false );
+
+    const ModelCullStats& GetStats() const { return m_stats; }
+
+private:
+    bool XM_CALLCONV IsBoxOutside( DirectX::FXMVECTOR center, DirectX::FXMVECTOR axisX, DirectX::FXMVECTOR axisY, DirectX::GXMVECTOR axisZ ) const;
+    bool XM_CALLCONV IsBoxOccluded( DirectX::FXMVECTOR center, DirectX::FXMVECTOR axisX, DirectX::FXMVECTOR axisY, DirectX::GXMVECTOR axisZ ) const;
+
+    DirectX::XMFLOAT4X4     m_view;
+    DirectX::XMFLOAT4X4     m_projection;
+    DirectX::XMFLOAT4X4     m_viewProjection;
+    DirectX::XMFLOAT4       m_planes[ 6 ];
+
+    size_t                  m_depthWidth;
+    size_t                  m_depthHeight;
+    std::vector<float>      m_depth;
+
+    // Bounding spheres of the model being culled, one array per component
+    std::vector<float>      m_sphereX;
+    std::vector<float>      m_sphereY;
+    std::vector<float>      m_sphereZ;
+    std::vector<float>      m_sphereRadius;
+    std::vector<uint8_t>    m_visible;
+
+    ModelCullStats          m_stats;
+};
@@ -0,0 +1,928 @@
+//--------------------------------------------------------------------------------------
+// File: ModelData.cpp
+//
+// Device-independent model description, produced by the file parsers and turned into
+// a Model by a separate upload step
+//
+// Parsing only touches memory, so it can run on any thread, on machines without a GPU,
+// and under a fuzzer. CreateModelFromData then makes the D3D objects: one buffer per
+// vertex and index buffer, one effect per material, and one input layout for each
+// material and vertex buffer pair.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "Effects.h"
+#include "Model.h"
+#include "VertexTypes.h"
+
+#include "ModelData.h"
+#include "EffectCache.h"
+#include "GeometryPool.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "DirectXHelpers.h"
+#include "PlatformHelpers.h"
+
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+void ModelData::Clear()
+{
+    name.clear();
+    blob.clear();
+    vertexBuffers.clear();
+    indexBuffers.clear();
+    materials.clear();
+    meshes.clear();
+    bones.clear();
+}
+
+size_t ModelData::MemoryUsage() const
+{
+    size_t bytes = blob.capacity()
+                   + vertexBuffers.capacity() * sizeof(ModelDataVertexBuffer)
+                   + indexBuffers.capacity() * sizeof(ModelDataIndexBuffer)
+                   + materials.capacity() * sizeof(ModelDataMaterial)
+                   + meshes.capacity() * sizeof(ModelDataMesh)
+                   + bones.capacity() * sizeof(ModelDataBone);
+
+    for( auto it = vertexBuffers.cbegin(); it != vertexBuffers.cend(); ++it )
+    {
+        if ( it->vbDecl )
+            bytes += it->vbDecl->capacity() * sizeof(D3D11_INPUT_ELEMENT_DESC);
+    }
+
+    for( auto it = meshes.cbegin(); it != meshes.cend(); ++it )
+    {
+        bytes += it->parts.capacity() * sizeof(ModelDataPart) + it->boneInfluences.capacity() * sizeof(uint32_t);
+    }
+
+    return bytes;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT ReadModelDataFile( _In_z_ const wchar_t* szFileName, ModelData& data )
+{
+    data.Clear();
+
+    ScopedHandle hFile( safe_handle( CreateFileW( szFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr ) ) );
+    if ( !hFile )
+        return HRESULT_FROM_WIN32( GetLastError() );
+
+    LARGE_INTEGER fileSize = {};
+    if ( !GetFileSizeEx( hFile.get(), &fileSize ) )
+        return HRESULT_FROM_WIN32( GetLastError() );
+
+    if ( fileSize.QuadPart > UINT32_MAX )
+        return HRESULT_FROM_WIN32( ERROR_FILE_TOO_LARGE );
+
+    data.blob.resize( static_cast<size_t>( fileSize.QuadPart ) );
+
+    DWORD bytesRead = 0;
+    if ( !ReadFile( hFile.get(), data.blob.data(), static_cast<DWORD>( data.blob.size() ), &bytesRead, nullptr ) )
+        return HRESULT_FROM_WIN32( GetLastError() );
+
+    if ( bytesRead != data.blob.size() )
+        return E_FAIL;
+
+    data.name = szFileName;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+namespace
+{
+    // Bounds-checked sequential reads from the file part of ModelData::blob. Only offsets
+    // are kept, so the parser may append to the blob between reads.
+    class BlobReader
+    {
+    public:
+        BlobReader( const std::vector<uint8_t>& blob, size_t size ) : m_blob( blob ), m_size( size ), m_used( 0 ) {}
+
+        template<typename T>
+        bool Read( size_t count, size_t& offset )
+        {
+            if ( count > ( m_size - m_used ) / sizeof(T) )
+                return false;
+
+            offset = m_used;
+            m_used += sizeof(T) * count;
+            return true;
+        }
+
+        template<typename T>
+        const T* Read( size_t count = 1 )
+        {
+            size_t offset;
+            if ( !Read<T>( count, offset ) )
+                return nullptr;
+
+            return reinterpret_cast<const T*>( m_blob.data() + offset );
+        }
+
+        // UINT character count (including the terminator), then the characters
+        bool ReadString( std::wstring& str )
+        {
+            auto length = Read<UINT>();
+            if ( !length )
+                return false;
+
+            auto chars = Read<wchar_t>( *length );
+            if ( !chars )
+                return false;
+
+            str.assign( chars, std::find( chars, chars + *length, L'\0' ) );
+            return true;
+        }
+
+        size_t used() const { return m_used; }
+        size_t remaining() const { return m_size - m_used; }
+
+    private:
+        const std::vector<uint8_t>&     m_blob;
+        size_t                          m_size;
+        size_t                          m_used;
+    };
+
+    // Visual Studio Starter Kit mesh file layout
+    namespace VSD3DStarter
+    {
+        const size_t MAX_TEXTURE = 8;
+
+        #pragma pack(push,1)
+
+        struct Material
+        {
+            XMFLOAT4    Ambient;
+            XMFLOAT4    Diffuse;
+            XMFLOAT4    Specular;
+            float       SpecularPower;
+            XMFLOAT4    Emissive;
+            XMFLOAT4X4  UVTransform;
+        };
+
+        struct SubMesh
+        {
+            UINT MaterialIndex;
+            UINT IndexBufferIndex;
+            UINT VertexBufferIndex;
+            UINT StartIndex;
+            UINT PrimCount;
+        };
+
+        const size_t NUM_BONE_INFLUENCES = 4;
+
+        struct SkinningVertex
+        {
+            UINT boneIndex[ NUM_BONE_INFLUENCES ];
+            float boneWeight[ NUM_BONE_INFLUENCES ];
+        };
+
+        struct MeshExtents
+        {
+            float CenterX, CenterY, CenterZ;
+            float Radius;
+
+            float MinX, MinY, MinZ;
+            float MaxX, MaxY, MaxZ;
+        };
+
+        struct Bone
+        {
+            INT ParentIndex;
+            XMFLOAT4X4 InvBindPos;
+            XMFLOAT4X4 BindPos;
+            XMFLOAT4X4 LocalTransform;
+        };
+
+        struct Clip
+        {
+            float StartTime;
+            float EndTime;
+            UINT  keys;
+        };
+
+        struct Keyframe
+        {
+            UINT BoneIndex;
+            float Time;
+            XMFLOAT4X4 Transform;
+        };
+
+        #pragma pack(pop)
+
+        static_assert( sizeof(Material) == 132, "CMO Mesh structure size incorrect" );
+        static_assert( sizeof(SubMesh) == 20, "CMO Mesh structure size incorrect" );
+        static_assert( sizeof(SkinningVertex) == 32, "CMO Mesh structure size incorrect" );
+        static_assert( sizeof(MeshExtents) == 40, "CMO Mesh structure size incorrect" );
+        static_assert( sizeof(Bone) == 196, "CMO Mesh structure size incorrect" );
+        static_assert( sizeof(Clip) == 12, "CMO Mesh structure size incorrect" );
+        static_assert( sizeof(Keyframe) == 72, "CMO Mesh structure size incorrect" );
+    }
+
+    static_assert( sizeof(VertexPositionNormalTangentColorTexture) == 52, "CMO vertex size incorrect" );
+    static_assert( sizeof(VertexPositionNormalTangentColorTextureSkinning) == 60, "CMO skinned vertex size incorrect" );
+
+    struct CMOBuffer
+    {
+        size_t offset;
+        size_t count;
+    };
+}
+
+static std::shared_ptr<std::vector<D3D11_INPUT_ELEMENT_DESC>> MakeDecl( _In_reads_(count) const D3D11_INPUT_ELEMENT_DESC* elements, size_t count )
+{
+    return std::make_shared<std::vector<D3D11_INPUT_ELEMENT_DESC>>( elements, elements + count );
+}
+
+static inline uint32_t PackUnorm8( float value )
+{
+    value = std::min( std::max( value, 0.f ), 1.f );
+    return static_cast<uint32_t>( value * 255.f + 0.5f );
+}
+
+static HRESULT ParseCMO( ModelData& data )
+{
+    using namespace VSD3DStarter;
+
+    const size_t fileSize = data.blob.size();
+    BlobReader reader( data.blob, fileSize );
+
+    auto nMesh = reader.Read<UINT>();
+    if ( !nMesh || !*nMesh )
+        return E_FAIL;
+
+    std::shared_ptr<std::vector<D3D11_INPUT_ELEMENT_DESC>> vbDecl;
+    std::shared_ptr<std::vector<D3D11_INPUT_ELEMENT_DESC>> vbDeclSkinning;
+
+    const UINT meshCount = *nMesh;
+    for( UINT meshIndex = 0; meshIndex < meshCount; ++meshIndex )
+    {
+        ModelDataMesh mesh;
+        if ( !reader.ReadString( mesh.name ) )
+            return E_FAIL;
+
+        // Materials
+        auto nMats = reader.Read<UINT>();
+        if ( !nMats )
+            return E_FAIL;
+
+        // Each material is at least its fixed-size block, so a count the file cannot hold
+        // is rejected before anything is allocated for it
+        const UINT materialCount = *nMats;
+        if ( materialCount > reader.remaining() / sizeof(Material) )
+            return E_FAIL;
+
+        const size_t materialBase = data.materials.size();
+        std::vector<size_t> materialOffsets( materialCount );
+
+        for( UINT j = 0; j < materialCount; ++j )
+        {
+            ModelDataMaterial mat;
+            if ( !reader.ReadString( mat.name ) )
+                return E_FAIL;
+
+            if ( !reader.Read<Material>( 1, materialOffsets[ j ] ) )
+                return E_FAIL;
+
+            if ( !reader.ReadString( mat.pixelShader ) )
+                return E_FAIL;
+
+            static_assert( MAX_TEXTURE == ModelDataMaterial::DGSL_TEXTURES, "CMO texture slot count mismatch" );
+
+            for( size_t t = 0; t < MAX_TEXTURE; ++t )
+            {
+                if ( !reader.ReadString( mat.dgslTextures[ t ] ) )
+                    return E_FAIL;
+            }
+
+            mat.texture = mat.dgslTextures[ 0 ];
+
+            data.materials.emplace_back( std::move( mat ) );
+        }
+
+        auto bSkeleton = reader.Read<BYTE>();
+        if ( !bSkeleton )
+            return E_FAIL;
+
+        const bool hasSkeleton = ( *bSkeleton != 0 );
+
+        // Submeshes
+        auto nSubmesh = reader.Read<UINT>();
+        if ( !nSubmesh )
+            return E_FAIL;
+
+        const UINT submeshCount = *nSubmesh;
+        size_t submeshOffset;
+        if ( !reader.Read<SubMesh>( submeshCount, submeshOffset ) )
+            return E_FAIL;
+
+        // Index buffers
+        auto nIBs = reader.Read<UINT>();
+        if ( !nIBs )
+            return E_FAIL;
+
+        const UINT ibCount = *nIBs;
+        const size_t ibBase = data.indexBuffers.size();
+
+        for( UINT j = 0; j < ibCount; ++j )
+        {
+            auto nIndexes = reader.Read<UINT>();
+            if ( !nIndexes || !*nIndexes )
+                return E_FAIL;
+
+            ModelDataIndexBuffer ib;
+            ib.indexCount = *nIndexes;
+            ib.sizeBytes = sizeof(USHORT) * ib.indexCount;
+            ib.indexFormat = DXGI_FORMAT_R16_UINT;
+            if ( !reader.Read<USHORT>( ib.indexCount, ib.offset ) )
+                return E_FAIL;
+
+            data.indexBuffers.push_back( ib );
+        }
+
+        // Vertex buffers
+        auto nVBs = reader.Read<UINT>();
+        if ( !nVBs )
+            return E_FAIL;
+
+        const UINT vbCount = *nVBs;
+        if ( vbCount > reader.remaining() / sizeof(UINT) )
+            return E_FAIL;
+
+        std::vector<CMOBuffer> vbs( vbCount );
+
+        for( UINT j = 0; j < vbCount; ++j )
+        {
+            auto nVerts = reader.Read<UINT>();
+            if ( !nVerts || !*nVerts )
+                return E_FAIL;
+
+            vbs[ j ].count = *nVerts;
+            if ( !reader.Read<VertexPositionNormalTangentColorTexture>( vbs[ j ].count, vbs[ j ].offset ) )
+                return E_FAIL;
+        }
+
+        // Skinning vertex buffers, one for each vertex buffer when present
+        auto nSkinVBs = reader.Read<UINT>();
+        if ( !nSkinVBs )
+            return E_FAIL;
+
+        const UINT skinVBCount = *nSkinVBs;
+        if ( skinVBCount && skinVBCount != vbCount )
+            return E_FAIL;
+
+        std::vector<CMOBuffer> skinVBs( skinVBCount );
+
+        for( UINT j = 0; j < skinVBCount; ++j )
+        {
+            auto nVerts = reader.Read<UINT>();
+            if ( !nVerts || *nVerts != vbs[ j ].count )
+                return E_FAIL;
+
+            skinVBs[ j ].count = *nVerts;
+            if ( !reader.Read<SkinningVertex>( skinVBs[ j ].count, skinVBs[ j ].offset ) )
+                return E_FAIL;
+        }
+
+        // Extents
+        auto extents = reader.Read<MeshExtents>();
+        if ( !extents )
+            return E_FAIL;
+
+        mesh.boundingSphere.Center = XMFLOAT3( extents->CenterX, extents->CenterY, extents->CenterZ );
+        mesh.boundingSphere.Radius = extents->Radius;
+
+        mesh.boundingBox.Center = XMFLOAT3( ( extents->MinX + extents->MaxX ) * 0.5f,
+                                            ( extents->MinY + extents->MaxY ) * 0.5f,
+                                            ( extents->MinZ + extents->MaxZ ) * 0.5f );
+        mesh.boundingBox.Extents = XMFLOAT3( ( extents->MaxX - extents->MinX ) * 0.5f,
+                                             ( extents->MaxY - extents->MinY ) * 0.5f,
+                                             ( extents->MaxZ - extents->MinZ ) * 0.5f );
+
+        // Skeleton and animation clips
+        if ( hasSkeleton )
+        {
+            auto nBones = reader.Read<UINT>();
+            if ( !nBones )
+                return E_FAIL;
+
+            const UINT boneCount = *nBones;
+            if ( boneCount > reader.remaining() / sizeof(Bone) )
+                return E_FAIL;
+
+            const size_t boneBase = data.bones.size();
+
+            for( UINT j = 0; j < boneCount; ++j )
+            {
+                ModelDataBone bone;
+                if ( !reader.ReadString( bone.name ) )
+                    return E_FAIL;
+
+                auto bh = reader.Read<Bone>();
+                if ( !bh )
+                    return E_FAIL;
+
+                if ( bh->ParentIndex >= 0 && static_cast<UINT>( bh->ParentIndex ) >= boneCount )
+                    return E_FAIL;
+
+                bone.parentIndex = ( bh->ParentIndex < 0 ) ? ModelDataBone::NO_PARENT : static_cast<uint32_t>( boneBase + bh->ParentIndex );
+                bone.localTransform = bh->LocalTransform;
+                bone.invBindPose = bh->InvBindPos;
+
+                data.bones.emplace_back( std::move( bone ) );
+                mesh.boneInfluences.push_back( static_cast<uint32_t>( boneBase + j ) );
+            }
+
+            auto nClips = reader.Read<UINT>();
+            if ( !nClips )
+                return E_FAIL;
+
+            const UINT clipCount = *nClips;
+            for( UINT j = 0; j < clipCount; ++j )
+            {
+                std::wstring clipName;
+                if ( !reader.ReadString( clipName ) )
+                    return E_FAIL;
+
+                auto clip = reader.Read<Clip>();
+                if ( !clip )
+                    return E_FAIL;
+
+                size_t keyframes;
+                if ( !reader.Read<Keyframe>( clip->keys, keyframes ) )
+                    return E_FAIL;
+            }
+        }
+
+        const bool enableSkinning = ( skinVBCount != 0 );
+
+        for( UINT j = 0; j < materialCount; ++j )
+        {
+            auto& mh = *reinterpret_cast<const Material*>( data.Data( materialOffsets[ j ] ) );
+            auto& mat = data.materials[ materialBase + j ];
+
+            mat.perVertexColor = true;
+            mat.enableSkinning = enableSkinning;
+            mat.specularPower = mh.SpecularPower;
+            mat.alpha = mh.Diffuse.w;
+            mat.ambientColor = XMFLOAT3( mh.Ambient.x, mh.Ambient.y, mh.Ambient.z );
+            mat.diffuseColor = XMFLOAT3( mh.Diffuse.x, mh.Diffuse.y, mh.Diffuse.z );
+            mat.specularColor = XMFLOAT3( mh.Specular.x, mh.Specular.y, mh.Specular.z );
+            mat.emissiveColor = XMFLOAT3( mh.Emissive.x, mh.Emissive.y, mh.Emissive.z );
+        }
+
+        // Skinned vertices are interleaved into new data after the file contents
+        const size_t vbBase = data.vertexBuffers.size();
+
+        for( UINT j = 0; j < vbCount; ++j )
+        {
+            ModelDataVertexBuffer vb;
+            vb.vertexCount = static_cast<uint32_t>( vbs[ j ].count );
+
+            if ( enableSkinning )
+            {
+                if ( !vbDeclSkinning )
+                    vbDeclSkinning = MakeDecl( VertexPositionNormalTangentColorTextureSkinning::InputElements, VertexPositionNormalTangentColorTextureSkinning::InputElementCount );
+
+                vb.stride = sizeof(VertexPositionNormalTangentColorTextureSkinning);
+                vb.sizeBytes = vb.stride * vbs[ j ].count;
+                vb.offset = data.blob.size();
+                vb.vbDecl = vbDeclSkinning;
+
+                data.blob.resize( vb.offset + vb.sizeBytes );
+
+                auto vptr = reinterpret_cast<const VertexPositionNormalTangentColorTexture*>( data.Data( vbs[ j ].offset ) );
+                auto sptr = reinterpret_cast<const SkinningVertex*>( data.Data( skinVBs[ j ].offset ) );
+                auto dest = reinterpret_cast<VertexPositionNormalTangentColorTextureSkinning*>( data.blob.data() + vb.offset );
+
+                for( size_t v = 0; v < vbs[ j ].count; ++v )
+                {
+                    memcpy( &dest[ v ], &vptr[ v ], sizeof(VertexPositionNormalTangentColorTexture) );
+
+                    uint32_t indices = 0;
+                    uint32_t weights = 0;
+                    for( size_t k = 0; k < NUM_BONE_INFLUENCES; ++k )
+                    {
+                        indices |= ( sptr[ v ].boneIndex[ k ] & 0xFF ) << ( k * 8 );
+                        weights |= PackUnorm8( sptr[ v ].boneWeight[ k ] ) << ( k * 8 );
+                    }
+
+                    dest[ v ].indices = indices;
+                    dest[ v ].weights = weights;
+                }
+            }
+            else
+            {
+                if ( !vbDecl )
+                    vbDecl = MakeDecl( VertexPositionNormalTangentColorTexture::InputElements, VertexPositionNormalTangentColorTexture::InputElementCount );
+
+                vb.stride = sizeof(VertexPositionNormalTangentColorTexture);
+                vb.sizeBytes = vb.stride * vbs[ j ].count;
+                vb.offset = vbs[ j ].offset;
+                vb.vbDecl = vbDecl;
+            }
+
+            data.vertexBuffers.push_back( vb );
+        }
+
+        // Mesh parts
+        auto submeshes = reinterpret_cast<const SubMesh*>( data.Data( submeshOffset ) );
+
+        mesh.parts.reserve( submeshCount );
+        for( UINT j = 0; j < submeshCount; ++j )
+        {
+            auto& sm = submeshes[ j ];
+
+            if ( sm.MaterialIndex >= materialCount || sm.IndexBufferIndex >= ibCount || sm.VertexBufferIndex >= vbCount )
+                return E_FAIL;
+
+            auto& ib = data.indexBuffers[ ibBase + sm.IndexBufferIndex ];
+            if ( sm.StartIndex > ib.indexCount || sm.PrimCount > ( ib.indexCount - sm.StartIndex ) / 3 )
+                return E_FAIL;
+
+            ModelDataPart part;
+            part.vertexBuffer = static_cast<uint32_t>( vbBase + sm.VertexBufferIndex );
+            part.indexBuffer = static_cast<uint32_t>( ibBase + sm.IndexBufferIndex );
+            part.material = static_cast<uint32_t>( materialBase + sm.MaterialIndex );
+            part.startIndex = sm.StartIndex;
+            part.indexCount = sm.PrimCount * 3;
+            part.vertexOffset = 0;
+            part.primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+            part.isAlpha = ( data.materials[ part.material ].alpha < 1.f );
+
+            mesh.parts.push_back( part );
+        }
+
+        data.meshes.emplace_back( std::move( mesh ) );
+    }
+
+    if ( reader.used() != fileSize )
+        return E_FAIL;
+
+    return S_OK;
+}
+
+HRESULT LoadModelDataFromCMO( _In_z_ const wchar_t* szFileName, ModelData& data )
+{
+    HRESULT hr = ReadModelDataFile( szFileName, data );
+    if ( FAILED(hr) )
+        return hr;
+
+    return ParseCMO( data );
+}
+
+HRESULT LoadModelDataFromCMO( _In_reads_bytes_(dataSize) const uint8_t* meshData, size_t dataSize, ModelData& data )
+{
+    data.Clear();
+    data.blob.assign( meshData, meshData + dataSize );
+
+    return ParseCMO( data );
+}
+
+
+//--------------------------------------------------------------------------------------
+namespace
+{
+    struct VBOHeader
+    {
+        uint32_t numVertices;
+        uint32_t numIndices;
+    };
+}
+
+static HRESULT ParseVBO( ModelData& data )
+{
+    BlobReader reader( data.blob, data.blob.size() );
+
+    auto header = reader.Read<VBOHeader>();
+    if ( !header || !header->numVertices || !header->numIndices )
+        return E_FAIL;
+
+    ModelDataVertexBuffer vb;
+    vb.stride = sizeof(VertexPositionNormalTexture);
+    vb.vertexCount = header->numVertices;
+    vb.sizeBytes = vb.stride * vb.vertexCount;
+    vb.vbDecl = MakeDecl( VertexPositionNormalTexture::InputElements, VertexPositionNormalTexture::InputElementCount );
+    if ( !reader.Read<VertexPositionNormalTexture>( vb.vertexCount, vb.offset ) )
+        return E_FAIL;
+
+    ModelDataIndexBuffer ib;
+    ib.indexCount = header->numIndices;
+    ib.sizeBytes = sizeof(uint16_t) * ib.indexCount;
+    ib.indexFormat = DXGI_FORMAT_R16_UINT;
+    if ( !reader.Read<uint16_t>( ib.indexCount, ib.offset ) )
+        return E_FAIL;
+
+    data.vertexBuffers.push_back( vb );
+    data.indexBuffers.push_back( ib );
+
+    // Same as the BasicEffect with default lighting that Model::CreateFromVBO uses
+    ModelDataMaterial mat;
+    mat.diffuseColor = XMFLOAT3( 1.f, 1.f, 1.f );
+    data.materials.push_back( mat );
+
+    ModelDataMesh mesh;
+    mesh.name = data.name;
+
+    auto vertices = reinterpret_cast<const VertexPositionNormalTexture*>( data.Data( vb.offset ) );
+    BoundingSphere::CreateFromPoints( mesh.boundingSphere, vb.vertexCount, &vertices[0].position, sizeof( VertexPositionNormalTexture ) );
+    BoundingBox::CreateFromPoints( mesh.boundingBox, vb.vertexCount, &vertices[0].position, sizeof( VertexPositionNormalTexture ) );
+
+    ModelDataPart part;
+    part.vertexBuffer = 0;
+    part.indexBuffer = 0;
+    part.material = 0;
+    part.startIndex = 0;
+    part.indexCount = ib.indexCount;
+    part.vertexOffset = 0;
+    part.primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    part.isAlpha = false;
+    mesh.parts.push_back( part );
+
+    data.meshes.emplace_back( std::move( mesh ) );
+
+    return S_OK;
+}
+
+HRESULT LoadModelDataFromVBO( _In_z_ const wchar_t* szFileName, ModelData& data )
+{
+    HRESULT hr = ReadModelDataFile( szFileName, data );
+    if ( FAILED(hr) )
+        return hr;
+
+    return ParseVBO( data );
+}
+
+HRESULT LoadModelDataFromVBO( _In_reads_bytes_(dataSize) const uint8_t* meshData, size_t dataSize, ModelData& data )
+{
+    data.Clear();
+    data.blob.assign( meshData, meshData + dataSize );
+
+    return ParseVBO( data );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Helper for creating a D3D vertex or index buffer.
+static void CreateBuffer( _In_ ID3D11Device* device, _In_reads_bytes_(size) const void* data, size_t size, D3D11_BIND_FLAG bindFlags, _Out_ ID3D11Buffer** pBuffer )
+{
+    if ( size > UINT32_MAX )
+        throw std::exception("Buffer too large for DirectX 11");
+
+    D3D11_BUFFER_DESC bufferDesc = {};
+
+    bufferDesc.ByteWidth = static_cast<UINT>( size );
+    bufferDesc.BindFlags = bindFlags;
+    bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+
+    D3D11_SUBRESOURCE_DATA dataDesc = {};
+
+    dataDesc.pSysMem = data;
+
+    ThrowIfFailed(
+        device->CreateBuffer( &bufferDesc, &dataDesc, pBuffer )
+    );
+
+    SetDebugObjectName( *pBuffer, "ModelData" );
+}
+
+// Helper for creating a D3D input layout, through the cache when there is one.
+static void CreateInputLayout( _In_ ID3D11Device* device, IEffect* effect, const std::vector<D3D11_INPUT_ELEMENT_DESC>& vbDecl, _In_opt_ InputLayoutCache* layoutCache,
+                               _Out_ ID3D11InputLayout** pInputLayout )
+{
+    if ( layoutCache )
+    {
+        layoutCache->CreateInputLayout( device, vbDecl.data(), vbDecl.size(), effect, pInputLayout );
+        return;
+    }
+
+    void const* shaderByteCode;
+    size_t byteCodeLength;
+
+    effect->GetVertexShaderBytecode( &shaderByteCode, &byteCodeLength );
+
+    ThrowIfFailed(
+        device->CreateInputLayout( vbDecl.data(), static_cast<UINT>( vbDecl.size() ),
+                                   shaderByteCode, byteCodeLength,
+                                   pInputLayout )
+    );
+
+    SetDebugObjectName( *pInputLayout, "ModelData" );
+}
+
+// Helper for filling in the EffectInfo fields of a material.
+static void GetEffectInfo( const ModelDataMaterial& mat, EffectFactory::EffectInfo& info )
+{
+    info.name = mat.name.c_str();
+    info.perVertexColor = mat.perVertexColor;
+    info.enableSkinning = mat.enableSkinning;
+    info.enableDualTexture = mat.enableDualTexture;
+    info.specularPower = mat.specularPower;
+    info.alpha = mat.alpha;
+    info.ambientColor = mat.ambientColor;
+    info.diffuseColor = mat.diffuseColor;
+    info.specularColor = mat.specularColor;
+    info.emissiveColor = mat.emissiveColor;
+    info.texture = mat.texture.empty() ? nullptr : mat.texture.c_str();
+    info.texture2 = mat.texture2.empty() ? nullptr : mat.texture2.c_str();
+}
+
+// Helper for creating the effect for a material. CMO materials get their pixel shader and
+// every texture slot when the factory is a DGSLEffectFactory, as Model::CreateFromCMO does.
+static std::shared_ptr<IEffect> CreateMaterialEffect( _In_ IEffectFactory& fxFactory, const ModelDataMaterial& mat, _In_opt_ ID3D11DeviceContext* deviceContext )
+{
+    auto dgslFactory = dynamic_cast<DGSLEffectFactory*>( &fxFactory );
+    if ( dgslFactory )
+    {
+        DGSLEffectFactory::DGSLEffectInfo info;
+        GetEffectInfo( mat, info );
+
+        // Slots 0 and 1 travel in 'texture' and 'texture2', the rest in 'textures'
+        const size_t offset = DGSLEffectFactory::DGSLEffectInfo::BaseTextureOffset;
+        static_assert( DGSLEffectFactory::DGSLEffectInfo::BaseTextureOffset == 2, "DGSL texture slots mismatch" );
+
+        info.texture2 = mat.dgslTextures[ 1 ].empty() ? nullptr : mat.dgslTextures[ 1 ].c_str();
+
+        for( size_t t = offset; t < ModelDataMaterial::DGSL_TEXTURES; ++t )
+        {
+            info.textures[ t - offset ] = mat.dgslTextures[ t ].empty() ? nullptr : mat.dgslTextures[ t ].c_str();
+        }
+
+        info.pixelShader = mat.pixelShader.empty() ? nullptr : mat.pixelShader.c_str();
+
+        return dgslFactory->CreateDGSLEffect( info, deviceContext );
+    }
+
+    EffectFactory::EffectInfo info;
+    GetEffectInfo( mat, info );
+
+    return fxFactory.CreateEffect( info, deviceContext );
+}
+
+std::unique_ptr<Model> CreateModelFromData( _In_ ID3D11Device* d3dDevice, const ModelData& data, _In_ IEffectFactory& fxFactory, bool ccw, bool pmalpha,
+                                            _In_opt_ ID3D11DeviceContext* deviceContext, _In_opt_ GeometryPool* pool, _In_opt_ InputLayoutCache* layoutCache )
+{
+    if ( !d3dDevice )
+        throw std::exception("Direct3D device is null");
+
+    // Buffers; without a pool every range starts at zero in a buffer of its own
+    std::vector<Microsoft::WRL::ComPtr<ID3D11Buffer>> vbs( data.vertexBuffers.size() );
+    std::vector<uint32_t> vbBase( data.vertexBuffers.size(), 0 );
+    for( size_t j = 0; j < data.vertexBuffers.size(); ++j )
+    {
+        auto& vb = data.vertexBuffers[ j ];
+        if ( !vb.vbDecl || vb.offset > data.blob.size() || vb.sizeBytes > data.blob.size() - vb.offset )
+            throw std::exception("Invalid vertex buffer in model data");
+
+        if ( pool )
+            pool->AllocateVertices( data.Data( vb.offset ), vb.sizeBytes, vb.stride, &vbs[ j ], &vbBase[ j ] );
+        else
+            CreateBuffer( d3dDevice, data.Data( vb.offset ), vb.sizeBytes, D3D11_BIND_VERTEX_BUFFER, &vbs[ j ] );
+    }
+
+    std::vector<Microsoft::WRL::ComPtr<ID3D11Buffer>> ibs( data.indexBuffers.size() );
+    std::vector<uint32_t> ibBase( data.indexBuffers.size(), 0 );
+    for( size_t j = 0; j < data.indexBuffers.size(); ++j )
+    {
+        auto& ib = data.indexBuffers[ j ];
+        if ( ib.offset > data.blob.size() || ib.sizeBytes > data.blob.size() - ib.offset )
+            throw std::exception("Invalid index buffer in model data");
+
+        if ( ib.indexFormat == DXGI_FORMAT_R32_UINT && d3dDevice->GetFeatureLevel() < D3D_FEATURE_LEVEL_9_2 )
+            throw std::exception("32-bit indices require Feature Level 9.2 or later");
+
+        if ( pool )
+            pool->AllocateIndices( data.Data( ib.offset ), ib.sizeBytes, ib.indexFormat, &ibs[ j ], &ibBase[ j ] );
+        else
+            CreateBuffer( d3dDevice, data.Data( ib.offset ), ib.sizeBytes, D3D11_BIND_INDEX_BUFFER, &ibs[ j ] );
+    }
+
+    // Effects are created on first use, and input layouts once per effect and vertex format
+    std::vector<std::shared_ptr<IEffect>> effects( data.materials.size() );
+    std::map<std::pair<uint32_t, uint32_t>, Microsoft::WRL::ComPtr<ID3D11InputLayout>> layouts;
+
+    std::unique_ptr<Model> model( new Model() );
+    model->name = data.name;
+
+    for( auto mit = data.meshes.cbegin(); mit != data.meshes.cend(); ++mit )
+    {
+        auto mesh = std::make_shared<ModelMesh>();
+        mesh->name = mit->name;
+        mesh->ccw = ccw;
+        mesh->pmalpha = pmalpha;
+        mesh->boundingSphere = mit->boundingSphere;
+        mesh->boundingBox = mit->boundingBox;
+
+        for( auto pit = mit->parts.cbegin(); pit != mit->parts.cend(); ++pit )
+        {
+            if ( pit->vertexBuffer >= vbs.size() || pit->indexBuffer >= ibs.size() || pit->material >= effects.size() )
+                throw std::exception("Invalid mesh part in model data");
+
+            auto& effect = effects[ pit->material ];
+            if ( !effect )
+                effect = CreateMaterialEffect( fxFactory, data.materials[ pit->material ], deviceContext );
+
+            auto& vb = data.vertexBuffers[ pit->vertexBuffer ];
+
+            auto& il = layouts[ std::make_pair( pit->material, pit->vertexBuffer ) ];
+            if ( !il )
+                CreateInputLayout( d3dDevice, effect.get(), *vb.vbDecl, layoutCache, &il );
+
+            auto part = new ModelMeshPart;
+
+            part->indexCount = pit->indexCount;
+            part->startIndex = ibBase[ pit->indexBuffer ] + pit->startIndex;
+            part->vertexOffset = vbBase[ pit->vertexBuffer ] + pit->vertexOffset;
+            part->vertexStride = vb.stride;
+            part->primitiveType = pit->primitiveType;
+            part->indexFormat = data.indexBuffers[ pit->indexBuffer ].indexFormat;
+            part->inputLayout = il;
+            part->indexBuffer = ibs[ pit->indexBuffer ];
+            part->vertexBuffer = vbs[ pit->vertexBuffer ];
+            part->effect = effect;
+            part->vbDecl = vb.vbDecl;
+            part->isAlpha = pit->isAlpha;
+
+            mesh->meshParts.emplace_back( part );
+        }
+
+        model->meshes.push_back( mesh );
+    }
+
+    return model;
+}
+
+std::unique_ptr<Model> CloneModelFromData( _In_ ID3D11Device* d3dDevice, const Model& model, const ModelData& data, _In_ IEffectFactory& fxFactory,
+                                           _In_opt_ ID3D11DeviceContext* deviceContext, _In_opt_ InputLayoutCache* layoutCache )
+{
+    if ( !d3dDevice )
+        throw std::exception("Direct3D device is null");
+
+    if ( model.meshes.size() != data.meshes.size() )
+        throw std::exception("Model does not match model data");
+
+    std::vector<std::shared_ptr<IEffect>> effects( data.materials.size() );
+    std::map<std::pair<uint32_t, uint32_t>, Microsoft::WRL::ComPtr<ID3D11InputLayout>> layouts;
+
+    std::unique_ptr<Model> clone( new Model() );
+    clone->name = model.name;
+
+    for( size_t m = 0; m < model.meshes.size(); ++m )
+    {
+        auto& source = *model.meshes[ m ];
+        auto& meshData = data.meshes[ m ];
+
+        if ( source.meshParts.size() != meshData.parts.size() )
+            throw std::exception("Model does not match model data");
+
+        auto mesh = std::make_shared<ModelMesh>();
+        mesh->name = source.name;
+        mesh->ccw = source.ccw;
+        mesh->pmalpha = source.pmalpha;
+        mesh->boundingSphere = source.boundingSphere;
+        mesh->boundingBox = source.boundingBox;
+
+        for( size_t j = 0; j < source.meshParts.size(); ++j )
+        {
+            auto& partData = meshData.parts[ j ];
+            if ( partData.material >= effects.size() || partData.vertexBuffer >= data.vertexBuffers.size() )
+                throw std::exception("Invalid mesh part in model data");
+
+            auto& effect = effects[ partData.material ];
+            if ( !effect )
+                effect = CreateMaterialEffect( fxFactory, data.materials[ partData.material ], deviceContext );
+
+            // The layout is rebuilt for the new effect, in case the factory picks other shaders
+            auto& il = layouts[ std::make_pair( partData.material, partData.vertexBuffer ) ];
+            if ( !il )
+                CreateInputLayout( d3dDevice, effect.get(), *data.vertexBuffers[ partData.vertexBuffer ].vbDecl, layoutCache, &il );
+
+            auto part = new ModelMeshPart( *source.meshParts[ j ] );
+            part->inputLayout = il;
+            part->effect = effect;
+
+            mesh->meshParts.emplace_back( part );
+        }
+
+        clone->meshes.push_back( mesh );
+    }
+
+    return clone;
+}
@@ -0,0 +1,156 @@
+//--------------------------------------------------------------------------------------
+// File: ModelData.h
+//
+// Device-independent model description, produced by the file parsers and turned into
+// a Model by a separate upload step
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Effects.h"
+#include "Model.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class GeometryPool;
+class InputLayoutCache;
+
+// Vertex data within ModelData::blob
+struct ModelDataVertexBuffer
+{
+    size_t                                                  offset;
+    size_t                                                  sizeBytes;
+    uint32_t                                                stride;
+    uint32_t                                                vertexCount;
+    std::shared_ptr<std::vector<D3D11_INPUT_ELEMENT_DESC>>  vbDecl;
+};
+
+// Index data within ModelData::blob
+struct ModelDataIndexBuffer
+{
+    size_t          offset;
+    size_t          sizeBytes;
+    uint32_t        indexCount;
+    DXGI_FORMAT     indexFormat;
+};
+
+// The fields of IEffectFactory::EffectInfo, with the strings held by value, and those
+// DGSLEffectFactory::DGSLEffectInfo adds for CMO materials
+struct ModelDataMaterial
+{
+    static const size_t DGSL_TEXTURES = 8;
+
+    std::wstring        name;
+    std::wstring        texture;
+    std::wstring        texture2;
+    std::wstring        pixelShader;                        // CMO only
+    std::wstring        dgslTextures[ DGSL_TEXTURES ];      // CMO only; slot 0 is also 'texture'
+    bool                perVertexColor;
+    bool                enableSkinning;
+    bool                enableDualTexture;
+    float               specularPower;
+    float               alpha;
+    DirectX::XMFLOAT3   ambientColor;
+    DirectX::XMFLOAT3   diffuseColor;
+    DirectX::XMFLOAT3   specularColor;
+    DirectX::XMFLOAT3   emissiveColor;
+
+    ModelDataMaterial() :
+        perVertexColor( false ),
+        enableSkinning( false ),
+        enableDualTexture( false ),
+        specularPower( 0.f ),
+        alpha( 1.f ),
+        ambientColor( 0.f, 0.f, 0.f ),
+        diffuseColor( 0.f, 0.f, 0.f ),
+        specularColor( 0.f, 0.f, 0.f ),
+        emissiveColor( 0.f, 0.f, 0.f ) {}
+};
+
+struct ModelDataPart
+{
+    uint32_t                    vertexBuffer;
+    uint32_t                    indexBuffer;
+    uint32_t                    material;
+    uint32_t                    startIndex;
+    uint32_t                    indexCount;
+    uint32_t                    vertexOffset;
+    D3D11_PRIMITIVE_TOPOLOGY    primitiveType;
+    bool                        isAlpha;
+};
+
+struct ModelDataMesh
+{
+    std::wstring                name;
+    DirectX::BoundingSphere     boundingSphere;
+    DirectX::BoundingBox        boundingBox;
+    std::vector<ModelDataPart>  parts;
+    std::vector<uint32_t>       boneInfluences;     // Indices into ModelData::bones
+};
+
+// A CMO bone or an SDKMESH frame
+struct ModelDataBone
+{
+    static const uint32_t NO_PARENT = uint32_t( -1 );
+
+    std::wstring            name;
+    uint32_t                parentIndex;
+    DirectX::XMFLOAT4X4     localTransform;
+    DirectX::XMFLOAT4X4     invBindPose;            // Identity for SDKMESH frames
+};
+
+class ModelData
+{
+public:
+    std::wstring                        name;
+    std::vector<uint8_t>                blob;       // The file contents, followed by any data the parser generated
+    std::vector<ModelDataVertexBuffer>  vertexBuffers;
+    std::vector<ModelDataIndexBuffer>   indexBuffers;
+    std::vector<ModelDataMaterial>      materials;
+    std::vector<ModelDataMesh>          meshes;
+    std::vector<ModelDataBone>          bones;
+
+    const uint8_t* Data( size_t offset ) const { return blob.data() + offset; }
+
+    void Clear();
+
+    // Heap bytes held, for load-time memory measurements
+    size_t MemoryUsage() const;
+};
+
+// Reads the whole file into data.blob; the parsers below work on the blob in place
+HRESULT ReadModelDataFile( _In_z_ const wchar_t* szFileName, ModelData& data );
+
+// Visual Studio Starter Kit .CMO files
+HRESULT LoadModelDataFromCMO( _In_z_ const wchar_t* szFileName, ModelData& data );
+HRESULT LoadModelDataFromCMO( _In_reads_bytes_(dataSize) const uint8_t* meshData, size_t dataSize, ModelData& data );
+
+// DirectXMesh .VBO files; these have no materials, so a single default material is added
+HRESULT LoadModelDataFromVBO( _In_z_ const wchar_t* szFileName, ModelData& data );
+HRESULT LoadModelDataFromVBO( _In_reads_bytes_(dataSize) const uint8_t* meshData, size_t dataSize, ModelData& data );
+
+// Creates the buffers, effects and input layouts for 'data' on 'd3dDevice'. With a 'pool',
+// vertex and index data are suballocated from its buffers instead, and each part's
+// vertexOffset and startIndex include the base of its range.
+std::unique_ptr<DirectX::Model> CreateModelFromData( _In_ ID3D11Device* d3dDevice, const ModelData& data, _In_ DirectX::IEffectFactory& fxFactory,
+                                                     bool ccw = true, bool pmalpha = false, _In_opt_ ID3D11DeviceContext* deviceContext = nullptr,
+                                                     _In_opt_ GeometryPool* pool = nullptr, _In_opt_ InputLayoutCache* layoutCache = nullptr );
+
+// Creates a model that draws from the same vertex and index buffers as 'model', which
+// must have been created from 'data', with its own effects from 'fxFactory'. Effects keep
+// their matrices and constant buffers, so a model drawn from several threads needs one
+// copy per thread.
+std::unique_ptr<DirectX::Model> CloneModelFromData( _In_ ID3D11Device* d3dDevice, const DirectX::Model& model, const ModelData& data,
+                                                    _In_ DirectX::IEffectFactory& fxFactory, _In_opt_ ID3D11DeviceContext* deviceContext = nullptr,
+                                                    _In_opt_ InputLayoutCache* layoutCache = nullptr );
@@ -22,11 +22,23 @@
 #include "Model.h"
 #include "VertexTypes.h"
 
+#include "BenchmarkTrace.h"
+#include "EffectCache.h"
+#include "MappedFile.h"
+#include "ModelLoadOBJ.h"
+
 #include <algorithm>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 #include <unordered_map>
 
+#include <stdio.h>
+#include <math.h>
+
 #include "PlatformHelpers.h"
 
 using namespace DirectX;
@@ -36,10 +48,17 @@ class WaveFrontObj
 public:
     WaveFrontObj() {}
 
-    HRESULT Load( _In_z_ const wchar_t* szFileName );
+    HRESULT Load( _In_z_ const wchar_t* szFileName, bool parallel = false );
+
+    static HRESULT Stream( _In_z_ const wchar_t* szFileName, const OBJStreamOptions& options, const OBJBatchCallback& callback, _Out_opt_ std::wstring* materialLibrary,
+                           _Out_opt_ OBJStreamStats* stats );
+
+    HRESULT LoadStream( _In_z_ const wchar_t* szFileName );
     HRESULT LoadMTL( _In_z_ const wchar_t* szFileName );
 
     void SortByAttributes();
+    void OptimizeFaces();
+    void OptimizeVertices();
 
     struct Material
     {
@@ -52,8 +71,9 @@ public:
 
         bool bSpecular;
 
-        wchar_t strName[MAX_PATH];
-        wchar_t strTexture[MAX_PATH];
+        // Ids in 'strings'
+        uint32_t name;
+        uint32_t texture;
 
         Material() :
             vAmbient( 0.2f, 0.2f, 0.2f ),
@@ -61,36 +81,457 @@ public:
             vSpecular(  1.0f, 1.0f, 1.0f ),
             nShininess( 0 ),
             fAlpha( 1.f ),
-            bSpecular( false )
-            { memset(strName, 0, MAX_PATH); memset(strTexture, 0, MAX_PATH); } 
+            bSpecular( false ),
+            name( 0 ),
+            texture( 0 ) {}
+    };
+
+    // Interned zero-terminated strings with dense ids; id 0 is the empty string
+    class StringTable
+    {
+    public:
+        StringTable();
+
+        uint32_t Intern( _In_z_ const wchar_t* str );
+
+        // Returns UINT32_MAX if the string was never interned
+        uint32_t Find( _In_z_ const wchar_t* str ) const;
+
+        const wchar_t* operator[]( uint32_t id ) const { return &m_chars[ m_offsets[ id ] ]; }
+        size_t size() const { return m_offsets.size(); }
+
+        const std::vector<wchar_t>& chars() const { return m_chars; }
+        const std::vector<uint32_t>& offsets() const { return m_offsets; }
+
+    private:
+        size_t FindSlot( _In_z_ const wchar_t* str, size_t length ) const;
+        void Rehash( size_t capacity );
+
+        std::vector<wchar_t>    m_chars;
+        std::vector<uint32_t>   m_offsets;
+        std::vector<uint32_t>   m_lengths;  // In characters, without the terminator
+        std::vector<uint32_t>   m_slots;    // id + 1, or 0 for an empty slot
     };
 
     std::vector<VertexPositionNormalTexture>    vertices;
-    std::vector<uint16_t>                       indices;
+    std::vector<uint32_t>                       indices;
     std::vector<uint32_t>                       attributes;
     std::vector<Material>                       materials;
+    StringTable                                 strings;
+
+    // Full path of the material library read by the last load (empty if none)
+    std::wstring                                materialLibrary;
 
 private:
-    typedef std::unordered_multimap<UINT, UINT> VertexCache;
+    static const size_t MAX_POLY = 16;
+
+    typedef OBJVertexKey FaceVertex;
+
+    // Open-addressing (linear probing) map from a face vertex's index triple to its
+    // entry in 'vertices'. Positions are never 0, so a zero key marks an empty slot.
+    class VertexCache
+    {
+    public:
+        VertexCache() : m_count( 0 ), m_peakBytes( 0 ) {}
+
+        void Reserve( size_t count );
+
+        // Returns the index already stored for the key, or stores and returns 'index'
+        uint32_t FindOrInsert( const FaceVertex& key, uint32_t index );
+
+        // Empties the cache but keeps its capacity
+        void Clear();
+
+        size_t PeakBytes() const { return m_peakBytes; }
+
+    private:
+        struct Entry
+        {
+            FaceVertex  key;
+            uint32_t    index;
+        };
+
+        void Rehash( size_t capacity );
+
+        std::vector<Entry>  m_entries;
+        size_t              m_count;
+        size_t              m_peakBytes;
+    };
+
+    // Cache used by LoadStream, keyed by position index only
+    typedef std::unordered_multimap<UINT, UINT> StreamVertexCache;
+
+    // usemtl command, applying from the given polygon of its chunk onwards
+    struct MaterialRef
+    {
+        size_t          polygon;
+        std::wstring    name;
+    };
+
+    // Temporary file for RecordPool blocks evicted from memory; created on first use and
+    // deleted when closed
+    class SpillFile
+    {
+    public:
+        SpillFile() : m_size( 0 ) {}
+
+        // Appends 'size' bytes and returns where they were written
+        HRESULT Write( _In_reads_bytes_(size) const void* data, size_t size, _Out_ uint64_t& offset );
+        HRESULT Read( uint64_t offset, _Out_writes_bytes_(size) void* data, size_t size );
+
+        uint64_t size() const { return m_size; }
+
+    private:
+        ScopedHandle    m_hFile;
+        uint64_t        m_size;
+    };
+
+    // Append-only store of v/vt/vn records in fixed-size blocks. With a limit, no more than
+    // that many bytes of blocks are held: a full block is written to the spill file the
+    // first time it is evicted, and read back into the least recently used slot when a face
+    // refers to it again. The block being appended to is never evicted.
+    template<class T>
+    class RecordPool
+    {
+    public:
+        static const size_t BLOCK_RECORDS = 16384;
+
+        RecordPool() : m_size( 0 ), m_maxSlots( SIZE_MAX ), m_tick( 0 ), m_reads( 0 ), m_spill( nullptr ) {}
+
+        // 0 holds every block; otherwise at least two blocks are held
+        void SetLimit( size_t maxBytes, _In_ SpillFile* spill );
+
+        HRESULT Append( _In_reads_(count) const T* records, size_t count );
+
+        // 'index' is 0-based and less than size()
+        HRESULT Get( size_t index, _Out_ T& record );
+
+        size_t size() const { return m_size; }
+        size_t PeakBytes() const { return m_slots.size() * BLOCK_RECORDS * sizeof(T); }
+        size_t BlockReads() const { return m_reads; }
+
+    private:
+        static const uint32_t NO_SLOT = UINT32_MAX;
+        static const uint64_t NOT_WRITTEN = UINT64_MAX;
+
+        HRESULT AcquireSlot( size_t block, _Out_ uint32_t& slot );
+
+        std::vector<std::unique_ptr<T[]>>   m_slots;
+        std::vector<size_t>                 m_slotBlock;
+        std::vector<uint64_t>               m_slotUse;
+        std::vector<uint32_t>               m_blockSlot;
+        std::vector<uint64_t>               m_blockOffset;      // In the spill file, or NOT_WRITTEN
+        size_t                              m_size;
+        size_t                              m_maxSlots;
+        uint64_t                            m_tick;
+        size_t                              m_reads;
+        SpillFile*                          m_spill;
+    };
+
+    // Unresolved records from one line-aligned span of the file
+    struct Chunk
+    {
+        std::vector<XMFLOAT3>       positions;
+        std::vector<XMFLOAT3>       normals;
+        std::vector<XMFLOAT2>       texCoords;
+        std::vector<FaceVertex>     faceVertices;
+        std::vector<uint8_t>        polygonSizes;
+        std::vector<MaterialRef>    materialRefs;
+        std::wstring                materialLibrary;
+        HRESULT                     hr;
+
+        Chunk() : hr( S_OK ) {}
+    };
+
+    // Resolves chunks in file order into bounded, single-material batches, or, given a
+    // target, straight into its vertices, indices and attributes with no batch limits
+    class BatchBuilder
+    {
+    public:
+        BatchBuilder( const OBJStreamOptions& options, const OBJBatchCallback& callback );
+        BatchBuilder( const OBJStreamOptions& options, WaveFrontObj& target );
+
+        HRESULT Add( std::vector<Chunk>& chunks );
+        HRESULT Finish();
+
+        const std::wstring& MaterialLibrary() const { return m_materialLibrary; }
+
+        void GetStats( OBJStreamStats& stats ) const;
+
+    private:
+        void SetPoolLimits( const OBJStreamOptions& options );
+        HRESULT AddPolygon( const FaceVertex* faceVertices, size_t count );
+        HRESULT UseMaterial( const std::wstring& name );
+        HRESULT Flush();
+
+        OBJBatchCallback                            m_callback;
+        WaveFrontObj*                               m_target;
+        uint32_t                                    m_subset;       // Target material in use
+        size_t                                      m_maxVertices;
+        size_t                                      m_maxTriangles;
+        size_t                                      m_triangles;    // Added so far
+
+        SpillFile                                   m_spill;
+        RecordPool<XMFLOAT3>                        m_positions;
+        RecordPool<XMFLOAT3>                        m_normals;
+        RecordPool<XMFLOAT2>                        m_texCoords;
+        std::wstring                                m_materialLibrary;
+
+        std::wstring                                m_material;
+        bool                                        m_materialEmitted;
+        std::vector<VertexPositionNormalTexture>    m_vertices;
+        std::vector<FaceVertex>                     m_keys;
+        std::vector<uint32_t>                       m_indices;
+        VertexCache                                 m_cache;
+    };
+
+    static HRESULT StreamFile( _In_z_ const wchar_t* szFileName, const OBJStreamOptions& options, BatchBuilder& builder );
+    static HRESULT ParseSpan( _In_reads_bytes_(size) const char* data, size_t size, bool parallel, std::vector<Chunk>& chunks );
+    static HRESULT ParseChunk( const char* p, const char* end, Chunk& chunk );
+    uint32_t UseMaterial( _In_z_ const wchar_t* strName );
+    uint32_t FindMaterial( _In_z_ const wchar_t* strName ) const;
+    HRESULT LoadMaterialLibrary( _In_z_ const wchar_t* szFileName, _In_z_ const wchar_t* strMaterialFilename );
+
+    template<class Cache>
+    DWORD AddVertex( UINT hash, VertexPositionNormalTexture* pVertex, Cache& cache );
+
+    // Material index for each string id, or UINT32_MAX
+    std::vector<uint32_t> materialByName;
+
+    friend void BenchmarkOBJ( _In_z_ const wchar_t* szFileName, size_t iterations );
+};
+
+
+//--------------------------------------------------------------------------------------
+// Byte-oriented scanning helpers for the memory-mapped reader
+static inline bool IsDigit( char c )
+{
+    return ( c >= '0' && c <= '9' );
+}
+
+// Whitespace within a line; '\n' always terminates the current record
+static inline bool IsBlank( char c )
+{
+    return ( c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f' );
+}
+
+static inline void SkipBlanks( const char*& p, const char* end )
+{
+    while ( p < end && IsBlank( *p ) )
+        ++p;
+}
+
+static inline void SkipLine( const char*& p, const char* end )
+{
+    auto eol = static_cast<const char*>( memchr( p, '\n', end - p ) );
+    p = ( eol ) ? ( eol + 1 ) : end;
+}
+
+// Returns the length of the next whitespace-delimited token on the current line
+static inline size_t ReadToken( const char*& p, const char* end, const char*& token )
+{
+    SkipBlanks( p, end );
+
+    token = p;
+    while ( p < end && *p != '\n' && !IsBlank( *p ) )
+        ++p;
+
+    return static_cast<size_t>( p - token );
+}
+
+static inline bool IsToken( const char* token, size_t length, const char* keyword, size_t keywordLength )
+{
+    return ( length == keywordLength ) && ( 0 == memcmp( token, keyword, length ) );
+}
+
+// Converts a UTF-8 token into a zero-terminated wide string
+static bool WidenToken( const char* token, size_t length, _Out_writes_(count) wchar_t* dest, size_t count )
+{
+    *dest = 0;
+
+    if ( !length )
+        return false;
+
+    int result = MultiByteToWideChar( CP_UTF8, 0, token, static_cast<int>( length ), dest, static_cast<int>( count - 1 ) );
+    if ( result <= 0 )
+        return false;
+
+    dest[ result ] = 0;
+    return true;
+}
+
+static double ScalePow10( double value, int exponent )
+{
+    // Powers of ten up to 1e22 are exact in double precision
+    static const double s_pow10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    if ( exponent < 0 )
+    {
+        while ( exponent < -22 )
+        {
+            value /= 1e22;
+            exponent += 22;
+        }
+
+        return value / s_pow10[ -exponent ];
+    }
+
+    while ( exponent > 22 )
+    {
+        value *= 1e22;
+        exponent -= 22;
+    }
+
+    return value * s_pow10[ exponent ];
+}
+
+// Parses [+|-]digits[.digits][(e|E)[+|-]digits], skipping leading blanks
+static bool ParseFloat( const char*& p, const char* end, float& result )
+{
+    SkipBlanks( p, end );
+
+    bool negative = false;
+    if ( p < end && ( *p == '-' || *p == '+' ) )
+    {
+        negative = ( *p == '-' );
+        ++p;
+    }
+
+    // Accumulate up to 17 significant digits; anything beyond that is below float precision
+    static const uint64_t c_maxMantissa = 10000000000000000ull;
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+
+    for( ; p < end && IsDigit( *p ); ++p )
+    {
+        digits = true;
+        if ( mantissa < c_maxMantissa )
+            mantissa = mantissa * 10 + static_cast<uint64_t>( *p - '0' );
+        else
+            ++exponent;
+    }
+
+    if ( p < end && *p == '.' )
+    {
+        ++p;
+        for( ; p < end && IsDigit( *p ); ++p )
+        {
+            digits = true;
+            if ( mantissa < c_maxMantissa )
+            {
+                mantissa = mantissa * 10 + static_cast<uint64_t>( *p - '0' );
+                --exponent;
+            }
+        }
+    }
+
+    if ( !digits )
+        return false;
+
+    if ( p < end && ( *p == 'e' || *p == 'E' ) )
+    {
+        const char* q = p + 1;
+
+        bool negativeExp = false;
+        if ( q < end && ( *q == '-' || *q == '+' ) )
+        {
+            negativeExp = ( *q == '-' );
+            ++q;
+        }
+
+        if ( q < end && IsDigit( *q ) )
+        {
+            int e = 0;
+            for( ; q < end && IsDigit( *q ); ++q )
+            {
+                if ( e < 10000 )
+                    e = e * 10 + ( *q - '0' );
+            }
+
+            exponent += ( negativeExp ) ? -e : e;
+            p = q;
+        }
+    }
+
+    double value = static_cast<double>( mantissa );
+    if ( exponent != 0 && mantissa != 0 )
+        value = ScalePow10( value, exponent );
+
+    result = static_cast<float>( ( negative ) ? -value : value );
+    return true;
+}
+
+// Parses an unsigned decimal index with no leading blanks
+static bool ParseIndex( const char*& p, const char* end, uint32_t& result )
+{
+    if ( p >= end || !IsDigit( *p ) )
+        return false;
+
+    uint64_t value = 0;
+    for( ; p < end && IsDigit( *p ); ++p )
+    {
+        value = value * 10 + static_cast<uint64_t>( *p - '0' );
+        if ( value > UINT32_MAX )
+            return false;
+    }
+
+    result = static_cast<uint32_t>( value );
+    return true;
+}
+
+// Allocator that tracks the current and peak number of bytes allocated through it
+template<class T>
+struct CountingAllocator
+{
+    typedef T value_type;
+    template<class U> struct rebind { typedef CountingAllocator<U> other; };
+
+    size_t* current;
+    size_t* peak;
+
+    CountingAllocator( size_t* c, size_t* p ) : current( c ), peak( p ) {}
+    template<class U> CountingAllocator( const CountingAllocator<U>& other ) : current( other.current ), peak( other.peak ) {}
+
+    T* allocate( size_t n )
+    {
+        *current += n * sizeof(T);
+        *peak = std::max( *peak, *current );
+        return static_cast<T*>( ::operator new( n * sizeof(T) ) );
+    }
+
+    void deallocate( T* p, size_t n )
+    {
+        *current -= n * sizeof(T);
+        ::operator delete( p );
+    }
 
-    DWORD AddVertex( UINT hash, VertexPositionNormalTexture* pVertex, VertexCache& cache );
+    template<class U> bool operator==( const CountingAllocator<U>& other ) const { return current == other.current; }
+    template<class U> bool operator!=( const CountingAllocator<U>& other ) const { return current != other.current; }
 };
 
 
 //--------------------------------------------------------------------------------------
 // Helper for creating a D3D vertex or index buffer.
-template<typename T>
-static void CreateBuffer(_In_ ID3D11Device* device, T const& data, D3D11_BIND_FLAG bindFlags, _Out_ ID3D11Buffer** pBuffer)
+static void CreateBuffer(_In_ ID3D11Device* device, _In_reads_bytes_(size) const void* data, size_t size, D3D11_BIND_FLAG bindFlags, _Out_ ID3D11Buffer** pBuffer)
 {
+    if ( size > UINT32_MAX )
+        throw std::exception("Buffer too large for DirectX 11");
+
     D3D11_BUFFER_DESC bufferDesc = {};
 
-    bufferDesc.ByteWidth = (UINT)data.size() * sizeof(T::value_type);
+    bufferDesc.ByteWidth = static_cast<UINT>( size );
     bufferDesc.BindFlags = bindFlags;
     bufferDesc.Usage = D3D11_USAGE_DEFAULT;
 
     D3D11_SUBRESOURCE_DATA dataDesc = {};
 
-    dataDesc.pSysMem = data.data();
+    dataDesc.pSysMem = data;
 
     ThrowIfFailed(
         device->CreateBuffer(&bufferDesc, &dataDesc, pBuffer)
@@ -99,9 +540,16 @@ static void CreateBuffer(_In_ ID3D11Device* device, T const& data, D3D11_BIND_FL
     SetDebugObjectName(*pBuffer, "ModelOBJ");
 }
 
-// Helper for creating a D3D input layout.
-static void CreateInputLayout(_In_ ID3D11Device* device, IEffect* effect, _Out_ ID3D11InputLayout** pInputLayout)
+// Helper for creating a D3D input layout, through the cache when there is one.
+static void CreateInputLayout(_In_ ID3D11Device* device, IEffect* effect, _In_opt_ InputLayoutCache* layoutCache, _Out_ ID3D11InputLayout** pInputLayout)
 {
+    if (layoutCache)
+    {
+        layoutCache->CreateInputLayout(device, VertexPositionNormalTexture::InputElements, VertexPositionNormalTexture::InputElementCount,
+                                       effect, pInputLayout);
+        return;
+    }
+
     void const* shaderByteCode;
     size_t byteCodeLength;
 
@@ -135,134 +583,1578 @@ static BOOL CALLBACK InitializeDecl( PINIT_ONCE initOnce, PVOID Parameter, PVOID
 
 
 //--------------------------------------------------------------------------------------
-std::unique_ptr<Model> CreateModelFromOBJ( _In_ ID3D11Device* d3dDevice, _In_ ID3D11DeviceContext* deviceContext, _In_z_ const wchar_t* szFileName, _In_ IEffectFactory& fxFactory, bool ccw, bool pmalpha )
+// Mesh data ready for upload, either owned by a WaveFrontObj or mapped from a cache file
+namespace
 {
-    if ( !InitOnceExecuteOnce( &g_InitOnce, InitializeDecl, nullptr, nullptr ) )
-        throw std::exception("One-time initialization failed");
+    struct OBJMesh
+    {
+        const VertexPositionNormalTexture*  vertices;
+        size_t                              vertexCount;
+        const void*                         indices;
+        size_t                              indexCount;
+        DXGI_FORMAT                         indexFormat;
+        const uint32_t*                     attributes;     // One per triangle
+        const WaveFrontObj::Material*       materials;
+        size_t                              materialCount;
+        const wchar_t*                      chars;          // StringTable contents
+        size_t                              charCount;
+        const uint32_t*                     stringOffsets;
+        size_t                              stringCount;
+
+        OBJMesh() :
+            vertices( nullptr ), vertexCount( 0 ),
+            indices( nullptr ), indexCount( 0 ), indexFormat( DXGI_FORMAT_UNKNOWN ),
+            attributes( nullptr ), materials( nullptr ), materialCount( 0 ),
+            chars( nullptr ), charCount( 0 ), stringOffsets( nullptr ), stringCount( 0 ) {}
+
+        size_t IndexSize() const { return ( indexFormat == DXGI_FORMAT_R32_UINT ) ? sizeof( uint32_t ) : sizeof( uint16_t ); }
+
+        const wchar_t* String( uint32_t id ) const { return chars + stringOffsets[ id ]; }
+    };
+}
+
 
-    std::unique_ptr<WaveFrontObj> obj( new WaveFrontObj() );
+//--------------------------------------------------------------------------------------
+// Binary cache of a processed OBJ (<file>.objcache), written beside the source by
+// OBJ_LOADER_CACHE. It holds the sorted vertex, index and attribute arrays exactly
+// as they are uploaded, so a warm load maps the file and skips parsing entirely.
+//
+// The cache is stale if the OBJ or its MTL changed size. A changed timestamp with an
+// unchanged size falls back to comparing a hash of the contents, so touched or
+// re-synced files don't force a rebuild.
+//--------------------------------------------------------------------------------------
+namespace
+{
+    const uint32_t OBJ_CACHE_MAGIC = 0x434A424F; // "OBJC"
+    const uint32_t OBJ_CACHE_VERSION = 3;
+    const uint64_t OBJ_CACHE_ALIGNMENT = 16;
 
-    if ( FAILED( obj->Load( szFileName ) ) )
+    struct OBJCacheStamp
     {
-        throw std::exception("Failed loading WaveFront file");
-    }
+        uint64_t size;
+        uint64_t writeTime;
+        uint64_t hash;
+    };
 
-    if ( obj->vertices.empty() || obj->indices.empty() || obj->attributes.empty() || obj->materials.empty() )
+    struct OBJCacheHeader
     {
-        throw std::exception("Missing data in WaveFront file");
+        uint32_t        magic;
+        uint32_t        version;
+        uint32_t        vertexSize;
+        uint32_t        materialSize;
+        uint32_t        indexFormat;
+        uint32_t        loadFlags;      // OBJ_LOADER_OPTIMIZE if the arrays were optimized
+        OBJCacheStamp   source;
+        OBJCacheStamp   materialLibrary;
+        wchar_t         materialLibraryPath[MAX_PATH];
+        uint64_t        vertexCount;
+        uint64_t        vertexOffset;
+        uint64_t        indexCount;
+        uint64_t        indexOffset;
+        uint64_t        attributeOffset;
+        uint64_t        materialCount;
+        uint64_t        materialOffset;
+        uint64_t        charCount;
+        uint64_t        charOffset;
+        uint64_t        stringCount;
+        uint64_t        stringOffset;
+    };
+}
+
+static uint64_t HashBytes( _In_reads_bytes_(size) const void* data, size_t size )
+{
+    const uint64_t k = 0x9E3779B97F4A7C15ull;
+
+    uint64_t hash = size * k;
+
+    auto ptr = static_cast<const uint8_t*>( data );
+    for( ; size >= sizeof(uint64_t); ptr += sizeof(uint64_t), size -= sizeof(uint64_t) )
+    {
+        uint64_t word;
+        memcpy( &word, ptr, sizeof(uint64_t) );
+        hash = ( hash ^ word ) * k;
+        hash ^= hash >> 29;
     }
-    
-    obj->SortByAttributes();
 
-    // Create Vertex Buffer
-    Microsoft::WRL::ComPtr<ID3D11Buffer> vb;
-    CreateBuffer( d3dDevice, obj->vertices, D3D11_BIND_VERTEX_BUFFER, &vb );
+    uint64_t tail = 0;
+    memcpy( &tail, ptr, size );
+    hash = ( hash ^ tail ) * k;
+    hash ^= hash >> 32;
 
-    // Create Index Buffer
-    Microsoft::WRL::ComPtr<ID3D11Buffer> ib;
-    CreateBuffer( d3dDevice, obj->indices, D3D11_BIND_INDEX_BUFFER, &ib );
+    return hash;
+}
 
-    // Create mesh
-    auto mesh = std::make_shared<ModelMesh>();
-    mesh->name = szFileName;
-    mesh->ccw = ccw;
-    mesh->pmalpha = pmalpha;
+static HRESULT GetFileStamp( _In_z_ const wchar_t* szFileName, OBJCacheStamp& stamp )
+{
+    memset( &stamp, 0, sizeof(stamp) );
 
-    BoundingSphere::CreateFromPoints( mesh->boundingSphere, obj->vertices.size(), &obj->vertices[0].position, sizeof( VertexPositionNormalTexture ) );
-    BoundingBox::CreateFromPoints( mesh->boundingBox, obj->vertices.size(), &obj->vertices[0].position, sizeof( VertexPositionNormalTexture ) );
+    ScopedHandle hFile( safe_handle( CreateFileW( szFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr ) ) );
+    if ( !hFile )
+        return HRESULT_FROM_WIN32( GetLastError() );
 
-    // Create a subset for each attribute/material
-    uint32_t curmaterial = static_cast<uint32_t>( -1 );
-    std::shared_ptr<IEffect> effect;
-    bool alpha = false;
-    Microsoft::WRL::ComPtr<ID3D11InputLayout> il;
+    LARGE_INTEGER fileSize = {};
+    if ( !GetFileSizeEx( hFile.get(), &fileSize ) )
+        return HRESULT_FROM_WIN32( GetLastError() );
 
-    size_t index = 0;
-    size_t sindex = 0;
-    size_t nindices = 0;
-    for( auto it = obj->attributes.cbegin(); it != obj->attributes.cend(); ++it )
-    {
-        if ( *it != curmaterial )
-        {
-            auto mat = obj->materials[ *it ];
+    FILETIME writeTime = {};
+    if ( !GetFileTime( hFile.get(), nullptr, nullptr, &writeTime ) )
+        return HRESULT_FROM_WIN32( GetLastError() );
 
-            alpha = ( mat.fAlpha < 1.f ) ? true : false;
+    stamp.size = static_cast<uint64_t>( fileSize.QuadPart );
+    stamp.writeTime = ( static_cast<uint64_t>( writeTime.dwHighDateTime ) << 32 ) | writeTime.dwLowDateTime;
+    return S_OK;
+}
 
-            EffectFactory::EffectInfo info;
-            info.name = mat.strName;
-            info.alpha = mat.fAlpha;
-            info.ambientColor = mat.vAmbient;
-            info.diffuseColor = mat.vDiffuse;
+static HRESULT HashFile( _In_z_ const wchar_t* szFileName, uint64_t& hash )
+{
+    MappedFile file;
+    HRESULT hr = file.Open( szFileName );
+    if ( FAILED(hr) )
+        return hr;
 
-            if ( mat.bSpecular )
-            {
-                info.specularPower = static_cast<float>(mat.nShininess);
-                info.specularColor = mat.vSpecular;
-            }
+    hash = HashBytes( file.data(), file.size() );
+    return S_OK;
+}
 
-            info.texture = mat.strTexture;
+// 'writeTime' receives the file's current write time; when it differs from the cached
+// one the file only matched by hash, and the cache should be stamped again
+static bool IsStampCurrent( _In_z_ const wchar_t* szFileName, const OBJCacheStamp& cached, uint64_t& writeTime )
+{
+    OBJCacheStamp current;
+    if ( FAILED( GetFileStamp( szFileName, current ) ) )
+        return false;
 
-            effect = fxFactory.CreateEffect( info, deviceContext );
+    writeTime = current.writeTime;
 
-            // Create input layout from effect
-            CreateInputLayout( d3dDevice, effect.get(), &il );
+    if ( current.size != cached.size )
+        return false;
 
-            curmaterial = *it;
-        }
+    if ( current.writeTime == cached.writeTime )
+        return true;
 
-        nindices += 3;
+    uint64_t hash;
+    if ( FAILED( HashFile( szFileName, hash ) ) )
+        return false;
 
-        auto nit = it+1;
-        if ( nit == obj->attributes.cend() || *nit != curmaterial )
-        {
-            auto part = new ModelMeshPart;
+    return ( hash == cached.hash );
+}
 
-            part->indexCount = static_cast<uint32_t>( nindices );
-            part->startIndex = static_cast<uint32_t>( sindex );
-            part->vertexStride = sizeof( VertexPositionNormalTexture );
-            part->inputLayout = il;
-            part->indexBuffer = ib;
-            part->vertexBuffer = vb;
-            part->effect = effect;
-            part->vbDecl = g_vbdecl;
-            part->isAlpha = alpha;
-            
-            mesh->meshParts.emplace_back( part );
+// Rewrites the header of an existing cache in place; the cached arrays are untouched
+static HRESULT UpdateOBJCacheHeader( _In_z_ const wchar_t* szCacheName, const OBJCacheHeader& header )
+{
+    ScopedHandle hFile( safe_handle( CreateFileW( szCacheName, GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr ) ) );
+    if ( !hFile )
+        return HRESULT_FROM_WIN32( GetLastError() );
 
-            nindices = 0;
-            sindex = index + 3;
-        }
+    DWORD bytesWritten = 0;
+    if ( !WriteFile( hFile.get(), &header, sizeof(header), &bytesWritten, nullptr ) )
+        return HRESULT_FROM_WIN32( GetLastError() );
 
-        index += 3;
-    }
+    if ( bytesWritten != sizeof(header) )
+        return E_FAIL;
 
-    // Create model
-    std::unique_ptr<Model> model(new Model());
-    model->name = szFileName;
-    model->meshes.push_back( mesh );
- 
-    return model;
+    return S_OK;
 }
 
-
-//--------------------------------------------------------------------------------------
-HRESULT WaveFrontObj::Load( _In_z_ const wchar_t* szFileName )
+static bool IsSectionValid( uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize )
 {
-    static const size_t MAX_POLY = 16;
+    if ( offset % OBJ_CACHE_ALIGNMENT )
+        return false;
 
-    std::wifstream InFile( szFileName );
-    if( !InFile )
-        return HRESULT_FROM_WIN32( ERROR_FILE_NOT_FOUND );
+    if ( offset < sizeof(OBJCacheHeader) || offset > fileSize )
+        return false;
+
+    return ( count <= ( fileSize - offset ) / elementSize );
+}
+
+// Maps an up-to-date cache file and points 'mesh' into it; returns false if the cache
+// is missing, stale, or malformed. A source that matched only by hash (touched but not
+// changed) has its new write time stored in the cache when 'refreshStamps' is set, so
+// the next load does not hash it again.
+static bool ReadOBJCache( _In_z_ const wchar_t* szCacheName, _In_z_ const wchar_t* szFileName, unsigned int loadFlags, MappedFile& file, OBJMesh& mesh,
+                          bool refreshStamps = true )
+{
+    if ( FAILED( file.Open( szCacheName ) ) )
+        return false;
+
+    if ( file.size() < sizeof(OBJCacheHeader) )
+        return false;
+
+    auto header = reinterpret_cast<const OBJCacheHeader*>( file.data() );
+
+    if ( header->magic != OBJ_CACHE_MAGIC
+         || header->version != OBJ_CACHE_VERSION
+         || header->loadFlags != loadFlags
+         || header->vertexSize != sizeof(VertexPositionNormalTexture)
+         || header->materialSize != sizeof(WaveFrontObj::Material) )
+        return false;
+
+    if ( header->indexFormat != DXGI_FORMAT_R16_UINT && header->indexFormat != DXGI_FORMAT_R32_UINT )
+        return false;
+
+    if ( !header->vertexCount || !header->indexCount || ( header->indexCount % 3 ) || !header->materialCount || !header->charCount || !header->stringCount )
+        return false;
+
+    if ( header->materialLibraryPath[ MAX_PATH - 1 ] != 0 )
+        return false;
+
+    const uint64_t fileSize = file.size();
+    const uint64_t indexSize = ( header->indexFormat == DXGI_FORMAT_R32_UINT ) ? sizeof(uint32_t) : sizeof(uint16_t);
+
+    if ( !IsSectionValid( header->vertexOffset, header->vertexCount, sizeof(VertexPositionNormalTexture), fileSize )
+         || !IsSectionValid( header->indexOffset, header->indexCount, indexSize, fileSize )
+         || !IsSectionValid( header->attributeOffset, header->indexCount / 3, sizeof(uint32_t), fileSize )
+         || !IsSectionValid( header->materialOffset, header->materialCount, sizeof(WaveFrontObj::Material), fileSize )
+         || !IsSectionValid( header->charOffset, header->charCount, sizeof(wchar_t), fileSize )
+         || !IsSectionValid( header->stringOffset, header->stringCount, sizeof(uint32_t), fileSize ) )
+        return false;
+
+    uint64_t sourceWriteTime = header->source.writeTime;
+    if ( !IsStampCurrent( szFileName, header->source, sourceWriteTime ) )
+        return false;
+
+    uint64_t materialLibraryWriteTime = header->materialLibrary.writeTime;
+    if ( *header->materialLibraryPath && !IsStampCurrent( header->materialLibraryPath, header->materialLibrary, materialLibraryWriteTime ) )
+        return false;
+
+    mesh.vertices = reinterpret_cast<const VertexPositionNormalTexture*>( file.data() + header->vertexOffset );
+    mesh.vertexCount = static_cast<size_t>( header->vertexCount );
+    mesh.indices = file.data() + header->indexOffset;
+    mesh.indexCount = static_cast<size_t>( header->indexCount );
+    mesh.indexFormat = static_cast<DXGI_FORMAT>( header->indexFormat );
+    mesh.attributes = reinterpret_cast<const uint32_t*>( file.data() + header->attributeOffset );
+    mesh.materials = reinterpret_cast<const WaveFrontObj::Material*>( file.data() + header->materialOffset );
+    mesh.materialCount = static_cast<size_t>( header->materialCount );
+    mesh.chars = reinterpret_cast<const wchar_t*>( file.data() + header->charOffset );
+    mesh.charCount = static_cast<size_t>( header->charCount );
+    mesh.stringOffsets = reinterpret_cast<const uint32_t*>( file.data() + header->stringOffset );
+    mesh.stringCount = static_cast<size_t>( header->stringCount );
+
+    // Indices, attributes and strings come straight from the file, so range check them before use
+    if ( mesh.chars[ mesh.charCount - 1 ] != 0 )
+        return false;
+
+    if ( std::any_of( mesh.stringOffsets, mesh.stringOffsets + mesh.stringCount, [&]( uint32_t o ) { return o >= mesh.charCount; } ) )
+        return false;
+
+    if ( std::any_of( mesh.materials, mesh.materials + mesh.materialCount, [&]( const WaveFrontObj::Material& m ) { return m.name >= mesh.stringCount || m.texture >= mesh.stringCount; } ) )
+        return false;
+
+    auto attributesEnd = mesh.attributes + mesh.indexCount / 3;
+    if ( std::any_of( mesh.attributes, attributesEnd, [&]( uint32_t a ) { return a >= mesh.materialCount; } ) )
+        return false;
+
+    if ( mesh.indexFormat == DXGI_FORMAT_R32_UINT )
+    {
+        auto indices = static_cast<const uint32_t*>( mesh.indices );
+        if ( std::any_of( indices, indices + mesh.indexCount, [&]( uint32_t i ) { return i >= mesh.vertexCount; } ) )
+            return false;
+    }
+    else
+    {
+        auto indices = static_cast<const uint16_t*>( mesh.indices );
+        if ( std::any_of( indices, indices + mesh.indexCount, [&]( uint16_t i ) { return i >= mesh.vertexCount; } ) )
+            return false;
+    }
+
+    if ( refreshStamps
+         && ( sourceWriteTime != header->source.writeTime || materialLibraryWriteTime != header->materialLibrary.writeTime ) )
+    {
+        OBJCacheHeader updated = *header;
+        updated.source.writeTime = sourceWriteTime;
+        updated.materialLibrary.writeTime = materialLibraryWriteTime;
+
+        // The mapping holds the file open, so release it for the write and map it again;
+        // the second read checks the whole cache afresh
+        mesh = OBJMesh();
+        file.Close();
+
+        HRESULT hr = UpdateOBJCacheHeader( szCacheName, updated );
+        if ( FAILED(hr) )
+        {
+            BenchmarkTrace( "WARNING: Failed updating OBJ cache %ls (%08X)\n", szCacheName, hr );
+        }
+
+        return ReadOBJCache( szCacheName, szFileName, loadFlags, file, mesh, false );
+    }
+
+    return true;
+}
+
+static HRESULT WriteOBJCache( _In_z_ const wchar_t* szCacheName, _In_z_ const wchar_t* szFileName, _In_z_ const wchar_t* szMaterialLibrary, unsigned int loadFlags, const OBJMesh& mesh )
+{
+    OBJCacheHeader header = {};
+    header.magic = OBJ_CACHE_MAGIC;
+    header.version = OBJ_CACHE_VERSION;
+    header.loadFlags = loadFlags;
+    header.vertexSize = sizeof(VertexPositionNormalTexture);
+    header.materialSize = sizeof(WaveFrontObj::Material);
+    header.indexFormat = static_cast<uint32_t>( mesh.indexFormat );
+
+    HRESULT hr = GetFileStamp( szFileName, header.source );
+    if ( FAILED(hr) )
+        return hr;
+
+    hr = HashFile( szFileName, header.source.hash );
+    if ( FAILED(hr) )
+        return hr;
+
+    if ( *szMaterialLibrary )
+    {
+        if ( wcscpy_s( header.materialLibraryPath, szMaterialLibrary ) )
+            return E_FAIL;
+
+        hr = GetFileStamp( szMaterialLibrary, header.materialLibrary );
+        if ( FAILED(hr) )
+            return hr;
+
+        hr = HashFile( szMaterialLibrary, header.materialLibrary.hash );
+        if ( FAILED(hr) )
+            return hr;
+    }
+
+    struct Section
+    {
+        const void* data;
+        uint64_t    size;
+        uint64_t*   offset;
+    };
+
+    const Section sections[] =
+    {
+        { mesh.vertices, sizeof(VertexPositionNormalTexture) * mesh.vertexCount, &header.vertexOffset },
+        { mesh.indices, mesh.IndexSize() * mesh.indexCount, &header.indexOffset },
+        { mesh.attributes, sizeof(uint32_t) * ( mesh.indexCount / 3 ), &header.attributeOffset },
+        { mesh.materials, sizeof(WaveFrontObj::Material) * mesh.materialCount, &header.materialOffset },
+        { mesh.chars, sizeof(wchar_t) * mesh.charCount, &header.charOffset },
+        { mesh.stringOffsets, sizeof(uint32_t) * mesh.stringCount, &header.stringOffset },
+    };
+
+    header.vertexCount = mesh.vertexCount;
+    header.indexCount = mesh.indexCount;
+    header.materialCount = mesh.materialCount;
+    header.charCount = mesh.charCount;
+    header.stringCount = mesh.stringCount;
+
+    uint64_t offset = sizeof(OBJCacheHeader);
+    for( auto& section : sections )
+    {
+        offset = ( offset + OBJ_CACHE_ALIGNMENT - 1 ) & ~( OBJ_CACHE_ALIGNMENT - 1 );
+        *section.offset = offset;
+        offset += section.size;
+    }
+
+    // Write to a temporary file and swap it in, so a concurrent or interrupted
+    // load never sees a partial cache
+    std::wstring tempName( szCacheName );
+    tempName += L".tmp";
+
+    {
+        ScopedHandle hFile( safe_handle( CreateFileW( tempName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr ) ) );
+        if ( !hFile )
+            return HRESULT_FROM_WIN32( GetLastError() );
+
+        uint64_t written = 0;
+        auto write = [&]( const void* data, uint64_t size ) -> HRESULT
+        {
+            auto ptr = static_cast<const uint8_t*>( data );
+            while ( size > 0 )
+            {
+                DWORD bytes = static_cast<DWORD>( std::min<uint64_t>( size, 0x40000000 ) );
+                DWORD bytesWritten = 0;
+                if ( !WriteFile( hFile.get(), ptr, bytes, &bytesWritten, nullptr ) )
+                    return HRESULT_FROM_WIN32( GetLastError() );
+
+                if ( bytesWritten != bytes )
+                    return E_FAIL;
+
+                ptr += bytes;
+                size -= bytes;
+                written += bytes;
+            }
+            return S_OK;
+        };
+
+        hr = write( &header, sizeof(header) );
+
+        static const uint8_t s_padding[ OBJ_CACHE_ALIGNMENT ] = {};
+        for( auto& section : sections )
+        {
+            if ( FAILED(hr) )
+                break;
+
+            hr = write( s_padding, *section.offset - written );
+            if ( SUCCEEDED(hr) )
+                hr = write( section.data, section.size );
+        }
+    }
+
+    if ( FAILED(hr) )
+    {
+        DeleteFileW( tempName.c_str() );
+        return hr;
+    }
+
+    if ( !MoveFileExW( tempName.c_str(), szCacheName, MOVEFILE_REPLACE_EXISTING ) )
+    {
+        hr = HRESULT_FROM_WIN32( GetLastError() );
+        DeleteFileW( tempName.c_str() );
+        return hr;
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Fills 'objMesh' from the cache when OBJ_LOADER_CACHE allows, otherwise by parsing the
+// file. 'objMesh' points into 'cacheFile', 'obj' or 'indices16' afterwards.
+static HRESULT LoadOBJMesh( _In_z_ const wchar_t* szFileName, unsigned int loadFlags, MappedFile& cacheFile, std::unique_ptr<WaveFrontObj>& obj, std::vector<uint16_t>& indices16, OBJMesh& objMesh )
+{
+    std::wstring cacheName( szFileName );
+    cacheName += L".objcache";
+
+    // Flags that change the cached arrays
+    const unsigned int cacheFlags = loadFlags & OBJ_LOADER_OPTIMIZE;
+
+    if ( !( loadFlags & OBJ_LOADER_CACHE ) || !ReadOBJCache( cacheName.c_str(), szFileName, cacheFlags, cacheFile, objMesh ) )
+    {
+        obj.reset( new WaveFrontObj() );
+
+        HRESULT hr = obj->Load( szFileName, ( loadFlags & OBJ_LOADER_PARALLEL ) != 0 );
+        if ( FAILED(hr) )
+            return hr;
+
+        if ( obj->vertices.empty() || obj->indices.empty() || obj->attributes.empty() || obj->materials.empty() )
+            return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+
+        obj->SortByAttributes();
+
+        if ( loadFlags & OBJ_LOADER_OPTIMIZE )
+        {
+            obj->OptimizeFaces();
+            obj->OptimizeVertices();
+        }
+
+        objMesh.vertices = obj->vertices.data();
+        objMesh.vertexCount = obj->vertices.size();
+        objMesh.indexCount = obj->indices.size();
+        objMesh.attributes = obj->attributes.data();
+        objMesh.materials = obj->materials.data();
+        objMesh.materialCount = obj->materials.size();
+        objMesh.chars = obj->strings.chars().data();
+        objMesh.charCount = obj->strings.chars().size();
+        objMesh.stringOffsets = obj->strings.offsets().data();
+        objMesh.stringCount = obj->strings.size();
+
+        // Use 16-bit indices whenever they can address every vertex (0xFFFF is left
+        // unused as it is the strip-cut value)
+        if ( obj->vertices.size() < 0xFFFF )
+        {
+            indices16.assign( obj->indices.cbegin(), obj->indices.cend() );
+            objMesh.indices = indices16.data();
+            objMesh.indexFormat = DXGI_FORMAT_R16_UINT;
+        }
+        else
+        {
+            objMesh.indices = obj->indices.data();
+            objMesh.indexFormat = DXGI_FORMAT_R32_UINT;
+        }
+
+        if ( loadFlags & OBJ_LOADER_CACHE )
+        {
+            hr = WriteOBJCache( cacheName.c_str(), szFileName, obj->materialLibrary.c_str(), cacheFlags, objMesh );
+            if ( FAILED(hr) )
+            {
+                BenchmarkTrace( "WARNING: Failed writing OBJ cache %ls (%08X)\n", cacheName.c_str(), hr );
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+std::unique_ptr<Model> CreateModelFromOBJ( _In_ ID3D11Device* d3dDevice, _In_ ID3D11DeviceContext* deviceContext, _In_z_ const wchar_t* szFileName, _In_ IEffectFactory& fxFactory, bool ccw, bool pmalpha, unsigned int loadFlags,
+                                           _In_opt_ InputLayoutCache* layoutCache )
+{
+    if ( !InitOnceExecuteOnce( &g_InitOnce, InitializeDecl, nullptr, nullptr ) )
+        throw std::exception("One-time initialization failed");
+
+    MappedFile cacheFile;
+    OBJMesh objMesh;
+
+    std::unique_ptr<WaveFrontObj> obj;
+    std::vector<uint16_t> indices16;
+
+    HRESULT hr = LoadOBJMesh( szFileName, loadFlags, cacheFile, obj, indices16, objMesh );
+    if ( hr == HRESULT_FROM_WIN32( ERROR_INVALID_DATA ) )
+        throw std::exception("Missing data in WaveFront file");
+
+    if ( FAILED(hr) )
+        throw std::exception("Failed loading WaveFront file");
+
+    // Create Vertex Buffer
+    Microsoft::WRL::ComPtr<ID3D11Buffer> vb;
+    CreateBuffer( d3dDevice, objMesh.vertices, sizeof( VertexPositionNormalTexture ) * objMesh.vertexCount, D3D11_BIND_VERTEX_BUFFER, &vb );
+
+    // Create Index Buffer
+    if ( objMesh.indexFormat == DXGI_FORMAT_R32_UINT && d3dDevice->GetFeatureLevel() < D3D_FEATURE_LEVEL_9_2 )
+        throw std::exception("32-bit indices require Feature Level 9.2 or later");
+
+    Microsoft::WRL::ComPtr<ID3D11Buffer> ib;
+    CreateBuffer( d3dDevice, objMesh.indices, objMesh.IndexSize() * objMesh.indexCount, D3D11_BIND_INDEX_BUFFER, &ib );
+
+    // Create mesh
+    auto mesh = std::make_shared<ModelMesh>();
+    mesh->name = szFileName;
+    mesh->ccw = ccw;
+    mesh->pmalpha = pmalpha;
+
+    BoundingSphere::CreateFromPoints( mesh->boundingSphere, objMesh.vertexCount, &objMesh.vertices[0].position, sizeof( VertexPositionNormalTexture ) );
+    BoundingBox::CreateFromPoints( mesh->boundingBox, objMesh.vertexCount, &objMesh.vertices[0].position, sizeof( VertexPositionNormalTexture ) );
+
+    // Create a subset for each attribute/material
+    uint32_t curmaterial = static_cast<uint32_t>( -1 );
+    std::shared_ptr<IEffect> effect;
+    bool alpha = false;
+    Microsoft::WRL::ComPtr<ID3D11InputLayout> il;
+    std::unordered_map<IEffect*, Microsoft::WRL::ComPtr<ID3D11InputLayout>> layouts;
+
+    const uint32_t* attributesEnd = objMesh.attributes + objMesh.indexCount / 3;
+
+    size_t index = 0;
+    size_t sindex = 0;
+    size_t nindices = 0;
+    for( auto it = objMesh.attributes; it != attributesEnd; ++it )
+    {
+        if ( *it != curmaterial )
+        {
+            const auto& mat = objMesh.materials[ *it ];
+
+            alpha = ( mat.fAlpha < 1.f ) ? true : false;
+
+            EffectFactory::EffectInfo info;
+            info.name = objMesh.String( mat.name );
+            info.alpha = mat.fAlpha;
+            info.ambientColor = mat.vAmbient;
+            info.diffuseColor = mat.vDiffuse;
+
+            if ( mat.bSpecular )
+            {
+                info.specularPower = static_cast<float>(mat.nShininess);
+                info.specularColor = mat.vSpecular;
+            }
+
+            info.texture = objMesh.String( mat.texture );
+
+            effect = fxFactory.CreateEffect( info, deviceContext );
+
+            // Create input layout from effect, once per effect
+            auto& effectLayout = layouts[ effect.get() ];
+            if ( !effectLayout )
+                CreateInputLayout( d3dDevice, effect.get(), layoutCache, &effectLayout );
+
+            il = effectLayout;
+
+            curmaterial = *it;
+        }
+
+        nindices += 3;
+
+        auto nit = it+1;
+        if ( nit == attributesEnd || *nit != curmaterial )
+        {
+            auto part = new ModelMeshPart;
+
+            part->indexCount = static_cast<uint32_t>( nindices );
+            part->startIndex = static_cast<uint32_t>( sindex );
+            part->vertexStride = sizeof( VertexPositionNormalTexture );
+            part->indexFormat = objMesh.indexFormat;
+            part->inputLayout = il;
+            part->indexBuffer = ib;
+            part->vertexBuffer = vb;
+            part->effect = effect;
+            part->vbDecl = g_vbdecl;
+            part->isAlpha = alpha;
+            
+            mesh->meshParts.emplace_back( part );
+
+            nindices = 0;
+            sindex = index + 3;
+        }
+
+        index += 3;
+    }
+
+    // Create model
+    std::unique_ptr<Model> model(new Model());
+    model->name = szFileName;
+    model->meshes.push_back( mesh );
+ 
+    return model;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT LoadModelDataFromOBJ( _In_z_ const wchar_t* szFileName, ModelData& data, unsigned int loadFlags )
+{
+    if ( !InitOnceExecuteOnce( &g_InitOnce, InitializeDecl, nullptr, nullptr ) )
+        return E_FAIL;
+
+    data.Clear();
+
+    MappedFile cacheFile;
+    OBJMesh objMesh;
+
+    std::unique_ptr<WaveFrontObj> obj;
+    std::vector<uint16_t> indices16;
+
+    HRESULT hr = LoadOBJMesh( szFileName, loadFlags, cacheFile, obj, indices16, objMesh );
+    if ( FAILED(hr) )
+        return hr;
+
+    if ( objMesh.vertexCount > UINT32_MAX || objMesh.indexCount > UINT32_MAX )
+        return HRESULT_FROM_WIN32( ERROR_FILE_TOO_LARGE );
+
+    data.name = szFileName;
+
+    // There is no binary image of an OBJ, so the blob holds the processed vertices and indices
+    ModelDataVertexBuffer vb;
+    vb.offset = 0;
+    vb.stride = sizeof( VertexPositionNormalTexture );
+    vb.vertexCount = static_cast<uint32_t>( objMesh.vertexCount );
+    vb.sizeBytes = vb.stride * objMesh.vertexCount;
+    vb.vbDecl = g_vbdecl;
+
+    ModelDataIndexBuffer ib;
+    ib.offset = vb.sizeBytes;
+    ib.indexCount = static_cast<uint32_t>( objMesh.indexCount );
+    ib.sizeBytes = objMesh.IndexSize() * objMesh.indexCount;
+    ib.indexFormat = objMesh.indexFormat;
+
+    data.blob.resize( vb.sizeBytes + ib.sizeBytes );
+    memcpy( data.blob.data() + vb.offset, objMesh.vertices, vb.sizeBytes );
+    memcpy( data.blob.data() + ib.offset, objMesh.indices, ib.sizeBytes );
+
+    data.vertexBuffers.push_back( vb );
+    data.indexBuffers.push_back( ib );
+
+    data.materials.resize( objMesh.materialCount );
+    for( size_t j = 0; j < objMesh.materialCount; ++j )
+    {
+        const auto& mat = objMesh.materials[ j ];
+        auto& info = data.materials[ j ];
+
+        info.name = objMesh.String( mat.name );
+        info.alpha = mat.fAlpha;
+        info.ambientColor = mat.vAmbient;
+        info.diffuseColor = mat.vDiffuse;
+
+        if ( mat.bSpecular )
+        {
+            info.specularPower = static_cast<float>( mat.nShininess );
+            info.specularColor = mat.vSpecular;
+        }
+
+        info.texture = objMesh.String( mat.texture );
+    }
+
+    ModelDataMesh mesh;
+    mesh.name = szFileName;
+
+    BoundingSphere::CreateFromPoints( mesh.boundingSphere, objMesh.vertexCount, &objMesh.vertices[0].position, sizeof( VertexPositionNormalTexture ) );
+    BoundingBox::CreateFromPoints( mesh.boundingBox, objMesh.vertexCount, &objMesh.vertices[0].position, sizeof( VertexPositionNormalTexture ) );
+
+    // A part for each run of triangles with the same material
+    const size_t faceCount = objMesh.indexCount / 3;
+    for( size_t face = 0; face < faceCount; )
+    {
+        const uint32_t material = objMesh.attributes[ face ];
+
+        size_t end = face + 1;
+        while ( end < faceCount && objMesh.attributes[ end ] == material )
+            ++end;
+
+        ModelDataPart part;
+        part.vertexBuffer = 0;
+        part.indexBuffer = 0;
+        part.material = material;
+        part.startIndex = static_cast<uint32_t>( face * 3 );
+        part.indexCount = static_cast<uint32_t>( ( end - face ) * 3 );
+        part.vertexOffset = 0;
+        part.primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+        part.isAlpha = ( objMesh.materials[ material ].fAlpha < 1.f );
+        mesh.parts.push_back( part );
+
+        face = end;
+    }
+
+    data.meshes.emplace_back( std::move( mesh ) );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT StreamOBJ( _In_z_ const wchar_t* szFileName, const OBJStreamOptions& options, const OBJBatchCallback& callback, _Out_opt_ std::wstring* materialLibrary,
+                   _Out_opt_ OBJStreamStats* stats )
+{
+    if ( !szFileName || !callback )
+        return E_INVALIDARG;
+
+    return WaveFrontObj::Stream( szFileName, options, callback, materialLibrary, stats );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Builds the single indexed mesh directly from the streamed faces, so every face vertex
+// goes through one whole-file vertex cache rather than a batch cache and then a merge
+HRESULT WaveFrontObj::Load( _In_z_ const wchar_t* szFileName, bool parallel )
+{
+    // One view of the whole file, so faces may refer to vertex data that follows them
+    OBJStreamOptions options;
+    options.windowSize = SIZE_MAX;
+    options.parallel = parallel;
+
+    BatchBuilder builder( options, *this );
+
+    HRESULT hr = StreamFile( szFileName, options, builder );
+    if ( FAILED(hr) )
+        return hr;
+
+    return LoadMaterialLibrary( szFileName, builder.MaterialLibrary().c_str() );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Maps the file one window at a time, parses each window's complete lines (split
+// across threads if requested) and hands the faces to a BatchBuilder. Memory use is
+// bounded by the window and batch sizes, and by options.maxPoolBytes for the v/vt/vn
+// records, which faces may refer to at any later point.
+HRESULT WaveFrontObj::Stream( _In_z_ const wchar_t* szFileName, const OBJStreamOptions& options, const OBJBatchCallback& callback, _Out_opt_ std::wstring* materialLibrary,
+                              _Out_opt_ OBJStreamStats* stats )
+{
+    if ( materialLibrary )
+        materialLibrary->clear();
+
+    if ( stats )
+        memset( stats, 0, sizeof(OBJStreamStats) );
+
+    BatchBuilder builder( options, callback );
+
+    HRESULT hr = StreamFile( szFileName, options, builder );
+    if ( FAILED(hr) )
+        return hr;
+
+    if ( materialLibrary )
+        *materialLibrary = builder.MaterialLibrary();
+
+    if ( stats )
+        builder.GetStats( *stats );
+
+    return S_OK;
+}
+
+HRESULT WaveFrontObj::StreamFile( _In_z_ const wchar_t* szFileName, const OBJStreamOptions& options, BatchBuilder& builder )
+{
+    MappedFile file;
+    HRESULT hr = file.OpenMapping( szFileName );
+    if ( FAILED(hr) )
+        return hr;
+
+    SYSTEM_INFO info = {};
+    GetSystemInfo( &info );
+    const uint64_t granularity = info.dwAllocationGranularity;
+
+    // Views start on a granularity boundary, up to one granule before the next line
+    uint64_t windowSize = std::max<uint64_t>( options.windowSize, granularity * 2 );
+    if ( windowSize != SIZE_MAX )
+        windowSize = ( windowSize + granularity - 1 ) & ~( granularity - 1 );
+
+    std::vector<Chunk> chunks;
+
+    uint64_t offset = 0;
+    while ( offset < file.fileSize() )
+    {
+        uint64_t base = offset & ~( granularity - 1 );
+        uint64_t viewSize = std::min( windowSize, file.fileSize() - base );
+        if ( viewSize > SIZE_MAX )
+            return HRESULT_FROM_WIN32( ERROR_FILE_TOO_LARGE );
+
+        hr = file.MapView( base, static_cast<size_t>( viewSize ) );
+        if ( FAILED(hr) )
+            return hr;
+
+        const char* begin = file.data() + ( offset - base );
+        const char* end = file.data() + file.size();
+
+        if ( base + viewSize < file.fileSize() )
+        {
+            // Leave the partial last line for the next window
+            while ( end > begin && end[ -1 ] != '\n' )
+                --end;
+
+            if ( end == begin )
+                return HRESULT_FROM_WIN32( ERROR_INSUFFICIENT_BUFFER );
+        }
+
+        hr = ParseSpan( begin, end - begin, options.parallel, chunks );
+        if ( FAILED(hr) )
+            return hr;
+
+        hr = builder.Add( chunks );
+        if ( FAILED(hr) )
+            return hr;
+
+        offset += end - begin;
+    }
+
+    return builder.Finish();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WaveFrontObj::ParseSpan( _In_reads_bytes_(size) const char* data, size_t size, bool parallel, std::vector<Chunk>& chunks )
+{
+    // Smaller spans are not worth the thread start-up cost
+    static const size_t MIN_CHUNK_SIZE = 1024 * 1024;
+
+    size_t count = 1;
+    if ( parallel )
+    {
+        count = std::min<size_t>( std::thread::hardware_concurrency(), size / MIN_CHUNK_SIZE );
+        count = std::max<size_t>( count, 1 );
+    }
+
+    // Split at line boundaries so that every record is parsed by exactly one chunk
+    const char* end = data + size;
+
+    std::vector<const char*> bounds( count + 1 );
+    bounds[ 0 ] = data;
+    bounds[ count ] = end;
+    for( size_t j = 1; j < count; ++j )
+    {
+        const char* p = std::max( data + ( size * j ) / count, bounds[ j - 1 ] );
+        SkipLine( p, end );
+        bounds[ j ] = p;
+    }
+
+    chunks.clear();
+    chunks.resize( count );
+
+    if ( count == 1 )
+    {
+        chunks[ 0 ].hr = ParseChunk( data, end, chunks[ 0 ] );
+    }
+    else
+    {
+        auto work = [&]( size_t j )
+        {
+            try
+            {
+                chunks[ j ].hr = ParseChunk( bounds[ j ], bounds[ j + 1 ], chunks[ j ] );
+            }
+            catch( ... )
+            {
+                chunks[ j ].hr = E_OUTOFMEMORY;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve( count - 1 );
+        for( size_t j = 1; j < count; ++j )
+        {
+            workers.emplace_back( work, j );
+        }
+
+        work( 0 );
+
+        for( auto it = workers.begin(); it != workers.end(); ++it )
+        {
+            it->join();
+        }
+    }
+
+    for( auto it = chunks.cbegin(); it != chunks.cend(); ++it )
+    {
+        if ( FAILED( it->hr ) )
+            return it->hr;
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Records the v/vt/vn/f/usemtl/mtllib commands from [p, end) without resolving any
+// face indices, so that chunks can be parsed independently of each other
+HRESULT WaveFrontObj::ParseChunk( const char* p, const char* end, Chunk& chunk )
+{
+    while( p < end )
+    {
+        const char* token;
+        size_t length = ReadToken( p, end, token );
+        if ( !length )
+        {
+            // Blank line
+            SkipLine( p, end );
+            continue;
+        }
+
+        bool recognized = true;
+        switch( *token )
+        {
+        case '#':
+            // Comment
+            break;
+
+        case 'v':
+            if ( length == 1 )
+            {
+                // Vertex Position
+                XMFLOAT3 v;
+                if ( !ParseFloat( p, end, v.x ) || !ParseFloat( p, end, v.y ) || !ParseFloat( p, end, v.z ) )
+                    return E_FAIL;
+                chunk.positions.push_back( v );
+            }
+            else if ( IsToken( token, length, "vt", 2 ) )
+            {
+                // Vertex TexCoord
+                XMFLOAT2 vt;
+                if ( !ParseFloat( p, end, vt.x ) || !ParseFloat( p, end, vt.y ) )
+                    return E_FAIL;
+                chunk.texCoords.push_back( vt );
+            }
+            else if ( IsToken( token, length, "vn", 2 ) )
+            {
+                // Vertex Normal
+                XMFLOAT3 vn;
+                if ( !ParseFloat( p, end, vn.x ) || !ParseFloat( p, end, vn.y ) || !ParseFloat( p, end, vn.z ) )
+                    return E_FAIL;
+                chunk.normals.push_back( vn );
+            }
+            else
+            {
+                recognized = false;
+            }
+            break;
+
+        case 'f':
+            if ( length == 1 )
+            {
+                // Face
+                size_t iFace = 0;
+                for(;;)
+                {
+                    SkipBlanks( p, end );
+                    if ( p >= end || *p == '\n' )
+                        break;
+
+                    if ( iFace >= MAX_POLY )
+                    {
+                        // Too many polygon verts for the reader
+                        return E_FAIL;
+                    }
+
+                    // OBJ format uses 1-based arrays; 0 marks a missing texcoord or normal
+                    FaceVertex fv = {};
+                    if ( !ParseIndex( p, end, fv.position ) || !fv.position )
+                        return E_FAIL;
+
+                    if ( p < end && *p == '/' )
+                    {
+                        ++p;
+
+                        if ( p < end && *p != '/' )
+                        {
+                            // Optional texture coordinate
+                            if ( !ParseIndex( p, end, fv.texCoord ) || !fv.texCoord )
+                                return E_FAIL;
+                        }
+
+                        if ( p < end && *p == '/' )
+                        {
+                            ++p;
+
+                            // Optional vertex normal
+                            if ( !ParseIndex( p, end, fv.normal ) || !fv.normal )
+                                return E_FAIL;
+                        }
+                    }
+
+                    chunk.faceVertices.push_back( fv );
+                    ++iFace;
+                }
+
+                if ( iFace < 3 )
+                {
+                    // Need at least 3 points to form a triangle
+                    return E_FAIL;
+                }
+
+                chunk.polygonSizes.push_back( static_cast<uint8_t>( iFace ) );
+            }
+            else
+            {
+                recognized = false;
+            }
+            break;
+
+        case 'm':
+            if ( IsToken( token, length, "mtllib", 6 ) )
+            {
+                // Material library
+                const char* name;
+                size_t nameLength = ReadToken( p, end, name );
+
+                wchar_t strName[MAX_PATH] = {};
+                if ( !WidenToken( name, nameLength, strName, MAX_PATH ) )
+                    return E_FAIL;
+
+                chunk.materialLibrary = strName;
+            }
+            else
+            {
+                recognized = false;
+            }
+            break;
+
+        case 'u':
+            if ( IsToken( token, length, "usemtl", 6 ) )
+            {
+                // Material
+                const char* name;
+                size_t nameLength = ReadToken( p, end, name );
+
+                wchar_t strName[MAX_PATH] = {};
+                if ( !WidenToken( name, nameLength, strName, MAX_PATH ) )
+                    return E_FAIL;
+
+                MaterialRef ref;
+                ref.polygon = chunk.polygonSizes.size();
+                ref.name = strName;
+                chunk.materialRefs.push_back( ref );
+            }
+            else
+            {
+                recognized = false;
+            }
+            break;
+
+        case 'g':
+        case 'o':
+        case 's':
+            // Groups, objects, and smoothing groups are not used by this reader
+            recognized = ( length == 1 );
+            break;
+
+        default:
+            recognized = false;
+            break;
+        }
+
+        if ( !recognized )
+        {
+            // Unimplemented or unrecognized command
+            wchar_t strCommand[256] = {};
+            if ( WidenToken( token, std::min<size_t>( length, 255 ), strCommand, 256 ) )
+                OutputDebugStringW( strCommand );
+        }
+
+        SkipLine( p, end );
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Chunks are added in file order, so batches do not depend on how the file was split.
+// Every usemtl ends the current batch; a material with no faces still produces an
+// empty batch, so consumers see materials in the order the file names them.
+WaveFrontObj::BatchBuilder::BatchBuilder( const OBJStreamOptions& options, const OBJBatchCallback& callback ) :
+    m_callback( callback ),
+    m_target( nullptr ),
+    m_subset( 0 ),
+    m_maxVertices( std::min<size_t>( std::max<size_t>( options.maxBatchVertices, MAX_POLY ), UINT32_MAX ) ),
+    m_maxTriangles( std::max<size_t>( options.maxBatchTriangles, MAX_POLY - 2 ) ),
+    m_triangles( 0 ),
+    m_material( L"default" ),
+    m_materialEmitted( true )
+{
+    SetPoolLimits( options );
+}
+
+WaveFrontObj::BatchBuilder::BatchBuilder( const OBJStreamOptions& options, WaveFrontObj& target ) :
+    m_target( &target ),
+    m_subset( target.UseMaterial( L"default" ) ),
+    m_maxVertices( UINT32_MAX ),
+    m_maxTriangles( SIZE_MAX ),
+    m_triangles( 0 ),
+    m_material( L"default" ),
+    m_materialEmitted( true )
+{
+    SetPoolLimits( options );
+}
+
+void WaveFrontObj::BatchBuilder::SetPoolLimits( const OBJStreamOptions& options )
+{
+    if ( options.maxPoolBytes )
+    {
+        // The limit is shared out by record size
+        const size_t records = std::max<size_t>( options.maxPoolBytes / ( sizeof(XMFLOAT3) * 2 + sizeof(XMFLOAT2) ), 1 );
+
+        m_positions.SetLimit( records * sizeof(XMFLOAT3), &m_spill );
+        m_normals.SetLimit( records * sizeof(XMFLOAT3), &m_spill );
+        m_texCoords.SetLimit( records * sizeof(XMFLOAT2), &m_spill );
+    }
+}
+
+HRESULT WaveFrontObj::BatchBuilder::Add( std::vector<Chunk>& chunks )
+{
+    for( auto chunk = chunks.begin(); chunk != chunks.end(); ++chunk )
+    {
+        HRESULT hr = m_positions.Append( chunk->positions.data(), chunk->positions.size() );
+        if ( SUCCEEDED(hr) )
+            hr = m_normals.Append( chunk->normals.data(), chunk->normals.size() );
+        if ( SUCCEEDED(hr) )
+            hr = m_texCoords.Append( chunk->texCoords.data(), chunk->texCoords.size() );
+        if ( FAILED(hr) )
+            return hr;
+
+        std::vector<XMFLOAT3>().swap( chunk->positions );
+        std::vector<XMFLOAT3>().swap( chunk->normals );
+        std::vector<XMFLOAT2>().swap( chunk->texCoords );
+    }
+
+    // Size the vertex cache for these faces up front instead of growing it by rehashing;
+    // there are rarely more distinct face vertices than either triangles or positions
+    size_t triangles = 0;
+    for( auto chunk = chunks.cbegin(); chunk != chunks.cend(); ++chunk )
+    {
+        for( auto it = chunk->polygonSizes.cbegin(); it != chunk->polygonSizes.cend(); ++it )
+        {
+            triangles += *it - 2;
+        }
+    }
+
+    m_triangles += triangles;
+
+    if ( m_target )
+    {
+        m_cache.Reserve( std::min( m_triangles, m_positions.size() ) );
+        m_target->indices.reserve( m_triangles * 3 );
+        m_target->attributes.reserve( m_triangles );
+    }
+    else
+    {
+        m_cache.Reserve( std::min( std::min( triangles, m_positions.size() ), m_maxVertices ) );
+    }
+
+    for( auto chunk = chunks.cbegin(); chunk != chunks.cend(); ++chunk )
+    {
+        if ( !chunk->materialLibrary.empty() )
+        {
+            m_materialLibrary = chunk->materialLibrary;
+        }
+
+        auto ref = chunk->materialRefs.cbegin();
+        const FaceVertex* fv = chunk->faceVertices.data();
+
+        for( size_t poly = 0; poly < chunk->polygonSizes.size(); ++poly )
+        {
+            for( ; ref != chunk->materialRefs.cend() && ref->polygon == poly; ++ref )
+            {
+                HRESULT hr = UseMaterial( ref->name );
+                if ( FAILED(hr) )
+                    return hr;
+            }
+
+            size_t iFace = chunk->polygonSizes[ poly ];
+
+            HRESULT hr = AddPolygon( fv, iFace );
+            if ( FAILED(hr) )
+                return hr;
+
+            fv += iFace;
+        }
+
+        for( ; ref != chunk->materialRefs.cend(); ++ref )
+        {
+            HRESULT hr = UseMaterial( ref->name );
+            if ( FAILED(hr) )
+                return hr;
+        }
+    }
+
+    return S_OK;
+}
+
+HRESULT WaveFrontObj::BatchBuilder::Finish()
+{
+    if ( m_target )
+        return S_OK;
+
+    if ( !m_indices.empty() || !m_materialEmitted )
+        return Flush();
+
+    return S_OK;
+}
+
+HRESULT WaveFrontObj::BatchBuilder::AddPolygon( const FaceVertex* faceVertices, size_t count )
+{
+    if ( !m_target && ( m_vertices.size() + count > m_maxVertices || m_indices.size() / 3 + count - 2 > m_maxTriangles ) )
+    {
+        HRESULT hr = Flush();
+        if ( FAILED(hr) )
+            return hr;
+    }
+
+    auto& vertices = m_target ? m_target->vertices : m_vertices;
+    auto& indices = m_target ? m_target->indices : m_indices;
+
+    if ( vertices.size() + count > UINT32_MAX )
+        return E_FAIL;
+
+    DWORD faceIndex[ MAX_POLY ];
+    for( size_t j = 0; j < count; ++j )
+    {
+        const FaceVertex& fv = faceVertices[ j ];
+
+        // If a duplicate vertex doesn't exist in this batch (or the target), add it
+        auto next = static_cast<uint32_t>( vertices.size() );
+        uint32_t index = m_cache.FindOrInsert( fv, next );
+        if ( index == next )
+        {
+            VertexPositionNormalTexture vertex;
+            memset( &vertex, 0, sizeof( vertex ) );
+
+            if ( fv.position > m_positions.size() )
+                return E_FAIL;
+
+            HRESULT hr = m_positions.Get( fv.position - 1, vertex.position );
+            if ( FAILED(hr) )
+                return hr;
+
+            if ( fv.texCoord )
+            {
+                if ( fv.texCoord > m_texCoords.size() )
+                    return E_FAIL;
+
+                hr = m_texCoords.Get( fv.texCoord - 1, vertex.textureCoordinate );
+                if ( FAILED(hr) )
+                    return hr;
+            }
+
+            if ( fv.normal )
+            {
+                if ( fv.normal > m_normals.size() )
+                    return E_FAIL;
+
+                hr = m_normals.Get( fv.normal - 1, vertex.normal );
+                if ( FAILED(hr) )
+                    return hr;
+            }
+
+            vertices.push_back( vertex );
+            if ( !m_target )
+                m_keys.push_back( fv );
+        }
+
+        faceIndex[ j ] = index;
+    }
+
+    // Convert polygons to triangles
+    DWORD i0 = faceIndex[0];
+    DWORD i1 = faceIndex[1];
+
+    for( size_t j = 2; j < count; ++ j )
+    {
+        DWORD index = faceIndex[ j ];
+        indices.push_back( static_cast<uint32_t>( i0 ) );
+        indices.push_back( static_cast<uint32_t>( i1 ) );
+        indices.push_back( static_cast<uint32_t>( index ) );
+
+        i1 = index;
+    }
+
+    if ( m_target )
+        m_target->attributes.insert( m_target->attributes.end(), count - 2, m_subset );
+
+    return S_OK;
+}
+
+HRESULT WaveFrontObj::BatchBuilder::UseMaterial( const std::wstring& name )
+{
+    if ( m_target )
+    {
+        m_subset = m_target->UseMaterial( name.c_str() );
+        return S_OK;
+    }
+
+    if ( !m_indices.empty() || !m_materialEmitted )
+    {
+        HRESULT hr = Flush();
+        if ( FAILED(hr) )
+            return hr;
+    }
+
+    m_material = name;
+    m_materialEmitted = false;
+    return S_OK;
+}
+
+HRESULT WaveFrontObj::BatchBuilder::Flush()
+{
+    OBJBatch batch;
+    batch.material = m_material.c_str();
+    batch.vertices = m_vertices.data();
+    batch.vertexKeys = m_keys.data();
+    batch.vertexCount = m_vertices.size();
+    batch.indices = m_indices.data();
+    batch.indexCount = m_indices.size();
+
+    HRESULT hr = m_callback( batch );
+
+    m_materialEmitted = true;
+    m_vertices.clear();
+    m_keys.clear();
+    m_indices.clear();
+    m_cache.Clear();
+
+    return hr;
+}
+
+void WaveFrontObj::BatchBuilder::GetStats( OBJStreamStats& stats ) const
+{
+    stats.peakPoolBytes = m_positions.PeakBytes() + m_normals.PeakBytes() + m_texCoords.PeakBytes();
+    stats.spilledBytes = m_spill.size();
+    stats.blockReads = m_positions.BlockReads() + m_normals.BlockReads() + m_texCoords.BlockReads();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WaveFrontObj::SpillFile::Write( _In_reads_bytes_(size) const void* data, size_t size, _Out_ uint64_t& offset )
+{
+    offset = 0;
+
+    if ( size > UINT32_MAX )
+        return E_INVALIDARG;
+
+    if ( !m_hFile )
+    {
+        wchar_t tempPath[ MAX_PATH ] = {};
+        wchar_t tempName[ MAX_PATH ] = {};
+        if ( !GetTempPathW( MAX_PATH, tempPath ) || !GetTempFileNameW( tempPath, L"obj", 0, tempName ) )
+            return HRESULT_FROM_WIN32( GetLastError() );
+
+        m_hFile.reset( safe_handle( CreateFileW( tempName, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                                                 FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr ) ) );
+        if ( !m_hFile )
+            return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    OVERLAPPED position = {};
+    position.Offset = static_cast<DWORD>( m_size );
+    position.OffsetHigh = static_cast<DWORD>( m_size >> 32 );
+
+    DWORD bytesWritten = 0;
+    if ( !WriteFile( m_hFile.get(), data, static_cast<DWORD>( size ), &bytesWritten, &position ) )
+        return HRESULT_FROM_WIN32( GetLastError() );
+
+    if ( bytesWritten != size )
+        return E_FAIL;
+
+    offset = m_size;
+    m_size += size;
+    return S_OK;
+}
+
+HRESULT WaveFrontObj::SpillFile::Read( uint64_t offset, _Out_writes_bytes_(size) void* data, size_t size )
+{
+    if ( !m_hFile || size > UINT32_MAX || offset > m_size || size > m_size - offset )
+        return E_UNEXPECTED;
+
+    OVERLAPPED position = {};
+    position.Offset = static_cast<DWORD>( offset );
+    position.OffsetHigh = static_cast<DWORD>( offset >> 32 );
+
+    DWORD bytesRead = 0;
+    if ( !ReadFile( m_hFile.get(), data, static_cast<DWORD>( size ), &bytesRead, &position ) )
+        return HRESULT_FROM_WIN32( GetLastError() );
+
+    if ( bytesRead != size )
+        return E_FAIL;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+template<class T> const size_t WaveFrontObj::RecordPool<T>::BLOCK_RECORDS;
+template<class T> const uint32_t WaveFrontObj::RecordPool<T>::NO_SLOT;
+template<class T> const uint64_t WaveFrontObj::RecordPool<T>::NOT_WRITTEN;
+
+template<class T>
+void WaveFrontObj::RecordPool<T>::SetLimit( size_t maxBytes, _In_ SpillFile* spill )
+{
+    m_maxSlots = ( maxBytes ) ? std::max<size_t>( maxBytes / ( BLOCK_RECORDS * sizeof(T) ), 2 ) : SIZE_MAX;
+    m_spill = spill;
+}
+
+template<class T>
+HRESULT WaveFrontObj::RecordPool<T>::Append( _In_reads_(count) const T* records, size_t count )
+{
+    while ( count > 0 )
+    {
+        size_t block = m_size / BLOCK_RECORDS;
+        size_t first = m_size % BLOCK_RECORDS;
+
+        if ( !first )
+        {
+            m_blockSlot.push_back( NO_SLOT );
+            m_blockOffset.push_back( NOT_WRITTEN );
+
+            uint32_t slot;
+            HRESULT hr = AcquireSlot( block, slot );
+            if ( FAILED(hr) )
+                return hr;
+        }
+
+        size_t n = std::min( count, BLOCK_RECORDS - first );
+        memcpy( &m_slots[ m_blockSlot[ block ] ][ first ], records, n * sizeof(T) );
+
+        m_size += n;
+        records += n;
+        count -= n;
+    }
+
+    return S_OK;
+}
+
+template<class T>
+HRESULT WaveFrontObj::RecordPool<T>::Get( size_t index, _Out_ T& record )
+{
+    size_t block = index / BLOCK_RECORDS;
+
+    uint32_t slot = m_blockSlot[ block ];
+    if ( slot == NO_SLOT )
+    {
+        // Only full blocks are evicted, and each was written out on its first eviction
+        HRESULT hr = AcquireSlot( block, slot );
+        if ( FAILED(hr) )
+            return hr;
+
+        hr = m_spill->Read( m_blockOffset[ block ], m_slots[ slot ].get(), BLOCK_RECORDS * sizeof(T) );
+        if ( FAILED(hr) )
+            return hr;
+
+        ++m_reads;
+    }
+
+    m_slotUse[ slot ] = ++m_tick;
+
+    record = m_slots[ slot ][ index % BLOCK_RECORDS ];
+    return S_OK;
+}
+
+template<class T>
+HRESULT WaveFrontObj::RecordPool<T>::AcquireSlot( size_t block, _Out_ uint32_t& slot )
+{
+    if ( m_slots.size() < m_maxSlots )
+    {
+        std::unique_ptr<T[]> data( new (std::nothrow) T[ BLOCK_RECORDS ] );
+        if ( !data )
+            return E_OUTOFMEMORY;
+
+        slot = static_cast<uint32_t>( m_slots.size() );
+
+        m_slots.emplace_back( std::move( data ) );
+        m_slotBlock.push_back( block );
+        m_slotUse.push_back( 0 );
+    }
+    else
+    {
+        // Least recently used slot, other than the one holding the last record
+        const size_t tail = ( m_size - 1 ) / BLOCK_RECORDS;
+
+        slot = NO_SLOT;
+        for( uint32_t j = 0; j < m_slots.size(); ++j )
+        {
+            if ( m_slotBlock[ j ] != tail && ( slot == NO_SLOT || m_slotUse[ j ] < m_slotUse[ slot ] ) )
+                slot = j;
+        }
+
+        size_t evicted = m_slotBlock[ slot ];
+        if ( m_blockOffset[ evicted ] == NOT_WRITTEN )
+        {
+            uint64_t offset;
+            HRESULT hr = m_spill->Write( m_slots[ slot ].get(), BLOCK_RECORDS * sizeof(T), offset );
+            if ( FAILED(hr) )
+                return hr;
+
+            m_blockOffset[ evicted ] = offset;
+        }
+
+        m_blockSlot[ evicted ] = NO_SLOT;
+        m_slotBlock[ slot ] = block;
+    }
+
+    m_blockSlot[ block ] = slot;
+    m_slotUse[ slot ] = ++m_tick;
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+uint32_t WaveFrontObj::UseMaterial( _In_z_ const wchar_t* strName )
+{
+    uint32_t id = strings.Intern( strName );
+    if ( id >= materialByName.size() )
+        materialByName.resize( strings.size(), UINT32_MAX );
+
+    uint32_t& index = materialByName[ id ];
+    if ( index == UINT32_MAX )
+    {
+        index = static_cast<uint32_t>( materials.size() );
+
+        Material mat;
+        mat.name = id;
+        materials.push_back( mat );
+    }
+
+    return index;
+}
+
+uint32_t WaveFrontObj::FindMaterial( _In_z_ const wchar_t* strName ) const
+{
+    uint32_t id = strings.Find( strName );
+    if ( id >= materialByName.size() )
+        return UINT32_MAX;
+
+    return materialByName[ id ];
+}
+
+
+//--------------------------------------------------------------------------------------
+// Original std::wifstream-based reader, kept as the reference for BenchmarkOBJ
+HRESULT WaveFrontObj::LoadStream( _In_z_ const wchar_t* szFileName )
+{
+    static const size_t MAX_POLY = 16;
+
+    std::wifstream InFile( szFileName );
+    if( !InFile )
+        return HRESULT_FROM_WIN32( ERROR_FILE_NOT_FOUND );
 
     std::vector<XMFLOAT3>   positions;
     std::vector<XMFLOAT3>   normals;
     std::vector<XMFLOAT2>   texCoords;
 
-    VertexCache  vertexCache;
+    StreamVertexCache  vertexCache;
 
-    Material defmat;
-    wcscpy_s( defmat.strName, L"default" );
-    materials.push_back( defmat );
+    UseMaterial( L"default" );
 
     uint32_t curSubset = 0;
 
@@ -359,12 +2251,6 @@ HRESULT WaveFrontObj::Load( _In_z_ const wchar_t* szFileName )
                 if ( index == (DWORD)-1 )
                    return E_OUTOFMEMORY;
 
-                if ( index >= 0xFFFF )
-                {
-                    // Too many indices for 16-bit IB!
-                    return E_FAIL;
-                }
-
                 faceIndex[ iFace ] = index;
                 ++iFace;
    
@@ -402,9 +2288,9 @@ HRESULT WaveFrontObj::Load( _In_z_ const wchar_t* szFileName )
             for( size_t j = 2; j < iFace; ++ j )
             {
                 DWORD index = faceIndex[ j ];
-                indices.push_back( static_cast<uint16_t>( i0 ) );
-                indices.push_back( static_cast<uint16_t>( i1 ) );
-                indices.push_back( static_cast<uint16_t>( index ) );
+                indices.push_back( static_cast<uint32_t>( i0 ) );
+                indices.push_back( static_cast<uint32_t>( i1 ) );
+                indices.push_back( static_cast<uint32_t>( index ) );
 
                 attributes.push_back( curSubset );
 
@@ -424,25 +2310,7 @@ HRESULT WaveFrontObj::Load( _In_z_ const wchar_t* szFileName )
             wchar_t strName[MAX_PATH] = {};
             InFile >> strName;
 
-            bool bFound = false;
-            uint32_t count = 0;
-            for( auto it = materials.cbegin(); it != materials.cend(); ++it, ++count )
-            {
-                if( 0 == wcscmp( it->strName, strName ) )
-                {
-                    bFound = true;
-                    curSubset = count;
-                    break;
-                }
-            }
-
-            if( !bFound )
-            {
-                Material mat;
-                curSubset = static_cast<uint32_t>( materials.size() );
-                wcscpy_s( mat.strName, MAX_PATH - 1, strName );
-                materials.push_back( mat );
-            }
+            curSubset = UseMaterial( strName );
         }
         else
         {
@@ -456,6 +2324,13 @@ HRESULT WaveFrontObj::Load( _In_z_ const wchar_t* szFileName )
     // Cleanup
     InFile.close();
 
+    return LoadMaterialLibrary( szFileName, strMaterialFilename );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WaveFrontObj::LoadMaterialLibrary( _In_z_ const wchar_t* szFileName, _In_z_ const wchar_t* strMaterialFilename )
+{
     // If an associated material file was found, read that in as well.
     if( *strMaterialFilename )
     {
@@ -473,6 +2348,8 @@ HRESULT WaveFrontObj::Load( _In_z_ const wchar_t* szFileName )
         HRESULT hr = LoadMTL( szPath );
         if ( FAILED(hr) )
             return hr;
+
+        materialLibrary = szPath;
     }
 
     return S_OK;
@@ -488,141 +2365,658 @@ HRESULT WaveFrontObj::LoadMTL( _In_z_ const wchar_t* szFileName )
 
     auto curMaterial = materials.end();
 
-    wchar_t strCommand[256] = {};
-    for( ;; )
+    wchar_t strCommand[256] = {};
+    for( ;; )
+    {
+        InFile >> strCommand;
+        if( !InFile )
+            break;
+
+        if( 0 == wcscmp( strCommand, L"newmtl" ) )
+        {
+            // Switching active materials
+            wchar_t strName[MAX_PATH] = {};
+            InFile >> strName;
+
+            uint32_t index = FindMaterial( strName );
+            curMaterial = ( index != UINT32_MAX ) ? ( materials.begin() + index ) : materials.end();
+        }
+
+        // The rest of the commands rely on an active material
+        if( curMaterial == materials.end() )
+            continue;
+
+        if( 0 == wcscmp( strCommand, L"#" ) )
+        {
+            // Comment
+        }
+        else if( 0 == wcscmp( strCommand, L"Ka" ) )
+        {
+            // Ambient color
+            float r, g, b;
+            InFile >> r >> g >> b;
+            curMaterial->vAmbient = XMFLOAT3( r, g, b );
+        }
+        else if( 0 == wcscmp( strCommand, L"Kd" ) )
+        {
+            // Diffuse color
+            float r, g, b;
+            InFile >> r >> g >> b;
+            curMaterial->vDiffuse = XMFLOAT3( r, g, b );
+        }
+        else if( 0 == wcscmp( strCommand, L"Ks" ) )
+        {
+            // Specular color
+            float r, g, b;
+            InFile >> r >> g >> b;
+            curMaterial->vSpecular = XMFLOAT3( r, g, b );
+        }
+        else if( 0 == wcscmp( strCommand, L"d" ) ||
+                 0 == wcscmp( strCommand, L"Tr" ) )
+        {
+            // Alpha
+            InFile >> curMaterial->fAlpha;
+        }
+        else if( 0 == wcscmp( strCommand, L"Ns" ) )
+        {
+            // Shininess
+            int nShininess;
+            InFile >> nShininess;
+            curMaterial->nShininess = nShininess;
+        }
+        else if( 0 == wcscmp( strCommand, L"illum" ) )
+        {
+            // Specular on/off
+            int illumination;
+            InFile >> illumination;
+            curMaterial->bSpecular = ( illumination == 2 );
+        }
+        else if( 0 == wcscmp( strCommand, L"map_Kd" ) )
+        {
+            // Texture
+            wchar_t strTexture[MAX_PATH] = {};
+            InFile >> strTexture;
+            curMaterial->texture = strings.Intern( strTexture );
+        }
+        else
+        {
+            // Unimplemented or unrecognized command
+        }
+
+        InFile.ignore( 1000, L'\n' );
+    }
+
+    InFile.close();
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+template<class Cache>
+DWORD WaveFrontObj::AddVertex( UINT hash, VertexPositionNormalTexture* pVertex, Cache& cache )
+{
+    auto f = cache.equal_range( hash );
+
+    for( auto it = f.first; it != f.second; ++it )
+    {
+        auto& tv = vertices[ it->second ];
+
+        if ( 0 == memcmp( pVertex, &tv, sizeof(VertexPositionNormalTexture) ) )
+        {
+            return it->second;
+        }
+    }
+
+    DWORD index = static_cast<UINT>( vertices.size() );
+    vertices.push_back( *pVertex );
+
+    typename Cache::value_type entry( hash, index );
+    cache.insert( entry );
+    return index;
+}
+
+
+//--------------------------------------------------------------------------------------
+static inline size_t HashFaceVertex( uint32_t position, uint32_t texCoord, uint32_t normal )
+{
+    uint64_t h = uint64_t( position ) * 0x9E3779B97F4A7C15ull;
+    h ^= uint64_t( texCoord ) * 0xC2B2AE3D27D4EB4Full;
+    h ^= uint64_t( normal ) * 0x165667B19E3779F9ull;
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ull;
+    h ^= h >> 32;
+    return static_cast<size_t>( h );
+}
+
+void WaveFrontObj::VertexCache::Reserve( size_t count )
+{
+    // Keep the load factor at or below 3/4
+    size_t capacity = 16;
+    while ( capacity * 3 < count * 4 )
+        capacity <<= 1;
+
+    if ( capacity > m_entries.size() )
+        Rehash( capacity );
+}
+
+uint32_t WaveFrontObj::VertexCache::FindOrInsert( const FaceVertex& key, uint32_t index )
+{
+    if ( ( m_count + 1 ) * 4 > m_entries.size() * 3 )
+        Rehash( std::max<size_t>( 16, m_entries.size() * 2 ) );
+
+    size_t mask = m_entries.size() - 1;
+    for( size_t slot = HashFaceVertex( key.position, key.texCoord, key.normal ) & mask; ; slot = ( slot + 1 ) & mask )
+    {
+        Entry& entry = m_entries[ slot ];
+
+        if ( !entry.key.position )
+        {
+            entry.key = key;
+            entry.index = index;
+            ++m_count;
+            return index;
+        }
+
+        if ( entry.key.position == key.position
+             && entry.key.texCoord == key.texCoord
+             && entry.key.normal == key.normal )
+        {
+            return entry.index;
+        }
+    }
+}
+
+void WaveFrontObj::VertexCache::Clear()
+{
+    if ( m_count )
+    {
+        std::fill( m_entries.begin(), m_entries.end(), Entry() );
+        m_count = 0;
+    }
+}
+
+void WaveFrontObj::VertexCache::Rehash( size_t capacity )
+{
+    assert( capacity && !( capacity & ( capacity - 1 ) ) );
+
+    std::vector<Entry> entries( capacity );
+
+    m_peakBytes = std::max( m_peakBytes, ( m_entries.size() + capacity ) * sizeof(Entry) );
+
+    size_t mask = capacity - 1;
+    for( auto it = m_entries.cbegin(); it != m_entries.cend(); ++it )
+    {
+        if ( !it->key.position )
+            continue;
+
+        size_t slot = HashFaceVertex( it->key.position, it->key.texCoord, it->key.normal ) & mask;
+        while ( entries[ slot ].key.position )
+            slot = ( slot + 1 ) & mask;
+
+        entries[ slot ] = *it;
+    }
+
+    m_entries.swap( entries );
+}
+
+
+//--------------------------------------------------------------------------------------
+static inline size_t HashString( _In_reads_(length) const wchar_t* str, size_t length )
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    for( size_t j = 0; j < length; ++j )
+    {
+        h = ( h ^ uint64_t( str[ j ] ) ) * 0x100000001B3ull;
+    }
+    h ^= h >> 32;
+    return static_cast<size_t>( h );
+}
+
+WaveFrontObj::StringTable::StringTable() :
+    m_chars( 1, L'\0' ),
+    m_offsets( 1, 0 ),
+    m_lengths( 1, 0 )
+{
+}
+
+size_t WaveFrontObj::StringTable::FindSlot( _In_z_ const wchar_t* str, size_t length ) const
+{
+    size_t mask = m_slots.size() - 1;
+    for( size_t slot = HashString( str, length ) & mask; ; slot = ( slot + 1 ) & mask )
+    {
+        uint32_t entry = m_slots[ slot ];
+        if ( !entry )
+            return slot;
+
+        // Compare lengths first, so wmemcmp never reads past a shorter stored string
+        if ( m_lengths[ entry - 1 ] == length && 0 == wmemcmp( &m_chars[ m_offsets[ entry - 1 ] ], str, length ) )
+            return slot;
+    }
+}
+
+uint32_t WaveFrontObj::StringTable::Intern( _In_z_ const wchar_t* str )
+{
+    size_t length = wcslen( str );
+    if ( !length )
+        return 0;
+
+    // Keep the load factor at or below 3/4
+    if ( m_offsets.size() * 4 > m_slots.size() * 3 )
+        Rehash( std::max<size_t>( 16, m_slots.size() * 2 ) );
+
+    size_t slot = FindSlot( str, length );
+    if ( m_slots[ slot ] )
+        return m_slots[ slot ] - 1;
+
+    auto id = static_cast<uint32_t>( m_offsets.size() );
+    m_offsets.push_back( static_cast<uint32_t>( m_chars.size() ) );
+    m_lengths.push_back( static_cast<uint32_t>( length ) );
+    m_chars.insert( m_chars.end(), str, str + length + 1 );
+    m_slots[ slot ] = id + 1;
+
+    return id;
+}
+
+uint32_t WaveFrontObj::StringTable::Find( _In_z_ const wchar_t* str ) const
+{
+    size_t length = wcslen( str );
+    if ( !length )
+        return 0;
+
+    if ( m_slots.empty() )
+        return UINT32_MAX;
+
+    uint32_t entry = m_slots[ FindSlot( str, length ) ];
+    return ( entry ) ? ( entry - 1 ) : UINT32_MAX;
+}
+
+void WaveFrontObj::StringTable::Rehash( size_t capacity )
+{
+    assert( capacity && !( capacity & ( capacity - 1 ) ) );
+
+    m_slots.assign( capacity, 0 );
+
+    size_t mask = capacity - 1;
+    for( uint32_t id = 1; id < m_offsets.size(); ++id )
+    {
+        size_t slot = HashString( &m_chars[ m_offsets[ id ] ], m_lengths[ id ] ) & mask;
+        while ( m_slots[ slot ] )
+            slot = ( slot + 1 ) & mask;
+
+        m_slots[ slot ] = id + 1;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Material IDs are small and dense, so a counting sort places every face directly in
+// its final slot. Faces keep their relative order within a material, as stable_sort did.
+void WaveFrontObj::SortByAttributes()
+{
+    if ( attributes.empty() || indices.empty() )
+        return;
+
+    assert( attributes.size()*3 == indices.size() );
+
+    if ( std::is_sorted( attributes.cbegin(), attributes.cend() ) )
+        return;
+
+    uint32_t maxAttribute = *std::max_element( attributes.cbegin(), attributes.cend() );
+
+    // offsets[ m + 1 ] counts the faces of material m, then becomes its first slot
+    std::vector<size_t> offsets( size_t( maxAttribute ) + 2, 0 );
+    for( auto it = attributes.cbegin(); it != attributes.cend(); ++it )
+    {
+        ++offsets[ *it + 1 ];
+    }
+
+    for( size_t m = 1; m < offsets.size(); ++m )
+    {
+        offsets[ m ] += offsets[ m - 1 ];
+    }
+
+    std::vector<uint32_t> sorted( indices.size() );
+
+    for( size_t i = 0; i < attributes.size(); ++i )
+    {
+        size_t dest = offsets[ attributes[ i ] ]++;
+        sorted[ dest*3 ] = indices[ i*3 ];
+        sorted[ dest*3 + 1 ] = indices[ i*3 + 1 ];
+        sorted[ dest*3 + 2 ] = indices[ i*3 + 2 ];
+    }
+
+    indices.swap( sorted );
+
+    // After the scatter offsets[ m ] is the end of material m's run
+    size_t begin = 0;
+    for( uint32_t m = 0; m <= maxAttribute; ++m )
+    {
+        std::fill( attributes.begin() + begin, attributes.begin() + offsets[ m ], m );
+        begin = offsets[ m ];
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Post-transform vertex cache optimization
+//
+// Triangles are reordered with Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+// (https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html): each vertex is
+// scored by its position in a simulated LRU cache and by how many of its triangles
+// remain, and the next triangle is the best scoring one touching the cache.
+//--------------------------------------------------------------------------------------
+namespace
+{
+    const int FORSYTH_CACHE_SIZE = 32;
+    const uint32_t FORSYTH_MAX_VALENCE = 64;
+
+    class ForsythScores
+    {
+    public:
+        ForsythScores()
+        {
+            // Vertices used by the last triangle get a fixed score so that the next
+            // triangle does not simply reuse the same three vertices
+            for( int j = 0; j < 3; ++j )
+            {
+                m_cache[ j ] = 0.75f;
+            }
+
+            for( int j = 3; j < FORSYTH_CACHE_SIZE; ++j )
+            {
+                float scaler = 1.0f - float( j - 3 ) / float( FORSYTH_CACHE_SIZE - 3 );
+                m_cache[ j ] = powf( scaler, 1.5f );
+            }
+
+            // Boost vertices with few triangles left, to clear out lone triangles
+            m_valence[ 0 ] = 0.f;
+            for( uint32_t j = 1; j <= FORSYTH_MAX_VALENCE; ++j )
+            {
+                m_valence[ j ] = 2.0f / sqrtf( float( j ) );
+            }
+        }
+
+        float Vertex( int cachePosition, uint32_t remaining ) const
+        {
+            if ( !remaining )
+                return -1.0f;
+
+            float score = m_valence[ std::min( remaining, FORSYTH_MAX_VALENCE ) ];
+            if ( cachePosition >= 0 )
+                score += m_cache[ cachePosition ];
+
+            return score;
+        }
+
+    private:
+        float m_cache[ FORSYTH_CACHE_SIZE ];
+        float m_valence[ FORSYTH_MAX_VALENCE + 1 ];
+    };
+
+    // Reorders 'ntriangles' triangles in place. 'remap' must hold one UINT32_MAX per
+    // vertex, and is restored before returning.
+    void OptimizeFacesForsyth( _Inout_updates_(ntriangles*3) uint32_t* indices, size_t ntriangles, std::vector<uint32_t>& remap )
     {
-        InFile >> strCommand;
-        if( !InFile )
-            break;
+        static const ForsythScores s_scores;
 
-        if( 0 == wcscmp( strCommand, L"newmtl" ) )
+        // Compact the vertices used by this range
+        std::vector<uint32_t> vertices;
+        std::vector<uint32_t> local( ntriangles * 3 );
+        for( size_t j = 0; j < ntriangles * 3; ++j )
         {
-            // Switching active materials
-            wchar_t strName[MAX_PATH] = {};
-            InFile >> strName;
-
-            curMaterial = materials.end();
-            for( auto it = materials.begin(); it != materials.end(); ++it )
+            uint32_t& slot = remap[ indices[ j ] ];
+            if ( slot == UINT32_MAX )
             {
-                if( 0 == wcscmp( it->strName, strName ) )
-                {
-                    curMaterial = it;
-                    break;
-                }
+                slot = static_cast<uint32_t>( vertices.size() );
+                vertices.push_back( indices[ j ] );
             }
+            local[ j ] = slot;
         }
 
-        // The rest of the commands rely on an active material
-        if( curMaterial == materials.end() )
-            continue;
-
-        if( 0 == wcscmp( strCommand, L"#" ) )
+        for( auto it = vertices.cbegin(); it != vertices.cend(); ++it )
         {
-            // Comment
+            remap[ *it ] = UINT32_MAX;
         }
-        else if( 0 == wcscmp( strCommand, L"Ka" ) )
+
+        const size_t nverts = vertices.size();
+
+        // Triangle adjacency per vertex; the first remaining[v] entries are still unused
+        std::vector<uint32_t> remaining( nverts, 0 );
+        for( auto it = local.cbegin(); it != local.cend(); ++it )
         {
-            // Ambient color
-            float r, g, b;
-            InFile >> r >> g >> b;
-            curMaterial->vAmbient = XMFLOAT3( r, g, b );
+            ++remaining[ *it ];
         }
-        else if( 0 == wcscmp( strCommand, L"Kd" ) )
+
+        std::vector<uint32_t> adjacencyOffset( nverts + 1, 0 );
+        for( size_t v = 0; v < nverts; ++v )
         {
-            // Diffuse color
-            float r, g, b;
-            InFile >> r >> g >> b;
-            curMaterial->vDiffuse = XMFLOAT3( r, g, b );
+            adjacencyOffset[ v + 1 ] = adjacencyOffset[ v ] + remaining[ v ];
         }
-        else if( 0 == wcscmp( strCommand, L"Ks" ) )
+
+        std::vector<uint32_t> adjacency( local.size() );
         {
-            // Specular color
-            float r, g, b;
-            InFile >> r >> g >> b;
-            curMaterial->vSpecular = XMFLOAT3( r, g, b );
+            std::vector<uint32_t> fill( adjacencyOffset.cbegin(), adjacencyOffset.cend() - 1 );
+            for( size_t j = 0; j < local.size(); ++j )
+            {
+                adjacency[ fill[ local[ j ] ]++ ] = static_cast<uint32_t>( j / 3 );
+            }
         }
-        else if( 0 == wcscmp( strCommand, L"d" ) ||
-                 0 == wcscmp( strCommand, L"Tr" ) )
+
+        std::vector<int> cachePosition( nverts, -1 );
+        std::vector<float> vertexScore( nverts );
+        for( size_t v = 0; v < nverts; ++v )
         {
-            // Alpha
-            InFile >> curMaterial->fAlpha;
+            vertexScore[ v ] = s_scores.Vertex( -1, remaining[ v ] );
         }
-        else if( 0 == wcscmp( strCommand, L"Ns" ) )
+
+        std::vector<float> triangleScore( ntriangles );
+        std::vector<bool> added( ntriangles, false );
+
+        size_t best = 0;
+        for( size_t t = 0; t < ntriangles; ++t )
         {
-            // Shininess
-            int nShininess;
-            InFile >> nShininess;
-            curMaterial->nShininess = nShininess;
+            triangleScore[ t ] = vertexScore[ local[ t*3 ] ] + vertexScore[ local[ t*3 + 1 ] ] + vertexScore[ local[ t*3 + 2 ] ];
+            if ( triangleScore[ t ] > triangleScore[ best ] )
+                best = t;
         }
-        else if( 0 == wcscmp( strCommand, L"illum" ) )
+
+        uint32_t cache[ FORSYTH_CACHE_SIZE + 3 ];
+        size_t cacheCount = 0;
+
+        std::vector<uint32_t> order;
+        order.reserve( ntriangles );
+
+        size_t nextUnadded = 0;
+
+        for( size_t count = 0; count < ntriangles; ++count )
         {
-            // Specular on/off
-            int illumination;
-            InFile >> illumination;
-            curMaterial->bSpecular = ( illumination == 2 );
+            if ( best == SIZE_MAX )
+            {
+                // Nothing in the cache has triangles left; continue from the next unused one
+                while ( added[ nextUnadded ] )
+                    ++nextUnadded;
+
+                best = nextUnadded;
+            }
+
+            added[ best ] = true;
+            order.push_back( static_cast<uint32_t>( best ) );
+
+            const uint32_t* tri = &local[ best*3 ];
+
+            for( size_t k = 0; k < 3; ++k )
+            {
+                uint32_t v = tri[ k ];
+                uint32_t* first = &adjacency[ adjacencyOffset[ v ] ];
+                uint32_t* last = first + remaining[ v ] - 1;
+                *std::find( first, last, static_cast<uint32_t>( best ) ) = *last;
+                --remaining[ v ];
+            }
+
+            // Move the triangle's vertices to the front of the LRU cache
+            uint32_t newCache[ FORSYTH_CACHE_SIZE + 3 ];
+            size_t newCount = 0;
+
+            for( size_t k = 0; k < 3; ++k )
+            {
+                newCache[ newCount++ ] = tri[ k ];
+            }
+
+            for( size_t k = 0; k < cacheCount; ++k )
+            {
+                uint32_t v = cache[ k ];
+                if ( v != tri[ 0 ] && v != tri[ 1 ] && v != tri[ 2 ] )
+                    newCache[ newCount++ ] = v;
+            }
+
+            for( size_t k = 0; k < newCount; ++k )
+            {
+                uint32_t v = newCache[ k ];
+                cachePosition[ v ] = ( k < FORSYTH_CACHE_SIZE ) ? static_cast<int>( k ) : -1;
+                vertexScore[ v ] = s_scores.Vertex( cachePosition[ v ], remaining[ v ] );
+            }
+
+            // Rescore the triangles whose vertices moved, and pick the best one in the cache
+            best = SIZE_MAX;
+            float bestScore = -1.0f;
+
+            for( size_t k = 0; k < newCount; ++k )
+            {
+                uint32_t v = newCache[ k ];
+                const uint32_t* adj = &adjacency[ adjacencyOffset[ v ] ];
+
+                for( uint32_t a = 0; a < remaining[ v ]; ++a )
+                {
+                    uint32_t t = adj[ a ];
+                    float score = vertexScore[ local[ t*3 ] ] + vertexScore[ local[ t*3 + 1 ] ] + vertexScore[ local[ t*3 + 2 ] ];
+                    triangleScore[ t ] = score;
+
+                    if ( k < FORSYTH_CACHE_SIZE && score > bestScore )
+                    {
+                        best = t;
+                        bestScore = score;
+                    }
+                }
+            }
+
+            cacheCount = std::min<size_t>( newCount, FORSYTH_CACHE_SIZE );
+            memcpy( cache, newCache, cacheCount * sizeof(uint32_t) );
         }
-        else if( 0 == wcscmp( strCommand, L"map_Kd" ) )
+
+        for( size_t t = 0; t < ntriangles; ++t )
         {
-            // Texture
-            InFile >> curMaterial->strTexture;
+            const uint32_t* tri = &local[ order[ t ] * 3 ];
+            indices[ t*3 ] = vertices[ tri[ 0 ] ];
+            indices[ t*3 + 1 ] = vertices[ tri[ 1 ] ];
+            indices[ t*3 + 2 ] = vertices[ tri[ 2 ] ];
         }
-        else
+    }
+}
+
+// Reorders the triangles of each material run for post-transform cache reuse;
+// call after SortByAttributes
+void WaveFrontObj::OptimizeFaces()
+{
+    if ( attributes.empty() || indices.empty() )
+        return;
+
+    assert( attributes.size()*3 == indices.size() );
+
+    std::vector<uint32_t> remap( vertices.size(), UINT32_MAX );
+
+    size_t start = 0;
+    for( size_t j = 1; j <= attributes.size(); ++j )
+    {
+        if ( j == attributes.size() || attributes[ j ] != attributes[ start ] )
         {
-            // Unimplemented or unrecognized command
+            OptimizeFacesForsyth( &indices[ start*3 ], j - start, remap );
+            start = j;
         }
+    }
+}
 
-        InFile.ignore( 1000, L'\n' );
+// Renumbers vertices in order of first use so vertex fetch walks the buffer
+// sequentially; unreferenced vertices move to the end
+void WaveFrontObj::OptimizeVertices()
+{
+    if ( vertices.empty() )
+        return;
+
+    std::vector<uint32_t> remap( vertices.size(), UINT32_MAX );
+    std::vector<VertexPositionNormalTexture> sorted;
+    sorted.reserve( vertices.size() );
+
+    for( auto it = indices.begin(); it != indices.end(); ++it )
+    {
+        uint32_t& slot = remap[ *it ];
+        if ( slot == UINT32_MAX )
+        {
+            slot = static_cast<uint32_t>( sorted.size() );
+            sorted.push_back( vertices[ *it ] );
+        }
+        *it = slot;
     }
 
-    InFile.close();
+    for( size_t v = 0; v < vertices.size(); ++v )
+    {
+        if ( remap[ v ] == UINT32_MAX )
+            sorted.push_back( vertices[ v ] );
+    }
 
-    return S_OK;
+    vertices.swap( sorted );
 }
 
-
 //--------------------------------------------------------------------------------------
-DWORD WaveFrontObj::AddVertex( UINT hash, VertexPositionNormalTexture* pVertex, VertexCache& cache )
+// Simulates a FIFO post-transform cache of 'cacheSize' entries and returns the average
+// cache miss ratio (transformed vertices per triangle, 0.5 is the ideal) and the average
+// transform to vertex ratio (1.0 is the ideal)
+static void ComputeVertexCacheMetrics( const std::vector<uint32_t>& indices, size_t vertexCount, size_t cacheSize, double& acmr, double& atvr )
 {
-    auto f = cache.equal_range( hash );
+    acmr = atvr = 0.0;
 
-    for( auto it = f.first; it != f.second; ++it )
-    {
-        auto& tv = vertices[ it->second ];
+    if ( indices.empty() || !vertexCount )
+        return;
 
-        if ( 0 == memcmp( pVertex, &tv, sizeof(VertexPositionNormalTexture) ) )
+    // A vertex is cached if fewer than cacheSize misses happened since it was loaded
+    std::vector<size_t> loadedAt( vertexCount, 0 );
+    std::vector<bool> used( vertexCount, false );
+    size_t misses = 0;
+    size_t unique = 0;
+
+    for( auto it = indices.cbegin(); it != indices.cend(); ++it )
+    {
+        if ( !used[ *it ] )
         {
-            return it->second;
+            used[ *it ] = true;
+            ++unique;
+        }
+        else if ( misses - loadedAt[ *it ] < cacheSize )
+        {
+            continue;
         }
-    }
 
-    DWORD index = static_cast<UINT>( vertices.size() );
-    vertices.push_back( *pVertex );
+        loadedAt[ *it ] = ++misses;
+    }
 
-    VertexCache::value_type entry( hash, index );
-    cache.insert( entry );
-    return index;
+    acmr = double( misses ) / double( indices.size() / 3 );
+    atvr = double( misses ) / double( unique );
 }
 
-
 //--------------------------------------------------------------------------------------
-void WaveFrontObj::SortByAttributes()
+// Original comparison-based SortByAttributes, kept as the benchmark reference
+static void StableSortByAttributes( std::vector<uint32_t>& attributes, std::vector<uint32_t>& indices )
 {
-    if ( attributes.empty() || indices.empty() )
-        return;
-
     struct Face
     {
         uint32_t attribute;
-        uint16_t a;
-        uint16_t b;
-        uint16_t c;
+        uint32_t a;
+        uint32_t b;
+        uint32_t c;
     };
 
     std::vector<Face> faces;
     faces.reserve( attributes.size() );
 
-    assert( attributes.size()*3 == indices.size() );
-
     for( size_t i = 0; i < attributes.size(); ++i )
     {
         Face f;
@@ -649,4 +3043,286 @@ void WaveFrontObj::SortByAttributes()
         indices.push_back( it->b );
         indices.push_back( it->c );
     }
-}
\ No newline at end of file
+}
+
+//--------------------------------------------------------------------------------------
+// Compares the de-indexed triangles, which do not depend on how vertices were de-duplicated
+static bool SameOutput( const WaveFrontObj& a, const WaveFrontObj& b )
+{
+    if ( a.indices.size() != b.indices.size()
+         || a.attributes != b.attributes
+         || a.materials.size() != b.materials.size() )
+        return false;
+
+    for( size_t j = 0; j < a.indices.size(); ++j )
+    {
+        if ( 0 != memcmp( &a.vertices[ a.indices[ j ] ], &b.vertices[ b.indices[ j ] ], sizeof(VertexPositionNormalTexture) ) )
+            return false;
+    }
+
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Times the memory-mapped reader (serial and parallel) against the original
+// std::wifstream reader and reports throughput to the debug output
+void BenchmarkOBJ( _In_z_ const wchar_t* szFileName, size_t iterations )
+{
+    MappedFile file;
+    if ( FAILED( file.Open( szFileName ) ) || !iterations )
+    {
+        BenchmarkTrace( "ERROR: BenchmarkOBJ could not open %ls\n", szFileName );
+        return;
+    }
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency( &freq );
+
+    auto timeLoad = [&]( std::function<HRESULT(WaveFrontObj&)> load, std::unique_ptr<WaveFrontObj>& obj ) -> double
+    {
+        LARGE_INTEGER start;
+        QueryPerformanceCounter( &start );
+
+        for( size_t j = 0; j < iterations; ++j )
+        {
+            obj.reset( new WaveFrontObj() );
+            if ( FAILED( load( *obj ) ) )
+                return -1.0;
+        }
+
+        LARGE_INTEGER stop;
+        QueryPerformanceCounter( &stop );
+
+        return double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+    };
+
+    std::unique_ptr<WaveFrontObj> reference;
+    double streamTime = timeLoad( [&]( WaveFrontObj& obj ) { return obj.LoadStream( szFileName ); }, reference );
+
+    std::unique_ptr<WaveFrontObj> mapped;
+    double mappedTime = timeLoad( [&]( WaveFrontObj& obj ) { return obj.Load( szFileName ); }, mapped );
+
+    std::unique_ptr<WaveFrontObj> parallel;
+    double parallelTime = timeLoad( [&]( WaveFrontObj& obj ) { return obj.Load( szFileName, true ); }, parallel );
+
+    if ( streamTime <= 0.0 || mappedTime <= 0.0 || parallelTime <= 0.0 )
+    {
+        BenchmarkTrace( "ERROR: BenchmarkOBJ failed loading %ls\n", szFileName );
+        return;
+    }
+
+    double megabytes = double( file.size() ) * double( iterations ) / ( 1024.0 * 1024.0 );
+
+    BenchmarkTrace( "OBJ %ls: %Iu bytes x %Iu iterations\n", szFileName, file.size(), iterations );
+    BenchmarkTrace( "    wifstream %8.2f MB/s\n", megabytes / streamTime );
+    BenchmarkTrace( "    mapped    %8.2f MB/s (%.1fx)\n", megabytes / mappedTime, streamTime / mappedTime );
+    BenchmarkTrace( "    parallel  %8.2f MB/s (%.1fx, %u threads)\n", megabytes / parallelTime, streamTime / parallelTime, std::thread::hardware_concurrency() );
+    BenchmarkTrace( "    outputs %s\n", ( SameOutput( *reference, *mapped ) && SameOutput( *mapped, *parallel ) ) ? "match" : "DIFFER" );
+
+    // Streaming through a bounded window, as used for files too large to load whole
+    {
+        OBJStreamOptions options;
+        options.windowSize = 16 * 1024 * 1024;
+
+        size_t batches = 0;
+        size_t triangles = 0;
+        size_t batchVertices = 0;
+
+        LARGE_INTEGER start, stop;
+        QueryPerformanceCounter( &start );
+
+        HRESULT hr = S_OK;
+        for( size_t j = 0; j < iterations && SUCCEEDED(hr); ++j )
+        {
+            batches = triangles = batchVertices = 0;
+            hr = StreamOBJ( szFileName, options, [&]( const OBJBatch& batch ) -> HRESULT
+            {
+                ++batches;
+                triangles += batch.indexCount / 3;
+                batchVertices += batch.vertexCount;
+                return S_OK;
+            } );
+        }
+
+        QueryPerformanceCounter( &stop );
+        double streamedTime = double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+
+        if ( SUCCEEDED(hr) )
+        {
+            BenchmarkTrace( "    streamed  %8.2f MB/s (%.1fx, %Iu KB window), %Iu batches, %Iu triangles, %Iu batch vertices\n",
+                            megabytes / streamedTime, streamTime / streamedTime, options.windowSize / 1024, batches, triangles, batchVertices );
+        }
+        else
+        {
+            BenchmarkTrace( "    streamed  failed (%08X)\n", hr );
+        }
+
+        // Again with the v/vt/vn records capped, holding the rest in a temporary file
+        OBJStreamStats unbounded = {};
+        OBJStreamStats bounded = {};
+
+        hr = StreamOBJ( szFileName, options, []( const OBJBatch& ) -> HRESULT { return S_OK; }, nullptr, &unbounded );
+
+        options.maxPoolBytes = 1024 * 1024;
+
+        QueryPerformanceCounter( &start );
+
+        for( size_t j = 0; j < iterations && SUCCEEDED(hr); ++j )
+        {
+            hr = StreamOBJ( szFileName, options, []( const OBJBatch& ) -> HRESULT { return S_OK; }, nullptr, &bounded );
+        }
+
+        QueryPerformanceCounter( &stop );
+        double boundedTime = double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+
+        if ( SUCCEEDED(hr) )
+        {
+            BenchmarkTrace( "    bounded   %8.2f MB/s (%.1fx), records peak %Iu KB (unbounded %Iu KB), %I64u KB spilled, %Iu blocks read back\n",
+                            megabytes / boundedTime, streamTime / boundedTime, bounded.peakPoolBytes / 1024, unbounded.peakPoolBytes / 1024,
+                            bounded.spilledBytes / 1024, bounded.blockReads );
+        }
+        else
+        {
+            BenchmarkTrace( "    bounded   failed (%08X)\n", hr );
+        }
+    }
+
+    // Attribute sort: stable_sort of a Face array vs. the counting sort
+    {
+        double stableTime = 0.0;
+        double countingTime = 0.0;
+        bool sortsMatch = true;
+
+        for( size_t j = 0; j < iterations; ++j )
+        {
+            std::vector<uint32_t> stableAttributes( mapped->attributes );
+            std::vector<uint32_t> stableIndices( mapped->indices );
+
+            WaveFrontObj sorted;
+            sorted.attributes = mapped->attributes;
+            sorted.indices = mapped->indices;
+
+            LARGE_INTEGER start, stop;
+            QueryPerformanceCounter( &start );
+            StableSortByAttributes( stableAttributes, stableIndices );
+            QueryPerformanceCounter( &stop );
+            stableTime += double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+
+            QueryPerformanceCounter( &start );
+            sorted.SortByAttributes();
+            QueryPerformanceCounter( &stop );
+            countingTime += double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+
+            sortsMatch = sortsMatch && ( stableAttributes == sorted.attributes ) && ( stableIndices == sorted.indices );
+        }
+
+        double faces = double( mapped->attributes.size() ) * double( iterations ) / 1000000.0;
+
+        BenchmarkTrace( "  attribute sort: %Iu faces, %Iu materials x %Iu iterations\n", mapped->attributes.size(), mapped->materials.size(), iterations );
+        BenchmarkTrace( "    stable_sort %8.2f M faces/s\n", faces / stableTime );
+        BenchmarkTrace( "    counting    %8.2f M faces/s (%.1fx), outputs %s\n", faces / countingTime, stableTime / countingTime, sortsMatch ? "match" : "DIFFER" );
+    }
+
+    // Vertex cache optimization, measured against a 16 entry FIFO
+    {
+        WaveFrontObj optimized;
+        optimized.vertices = mapped->vertices;
+        optimized.indices = mapped->indices;
+        optimized.attributes = mapped->attributes;
+        optimized.SortByAttributes();
+
+        double acmrBefore, atvrBefore;
+        ComputeVertexCacheMetrics( optimized.indices, optimized.vertices.size(), 16, acmrBefore, atvrBefore );
+
+        LARGE_INTEGER start, stop;
+        QueryPerformanceCounter( &start );
+        optimized.OptimizeFaces();
+        optimized.OptimizeVertices();
+        QueryPerformanceCounter( &stop );
+        double optimizeTime = double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+
+        double acmrAfter, atvrAfter;
+        ComputeVertexCacheMetrics( optimized.indices, optimized.vertices.size(), 16, acmrAfter, atvrAfter );
+
+        BenchmarkTrace( "  vertex cache optimization: %.1f ms\n", optimizeTime * 1000.0 );
+        BenchmarkTrace( "    file order ACMR %.3f ATVR %.3f\n", acmrBefore, atvrBefore );
+        BenchmarkTrace( "    optimized  ACMR %.3f ATVR %.3f\n", acmrAfter, atvrAfter );
+    }
+
+    // Vertex de-duplication alone: position-keyed std::unordered_multimap vs. VertexCache
+    WaveFrontObj::Chunk chunk;
+    if ( FAILED( WaveFrontObj::ParseChunk( file.data(), file.data() + file.size(), chunk ) ) || chunk.faceVertices.empty() )
+        return;
+
+    size_t ntriangles = 0;
+    for( auto it = chunk.polygonSizes.cbegin(); it != chunk.polygonSizes.cend(); ++it )
+    {
+        ntriangles += *it - 2;
+    }
+
+    // Indices were validated by the loads above
+    auto makeVertex = [&]( const WaveFrontObj::FaceVertex& fv ) -> VertexPositionNormalTexture
+    {
+        VertexPositionNormalTexture vertex;
+        memset( &vertex, 0, sizeof( vertex ) );
+        vertex.position = chunk.positions[ fv.position - 1 ];
+        if ( fv.texCoord )
+            vertex.textureCoordinate = chunk.texCoords[ fv.texCoord - 1 ];
+        if ( fv.normal )
+            vertex.normal = chunk.normals[ fv.normal - 1 ];
+        return vertex;
+    };
+
+    typedef CountingAllocator<std::pair<const UINT, UINT>> MultimapAllocator;
+    typedef std::unordered_multimap<UINT, UINT, std::hash<UINT>, std::equal_to<UINT>, MultimapAllocator> CountedStreamVertexCache;
+
+    size_t multimapCurrent = 0;
+    size_t multimapPeak = 0;
+    size_t flatPeak = 0;
+
+    LARGE_INTEGER start, stop;
+    QueryPerformanceCounter( &start );
+
+    for( size_t j = 0; j < iterations; ++j )
+    {
+        WaveFrontObj obj;
+        CountedStreamVertexCache cache( 0, std::hash<UINT>(), std::equal_to<UINT>(), MultimapAllocator( &multimapCurrent, &multimapPeak ) );
+
+        for( auto it = chunk.faceVertices.cbegin(); it != chunk.faceVertices.cend(); ++it )
+        {
+            VertexPositionNormalTexture vertex = makeVertex( *it );
+            obj.AddVertex( it->position, &vertex, cache );
+        }
+    }
+
+    QueryPerformanceCounter( &stop );
+    double multimapTime = double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+
+    QueryPerformanceCounter( &start );
+
+    for( size_t j = 0; j < iterations; ++j )
+    {
+        WaveFrontObj obj;
+        WaveFrontObj::VertexCache cache;
+        cache.Reserve( std::min( ntriangles, chunk.positions.size() ) );
+
+        for( auto it = chunk.faceVertices.cbegin(); it != chunk.faceVertices.cend(); ++it )
+        {
+            auto next = static_cast<uint32_t>( obj.vertices.size() );
+            if ( cache.FindOrInsert( *it, next ) == next )
+                obj.vertices.push_back( makeVertex( *it ) );
+        }
+
+        flatPeak = std::max( flatPeak, cache.PeakBytes() );
+    }
+
+    QueryPerformanceCounter( &stop );
+    double flatTime = double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+
+    double lookups = double( chunk.faceVertices.size() ) * double( iterations ) / 1000000.0;
+
+    BenchmarkTrace( "  vertex cache: %Iu face vertices x %Iu iterations\n", chunk.faceVertices.size(), iterations );
+    BenchmarkTrace( "    multimap  %8.2f M/s, peak %Iu KB\n", lookups / multimapTime, multimapPeak / 1024 );
+    BenchmarkTrace( "    flat      %8.2f M/s, peak %Iu KB (%.1fx)\n", lookups / flatTime, flatPeak / 1024, multimapTime / flatTime );
+}
@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------------------------
+// File: ModelLoadOBJ.h
+//
+// Code for loading a Model from a WaveFront OBJ file
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Effects.h"
+#include "Model.h"
+#include "VertexTypes.h"
+
+#include "ModelData.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+enum OBJ_LOADER_FLAGS
+{
+    OBJ_LOADER_DEFAULT  = 0x0,
+    OBJ_LOADER_PARALLEL = 0x1,  // Parse the file in line-aligned chunks on worker threads
+    OBJ_LOADER_CACHE    = 0x2,  // Load from <file>.objcache when current, otherwise write it after parsing
+    OBJ_LOADER_OPTIMIZE = 0x4,  // Reorder triangles and vertices for post-transform cache and fetch locality
+};
+
+std::unique_ptr<DirectX::Model> CreateModelFromOBJ( _In_ ID3D11Device* d3dDevice, _In_ ID3D11DeviceContext* context, _In_z_ const wchar_t* szFileName,
+                                                    _In_ DirectX::IEffectFactory& fxFactory, bool ccw = true, bool pmalpha = false,
+                                                    unsigned int loadFlags = OBJ_LOADER_DEFAULT, _In_opt_ InputLayoutCache* layoutCache = nullptr );
+
+// Parses the file (or reads the cache) into a ModelData; no device is used
+HRESULT LoadModelDataFromOBJ( _In_z_ const wchar_t* szFileName, ModelData& data, unsigned int loadFlags = OBJ_LOADER_DEFAULT );
+
+void BenchmarkOBJ( _In_z_ const wchar_t* szFileName, size_t iterations );
+
+
+//--------------------------------------------------------------------------------------
+// Streaming reader for OBJ files too large to hold as a single mesh
+//--------------------------------------------------------------------------------------
+
+// 1-based indices of a face vertex as written in the file; 0 marks an omitted element
+struct OBJVertexKey
+{
+    uint32_t position;
+    uint32_t texCoord;
+    uint32_t normal;
+};
+
+// Triangles of a single material, with vertices de-duplicated within the batch. The
+// pointers are only valid for the duration of the callback.
+struct OBJBatch
+{
+    const wchar_t*                                  material;
+    const DirectX::VertexPositionNormalTexture*     vertices;
+    const OBJVertexKey*                             vertexKeys;     // One per vertex, to merge vertices across batches
+    size_t                                          vertexCount;
+    const uint32_t*                                 indices;        // Into 'vertices'
+    size_t                                          indexCount;
+};
+
+struct OBJStreamOptions
+{
+    size_t  windowSize;         // Bytes of the file mapped at once; lines may not be longer
+    size_t  maxBatchVertices;
+    size_t  maxBatchTriangles;
+    size_t  maxPoolBytes;       // v/vt/vn records held in memory before older ones spill to a temporary file; 0 holds them all
+    bool    parallel;           // Parse each window on worker threads
+
+    OBJStreamOptions() :
+        windowSize( 64 * 1024 * 1024 ),
+        maxBatchVertices( 0xFFFF ),
+        maxBatchTriangles( 0x10000 ),
+        maxPoolBytes( 0 ),
+        parallel( false ) {}
+};
+
+struct OBJStreamStats
+{
+    size_t      peakPoolBytes;      // Most v/vt/vn record memory held at once
+    uint64_t    spilledBytes;       // Written to the temporary file
+    size_t      blockReads;         // Spilled blocks read back for faces that refer to them
+};
+
+// Returning a failure code from the callback stops the stream and is passed through
+typedef std::function<HRESULT( const OBJBatch& batch )> OBJBatchCallback;
+
+// Calls 'callback' with batches in file order. Faces may only use vertex data from earlier
+// in the file or from the same window. 'materialLibrary' receives the mtllib name, if any.
+// With options.maxPoolBytes set, memory use no longer grows with the vertex count: records
+// past the limit are kept in a temporary file, which suits files whose faces mostly refer
+// to recent vertices.
+HRESULT StreamOBJ( _In_z_ const wchar_t* szFileName, const OBJStreamOptions& options, const OBJBatchCallback& callback,
+                   _Out_opt_ std::wstring* materialLibrary = nullptr, _Out_opt_ OBJStreamStats* stats = nullptr );
@@ -0,0 +1,382 @@
+//--------------------------------------------------------------------------------------
+// File: ModelLoadSDKMESH.cpp
+//
+// Memory-mapped loading of DirectX SDK Mesh files
+//
+// Model::CreateFromSDKMESH( device, szFileName, ... ) reads the whole file into a heap
+// buffer before slicing out the vertex and index data. Mapping the file and using the
+// in-memory overload instead lets buffer creation read straight from the file's pages.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "Effects.h"
+#include "Model.h"
+
+#include "MappedFile.h"
+#include "ModelData.h"
+#include "ModelLoadSDKMESH.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include <stdio.h>
+
+#include "PlatformHelpers.h"
+
+using namespace DirectX;
+using namespace SDKMESH;
+
+//--------------------------------------------------------------------------------------
+namespace
+{
+    enum VERTEX_FORMAT_FLAGS
+    {
+        VF_PER_VERTEX_COLOR = 0x1,
+        VF_SKINNING         = 0x2,
+        VF_DUAL_TEXTURE     = 0x4,
+    };
+}
+
+// Converts a Direct3D 9 vertex declaration to Direct3D 11 input elements
+static HRESULT GetInputLayoutDesc( const SDKMESH_VERTEX_BUFFER_HEADER& vh, std::vector<D3D11_INPUT_ELEMENT_DESC>& inputDesc, uint32_t& flags )
+{
+    inputDesc.clear();
+    flags = 0;
+
+    for( size_t j = 0; j < MAX_VERTEX_ELEMENTS; ++j )
+    {
+        auto& element = vh.Decl[ j ];
+
+        if ( element.Stream == 0xFF || element.Type == D3DDECLTYPE_UNUSED )
+            break;
+
+        // Multiple vertex streams are not supported
+        if ( element.Stream != 0 || element.Offset >= vh.StrideBytes )
+            return E_FAIL;
+
+        D3D11_INPUT_ELEMENT_DESC desc = { nullptr, element.UsageIndex, DXGI_FORMAT_UNKNOWN, 0, element.Offset, D3D11_INPUT_PER_VERTEX_DATA, 0 };
+
+        switch( element.Usage )
+        {
+        case D3DDECLUSAGE_POSITION:     desc.SemanticName = "SV_Position"; break;
+        case D3DDECLUSAGE_NORMAL:       desc.SemanticName = "NORMAL"; break;
+        case D3DDECLUSAGE_TANGENT:      desc.SemanticName = "TANGENT"; break;
+        case D3DDECLUSAGE_BINORMAL:     desc.SemanticName = "BINORMAL"; break;
+
+        case D3DDECLUSAGE_TEXCOORD:
+            desc.SemanticName = "TEXCOORD";
+            if ( element.UsageIndex == 1 )
+                flags |= VF_DUAL_TEXTURE;
+            break;
+
+        case D3DDECLUSAGE_COLOR:
+            desc.SemanticName = "COLOR";
+            flags |= VF_PER_VERTEX_COLOR;
+            break;
+
+        case D3DDECLUSAGE_BLENDINDICES:
+            desc.SemanticName = "BLENDINDICES";
+            flags |= VF_SKINNING;
+            break;
+
+        case D3DDECLUSAGE_BLENDWEIGHT:
+            desc.SemanticName = "BLENDWEIGHT";
+            flags |= VF_SKINNING;
+            break;
+
+        default:
+            return E_FAIL;
+        }
+
+        switch( element.Type )
+        {
+        case D3DDECLTYPE_FLOAT1:    desc.Format = DXGI_FORMAT_R32_FLOAT; break;
+        case D3DDECLTYPE_FLOAT2:    desc.Format = DXGI_FORMAT_R32G32_FLOAT; break;
+        case D3DDECLTYPE_FLOAT3:    desc.Format = DXGI_FORMAT_R32G32B32_FLOAT; break;
+        case D3DDECLTYPE_FLOAT4:    desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT; break;
+        case D3DDECLTYPE_D3DCOLOR:  desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM; break;
+        case D3DDECLTYPE_UBYTE4:    desc.Format = DXGI_FORMAT_R8G8B8A8_UINT; break;
+        case D3DDECLTYPE_SHORT2:    desc.Format = DXGI_FORMAT_R16G16_SINT; break;
+        case D3DDECLTYPE_SHORT4:    desc.Format = DXGI_FORMAT_R16G16B16A16_SINT; break;
+        case D3DDECLTYPE_UBYTE4N:   desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; break;
+        case D3DDECLTYPE_SHORT2N:   desc.Format = DXGI_FORMAT_R16G16_SNORM; break;
+        case D3DDECLTYPE_SHORT4N:   desc.Format = DXGI_FORMAT_R16G16B16A16_SNORM; break;
+        case D3DDECLTYPE_USHORT2N:  desc.Format = DXGI_FORMAT_R16G16_UNORM; break;
+        case D3DDECLTYPE_USHORT4N:  desc.Format = DXGI_FORMAT_R16G16B16A16_UNORM; break;
+        case D3DDECLTYPE_UDEC3:     desc.Format = DXGI_FORMAT_R10G10B10A2_UINT; break;
+        case D3DDECLTYPE_DEC3N:     desc.Format = DXGI_FORMAT_R10G10B10A2_UNORM; break;
+        case D3DDECLTYPE_FLOAT16_2: desc.Format = DXGI_FORMAT_R16G16_FLOAT; break;
+        case D3DDECLTYPE_FLOAT16_4: desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT; break;
+        default:                    return E_FAIL;
+        }
+
+        inputDesc.push_back( desc );
+    }
+
+    return inputDesc.empty() ? E_FAIL : S_OK;
+}
+
+static bool GetPrimitiveType( UINT primitiveType, D3D11_PRIMITIVE_TOPOLOGY& topology )
+{
+    switch( primitiveType )
+    {
+    case PT_TRIANGLE_LIST:      topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST; return true;
+    case PT_TRIANGLE_STRIP:     topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP; return true;
+    case PT_LINE_LIST:          topology = D3D11_PRIMITIVE_TOPOLOGY_LINELIST; return true;
+    case PT_LINE_STRIP:         topology = D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP; return true;
+    case PT_POINT_LIST:         topology = D3D11_PRIMITIVE_TOPOLOGY_POINTLIST; return true;
+    case PT_TRIANGLE_LIST_ADJ:  topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST_ADJ; return true;
+    case PT_TRIANGLE_STRIP_ADJ: topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP_ADJ; return true;
+    case PT_LINE_LIST_ADJ:      topology = D3D11_PRIMITIVE_TOPOLOGY_LINELIST_ADJ; return true;
+    case PT_LINE_STRIP_ADJ:     topology = D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP_ADJ; return true;
+
+    default:
+        // Patch lists need tessellation shaders, which the built-in effects do not have
+        return false;
+    }
+}
+
+// Names in the file are fixed-size ANSI fields that may fill the whole field
+static std::wstring GetName( _In_reads_(maxLength) const char* name, size_t maxLength )
+{
+    size_t length = strnlen( name, maxLength );
+    if ( !length )
+        return std::wstring();
+
+    wchar_t buff[ MAX_MATERIAL_PATH ] = {};
+    int result = MultiByteToWideChar( CP_ACP, 0, name, static_cast<int>( length ), buff, static_cast<int>( _countof( buff ) ) );
+    if ( result <= 0 )
+        return std::wstring();
+
+    return std::wstring( buff, static_cast<size_t>( result ) );
+}
+
+static void LoadMaterial( const SDKMESH_MATERIAL& mh, uint32_t flags, ModelDataMaterial& mat )
+{
+    mat.name = GetName( mh.Name, MAX_MATERIAL_NAME );
+    mat.perVertexColor = ( flags & VF_PER_VERTEX_COLOR ) != 0;
+    mat.enableSkinning = ( flags & VF_SKINNING ) != 0;
+    mat.enableDualTexture = ( flags & VF_DUAL_TEXTURE ) != 0;
+
+    mat.ambientColor = XMFLOAT3( mh.Ambient.x, mh.Ambient.y, mh.Ambient.z );
+    mat.diffuseColor = XMFLOAT3( mh.Diffuse.x, mh.Diffuse.y, mh.Diffuse.z );
+    mat.emissiveColor = XMFLOAT3( mh.Emissive.x, mh.Emissive.y, mh.Emissive.z );
+
+    // Exporters write 0 as well as 1 for opaque materials
+    mat.alpha = ( mh.Diffuse.w != 1.f && mh.Diffuse.w != 0.f ) ? mh.Diffuse.w : 1.f;
+
+    if ( mh.Power )
+    {
+        mat.specularPower = mh.Power;
+        mat.specularColor = XMFLOAT3( mh.Specular.x, mh.Specular.y, mh.Specular.z );
+    }
+
+    mat.texture = GetName( mh.DiffuseTexture, MAX_TEXTURE_NAME );
+
+    // Dual-texture (lightmapped) content keeps the second texture in the specular slot
+    if ( mat.enableDualTexture )
+        mat.texture2 = GetName( mh.SpecularTexture, MAX_TEXTURE_NAME );
+}
+
+static HRESULT ParseSDKMESH( ModelData& data )
+{
+    if ( !ValidateSDKMESH( data.blob.data(), data.blob.size() ) )
+        return E_FAIL;
+
+    auto meshData = data.blob.data();
+    auto header = reinterpret_cast<const SDKMESH_HEADER*>( meshData );
+
+    auto vbArray = reinterpret_cast<const SDKMESH_VERTEX_BUFFER_HEADER*>( meshData + header->VertexStreamHeadersOffset );
+    auto ibArray = reinterpret_cast<const SDKMESH_INDEX_BUFFER_HEADER*>( meshData + header->IndexStreamHeadersOffset );
+    auto meshArray = reinterpret_cast<const SDKMESH_MESH*>( meshData + header->MeshDataOffset );
+    auto subsetArray = reinterpret_cast<const SDKMESH_SUBSET*>( meshData + header->SubsetDataOffset );
+    auto frameArray = reinterpret_cast<const SDKMESH_FRAME*>( meshData + header->FrameDataOffset );
+    auto materialArray = reinterpret_cast<const SDKMESH_MATERIAL*>( meshData + header->MaterialDataOffset );
+
+    // Vertex buffers
+    std::vector<uint32_t> vbFlags( header->NumVertexBuffers );
+
+    data.vertexBuffers.reserve( header->NumVertexBuffers );
+    for( UINT j = 0; j < header->NumVertexBuffers; ++j )
+    {
+        auto& vh = vbArray[ j ];
+
+        if ( vh.NumVertices > UINT32_MAX || vh.StrideBytes > UINT32_MAX )
+            return E_FAIL;
+
+        ModelDataVertexBuffer vb;
+        vb.offset = static_cast<size_t>( vh.DataOffset );
+        vb.sizeBytes = static_cast<size_t>( vh.SizeBytes );
+        vb.stride = static_cast<uint32_t>( vh.StrideBytes );
+        vb.vertexCount = static_cast<uint32_t>( vh.NumVertices );
+        vb.vbDecl = std::make_shared<std::vector<D3D11_INPUT_ELEMENT_DESC>>();
+
+        HRESULT hr = GetInputLayoutDesc( vh, *vb.vbDecl, vbFlags[ j ] );
+        if ( FAILED(hr) )
+            return hr;
+
+        data.vertexBuffers.push_back( vb );
+    }
+
+    // Index buffers
+    data.indexBuffers.reserve( header->NumIndexBuffers );
+    for( UINT j = 0; j < header->NumIndexBuffers; ++j )
+    {
+        auto& ih = ibArray[ j ];
+
+        if ( ih.NumIndices > UINT32_MAX )
+            return E_FAIL;
+
+        ModelDataIndexBuffer ib;
+        ib.offset = static_cast<size_t>( ih.DataOffset );
+        ib.sizeBytes = static_cast<size_t>( ih.SizeBytes );
+        ib.indexCount = static_cast<uint32_t>( ih.NumIndices );
+        ib.indexFormat = ( ih.IndexType == IT_32BIT ) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+
+        data.indexBuffers.push_back( ib );
+    }
+
+    // One material for each SDKMESH material and vertex format used with it
+    std::vector<std::pair<UINT, uint32_t>> materialKeys;
+
+    auto findMaterial = [&]( UINT materialID, uint32_t flags ) -> uint32_t
+    {
+        auto key = std::make_pair( materialID, flags );
+
+        auto it = std::find( materialKeys.cbegin(), materialKeys.cend(), key );
+        if ( it != materialKeys.cend() )
+            return static_cast<uint32_t>( it - materialKeys.cbegin() );
+
+        ModelDataMaterial mat;
+        if ( materialID < header->NumMaterials )
+        {
+            LoadMaterial( materialArray[ materialID ], flags, mat );
+        }
+        else
+        {
+            // Files without materials
+            mat.diffuseColor = XMFLOAT3( 1.f, 1.f, 1.f );
+        }
+
+        materialKeys.push_back( key );
+        data.materials.emplace_back( std::move( mat ) );
+        return static_cast<uint32_t>( data.materials.size() - 1 );
+    };
+
+    // Meshes
+    data.meshes.resize( header->NumMeshes );
+    for( UINT j = 0; j < header->NumMeshes; ++j )
+    {
+        auto& mh = meshArray[ j ];
+        auto& mesh = data.meshes[ j ];
+
+        mesh.name = GetName( mh.Name, MAX_MESH_NAME );
+        mesh.boundingBox.Center = mh.BoundingBoxCenter;
+        mesh.boundingBox.Extents = mh.BoundingBoxExtents;
+        BoundingSphere::CreateFromBoundingBox( mesh.boundingSphere, mesh.boundingBox );
+
+        if ( mh.NumFrameInfluences )
+        {
+            auto influences = reinterpret_cast<const UINT*>( meshData + mh.FrameInfluenceOffset );
+            for( UINT k = 0; k < mh.NumFrameInfluences; ++k )
+            {
+                if ( influences[ k ] >= header->NumFrames )
+                    return E_FAIL;
+            }
+
+            mesh.boneInfluences.assign( influences, influences + mh.NumFrameInfluences );
+        }
+
+        // Only the first vertex stream is used; some exporters fill NumVertexBuffers with
+        // other values (TankScene.sdkmesh counts up per mesh) while writing a single stream
+        const UINT vbIndex = mh.VertexBuffers[ 0 ];
+
+        auto subsets = reinterpret_cast<const UINT*>( meshData + mh.SubsetOffset );
+
+        mesh.parts.reserve( mh.NumSubsets );
+        for( UINT k = 0; k < mh.NumSubsets; ++k )
+        {
+            auto& subset = subsetArray[ subsets[ k ] ];
+
+            if ( subset.IndexStart > UINT32_MAX || subset.IndexCount > UINT32_MAX || subset.VertexStart > UINT32_MAX )
+                return E_FAIL;
+
+            ModelDataPart part;
+            if ( !GetPrimitiveType( subset.PrimitiveType, part.primitiveType ) )
+                return E_FAIL;
+
+            part.vertexBuffer = vbIndex;
+            part.indexBuffer = mh.IndexBuffer;
+            part.material = findMaterial( header->NumMaterials ? subset.MaterialID : UINT( -1 ), vbFlags[ vbIndex ] );
+            part.startIndex = static_cast<uint32_t>( subset.IndexStart );
+            part.indexCount = static_cast<uint32_t>( subset.IndexCount );
+            part.vertexOffset = static_cast<uint32_t>( subset.VertexStart );
+            part.isAlpha = ( data.materials[ part.material ].alpha < 1.f );
+
+            mesh.parts.push_back( part );
+        }
+    }
+
+    // Frames
+    data.bones.resize( header->NumFrames );
+    for( UINT j = 0; j < header->NumFrames; ++j )
+    {
+        auto& frame = frameArray[ j ];
+        auto& bone = data.bones[ j ];
+
+        bone.name = GetName( frame.Name, MAX_FRAME_NAME );
+        bone.parentIndex = ( frame.ParentFrame == INVALID_FRAME ) ? ModelDataBone::NO_PARENT : frame.ParentFrame;
+        bone.localTransform = frame.Matrix;
+        XMStoreFloat4x4( &bone.invBindPose, XMMatrixIdentity() );
+    }
+
+    return S_OK;
+}
+
+HRESULT LoadModelDataFromSDKMESH( _In_z_ const wchar_t* szFileName, ModelData& data )
+{
+    HRESULT hr = ReadModelDataFile( szFileName, data );
+    if ( FAILED(hr) )
+        return hr;
+
+    return ParseSDKMESH( data );
+}
+
+HRESULT LoadModelDataFromSDKMESH( _In_reads_bytes_(dataSize) const uint8_t* meshData, size_t dataSize, ModelData& data )
+{
+    data.Clear();
+    data.blob.assign( meshData, meshData + dataSize );
+
+    return ParseSDKMESH( data );
+}
+
+
+//--------------------------------------------------------------------------------------
+std::unique_ptr<Model> CreateModelFromSDKMESHMapped( _In_ ID3D11Device* d3dDevice, _In_z_ const wchar_t* szFileName, _In_ IEffectFactory& fxFactory, bool ccw, bool pmalpha )
+{
+    MappedFile file;
+    if ( FAILED( file.Open( szFileName ) ) )
+        throw std::exception("Failed opening SDKMESH file");
+
+    auto meshData = reinterpret_cast<const uint8_t*>( file.data() );
+
+    if ( !ValidateSDKMESH( meshData, file.size() ) )
+        throw std::exception("Invalid SDKMESH file");
+
+    auto model = Model::CreateFromSDKMESH( d3dDevice, meshData, file.size(), fxFactory, ccw, pmalpha );
+
+    model->name = szFileName;
+
+    return model;
+}
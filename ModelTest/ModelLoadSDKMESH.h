@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// File: ModelLoadSDKMESH.h
+//
+// Memory-mapped loading of DirectX SDK Mesh files; the validator and benchmark that
+// build without Windows are in SDKMESHValidate.h
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Effects.h"
+#include "Model.h"
+
+#include "ModelData.h"
+#include "SDKMESHValidate.h"
+
+#include <memory>
+
+// Validates and parses an SDKMESH into a ModelData; no device is used
+HRESULT LoadModelDataFromSDKMESH( _In_z_ const wchar_t* szFileName, ModelData& data );
+HRESULT LoadModelDataFromSDKMESH( _In_reads_bytes_(dataSize) const uint8_t* meshData, size_t dataSize, ModelData& data );
+
+// Maps the file and creates the model straight from the mapping, so vertex and index
+// data go from the file's pages to the buffers without a heap copy of the file
+std::unique_ptr<DirectX::Model> CreateModelFromSDKMESHMapped( _In_ ID3D11Device* d3dDevice, _In_z_ const wchar_t* szFileName,
+                                                              _In_ DirectX::IEffectFactory& fxFactory, bool ccw = false, bool pmalpha = false );
@@ -21,6 +21,20 @@
 #include "DDSTextureLoader.h"
 #include "ScreenGrab.h"
 
+#include "AsyncTextureFactory.h"
+#include "EffectCache.h"
+#include "InstancedModel.h"
+#include "LODModel.h"
+#include "ModelBatchLoader.h"
+#include "ModelCuller.h"
+#include "ModelLoadOBJ.h"
+#include "ModelLoadSDKMESH.h"
+#include "ParallelRecorder.h"
+#include "RenderQueue.h"
+#include "SharedEffectFactory.h"
+#include "SkinnedVertexCache.h"
+
+#include <stdio.h>
 #include <wincodec.h>
 
 using namespace DirectX;
@@ -30,10 +44,37 @@ using Microsoft::WRL::ComPtr;
 // Build for LH vs. RH coords
 #define LH_COORDS
 
-struct aligned_deleter { void operator()(void* p) { _aligned_free(p); } };
+// Run the CPU-side loader benchmarks at startup (results go to the debug output)
+//#define BENCHMARK_LOADERS
+
+// Load the CMO and SDKMESH models into shared vertex and index buffers
+//#define USE_GEOMETRY_POOL
+
+// Share effects with equal materials across every model, and input layouts with equal formats and shaders
+//#define USE_EFFECT_CACHE
+
+// Create model effects with default.dds in place of their textures, which load on a background thread
+//#define USE_ASYNC_TEXTURES
+
+// Draw the models that are drawn once per frame through a sorted render queue
+//#define USE_RENDER_QUEUE
+
+// Draw a row of cups with one instanced draw per part
+//#define USE_INSTANCING
+
+// Draw a receding row of teapots, each at a level of detail picked by its size on screen
+//#define USE_LOD
+
+// Skip the meshes of the models drawn once per frame that are outside the view or behind the level
+//#define USE_CULLING
 
-extern std::unique_ptr<Model> CreateModelFromOBJ( _In_ ID3D11Device* d3dDevice, _In_ ID3D11DeviceContext* context, _In_z_ const wchar_t* szFileName,
-                                                  _In_ IEffectFactory& fxFactory, bool ccw = true, bool pmalpha = false );
+// Record the level's draws on deferred contexts from one thread per core
+//#define USE_DEFERRED_CONTEXTS
+
+// Skin a CPU-side copy of the soldier with the palette it is drawn with, and report its skinned bounds
+//#define USE_CPU_SKINNING
+
+struct aligned_deleter { void operator()(void* p) { _aligned_free(p); } };
 
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
@@ -147,7 +188,25 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
     if (FAILED(CreateDDSTextureFromFile(device.Get(), L"cubemap.dds", nullptr, cubeMap.GetAddressOf())))
         MessageBox(hwnd, L"Error loading cubemap.dds", L"ModelTest", MB_ICONERROR);
 
-    EffectFactory fx(device.Get());
+    EffectFactory baseFx(device.Get());
+    IEffectFactory* fxChain = &baseFx;
+
+#ifdef USE_ASYNC_TEXTURES
+    AsyncTextureFactory asyncFx(device.Get(), *fxChain, L"default.dds");
+    fxChain = &asyncFx;
+#endif
+
+#ifdef USE_EFFECT_CACHE
+    CachingEffectFactory cachedFx(*fxChain);
+    fxChain = &cachedFx;
+
+    InputLayoutCache layoutCache;
+    InputLayoutCache* layouts = &layoutCache;
+#else
+    InputLayoutCache* layouts = nullptr;
+#endif
+
+    IEffectFactory& fx = *fxChain;
 
 #ifdef LH_COORDS
     bool ccw = false;
@@ -165,7 +224,25 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
     }
 
     // Wavefront OBJ
-    auto cup = CreateModelFromOBJ( device.Get(), context.Get(), L"cup._obj", fx, !ccw );
+    auto cup = CreateModelFromOBJ( device.Get(), context.Get(), L"cup._obj", fx, !ccw, false, OBJ_LOADER_DEFAULT, layouts );
+
+#ifdef BENCHMARK_LOADERS
+    BenchmarkOBJ( L"cup._obj", 100 );
+#endif
+
+#ifdef USE_INSTANCING
+    const size_t cupInstanceCount = 12;
+
+    ModelData cupData;
+    if (FAILED(LoadModelDataFromOBJ( L"cup._obj", cupData )))
+        MessageBox(hwnd, L"Error loading cup._obj", L"ModelTest", MB_ICONERROR);
+
+    auto cupModel = CreateModelFromData( device.Get(), cupData, fx, !ccw, false, nullptr, nullptr, layouts );
+    InstancedModel cupInstances( device.Get(), *cupModel, cupData, fx );
+
+    std::unique_ptr<XMMATRIX[], aligned_deleter> cupWorlds(
+        reinterpret_cast<XMMATRIX*>( _aligned_malloc( sizeof(XMMATRIX) * cupInstanceCount, 16 ) ) );
+#endif
 
     // VBO
     auto vbo = Model::CreateFromVBO(device.Get(), L"player_ship_a.vbo", nullptr, !ccw);
@@ -177,6 +254,34 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
 
     auto vbo2 = Model::CreateFromVBO(device.Get(), L"player_ship_a.vbo", effect, !ccw);
 
+#ifdef USE_GEOMETRY_POOL
+    // The CMO and SDKMESH models share the pool's vertex and index buffers
+    GeometryPool pool( device.Get(), context.Get() );
+
+    std::unique_ptr<Model> teapot, gamelevel, ship, tiny, soldier, dwarf, lmap;
+    {
+        const ModelLoadRequest pooledRequests[] =
+        {
+            { L"teapot.cmo", MODEL_FORMAT_CMO, ccw, false },
+            { L"gamelevel.cmo", MODEL_FORMAT_CMO, ccw, false },
+            { L"25ab10e8-621a-47d4-a63d-f65a00bc1549_model.cmo", MODEL_FORMAT_CMO, ccw, false },
+            { L"tiny.sdkmesh", MODEL_FORMAT_SDKMESH, !ccw, false },
+            { L"soldier.sdkmesh", MODEL_FORMAT_SDKMESH, !ccw, false },
+            { L"dwarf.sdkmesh", MODEL_FORMAT_SDKMESH, !ccw, false },
+            { L"SimpleLightMap.sdkmesh", MODEL_FORMAT_SDKMESH, !ccw, false },
+        };
+
+        auto models = LoadModelsPooled( device.Get(), context.Get(), pooledRequests, _countof( pooledRequests ), fx, pool, 0, layouts );
+
+        teapot = std::move( models[ 0 ] );
+        gamelevel = std::move( models[ 1 ] );
+        ship = std::move( models[ 2 ] );
+        tiny = std::move( models[ 3 ] );
+        soldier = std::move( models[ 4 ] );
+        dwarf = std::move( models[ 5 ] );
+        lmap = std::move( models[ 6 ] );
+    }
+#else
     // VS 2012 CMO
     auto teapot = Model::CreateFromCMO( device.Get(), L"teapot.cmo", fx, ccw );
 
@@ -189,6 +294,125 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
     auto soldier = Model::CreateFromSDKMESH( device.Get(), L"soldier.sdkmesh", fx, !ccw );
     auto dwarf = Model::CreateFromSDKMESH( device.Get(), L"dwarf.sdkmesh", fx, !ccw );
     auto lmap = Model::CreateFromSDKMESH( device.Get(), L"SimpleLightMap.sdkmesh", fx, !ccw );
+#endif
+
+#ifdef USE_EFFECT_CACHE
+    {
+        EffectCacheStats cs = {};
+        cachedFx.GetStats( cs );
+        layoutCache.GetStats( cs );
+
+        char buff[ 256 ] = {};
+        sprintf_s( buff, "Effect cache: %Iu effects for %Iu requests, %Iu input layouts for %Iu requests\n",
+                   cs.effectsCreated, cs.effectRequests, cs.layoutsCreated, cs.layoutRequests );
+        OutputDebugStringA( buff );
+    }
+#endif
+
+#ifdef USE_LOD
+    const size_t lodTeapotCount = 5;
+    const float lodScreenSizes[] = { 0.25f, 0.12f, 0.f };
+
+    // Uses teapot_lod1.cmo and teapot_lod2.cmo when they exist, loaded in parallel...
+    SharedEffectFactory lodFx( device.Get() );
+    const ModelLoadRequest lodRequest = { L"teapot.cmo", MODEL_FORMAT_CMO, ccw, false };
+    auto teapotLOD = CreateLODModelFromFiles( device.Get(), lodRequest, lodFx, lodScreenSizes, _countof( lodScreenSizes ) );
+
+    if ( teapotLOD->GetLevelCount() < 2 )
+    {
+        // ...otherwise the coarser levels are generated by vertex clustering
+        ModelData teapotData;
+        if (FAILED(LoadModelData( lodRequest, teapotData )))
+            MessageBox(hwnd, L"Error loading teapot.cmo", L"ModelTest", MB_ICONERROR);
+
+        const size_t lodGridCells[] = { 24, 10 };
+
+        teapotLOD.reset( new LODModel );
+        teapotLOD->AddLevel( CreateModelFromData( device.Get(), teapotData, fx, ccw, false, nullptr, nullptr, layouts ), lodScreenSizes[ 0 ] );
+        for( size_t j = 0; j < _countof( lodGridCells ); ++j )
+        {
+            ModelData lodData;
+            if (FAILED(SimplifyModelData( teapotData, lodGridCells[ j ], lodData )))
+                MessageBox(hwnd, L"Error simplifying teapot.cmo", L"ModelTest", MB_ICONERROR);
+
+            teapotLOD->AddLevel( CreateModelFromData( device.Get(), lodData, fx, ccw, false, nullptr, nullptr, layouts ), lodScreenSizes[ j + 1 ] );
+        }
+    }
+#endif
+
+#ifdef BENCHMARK_LOADERS
+    BenchmarkSDKMESH( L"tiny.sdkmesh", 100 );
+    BenchmarkSDKMESH( L"soldier.sdkmesh", 100 );
+    BenchmarkSDKMESH( L"dwarf.sdkmesh", 100 );
+    BenchmarkSDKMESH( L"SimpleLightMap.sdkmesh", 100 );
+
+    {
+        const ModelLoadRequest requests[] =
+        {
+            { L"cup._obj", MODEL_FORMAT_OBJ, !ccw, false },
+            { L"player_ship_a.vbo", MODEL_FORMAT_VBO, !ccw, false },
+            { L"teapot.cmo", MODEL_FORMAT_CMO, ccw, false },
+            { L"gamelevel.cmo", MODEL_FORMAT_CMO, ccw, false },
+            { L"25ab10e8-621a-47d4-a63d-f65a00bc1549_model.cmo", MODEL_FORMAT_CMO, ccw, false },
+            { L"tiny.sdkmesh", MODEL_FORMAT_SDKMESH, !ccw, false },
+            { L"soldier.sdkmesh", MODEL_FORMAT_SDKMESH, !ccw, false },
+            { L"dwarf.sdkmesh", MODEL_FORMAT_SDKMESH, !ccw, false },
+            { L"SimpleLightMap.sdkmesh", MODEL_FORMAT_SDKMESH, !ccw, false },
+        };
+
+        const ModelLoadRequest mappedRequests[] =
+        {
+            { L"tiny.sdkmesh", MODEL_FORMAT_SDKMESH_MAPPED, !ccw, false },
+            { L"soldier.sdkmesh", MODEL_FORMAT_SDKMESH_MAPPED, !ccw, false },
+            { L"dwarf.sdkmesh", MODEL_FORMAT_SDKMESH_MAPPED, !ccw, false },
+            { L"SimpleLightMap.sdkmesh", MODEL_FORMAT_SDKMESH_MAPPED, !ccw, false },
+        };
+
+        BenchmarkModelLoads( requests, _countof( requests ), 10 );
+        BenchmarkModelLoads( mappedRequests, _countof( mappedRequests ), 10 );
+        BenchmarkModelData( requests, _countof( requests ), 10 );
+        BenchmarkGeometryPool( requests, _countof( requests ), 20 );
+    }
+#endif
+
+#ifdef USE_CULLING
+    // The level is the occluder, rasterized from its CPU-side copy
+    ModelData gamelevelData;
+    if (FAILED(LoadModelDataFromCMO( L"gamelevel.cmo", gamelevelData )))
+        MessageBox(hwnd, L"Error loading gamelevel.cmo", L"ModelTest", MB_ICONERROR);
+
+    ModelCuller culler( 256, 128 );
+    std::vector<uint8_t> visibleMeshes;
+#endif
+
+#ifdef USE_DEFERRED_CONTEXTS
+    // Each recorder draws its own copy of the level with effects of its own, since effects
+    // keep per-draw state; one factory creates them all, so the textures are read once
+    ModelData levelData;
+    if (FAILED(LoadModelDataFromCMO( L"gamelevel.cmo", levelData )))
+        MessageBox(hwnd, L"Error loading gamelevel.cmo", L"ModelTest", MB_ICONERROR);
+
+    ParallelRecorder recorder( device.Get() );
+
+    SharedEffectFactory recorderFx( device.Get() );
+    std::vector<std::unique_ptr<Model>> levelCopies;
+    for( size_t j = 0; j < recorder.GetRecorderCount(); ++j )
+    {
+        levelCopies.emplace_back( CloneModelFromData( device.Get(), *gamelevel, levelData, recorderFx ) );
+    }
+
+    const size_t levelMeshes = gamelevel->meshes.size();
+#endif
+
+#ifdef USE_CPU_SKINNING
+    ModelData soldierData;
+    if (FAILED(LoadModelDataFromSDKMESH( L"soldier.sdkmesh", soldierData )))
+        MessageBox(hwnd, L"Error loading soldier.sdkmesh", L"ModelTest", MB_ICONERROR);
+
+    SkinnedVertexCache soldierSkin( soldierData );
+
+    BenchmarkSkinnedVertexCache( soldierData, 100 );
+#endif
 
     bool quit = false;
 
@@ -206,9 +430,17 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
 
     size_t frame = 0;
 
+#ifdef USE_RENDER_QUEUE
+    RenderQueue queue;
+#endif
+
     context->OMSetDepthStencilState( states.DepthDefault(), 0 );
     context->OMSetBlendState( states.Opaque(), nullptr, 0xFFFFFFFF );
 
+#ifdef USE_ASYNC_TEXTURES
+    bool texturesLoaded = false;
+#endif
+
     while (!quit)
     {
         MSG msg;
@@ -222,6 +454,18 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
             DispatchMessage(&msg);
         }
 
+#ifdef USE_ASYNC_TEXTURES
+        // Loaded textures replace the placeholders between frames
+        if ( !texturesLoaded && asyncFx.Update() )
+        {
+            texturesLoaded = true;
+
+            char buff[ 128 ] = {};
+            sprintf_s( buff, "Async textures: %Iu loaded (%Iu failed) by frame %Iu\n", asyncFx.GetTextureCount(), asyncFx.GetFailedCount(), frame );
+            OutputDebugStringA( buff );
+        }
+#endif
+
         LARGE_INTEGER counter;
         QueryPerformanceCounter(&counter);
         
@@ -255,6 +499,24 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
         XMMATRIX projection = XMMatrixPerspectiveFovRH(1, aspect, 1, 15);
 #endif
 
+#ifdef USE_CULLING
+        culler.Begin( view, projection );
+#endif
+
+        auto drawModel = [&]( const Model& model, CXMMATRIX m )
+        {
+#if defined(USE_CULLING) && defined(USE_RENDER_QUEUE)
+            culler.Cull( model, m, visibleMeshes );
+            queue.Submit( model, m, false, visibleMeshes.data() );
+#elif defined(USE_CULLING)
+            culler.Draw( context.Get(), states, model, m );
+#elif defined(USE_RENDER_QUEUE)
+            queue.Submit( model, m );
+#else
+            model.Draw( context.Get(), states, m, view, projection );
+#endif
+        };
+
         const float row0 = 2.f;
         const float row1 = 0.f; 
         const float row2 = -2.f;
@@ -324,6 +586,25 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
                 fog->SetFogEnabled(false);
         });
 
+#ifdef USE_INSTANCING
+        for( size_t j = 0; j < cupInstanceCount; ++j )
+        {
+            local = XMMatrixMultiply( XMMatrixScaling( 0.5f, 0.5f, 0.5f ), XMMatrixTranslation( -5.5f + float(j), -3.f, 0.f ) );
+            cupWorlds[ j ] = XMMatrixMultiply( world, local );
+        }
+        cupInstances.Draw( context.Get(), states, cupWorlds.get(), cupInstanceCount, view, projection );
+#endif
+
+#ifdef USE_LOD
+        teapotLOD->ResetStats();
+        for( size_t j = 0; j < lodTeapotCount; ++j )
+        {
+            local = XMMatrixMultiply( XMMatrixScaling( 0.01f, 0.01f, 0.01f ), XMMatrixTranslation( -4.5f, -2.f, 2.f - 2.5f * float(j) ) );
+            local = XMMatrixMultiply( world, local );
+            teapotLOD->Draw( context.Get(), states, local, view, projection );
+        }
+#endif
+
         // Draw VBO models
         local = XMMatrixMultiply(XMMatrixScaling(0.25f, 0.25f, 0.25f), XMMatrixTranslation(4.5f, row0, 0.f));
         local = XMMatrixMultiply(world, local);
@@ -366,24 +647,52 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
 
         local = XMMatrixMultiply( XMMatrixScaling( 0.1f, 0.1f, 0.1f ), XMMatrixTranslation( 0.f, row1, 0.f ) );
         local = XMMatrixMultiply( world, local );
-        gamelevel->Draw( context.Get(), states, local, view, projection );
+#ifdef USE_CULLING
+        culler.AddOccluder( gamelevelData, local );
+#endif
+#ifdef USE_DEFERRED_CONTEXTS
+        // One job per mesh for the opaque pass, then one per mesh for the alpha pass
+        recorder.Record( levelMeshes * 2, [&]( ID3D11DeviceContext* deferred )
+        {
+            deferred->OMSetRenderTargets( 1, backBuffer.GetAddressOf(), depthStencil.Get() );
+            deferred->RSSetViewports( 1, &vp );
+        },
+        [&]( size_t r, ID3D11DeviceContext* deferred, size_t j )
+        {
+            bool alpha = ( j >= levelMeshes );
+            auto& mesh = levelCopies[ r ]->meshes[ alpha ? j - levelMeshes : j ];
+            mesh->PrepareForRendering( deferred, states, alpha );
+            mesh->Draw( deferred, local, view, projection, alpha );
+        });
+        recorder.Execute( context.Get() );
+
+        context->OMSetRenderTargets( 1, backBuffer.GetAddressOf(), depthStencil.Get() );
+        context->RSSetViewports( 1, &vp );
+#else
+        drawModel( *gamelevel, local );
+#endif
 
         local = XMMatrixMultiply( XMMatrixScaling( .2f, .2f, .2f ), XMMatrixTranslation( 0.f, row2, 0.f ) );
         local = XMMatrixMultiply( world, local );
-        ship->Draw( context.Get(), states, local, view, projection );
+        drawModel( *ship, local );
 
         // Draw SDKMESH models
         local = XMMatrixMultiply( XMMatrixScaling( 0.005f, 0.005f, 0.005f ), XMMatrixTranslation( 2.5f, row2, 0.f ) );
         local = XMMatrixMultiply( world, local );
-        tiny->Draw( context.Get(), states, local, view, projection );
+        drawModel( *tiny, local );
 
         local = XMMatrixTranslation(-2.5f, row2, 0.f );
         local = XMMatrixMultiply( world, local );
-        dwarf->Draw( context.Get(), states, local, view, projection );
+        drawModel( *dwarf, local );
 
         local = XMMatrixMultiply( XMMatrixScaling( 0.01f, 0.01f, 0.01f ), XMMatrixTranslation( -5.0f, row2, 0.f ) );
         local = XMMatrixMultiply( XMMatrixRotationRollPitchYaw(0, XM_PI, roll), local );
-        lmap->Draw( context.Get(), states, local, view, projection );
+        drawModel( *lmap, local );
+
+#ifdef USE_RENDER_QUEUE
+        queue.Draw( context.Get(), states, view, projection );
+        queue.Clear();
+#endif
 
         soldier->UpdateEffects([&](IEffect* effect)
         {
@@ -404,11 +713,90 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR,
         local = XMMatrixMultiply( XMMatrixScaling( 2.f, 2.f, 2.f ), XMMatrixTranslation( 2.5f, row1, 0.f ) );
         soldier->Draw( context.Get(), states, local, view, projection );
 
+#ifdef USE_CPU_SKINNING
+        for( size_t j = 0; j < soldierData.meshes.size(); ++j )
+        {
+            if ( soldierSkin.IsSkinned( j ) )
+                soldierSkin.Update( j, bones.get(), SkinnedEffect::MaxBones );
+        }
+#endif
+
         swapChain->Present(1, 0);
         ++frame;
 
         if ( frame == 10 )
         {
+#ifdef USE_RENDER_QUEUE
+            auto& qs = queue.GetStats();
+            char buff[ 512 ] = {};
+            sprintf_s( buff, "Render queue: %Iu draws; skipped %Iu/%Iu state, %Iu/%Iu effect, %Iu/%Iu layout, %Iu/%Iu VB, %Iu/%Iu IB, %Iu/%Iu topology\n",
+                       qs.draws, qs.stateChangesSkipped, qs.draws, qs.effectAppliesSkipped, qs.draws, qs.inputLayoutBindsSkipped, qs.draws,
+                       qs.vertexBufferBindsSkipped, qs.draws, qs.indexBufferBindsSkipped, qs.draws, qs.topologyChangesSkipped, qs.draws );
+            OutputDebugStringA( buff );
+#endif
+
+#ifdef USE_CULLING
+            auto& cs = culler.GetStats();
+            char cullBuff[ 256 ] = {};
+            sprintf_s( cullBuff, "Culling: %Iu of %Iu meshes visible, %Iu outside the frustum, %Iu occluded by %Iu triangles\n",
+                       cs.visible, cs.meshes, cs.frustumCulled, cs.occluded, cs.occluderTriangles );
+            OutputDebugStringA( cullBuff );
+#endif
+
+#ifdef USE_DEFERRED_CONTEXTS
+            char recordBuff[ 128 ] = {};
+            sprintf_s( recordBuff, "Deferred contexts: %Iu recorders, %ls command lists\n", recorder.GetRecorderCount(),
+                       recorder.IsDriverCommandLists() ? L"driver" : L"emulated" );
+            OutputDebugStringA( recordBuff );
+#endif
+
+#ifdef USE_LOD
+            auto& ls = teapotLOD->GetStats();
+            char lodBuff[ 256 ] = {};
+            int lodLen = sprintf_s( lodBuff, "LOD: %Iu draws, %Iu triangles drawn, %Iu saved; draws per level:", ls.draws, ls.trianglesDrawn, ls.trianglesSaved );
+            for( size_t j = 0; j < ls.levelDraws.size() && lodLen > 0 && lodLen < 240; ++j )
+            {
+                lodLen += sprintf_s( lodBuff + lodLen, _countof( lodBuff ) - lodLen, " %Iu", ls.levelDraws[ j ] );
+            }
+            OutputDebugStringA( lodBuff );
+            OutputDebugStringA( "\n" );
+#endif
+
+#ifdef USE_INSTANCING
+            char instBuff[ 128 ] = {};
+            sprintf_s( instBuff, "Instancing: %Iu cups in %Iu draws\n", cupInstanceCount, cupInstances.GetDrawCount() );
+            OutputDebugStringA( instBuff );
+#endif
+
+#ifdef USE_CPU_SKINNING
+            BoundingBox skinnedBounds;
+            bool hasBounds = false;
+            for( size_t j = 0; j < soldierData.meshes.size(); ++j )
+            {
+                for( size_t k = 0; k < soldierData.vertexBuffers.size(); ++k )
+                {
+                    auto positions = soldierSkin.GetPositions( j, static_cast<uint32_t>( k ) );
+                    if ( !positions || !soldierData.vertexBuffers[ k ].vertexCount )
+                        continue;
+
+                    BoundingBox box;
+                    BoundingBox::CreateFromPoints( box, soldierData.vertexBuffers[ k ].vertexCount, positions, sizeof(XMFLOAT3) );
+                    if ( hasBounds )
+                        BoundingBox::CreateMerged( skinnedBounds, skinnedBounds, box );
+                    else
+                        skinnedBounds = box;
+                    hasBounds = true;
+                }
+            }
+
+            auto& ss = soldierSkin.GetStats();
+            char skinBuff[ 256 ] = {};
+            sprintf_s( skinBuff, "CPU skinning: %Iu of %Iu updates skipped, %Iu vertices skinned, bounds center (%.2f %.2f %.2f) extents (%.2f %.2f %.2f)\n",
+                       ss.skipped, ss.updates, ss.verticesSkinned, skinnedBounds.Center.x, skinnedBounds.Center.y, skinnedBounds.Center.z,
+                       skinnedBounds.Extents.x, skinnedBounds.Extents.y, skinnedBounds.Extents.z );
+            OutputDebugStringA( skinBuff );
+#endif
+
             ComPtr<ID3D11Texture2D> backBufferTex;
             hr = swapChain->GetBuffer( 0, __uuidof( ID3D11Texture2D ), ( LPVOID* )&backBufferTex);
             if ( SUCCEEDED(hr) )
@@ -0,0 +1,223 @@
+//--------------------------------------------------------------------------------------
+// File: ParallelRecorder.cpp
+//
+// Records draws on deferred contexts from several threads and plays them back in order
+//
+// The worker threads live as long as the recorder and wait for each Record, so a frame
+// does not pay for thread creation.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "ParallelRecorder.h"
+
+#include <algorithm>
+
+#include "DirectXHelpers.h"
+#include "PlatformHelpers.h"
+
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+ParallelRecorder::ParallelRecorder( _In_ ID3D11Device* device, size_t recorderCount ) :
+    m_driverCommandLists( false ),
+    m_generation( 0 ),
+    m_pending( 0 ),
+    m_exit( false ),
+    m_jobCount( 0 ),
+    m_begin( nullptr ),
+    m_record( nullptr )
+{
+    if ( !device )
+        throw std::exception("Direct3D device is null");
+
+    if ( !recorderCount )
+        recorderCount = std::max<size_t>( std::thread::hardware_concurrency(), 1 );
+
+    D3D11_FEATURE_DATA_THREADING threading = {};
+    if ( SUCCEEDED( device->CheckFeatureSupport( D3D11_FEATURE_THREADING, &threading, sizeof(threading) ) ) )
+        m_driverCommandLists = ( threading.DriverCommandLists != FALSE );
+
+    m_recorders.resize( recorderCount );
+    for( auto it = m_recorders.begin(); it != m_recorders.end(); ++it )
+    {
+        ThrowIfFailed(
+            device->CreateDeferredContext( 0, &it->context )
+        );
+
+        SetDebugObjectName( it->context.Get(), "ParallelRecorder" );
+    }
+
+    try
+    {
+        m_threads.reserve( recorderCount - 1 );
+        for( size_t j = 1; j < recorderCount; ++j )
+        {
+            m_threads.emplace_back( &ParallelRecorder::WorkerThread, this, j );
+        }
+    }
+    catch( ... )
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_exit = true;
+        }
+        m_start.notify_all();
+
+        for( auto it = m_threads.begin(); it != m_threads.end(); ++it )
+        {
+            it->join();
+        }
+
+        throw;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+ParallelRecorder::~ParallelRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_exit = true;
+    }
+    m_start.notify_all();
+
+    for( auto it = m_threads.begin(); it != m_threads.end(); ++it )
+    {
+        it->join();
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void ParallelRecorder::Record( size_t count, const BeginCallback& begin, const RecordCallback& record )
+{
+    // Written before the workers are woken under the lock, so they see it
+    m_jobCount = count;
+    m_begin = &begin;
+    m_record = &record;
+    m_error = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_pending = m_threads.size();
+        ++m_generation;
+    }
+    m_start.notify_all();
+
+    RecordRange( 0 );
+
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_done.wait( lock, [&]() { return !m_pending; } );
+    }
+
+    m_begin = nullptr;
+    m_record = nullptr;
+
+    if ( m_error )
+    {
+        for( auto it = m_recorders.begin(); it != m_recorders.end(); ++it )
+        {
+            it->commandList.Reset();
+        }
+
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception( error );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void ParallelRecorder::Execute( _In_ ID3D11DeviceContext* immediateContext, bool restoreContextState )
+{
+    for( auto it = m_recorders.begin(); it != m_recorders.end(); ++it )
+    {
+        if ( it->commandList )
+        {
+            immediateContext->ExecuteCommandList( it->commandList.Get(), restoreContextState ? TRUE : FALSE );
+            it->commandList.Reset();
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void ParallelRecorder::RecordRange( size_t recorder )
+{
+    auto& rec = m_recorders[ recorder ];
+    rec.commandList.Reset();
+
+    const size_t count = m_recorders.size();
+    const size_t first = m_jobCount * recorder / count;
+    const size_t last = m_jobCount * ( recorder + 1 ) / count;
+
+    if ( first >= last )
+        return;
+
+    try
+    {
+        ID3D11DeviceContext* context = rec.context.Get();
+
+        ( *m_begin )( context );
+
+        for( size_t j = first; j < last; ++j )
+        {
+            ( *m_record )( recorder, context, j );
+        }
+    }
+    catch( ... )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( !m_error )
+            m_error = std::current_exception();
+    }
+
+    // Always finished, as this also resets the deferred context for the next Record
+    HRESULT hr = rec.context->FinishCommandList( FALSE, &rec.commandList );
+    if ( FAILED(hr) )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( !m_error )
+            m_error = std::make_exception_ptr( std::exception("FinishCommandList failed") );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void ParallelRecorder::WorkerThread( size_t recorder )
+{
+    uint64_t generation = 0;
+
+    for( ;; )
+    {
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            m_start.wait( lock, [&]() { return m_exit || m_generation != generation; } );
+
+            if ( m_exit )
+                return;
+
+            generation = m_generation;
+        }
+
+        RecordRange( recorder );
+
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            if ( !--m_pending )
+                m_done.notify_one();
+        }
+    }
+}
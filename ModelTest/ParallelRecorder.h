@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------------------------
+// File: ParallelRecorder.h
+//
+// Records draws on deferred contexts from several threads and plays them back in order
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <d3d11.h>
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <wrl/client.h>
+
+// Each recorder thread owns a deferred context, and the calling thread is recorder 0.
+// Record splits a list of jobs into one contiguous range per recorder, and Execute plays
+// the command lists back in recorder order, so the draws reach the GPU in job order.
+//
+// An effect keeps its matrices, dirty flags and constant buffer contents, so an effect
+// must only be used by one recorder: draw a per-recorder copy of each model (see
+// CloneModelFromData), and always with the same recorder.
+class ParallelRecorder
+{
+public:
+    typedef std::function<void( _In_ ID3D11DeviceContext* deviceContext )> BeginCallback;
+    typedef std::function<void( size_t recorder, _In_ ID3D11DeviceContext* deviceContext, size_t job )> RecordCallback;
+
+    // 'recorderCount' recorders; 0 uses one per core
+    explicit ParallelRecorder( _In_ ID3D11Device* device, size_t recorderCount = 0 );
+    ~ParallelRecorder();
+
+    ParallelRecorder( const ParallelRecorder& ) = delete;
+    ParallelRecorder& operator=( const ParallelRecorder& ) = delete;
+
+    size_t GetRecorderCount() const { return m_recorders.size(); }
+
+    // True when the driver records command lists itself rather than the runtime emulating them
+    bool IsDriverCommandLists() const { return m_driverCommandLists; }
+
+    // Calls record( recorder, context, job ) for every job < count. A deferred context
+    // starts with default state, so 'begin' is called on each one first to bind render
+    // targets and viewports. If a call throws, nothing is recorded and the first
+    // exception is rethrown once every recorder is done.
+    void Record( size_t count, const BeginCallback& begin, const RecordCallback& record );
+
+    // Executes the command lists from the last Record. Unless 'restoreContextState' is
+    // set, the immediate context is left in its default state afterwards.
+    void Execute( _In_ ID3D11DeviceContext* immediateContext, bool restoreContextState = false );
+
+private:
+    struct Recorder
+    {
+        Microsoft::WRL::ComPtr<ID3D11DeviceContext>     context;
+        Microsoft::WRL::ComPtr<ID3D11CommandList>       commandList;
+    };
+
+    void RecordRange( size_t recorder );
+    void WorkerThread( size_t recorder );
+
+    std::vector<Recorder>       m_recorders;
+    std::vector<std::thread>    m_threads;
+    bool                        m_driverCommandLists;
+
+    // The current Record, shared with the worker threads under m_mutex
+    std::mutex                  m_mutex;
+    std::condition_variable     m_start;
+    std::condition_variable     m_done;
+    uint64_t                    m_generation;
+    size_t                      m_pending;
+    bool                        m_exit;
+    size_t                      m_jobCount;
+    const BeginCallback*        m_begin;
+    const RecordCallback*       m_record;
+    std::exception_ptr          m_error;
+};
@@ -0,0 +1,245 @@
+//--------------------------------------------------------------------------------------
+// File: RenderQueue.cpp
+//
+// Collects the mesh parts of many models, sorts them by state, and draws them with
+// redundant binds skipped
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <functional>
+
+using namespace DirectX;
+
+//--------------------------------------------------------------------------------------
+void XM_CALLCONV RenderQueue::Submit( const Model& model, FXMMATRIX world, bool wireframe, _In_opt_ const uint8_t* meshVisible )
+{
+    auto worldIndex = static_cast<uint32_t>( m_worlds.size() );
+    m_worlds.emplace_back();
+    XMStoreFloat4x4( &m_worlds.back(), world );
+
+    for( auto mit = model.meshes.cbegin(); mit != model.meshes.cend(); ++mit )
+    {
+        if ( meshVisible && !meshVisible[ mit - model.meshes.cbegin() ] )
+            continue;
+
+        auto mesh = mit->get();
+
+        for( auto pit = mesh->meshParts.cbegin(); pit != mesh->meshParts.cend(); ++pit )
+        {
+            Item item;
+            item.part = pit->get();
+            item.mesh = mesh;
+            item.world = worldIndex;
+            item.sequence = static_cast<uint32_t>( m_items.size() );
+            item.wireframe = wireframe;
+
+            m_items.push_back( item );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void XM_CALLCONV RenderQueue::Draw( _In_ ID3D11DeviceContext* deviceContext, const CommonStates& states,
+                                    FXMMATRIX view, CXMMATRIX projection )
+{
+    m_stats = RenderQueueStats();
+
+    if ( m_items.empty() )
+        return;
+
+    std::sort( m_items.begin(), m_items.end(), []( const Item& a, const Item& b ) -> bool
+    {
+        if ( a.part->isAlpha != b.part->isAlpha )
+            return !a.part->isAlpha;
+
+        // Blending depends on draw order, so alpha parts keep theirs
+        if ( !a.part->isAlpha )
+        {
+            std::less<const void*> less;
+
+            if ( a.wireframe != b.wireframe )
+                return !a.wireframe;
+
+            if ( a.mesh->ccw != b.mesh->ccw )
+                return !a.mesh->ccw;
+
+            if ( a.part->effect != b.part->effect )
+                return less( a.part->effect.get(), b.part->effect.get() );
+
+            if ( a.part->inputLayout != b.part->inputLayout )
+                return less( a.part->inputLayout.Get(), b.part->inputLayout.Get() );
+
+            if ( a.part->vertexBuffer != b.part->vertexBuffer )
+                return less( a.part->vertexBuffer.Get(), b.part->vertexBuffer.Get() );
+
+            if ( a.part->vertexStride != b.part->vertexStride )
+                return a.part->vertexStride < b.part->vertexStride;
+
+            if ( a.part->indexBuffer != b.part->indexBuffer )
+                return less( a.part->indexBuffer.Get(), b.part->indexBuffer.Get() );
+
+            if ( a.world != b.world )
+                return a.world < b.world;
+        }
+
+        return a.sequence < b.sequence;
+    });
+
+    // The same samplers ModelMesh::PrepareForRendering sets for the effects' textures
+    ID3D11SamplerState* samplers[] =
+    {
+        states.LinearWrap(),
+        states.LinearWrap(),
+    };
+
+    deviceContext->PSSetSamplers( 0, 2, samplers );
+
+    ID3D11BlendState* blendState = nullptr;
+    ID3D11DepthStencilState* depthStencilState = nullptr;
+    ID3D11RasterizerState* rasterizerState = nullptr;
+    IEffect* effect = nullptr;
+    uint32_t world = 0;
+    ID3D11InputLayout* inputLayout = nullptr;
+    ID3D11Buffer* vertexBuffer = nullptr;
+    UINT vertexStride = 0;
+    ID3D11Buffer* indexBuffer = nullptr;
+    DXGI_FORMAT indexFormat = DXGI_FORMAT_UNKNOWN;
+    D3D11_PRIMITIVE_TOPOLOGY topology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+    bool first = true;
+    for( auto it = m_items.cbegin(); it != m_items.cend(); ++it )
+    {
+        auto part = it->part;
+        auto mesh = it->mesh;
+
+        // States as ModelMesh::PrepareForRendering chooses them
+        ID3D11BlendState* bs;
+        ID3D11DepthStencilState* ds;
+        if ( part->isAlpha )
+        {
+            bs = mesh->pmalpha ? states.AlphaBlend() : states.NonPremultiplied();
+            ds = states.DepthRead();
+        }
+        else
+        {
+            bs = states.Opaque();
+            ds = states.DepthDefault();
+        }
+
+        ID3D11RasterizerState* rs;
+        if ( it->wireframe )
+            rs = states.Wireframe();
+        else
+            rs = mesh->ccw ? states.CullCounterClockwise() : states.CullClockwise();
+
+        if ( first || bs != blendState || ds != depthStencilState || rs != rasterizerState )
+        {
+            deviceContext->OMSetBlendState( bs, nullptr, 0xFFFFFFFF );
+            deviceContext->OMSetDepthStencilState( ds, 0 );
+            deviceContext->RSSetState( rs );
+
+            blendState = bs;
+            depthStencilState = ds;
+            rasterizerState = rs;
+            ++m_stats.stateChanges;
+        }
+        else
+        {
+            ++m_stats.stateChangesSkipped;
+        }
+
+        // An effect only needs applying again for a new effect or new matrices
+        if ( first || part->effect.get() != effect || it->world != world )
+        {
+            auto imatrices = dynamic_cast<IEffectMatrices*>( part->effect.get() );
+            if ( imatrices )
+                imatrices->SetMatrices( XMLoadFloat4x4( &m_worlds[ it->world ] ), view, projection );
+
+            part->effect->Apply( deviceContext );
+
+            effect = part->effect.get();
+            world = it->world;
+            ++m_stats.effectApplies;
+        }
+        else
+        {
+            ++m_stats.effectAppliesSkipped;
+        }
+
+        if ( first || part->inputLayout.Get() != inputLayout )
+        {
+            inputLayout = part->inputLayout.Get();
+            deviceContext->IASetInputLayout( inputLayout );
+            ++m_stats.inputLayoutBinds;
+        }
+        else
+        {
+            ++m_stats.inputLayoutBindsSkipped;
+        }
+
+        // A pooled buffer can hold vertices of more than one stride
+        if ( first || part->vertexBuffer.Get() != vertexBuffer || part->vertexStride != vertexStride )
+        {
+            vertexBuffer = part->vertexBuffer.Get();
+            vertexStride = part->vertexStride;
+
+            UINT vertexOffset = 0;
+            deviceContext->IASetVertexBuffers( 0, 1, &vertexBuffer, &vertexStride, &vertexOffset );
+            ++m_stats.vertexBufferBinds;
+        }
+        else
+        {
+            ++m_stats.vertexBufferBindsSkipped;
+        }
+
+        if ( first || part->indexBuffer.Get() != indexBuffer || part->indexFormat != indexFormat )
+        {
+            indexBuffer = part->indexBuffer.Get();
+            indexFormat = part->indexFormat;
+            deviceContext->IASetIndexBuffer( indexBuffer, indexFormat, 0 );
+            ++m_stats.indexBufferBinds;
+        }
+        else
+        {
+            ++m_stats.indexBufferBindsSkipped;
+        }
+
+        if ( first || part->primitiveType != topology )
+        {
+            topology = part->primitiveType;
+            deviceContext->IASetPrimitiveTopology( topology );
+            ++m_stats.topologyChanges;
+        }
+        else
+        {
+            ++m_stats.topologyChangesSkipped;
+        }
+
+        deviceContext->DrawIndexed( part->indexCount, part->startIndex, part->vertexOffset );
+        ++m_stats.draws;
+
+        first = false;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void RenderQueue::Clear()
+{
+    m_items.clear();
+    m_worlds.clear();
+}
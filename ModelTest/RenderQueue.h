@@ -0,0 +1,84 @@
+//--------------------------------------------------------------------------------------
+// File: RenderQueue.h
+//
+// Collects the mesh parts of many models, sorts them by state, and draws them with
+// redundant binds skipped
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CommonStates.h"
+#include "Effects.h"
+#include "Model.h"
+
+#include <vector>
+
+// Each pair of counters adds up to the number of draws: the first is binds issued, the
+// second is binds skipped because the previous draw had already made them
+struct RenderQueueStats
+{
+    size_t  draws;
+    size_t  stateChanges;               // Blend, depth-stencil and rasterizer state together
+    size_t  stateChangesSkipped;
+    size_t  effectApplies;
+    size_t  effectAppliesSkipped;
+    size_t  inputLayoutBinds;
+    size_t  inputLayoutBindsSkipped;
+    size_t  vertexBufferBinds;
+    size_t  vertexBufferBindsSkipped;
+    size_t  indexBufferBinds;
+    size_t  indexBufferBindsSkipped;
+    size_t  topologyChanges;
+    size_t  topologyChangesSkipped;
+};
+
+// Opaque parts are sorted by rasterizer state, effect, input layout, then vertex and index
+// buffer. An effect holds its textures, so parts sharing an effect share textures. Alpha
+// parts are drawn after every opaque part, in the order they were submitted.
+//
+// Effects are applied when each part is drawn, not when it is submitted, so effect
+// settings must not change between Submit and Draw. A model whose effects are changed
+// between two draws of it in the same frame cannot use the queue for both.
+class RenderQueue
+{
+public:
+    RenderQueue() : m_stats() {}
+
+    // Adds every part of 'model', which must stay alive until Clear. With 'meshVisible', only
+    // the parts of meshes whose flag is nonzero are added (see ModelCuller::Cull).
+    void XM_CALLCONV Submit( const DirectX::Model& model, DirectX::FXMMATRIX world, bool wireframe = false,
+                             _In_opt_ const uint8_t* meshVisible = nullptr );
+
+    void XM_CALLCONV Draw( _In_ ID3D11DeviceContext* deviceContext, const DirectX::CommonStates& states,
+                           DirectX::FXMMATRIX view, DirectX::CXMMATRIX projection );
+
+    void Clear();
+
+    size_t Size() const { return m_items.size(); }
+
+    // Counters for the most recent Draw
+    const RenderQueueStats& GetStats() const { return m_stats; }
+
+private:
+    struct Item
+    {
+        const DirectX::ModelMeshPart*   part;
+        const DirectX::ModelMesh*       mesh;
+        uint32_t                        world;      // Index into m_worlds
+        uint32_t                        sequence;   // Submission order
+        bool                            wireframe;
+    };
+
+    std::vector<Item>                   m_items;
+    std::vector<DirectX::XMFLOAT4X4>    m_worlds;
+    RenderQueueStats                    m_stats;
+};
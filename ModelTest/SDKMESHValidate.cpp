@@ -0,0 +1,444 @@
+//--------------------------------------------------------------------------------------
+// File: SDKMESHValidate.cpp
+//
+// CPU-only validation of SDKMESH files, and a benchmark of mapping them against reading
+// them; builds without Windows
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include "SDKMESHValidate.h"
+
+#include "BenchmarkTrace.h"
+
+#include <chrono>
+#include <memory>
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <psapi.h>
+#pragma comment(lib,"psapi.lib")
+
+#include "MappedFile.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace SDKMESH;
+
+//--------------------------------------------------------------------------------------
+// True if 'count' elements of 'elementSize' bytes at 'offset' fit below 'limit'
+static bool IsRangeValid( uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t limit )
+{
+    if ( offset > limit )
+        return false;
+
+    return ( count <= ( limit - offset ) / elementSize );
+}
+
+template<typename T>
+static const T* GetArray( const uint8_t* meshData, uint64_t offset, uint64_t count, uint64_t limit )
+{
+    if ( !IsRangeValid( offset, count, sizeof(T), limit ) )
+        return nullptr;
+
+    return reinterpret_cast<const T*>( meshData + offset );
+}
+
+bool ValidateSDKMESH( const uint8_t* meshData, size_t dataSize, SDKMESHInfo* info )
+{
+    if ( info )
+        memset( info, 0, sizeof(SDKMESHInfo) );
+
+    if ( !meshData || dataSize < sizeof(SDKMESH_HEADER) )
+        return false;
+
+    auto header = reinterpret_cast<const SDKMESH_HEADER*>( meshData );
+
+    if ( header->Version != SDKMESH_FILE_VERSION || header->IsBigEndian || header->HeaderSize < sizeof(SDKMESH_HEADER) )
+        return false;
+
+    if ( !header->NumMeshes )
+        return false;
+
+    // HeaderSize covers the file header and the vertex/index stream headers; the other
+    // tables follow, then the vertex and index data
+    if ( !IsRangeValid( header->HeaderSize, header->NonBufferDataSize, 1, dataSize ) )
+        return false;
+
+    const uint64_t bufferDataOffset = header->HeaderSize + header->NonBufferDataSize;
+
+    if ( !IsRangeValid( bufferDataOffset, header->BufferDataSize, 1, dataSize ) )
+        return false;
+
+    auto vbArray = GetArray<SDKMESH_VERTEX_BUFFER_HEADER>( meshData, header->VertexStreamHeadersOffset, header->NumVertexBuffers, bufferDataOffset );
+    auto ibArray = GetArray<SDKMESH_INDEX_BUFFER_HEADER>( meshData, header->IndexStreamHeadersOffset, header->NumIndexBuffers, bufferDataOffset );
+    auto meshArray = GetArray<SDKMESH_MESH>( meshData, header->MeshDataOffset, header->NumMeshes, bufferDataOffset );
+    auto subsetArray = GetArray<SDKMESH_SUBSET>( meshData, header->SubsetDataOffset, header->NumTotalSubsets, bufferDataOffset );
+    auto frameArray = GetArray<SDKMESH_FRAME>( meshData, header->FrameDataOffset, header->NumFrames, bufferDataOffset );
+    auto materialArray = GetArray<SDKMESH_MATERIAL>( meshData, header->MaterialDataOffset, header->NumMaterials, bufferDataOffset );
+
+    if ( ( header->NumVertexBuffers && !vbArray )
+         || ( header->NumIndexBuffers && !ibArray )
+         || !meshArray
+         || ( header->NumTotalSubsets && !subsetArray )
+         || ( header->NumFrames && !frameArray )
+         || ( header->NumMaterials && !materialArray ) )
+        return false;
+
+    SDKMESHInfo result = {};
+
+    // Vertex and index data must lie within the buffer data section
+    for( uint32_t j = 0; j < header->NumVertexBuffers; ++j )
+    {
+        auto& vh = vbArray[ j ];
+
+        if ( !vh.StrideBytes || vh.DataOffset < bufferDataOffset )
+            return false;
+
+        if ( !IsRangeValid( vh.DataOffset, vh.SizeBytes, 1, dataSize )
+             || !IsRangeValid( 0, vh.NumVertices, vh.StrideBytes, vh.SizeBytes ) )
+            return false;
+
+        result.vertices += vh.NumVertices;
+        result.vertexBytes += vh.SizeBytes;
+    }
+
+    for( uint32_t j = 0; j < header->NumIndexBuffers; ++j )
+    {
+        auto& ih = ibArray[ j ];
+
+        uint64_t indexSize;
+        switch( ih.IndexType )
+        {
+        case IT_16BIT:  indexSize = sizeof(uint16_t); break;
+        case IT_32BIT:  indexSize = sizeof(uint32_t); break;
+        default:        return false;
+        }
+
+        if ( ih.DataOffset < bufferDataOffset )
+            return false;
+
+        if ( !IsRangeValid( ih.DataOffset, ih.SizeBytes, 1, dataSize )
+             || !IsRangeValid( 0, ih.NumIndices, indexSize, ih.SizeBytes ) )
+            return false;
+
+        result.indices += ih.NumIndices;
+        result.indexBytes += ih.SizeBytes;
+    }
+
+    for( uint32_t j = 0; j < header->NumMeshes; ++j )
+    {
+        auto& mh = meshArray[ j ];
+
+        if ( !mh.NumVertexBuffers || mh.NumVertexBuffers > MAX_VERTEX_STREAMS )
+            return false;
+
+        for( uint32_t k = 0; k < mh.NumVertexBuffers; ++k )
+        {
+            if ( mh.VertexBuffers[ k ] >= header->NumVertexBuffers )
+                return false;
+        }
+
+        if ( mh.IndexBuffer >= header->NumIndexBuffers )
+            return false;
+
+        auto& ih = ibArray[ mh.IndexBuffer ];
+
+        // Subsets are drawn from the first stream only, as ParseSDKMESH does
+        const uint64_t meshVertices = vbArray[ mh.VertexBuffers[ 0 ] ].NumVertices;
+
+        auto subsets = GetArray<uint32_t>( meshData, mh.SubsetOffset, mh.NumSubsets, bufferDataOffset );
+        if ( !mh.NumSubsets || !subsets )
+            return false;
+
+        if ( mh.NumFrameInfluences && !GetArray<uint32_t>( meshData, mh.FrameInfluenceOffset, mh.NumFrameInfluences, bufferDataOffset ) )
+            return false;
+
+        for( uint32_t k = 0; k < mh.NumSubsets; ++k )
+        {
+            if ( subsets[ k ] >= header->NumTotalSubsets )
+                return false;
+
+            auto& subset = subsetArray[ subsets[ k ] ];
+
+            if ( header->NumMaterials && subset.MaterialID >= header->NumMaterials )
+                return false;
+
+            // VertexCount is not checked: nothing draws with it, and exporters leave stale
+            // values there (every subset of TankScene.sdkmesh says 4112, whatever its stream)
+            if ( !IsRangeValid( subset.IndexStart, subset.IndexCount, 1, ih.NumIndices )
+                 || subset.VertexStart >= meshVertices )
+                return false;
+        }
+    }
+
+    for( uint32_t j = 0; j < header->NumFrames; ++j )
+    {
+        auto& frame = frameArray[ j ];
+
+        if ( ( frame.Mesh != INVALID_MESH && frame.Mesh >= header->NumMeshes )
+             || ( frame.ParentFrame != INVALID_FRAME && frame.ParentFrame >= header->NumFrames )
+             || ( frame.ChildFrame != INVALID_FRAME && frame.ChildFrame >= header->NumFrames )
+             || ( frame.SiblingFrame != INVALID_FRAME && frame.SiblingFrame >= header->NumFrames ) )
+            return false;
+    }
+
+    if ( info )
+    {
+        result.vertexBuffers = header->NumVertexBuffers;
+        result.indexBuffers = header->NumIndexBuffers;
+        result.meshes = header->NumMeshes;
+        result.subsets = header->NumTotalSubsets;
+        result.frames = header->NumFrames;
+        result.materials = header->NumMaterials;
+        *info = result;
+    }
+
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+namespace
+{
+    // Paths are wide on Windows, as the rest of the model tests use, and narrow elsewhere
+#ifdef _WIN32
+    typedef wchar_t PathChar;
+#else
+    typedef char PathChar;
+#endif
+
+    // A whole file mapped read-only: MappedFile on Windows, mmap elsewhere
+    class FileView
+    {
+    public:
+#ifdef _WIN32
+        bool Open( const wchar_t* fileName )
+        {
+            return SUCCEEDED( m_file.Open( fileName ) );
+        }
+
+        const uint8_t* data() const { return reinterpret_cast<const uint8_t*>( m_file.data() ); }
+        size_t size() const { return m_file.size(); }
+
+    private:
+        MappedFile  m_file;
+#else
+        FileView() : m_data( nullptr ), m_size( 0 ) {}
+        ~FileView() { if ( m_data ) munmap( m_data, m_size ); }
+
+        FileView( const FileView& ) = delete;
+        FileView& operator=( const FileView& ) = delete;
+
+        bool Open( const char* fileName )
+        {
+            int fd = open( fileName, O_RDONLY );
+            if ( fd < 0 )
+                return false;
+
+            // Zero-length files cannot be mapped
+            struct stat st = {};
+            if ( !fstat( fd, &st ) && st.st_size > 0 )
+            {
+                void* data = mmap( nullptr, static_cast<size_t>( st.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+                if ( data != MAP_FAILED )
+                {
+                    m_data = data;
+                    m_size = static_cast<size_t>( st.st_size );
+                }
+            }
+
+            close( fd );
+            return ( m_data != nullptr );
+        }
+
+        const uint8_t* data() const { return static_cast<const uint8_t*>( m_data ); }
+        size_t size() const { return m_size; }
+
+    private:
+        void*       m_data;
+        size_t      m_size;
+#endif
+    };
+
+    struct SDKMESHTimings
+    {
+        SDKMESHInfo info;
+        size_t      fileSize;
+        double      mappedTime;
+        double      readTime;
+        uint64_t    mappedPeak;
+        uint64_t    readPeak;
+    };
+}
+
+// Reads the file into a heap buffer the way Model::CreateFromSDKMESH( device, szFileName, ... ) does
+static bool ReadEntireFile( const PathChar* fileName, std::unique_ptr<uint8_t[]>& data, size_t& dataSize )
+{
+    FILE* file = nullptr;
+#ifdef _WIN32
+    if ( _wfopen_s( &file, fileName, L"rb" ) )
+        file = nullptr;
+#else
+    file = fopen( fileName, "rb" );
+#endif
+    if ( !file )
+        return false;
+
+    std::unique_ptr<FILE, int(*)(FILE*)> scopedFile( file, fclose );
+
+    if ( fseek( file, 0, SEEK_END ) )
+        return false;
+
+    long fileSize = ftell( file );
+    if ( fileSize < 0 || fseek( file, 0, SEEK_SET ) )
+        return false;
+
+    dataSize = static_cast<size_t>( fileSize );
+    data.reset( new uint8_t[ dataSize ] );
+
+    return ( fread( data.get(), 1, dataSize, file ) == dataSize );
+}
+
+// The process's peak resident set so far. It never goes down, so a phase only shows in it
+// by going past everything before it. ru_maxrss is in kilobytes on Linux, bytes on macOS.
+static uint64_t GetPeakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if ( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof(counters) ) )
+        return 0;
+
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage = {};
+    if ( getrusage( RUSAGE_SELF, &usage ) )
+        return 0;
+
+#ifdef __APPLE__
+    return uint64_t( usage.ru_maxrss );
+#else
+    return uint64_t( usage.ru_maxrss ) * 1024;
+#endif
+#endif
+}
+
+static bool TimeSDKMESH( const PathChar* fileName, size_t iterations, SDKMESHTimings& timings )
+{
+    memset( &timings, 0, sizeof(timings) );
+
+    bool ok = true;
+
+    // Mapping goes first: the peak only rises, so the copying reader would hide it
+    uint64_t peakBefore = GetPeakResidentBytes();
+
+    auto start = std::chrono::steady_clock::now();
+
+    for( size_t j = 0; j < iterations && ok; ++j )
+    {
+        FileView file;
+        ok = file.Open( fileName );
+        if ( ok )
+        {
+            timings.fileSize = file.size();
+            ok = ValidateSDKMESH( file.data(), file.size(), &timings.info );
+        }
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    timings.mappedTime = std::chrono::duration<double>( stop - start ).count();
+
+    uint64_t peakMapped = GetPeakResidentBytes();
+    timings.mappedPeak = peakMapped - peakBefore;
+
+    start = std::chrono::steady_clock::now();
+
+    for( size_t j = 0; j < iterations && ok; ++j )
+    {
+        std::unique_ptr<uint8_t[]> data;
+        ok = ReadEntireFile( fileName, data, timings.fileSize );
+        if ( ok )
+            ok = ValidateSDKMESH( data.get(), timings.fileSize, &timings.info );
+    }
+
+    stop = std::chrono::steady_clock::now();
+    timings.readTime = std::chrono::duration<double>( stop - start ).count();
+
+    timings.readPeak = GetPeakResidentBytes() - peakMapped;
+
+    return ok;
+}
+
+static void TraceSDKMESHTimings( const SDKMESHTimings& timings, size_t iterations )
+{
+    typedef unsigned long long ull;
+
+    auto& info = timings.info;
+    BenchmarkTrace( "    %llu bytes, %llu meshes, %llu subsets, %llu frames, %llu materials\n",
+                    ull( timings.fileSize ), ull( info.meshes ), ull( info.subsets ), ull( info.frames ), ull( info.materials ) );
+    BenchmarkTrace( "    %llu vertices (%llu bytes) in %llu VBs, %llu indices (%llu bytes) in %llu IBs\n",
+                    ull( info.vertices ), ull( info.vertexBytes ), ull( info.vertexBuffers ), ull( info.indices ), ull( info.indexBytes ), ull( info.indexBuffers ) );
+    BenchmarkTrace( "    mapped+validate %8.3f ms, peak resident set +%llu bytes\n",
+                    timings.mappedTime * 1000.0 / double( iterations ), ull( timings.mappedPeak ) );
+    BenchmarkTrace( "    read+validate   %8.3f ms, peak resident set +%llu bytes (mapped is %.1fx faster)\n",
+                    timings.readTime * 1000.0 / double( iterations ), ull( timings.readPeak ), timings.readTime / timings.mappedTime );
+}
+
+void BenchmarkSDKMESH( const char* fileName, size_t iterations )
+{
+    if ( !fileName || !iterations )
+        return;
+
+#ifdef _WIN32
+    wchar_t wideName[ MAX_PATH ] = {};
+    if ( !MultiByteToWideChar( CP_ACP, 0, fileName, -1, wideName, MAX_PATH ) )
+    {
+        BenchmarkTrace( "ERROR: BenchmarkSDKMESH failed on %s\n", fileName );
+        return;
+    }
+
+    BenchmarkSDKMESH( wideName, iterations );
+#else
+    SDKMESHTimings timings;
+    if ( !TimeSDKMESH( fileName, iterations, timings ) )
+    {
+        BenchmarkTrace( "ERROR: BenchmarkSDKMESH failed on %s\n", fileName );
+        return;
+    }
+
+    BenchmarkTrace( "SDKMESH %s:\n", fileName );
+    TraceSDKMESHTimings( timings, iterations );
+#endif
+}
+
+#ifdef _WIN32
+void BenchmarkSDKMESH( _In_z_ const wchar_t* szFileName, size_t iterations )
+{
+    if ( !szFileName || !iterations )
+        return;
+
+    SDKMESHTimings timings;
+    if ( !TimeSDKMESH( szFileName, iterations, timings ) )
+    {
+        BenchmarkTrace( "ERROR: BenchmarkSDKMESH failed on %ls\n", szFileName );
+        return;
+    }
+
+    BenchmarkTrace( "SDKMESH %ls:\n", szFileName );
+    TraceSDKMESHTimings( timings, iterations );
+}
+#endif
@@ -0,0 +1,256 @@
+//--------------------------------------------------------------------------------------
+// File: SDKMESHValidate.h
+//
+// SDKMESH file layout, and CPU-only validation of SDKMESH files that builds without
+// Windows, so load cost and peak resident memory can be measured headless
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//--------------------------------------------------------------------------------------
+// SDKMESH version 101 file layout (as written by the DirectX SDK samples content
+// exporter). Pointer fields of the original structures are stored as 64-bit offsets.
+//--------------------------------------------------------------------------------------
+namespace SDKMESH
+{
+    const uint32_t SDKMESH_FILE_VERSION = 101;
+
+    const size_t MAX_VERTEX_ELEMENTS = 32;
+    const size_t MAX_VERTEX_STREAMS = 16;
+    const size_t MAX_FRAME_NAME = 100;
+    const size_t MAX_MESH_NAME = 100;
+    const size_t MAX_SUBSET_NAME = 100;
+    const size_t MAX_MATERIAL_NAME = 100;
+    const size_t MAX_TEXTURE_NAME = 260;
+    const size_t MAX_MATERIAL_PATH = 260;
+
+    const uint32_t INVALID_FRAME = uint32_t( -1 );
+    const uint32_t INVALID_MESH = uint32_t( -1 );
+
+    enum SDKMESH_INDEX_TYPE
+    {
+        IT_16BIT = 0,
+        IT_32BIT,
+    };
+
+    enum SDKMESH_PRIMITIVE_TYPE
+    {
+        PT_TRIANGLE_LIST = 0,
+        PT_TRIANGLE_STRIP,
+        PT_LINE_LIST,
+        PT_LINE_STRIP,
+        PT_POINT_LIST,
+        PT_TRIANGLE_LIST_ADJ,
+        PT_TRIANGLE_STRIP_ADJ,
+        PT_LINE_LIST_ADJ,
+        PT_LINE_STRIP_ADJ,
+        PT_QUAD_PATCH_LIST,
+        PT_TRIANGLE_PATCH_LIST,
+    };
+
+    // Direct3D 9 vertex declaration values
+    enum D3DDECLTYPE
+    {
+        D3DDECLTYPE_FLOAT1 = 0,
+        D3DDECLTYPE_FLOAT2 = 1,
+        D3DDECLTYPE_FLOAT3 = 2,
+        D3DDECLTYPE_FLOAT4 = 3,
+        D3DDECLTYPE_D3DCOLOR = 4,
+        D3DDECLTYPE_UBYTE4 = 5,
+        D3DDECLTYPE_SHORT2 = 6,
+        D3DDECLTYPE_SHORT4 = 7,
+        D3DDECLTYPE_UBYTE4N = 8,
+        D3DDECLTYPE_SHORT2N = 9,
+        D3DDECLTYPE_SHORT4N = 10,
+        D3DDECLTYPE_USHORT2N = 11,
+        D3DDECLTYPE_USHORT4N = 12,
+        D3DDECLTYPE_UDEC3 = 13,
+        D3DDECLTYPE_DEC3N = 14,
+        D3DDECLTYPE_FLOAT16_2 = 15,
+        D3DDECLTYPE_FLOAT16_4 = 16,
+        D3DDECLTYPE_UNUSED = 17,
+    };
+
+    enum D3DDECLUSAGE
+    {
+        D3DDECLUSAGE_POSITION = 0,
+        D3DDECLUSAGE_BLENDWEIGHT = 1,
+        D3DDECLUSAGE_BLENDINDICES = 2,
+        D3DDECLUSAGE_NORMAL = 3,
+        D3DDECLUSAGE_TEXCOORD = 5,
+        D3DDECLUSAGE_TANGENT = 6,
+        D3DDECLUSAGE_BINORMAL = 7,
+        D3DDECLUSAGE_COLOR = 10,
+    };
+
+    #pragma pack(push,8)
+
+    struct SDKMESH_HEADER
+    {
+        uint32_t    Version;
+        uint8_t     IsBigEndian;
+        uint64_t    HeaderSize;
+        uint64_t    NonBufferDataSize;
+        uint64_t    BufferDataSize;
+
+        uint32_t    NumVertexBuffers;
+        uint32_t    NumIndexBuffers;
+        uint32_t    NumMeshes;
+        uint32_t    NumTotalSubsets;
+        uint32_t    NumFrames;
+        uint32_t    NumMaterials;
+
+        uint64_t    VertexStreamHeadersOffset;
+        uint64_t    IndexStreamHeadersOffset;
+        uint64_t    MeshDataOffset;
+        uint64_t    SubsetDataOffset;
+        uint64_t    FrameDataOffset;
+        uint64_t    MaterialDataOffset;
+    };
+
+    struct D3DVERTEXELEMENT9
+    {
+        uint16_t    Stream;
+        uint16_t    Offset;
+        uint8_t     Type;
+        uint8_t     Method;
+        uint8_t     Usage;
+        uint8_t     UsageIndex;
+    };
+
+    struct SDKMESH_VERTEX_BUFFER_HEADER
+    {
+        uint64_t            NumVertices;
+        uint64_t            SizeBytes;
+        uint64_t            StrideBytes;
+        D3DVERTEXELEMENT9   Decl[ MAX_VERTEX_ELEMENTS ];
+        uint64_t            DataOffset;
+    };
+
+    struct SDKMESH_INDEX_BUFFER_HEADER
+    {
+        uint64_t    NumIndices;
+        uint64_t    SizeBytes;
+        uint32_t    IndexType;
+        uint64_t    DataOffset;
+    };
+
+    struct SDKMESH_MESH
+    {
+        char                    Name[ MAX_MESH_NAME ];
+        uint8_t                 NumVertexBuffers;
+        uint32_t                VertexBuffers[ MAX_VERTEX_STREAMS ];
+        uint32_t                IndexBuffer;
+        uint32_t                NumSubsets;
+        uint32_t                NumFrameInfluences;
+
+        DirectX::XMFLOAT3       BoundingBoxCenter;
+        DirectX::XMFLOAT3       BoundingBoxExtents;
+
+        uint64_t                SubsetOffset;
+        uint64_t                FrameInfluenceOffset;
+    };
+
+    struct SDKMESH_SUBSET
+    {
+        char        Name[ MAX_SUBSET_NAME ];
+        uint32_t    MaterialID;
+        uint32_t    PrimitiveType;
+        uint64_t    IndexStart;
+        uint64_t    IndexCount;
+        uint64_t    VertexStart;
+        uint64_t    VertexCount;
+    };
+
+    struct SDKMESH_FRAME
+    {
+        char                    Name[ MAX_FRAME_NAME ];
+        uint32_t                Mesh;
+        uint32_t                ParentFrame;
+        uint32_t                ChildFrame;
+        uint32_t                SiblingFrame;
+        DirectX::XMFLOAT4X4     Matrix;
+        uint32_t                AnimationDataIndex;
+    };
+
+    struct SDKMESH_MATERIAL
+    {
+        char                    Name[ MAX_MATERIAL_NAME ];
+        char                    MaterialInstancePath[ MAX_MATERIAL_PATH ];
+        char                    DiffuseTexture[ MAX_TEXTURE_NAME ];
+        char                    NormalTexture[ MAX_TEXTURE_NAME ];
+        char                    SpecularTexture[ MAX_TEXTURE_NAME ];
+
+        DirectX::XMFLOAT4       Diffuse;
+        DirectX::XMFLOAT4       Ambient;
+        DirectX::XMFLOAT4       Specular;
+        DirectX::XMFLOAT4       Emissive;
+        float                   Power;
+
+        uint64_t                Force64_1;
+        uint64_t                Force64_2;
+        uint64_t                Force64_3;
+        uint64_t                Force64_4;
+        uint64_t                Force64_5;
+        uint64_t                Force64_6;
+    };
+
+    #pragma pack(pop)
+
+    static_assert( sizeof(SDKMESH_HEADER) == 104, "SDKMESH header size mismatch" );
+    static_assert( sizeof(D3DVERTEXELEMENT9) == 8, "Vertex element size mismatch" );
+    static_assert( sizeof(SDKMESH_VERTEX_BUFFER_HEADER) == 288, "SDKMESH vertex buffer header size mismatch" );
+    static_assert( sizeof(SDKMESH_INDEX_BUFFER_HEADER) == 32, "SDKMESH index buffer header size mismatch" );
+    static_assert( sizeof(SDKMESH_MESH) == 224, "SDKMESH mesh size mismatch" );
+    static_assert( sizeof(SDKMESH_SUBSET) == 144, "SDKMESH subset size mismatch" );
+    static_assert( sizeof(SDKMESH_FRAME) == 184, "SDKMESH frame size mismatch" );
+    static_assert( sizeof(SDKMESH_MATERIAL) == 1256, "SDKMESH material size mismatch" );
+}
+
+
+//--------------------------------------------------------------------------------------
+struct SDKMESHInfo
+{
+    size_t      vertexBuffers;
+    size_t      indexBuffers;
+    size_t      meshes;
+    size_t      subsets;
+    size_t      frames;
+    size_t      materials;
+    uint64_t    vertices;
+    uint64_t    indices;
+    uint64_t    vertexBytes;
+    uint64_t    indexBytes;
+};
+
+// Checks the header, every section, and every cross-reference of an SDKMESH image
+// without touching a device. False for malformed data.
+bool ValidateSDKMESH( const uint8_t* meshData, size_t dataSize, SDKMESHInfo* info = nullptr );
+
+// Times mapping the file against reading it into memory, each followed by
+// ValidateSDKMESH, and reports how far each raised the process's peak resident set;
+// no device is used
+void BenchmarkSDKMESH( const char* fileName, size_t iterations );
+
+#ifdef _WIN32
+// Wide paths, opened through Win32
+void BenchmarkSDKMESH( _In_z_ const wchar_t* szFileName, size_t iterations );
+#endif
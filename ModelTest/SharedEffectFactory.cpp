@@ -0,0 +1,247 @@
+//--------------------------------------------------------------------------------------
+// File: SharedEffectFactory.cpp
+//
+// Effect factory that can be called from several threads at once
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "DDSTextureLoader.h"
+#include "WICTextureLoader.h"
+
+#include "SharedEffectFactory.h"
+
+#include <exception>
+
+#include <stdlib.h>
+#include <wchar.h>
+
+using namespace DirectX;
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // Helper for the lighting colors BasicEffect and SkinnedEffect share
+    template<typename T>
+    void SetMaterialColors( T* effect, const IEffectFactory::EffectInfo& info )
+    {
+        effect->SetAlpha( info.alpha );
+
+        // Neither effect has an ambient material color
+        effect->SetDiffuseColor( XMLoadFloat3( &info.diffuseColor ) );
+
+        if ( info.specularColor.x != 0 || info.specularColor.y != 0 || info.specularColor.z != 0 )
+        {
+            effect->SetSpecularColor( XMLoadFloat3( &info.specularColor ) );
+            effect->SetSpecularPower( info.specularPower );
+        }
+        else
+        {
+            effect->DisableSpecular();
+        }
+
+        if ( info.emissiveColor.x != 0 || info.emissiveColor.y != 0 || info.emissiveColor.z != 0 )
+        {
+            effect->SetEmissiveColor( XMLoadFloat3( &info.emissiveColor ) );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT LoadTextureFile( _In_ ID3D11Device* device, _In_opt_ ID3D11DeviceContext* deviceContext, const std::wstring& directory, const std::wstring& name,
+                         _Outptr_ ID3D11ShaderResourceView** textureView )
+{
+    std::wstring fullName = directory + name;
+
+    WIN32_FILE_ATTRIBUTE_DATA fileAttr = {};
+    if ( directory.empty() || !GetFileAttributesExW( fullName.c_str(), GetFileExInfoStandard, &fileAttr ) )
+        fullName = name;
+
+    wchar_t ext[ _MAX_EXT ] = {};
+    _wsplitpath_s( name.c_str(), nullptr, 0, nullptr, 0, nullptr, 0, ext, _MAX_EXT );
+
+    if ( _wcsicmp( ext, L".dds" ) == 0 )
+        return CreateDDSTextureFromFile( device, fullName.c_str(), nullptr, textureView );
+
+    if ( deviceContext )
+        return CreateWICTextureFromFile( device, deviceContext, fullName.c_str(), nullptr, textureView );
+
+    return CreateWICTextureFromFile( device, fullName.c_str(), nullptr, textureView );
+}
+
+
+//--------------------------------------------------------------------------------------
+SharedEffectFactory::SharedEffectFactory( _In_ ID3D11Device* device ) :
+    m_device( device ),
+    m_textureRequests( 0 )
+{
+    if ( !device )
+        throw std::exception("Direct3D device is null");
+}
+
+
+//--------------------------------------------------------------------------------------
+std::shared_ptr<IEffect> SharedEffectFactory::CreateEffect( _In_ const EffectInfo& info, _In_opt_ ID3D11DeviceContext* deviceContext )
+{
+    ComPtr<ID3D11ShaderResourceView> texture;
+    if ( info.texture && *info.texture )
+        CreateTexture( info.texture, deviceContext, &texture );
+
+    if ( info.enableSkinning )
+    {
+        auto effect = std::make_shared<SkinnedEffect>( m_device.Get() );
+
+        effect->EnableDefaultLighting();
+        SetMaterialColors( effect.get(), info );
+
+        if ( texture )
+            effect->SetTexture( texture.Get() );
+
+        return effect;
+    }
+    else if ( info.enableDualTexture )
+    {
+        auto effect = std::make_shared<DualTextureEffect>( m_device.Get() );
+
+        // Dual texture effect doesn't support lighting (usually it's lightmaps)
+        effect->SetAlpha( info.alpha );
+
+        if ( info.perVertexColor )
+            effect->SetVertexColorEnabled( true );
+
+        effect->SetDiffuseColor( XMLoadFloat3( &info.diffuseColor ) );
+
+        if ( texture )
+            effect->SetTexture( texture.Get() );
+
+        if ( info.texture2 && *info.texture2 )
+        {
+            ComPtr<ID3D11ShaderResourceView> texture2;
+            CreateTexture( info.texture2, deviceContext, &texture2 );
+
+            effect->SetTexture2( texture2.Get() );
+        }
+
+        return effect;
+    }
+    else
+    {
+        auto effect = std::make_shared<BasicEffect>( m_device.Get() );
+
+        effect->EnableDefaultLighting();
+        effect->SetLightingEnabled( true );
+        SetMaterialColors( effect.get(), info );
+
+        if ( info.perVertexColor )
+            effect->SetVertexColorEnabled( true );
+
+        if ( texture )
+        {
+            effect->SetTexture( texture.Get() );
+            effect->SetTextureEnabled( true );
+        }
+
+        return effect;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void SharedEffectFactory::CreateTexture( _In_z_ const wchar_t* name, _In_opt_ ID3D11DeviceContext* deviceContext, _Outptr_ ID3D11ShaderResourceView** textureView )
+{
+    if ( !name || !textureView )
+        throw std::exception("name and textureView parameters can't be null");
+
+    *textureView = nullptr;
+
+    std::promise<ComPtr<ID3D11ShaderResourceView>> promise;
+    TextureFuture texture;
+    bool load = false;
+
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+
+        ++m_textureRequests;
+
+        auto it = m_textures.find( name );
+        if ( it == m_textures.end() )
+        {
+            texture = promise.get_future().share();
+            m_textures.emplace( name, texture );
+            load = true;
+        }
+        else
+        {
+            texture = it->second;
+        }
+    }
+
+    if ( load )
+    {
+        // Only loads that generate mips on the context need to run one at a time
+        std::unique_lock<std::mutex> contextLock( m_contextMutex, std::defer_lock );
+        if ( deviceContext )
+            contextLock.lock();
+
+        ComPtr<ID3D11ShaderResourceView> view;
+        HRESULT hr = LoadTextureFile( m_device.Get(), deviceContext, m_directory, name, &view );
+        if ( FAILED(hr) )
+        {
+            promise.set_exception( std::make_exception_ptr( std::exception("SharedEffectFactory::CreateTexture failed to read the texture") ) );
+        }
+        else
+        {
+            promise.set_value( view );
+        }
+    }
+
+    // Waits for whichever thread is reading the texture, and rethrows its failure
+    texture.get().CopyTo( textureView );
+}
+
+
+//--------------------------------------------------------------------------------------
+void SharedEffectFactory::SetDirectory( _In_opt_z_ const wchar_t* path )
+{
+    m_directory = ( path ) ? path : L"";
+
+    if ( !m_directory.empty() && m_directory.back() != L'\\' )
+        m_directory += L'\\';
+}
+
+
+//--------------------------------------------------------------------------------------
+void SharedEffectFactory::ReleaseCache()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    m_textures.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t SharedEffectFactory::GetTextureRequests()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    return m_textureRequests;
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t SharedEffectFactory::GetTextureCount()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    return m_textures.size();
+}
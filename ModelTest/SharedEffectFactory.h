@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// File: SharedEffectFactory.h
+//
+// Effect factory that can be called from several threads at once
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Effects.h"
+
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <wrl/client.h>
+
+// Reads a texture file as EffectFactory does: 'directory' first, then the current
+// directory, and DDS or WIC by extension. 'directory' is empty or ends in a backslash.
+// WIC textures get generated mips when 'deviceContext' is given, which the caller must
+// not be using on any other thread.
+HRESULT LoadTextureFile( _In_ ID3D11Device* device, _In_opt_ ID3D11DeviceContext* deviceContext, const std::wstring& directory, const std::wstring& name,
+                         _Outptr_ ID3D11ShaderResourceView** textureView );
+
+// Creates BasicEffect, DualTextureEffect and SkinnedEffect instances as EffectFactory does
+// with sharing turned off, so every call returns a new effect, while each texture is still
+// read only once. The lock covers only the table of texture names: the first thread to ask
+// for a name reads the file without holding it, and any other thread asking for the same
+// name waits on that read, so different textures load in parallel.
+//
+// As with EffectFactory, WIC textures get generated mips only when a device context is
+// passed in. The immediate context is not free-threaded, so loads given a context hold a
+// second lock and run one at a time; loads without one stay parallel. The texture is read
+// once, by the first caller, so whether it has mips depends on that caller's context.
+class SharedEffectFactory : public DirectX::IEffectFactory
+{
+public:
+    explicit SharedEffectFactory( _In_ ID3D11Device* device );
+
+    SharedEffectFactory( const SharedEffectFactory& ) = delete;
+    SharedEffectFactory& operator=( const SharedEffectFactory& ) = delete;
+
+    virtual std::shared_ptr<DirectX::IEffect> CreateEffect( _In_ const EffectInfo& info, _In_opt_ ID3D11DeviceContext* deviceContext ) override;
+
+    // Throws if the texture cannot be read; a name that failed once fails for every caller
+    virtual void CreateTexture( _In_z_ const wchar_t* name, _In_opt_ ID3D11DeviceContext* deviceContext, _Outptr_ ID3D11ShaderResourceView** textureView ) override;
+
+    // As EffectFactory::SetDirectory; not to be called while other threads are loading
+    void SetDirectory( _In_opt_z_ const wchar_t* path );
+
+    void ReleaseCache();
+
+    // Texture names seen since the factory was created, and the textures read for them
+    size_t GetTextureRequests();
+    size_t GetTextureCount();
+
+private:
+    typedef std::shared_future<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> TextureFuture;
+
+    Microsoft::WRL::ComPtr<ID3D11Device>    m_device;
+    std::wstring                            m_directory;
+
+    std::mutex                              m_mutex;
+    std::mutex                              m_contextMutex;     // Held while a load uses a device context
+    size_t                                  m_textureRequests;
+    std::map<std::wstring, TextureFuture>   m_textures;
+};
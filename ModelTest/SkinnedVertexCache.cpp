@@ -0,0 +1,409 @@
+//--------------------------------------------------------------------------------------
+// File: SkinnedVertexCache.cpp
+//
+// Skins model vertices on the CPU, for uses that need skinned positions without a device
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#include <windows.h>
+
+#include "SkinnedVertexCache.h"
+
+#include "BenchmarkTrace.h"
+
+#include <algorithm>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace DirectX;
+
+namespace
+{
+    // Bytes taken by the element formats the parsers produce, for layouts that use
+    // D3D11_APPEND_ALIGNED_ELEMENT; 0 for anything else
+    UINT ElementSize( DXGI_FORMAT format )
+    {
+        switch( format )
+        {
+        case DXGI_FORMAT_R32G32B32A32_FLOAT:    return 16;
+        case DXGI_FORMAT_R32G32B32_FLOAT:       return 12;
+
+        case DXGI_FORMAT_R32G32_FLOAT:
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+        case DXGI_FORMAT_R16G16B16A16_SINT:
+        case DXGI_FORMAT_R16G16B16A16_SNORM:
+        case DXGI_FORMAT_R16G16B16A16_UNORM:    return 8;
+
+        case DXGI_FORMAT_R32_FLOAT:
+        case DXGI_FORMAT_R8G8B8A8_UNORM:
+        case DXGI_FORMAT_R8G8B8A8_UINT:
+        case DXGI_FORMAT_B8G8R8A8_UNORM:
+        case DXGI_FORMAT_R16G16_FLOAT:
+        case DXGI_FORMAT_R16G16_SINT:
+        case DXGI_FORMAT_R16G16_SNORM:
+        case DXGI_FORMAT_R16G16_UNORM:
+        case DXGI_FORMAT_R10G10B10A2_UINT:
+        case DXGI_FORMAT_R10G10B10A2_UNORM:     return 4;
+
+        default:                                return 0;
+        }
+    }
+
+    inline bool IsFloat3( DXGI_FORMAT format )
+    {
+        return ( format == DXGI_FORMAT_R32G32B32_FLOAT || format == DXGI_FORMAT_R32G32B32A32_FLOAT );
+    }
+
+    // FNV-1a over 64-bit words, folded after each step so that high bits of a word also
+    // reach the low bits of the hash
+    uint64_t HashPalette( _In_reads_(count) const XMMATRIX* bones, size_t count )
+    {
+        uint64_t hash = 14695981039346656037ULL ^ count;
+
+        const uint64_t* words = reinterpret_cast<const uint64_t*>( bones );
+        const size_t wordCount = count * sizeof(XMMATRIX) / sizeof(uint64_t);
+        for( size_t j = 0; j < wordCount; ++j )
+        {
+            hash = ( hash ^ words[ j ] ) * 1099511628211ULL;
+            hash ^= hash >> 32;
+        }
+
+        return hash;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT GetSkinnedVertexFormat( const ModelDataVertexBuffer& vb, _Out_ SkinnedVertexFormat& format )
+{
+    format.stride = vb.stride;
+    format.position = format.normal = format.blendIndices = format.blendWeights = SkinnedVertexFormat::NO_ELEMENT;
+    format.blendWeightFormat = DXGI_FORMAT_UNKNOWN;
+
+    if ( !vb.vbDecl )
+        return E_INVALIDARG;
+
+    UINT offset = 0;
+    for( auto it = vb.vbDecl->cbegin(); it != vb.vbDecl->cend(); ++it )
+    {
+        if ( it->InputSlot != 0 || it->InputSlotClass != D3D11_INPUT_PER_VERTEX_DATA )
+            continue;
+
+        if ( it->AlignedByteOffset != D3D11_APPEND_ALIGNED_ELEMENT )
+            offset = it->AlignedByteOffset;
+
+        UINT size = ElementSize( it->Format );
+
+        const char* semantic = it->SemanticName ? it->SemanticName : "";
+        if ( it->SemanticIndex == 0 )
+        {
+            if ( !_stricmp( semantic, "SV_Position" ) || !_stricmp( semantic, "POSITION" ) )
+            {
+                if ( IsFloat3( it->Format ) )
+                    format.position = offset;
+            }
+            else if ( !_stricmp( semantic, "NORMAL" ) )
+            {
+                if ( IsFloat3( it->Format ) )
+                    format.normal = offset;
+            }
+            else if ( !_stricmp( semantic, "BLENDINDICES" ) )
+            {
+                if ( it->Format == DXGI_FORMAT_R8G8B8A8_UINT )
+                    format.blendIndices = offset;
+            }
+            else if ( !_stricmp( semantic, "BLENDWEIGHT" ) )
+            {
+                if ( it->Format == DXGI_FORMAT_R8G8B8A8_UNORM || it->Format == DXGI_FORMAT_R32G32B32A32_FLOAT )
+                {
+                    format.blendWeights = offset;
+                    format.blendWeightFormat = it->Format;
+                }
+            }
+        }
+
+        if ( !size )
+        {
+            // The offset of whatever follows can't be worked out
+            if ( it + 1 != vb.vbDecl->cend() && ( it + 1 )->AlignedByteOffset == D3D11_APPEND_ALIGNED_ELEMENT )
+                return HRESULT_FROM_WIN32( ERROR_NOT_SUPPORTED );
+        }
+
+        offset += size;
+    }
+
+    if ( format.position == SkinnedVertexFormat::NO_ELEMENT
+         || format.blendIndices == SkinnedVertexFormat::NO_ELEMENT
+         || format.blendWeights == SkinnedVertexFormat::NO_ELEMENT )
+        return HRESULT_FROM_WIN32( ERROR_NOT_SUPPORTED );
+
+    // Every element read must lie within the stride
+    const UINT weightSize = ElementSize( format.blendWeightFormat );
+    if ( format.position + 12 > format.stride
+         || ( format.normal != SkinnedVertexFormat::NO_ELEMENT && format.normal + 12 > format.stride )
+         || format.blendIndices + 4 > format.stride
+         || format.blendWeights + weightSize > format.stride )
+        return E_FAIL;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void SkinVertices( _In_reads_bytes_(vertexCount * format.stride) const uint8_t* vertices, size_t vertexCount, const SkinnedVertexFormat& format,
+                   _In_reads_(boneCount) const XMMATRIX* bones, size_t boneCount,
+                   _Out_writes_(vertexCount) XMFLOAT3* positions, _Out_writes_opt_(vertexCount) XMFLOAT3* normals )
+{
+    const bool hasNormals = ( normals && format.normal != SkinnedVertexFormat::NO_ELEMENT );
+    const bool byteWeights = ( format.blendWeightFormat == DXGI_FORMAT_R8G8B8A8_UNORM );
+
+    for( size_t v = 0; v < vertexCount; ++v )
+    {
+        const uint8_t* vertex = vertices + v * format.stride;
+        const uint8_t* indices = vertex + format.blendIndices;
+
+        XMVECTOR weights;
+        if ( byteWeights )
+        {
+            const uint8_t* w = vertex + format.blendWeights;
+            weights = XMVectorScale( XMVectorSet( float( w[0] ), float( w[1] ), float( w[2] ), float( w[3] ) ), 1.f / 255.f );
+        }
+        else
+        {
+            weights = XMLoadFloat4( reinterpret_cast<const XMFLOAT4*>( vertex + format.blendWeights ) );
+        }
+
+        XMFLOAT4 w;
+        XMStoreFloat4( &w, weights );
+        const float weight[4] = { w.x, w.y, w.z, w.w };
+
+        // The weighted sum of the palette matrices, as the skinning shaders blend them
+        XMVECTOR r0 = g_XMZero;
+        XMVECTOR r1 = g_XMZero;
+        XMVECTOR r2 = g_XMZero;
+        XMVECTOR r3 = g_XMZero;
+
+        for( size_t j = 0; j < 4; ++j )
+        {
+            if ( weight[ j ] == 0.f || indices[ j ] >= boneCount )
+                continue;
+
+            const XMMATRIX& bone = bones[ indices[ j ] ];
+            XMVECTOR vw = XMVectorReplicate( weight[ j ] );
+
+            r0 = XMVectorMultiplyAdd( bone.r[0], vw, r0 );
+            r1 = XMVectorMultiplyAdd( bone.r[1], vw, r1 );
+            r2 = XMVectorMultiplyAdd( bone.r[2], vw, r2 );
+            r3 = XMVectorMultiplyAdd( bone.r[3], vw, r3 );
+        }
+
+        XMMATRIX skinning( r0, r1, r2, r3 );
+
+        XMVECTOR position = XMLoadFloat3( reinterpret_cast<const XMFLOAT3*>( vertex + format.position ) );
+        XMStoreFloat3( &positions[ v ], XMVector3Transform( position, skinning ) );
+
+        if ( hasNormals )
+        {
+            XMVECTOR normal = XMLoadFloat3( reinterpret_cast<const XMFLOAT3*>( vertex + format.normal ) );
+            XMStoreFloat3( &normals[ v ], XMVector3Normalize( XMVector3TransformNormal( normal, skinning ) ) );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// SkinnedVertexCache
+//--------------------------------------------------------------------------------------
+
+SkinnedVertexCache::SkinnedVertexCache( const ModelData& data ) :
+    m_data( data ),
+    m_arenaSize( 0 )
+{
+    m_meshes.resize( data.meshes.size() );
+
+    for( size_t j = 0; j < data.meshes.size(); ++j )
+    {
+        auto& mesh = m_meshes[ j ];
+        mesh.poseHash = 0;
+        mesh.skinned = false;
+
+        for( auto it = data.meshes[ j ].parts.cbegin(); it != data.meshes[ j ].parts.cend(); ++it )
+        {
+            if ( it->vertexBuffer >= data.vertexBuffers.size() || FindStream( j, it->vertexBuffer ) )
+                continue;
+
+            auto& vb = data.vertexBuffers[ it->vertexBuffer ];
+
+            Stream stream;
+            if ( FAILED( GetSkinnedVertexFormat( vb, stream.format ) ) )
+                continue;
+
+            if ( vb.offset > data.blob.size() || size_t( vb.vertexCount ) * vb.stride > data.blob.size() - vb.offset )
+                throw std::exception("Vertex buffer outside the model data");
+
+            stream.vertexBuffer = it->vertexBuffer;
+            stream.positions = m_arenaSize;
+            m_arenaSize += vb.vertexCount;
+
+            if ( stream.format.normal != SkinnedVertexFormat::NO_ELEMENT )
+            {
+                stream.normals = m_arenaSize;
+                m_arenaSize += vb.vertexCount;
+            }
+            else
+            {
+                stream.normals = NO_NORMALS;
+            }
+
+            mesh.streams.push_back( stream );
+        }
+    }
+
+    if ( m_arenaSize )
+        m_arena.reset( new XMFLOAT3[ m_arenaSize ] );
+
+    ResetStats();
+}
+
+
+//--------------------------------------------------------------------------------------
+bool SkinnedVertexCache::Update( size_t mesh, _In_reads_(count) const XMMATRIX* bones, size_t count )
+{
+    auto& entry = m_meshes[ mesh ];
+
+    ++m_stats.updates;
+
+    uint64_t hash = HashPalette( bones, count );
+    if ( entry.skinned && entry.poseHash == hash )
+    {
+        ++m_stats.skipped;
+        return false;
+    }
+
+    for( auto it = entry.streams.cbegin(); it != entry.streams.cend(); ++it )
+    {
+        auto& vb = m_data.vertexBuffers[ it->vertexBuffer ];
+
+        SkinVertices( m_data.Data( vb.offset ), vb.vertexCount, it->format, bones, count,
+                      m_arena.get() + it->positions, ( it->normals != NO_NORMALS ) ? m_arena.get() + it->normals : nullptr );
+
+        m_stats.verticesSkinned += vb.vertexCount;
+    }
+
+    entry.poseHash = hash;
+    entry.skinned = true;
+
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+const SkinnedVertexCache::Stream* SkinnedVertexCache::FindStream( size_t mesh, uint32_t vertexBuffer ) const
+{
+    auto& streams = m_meshes[ mesh ].streams;
+    for( auto it = streams.cbegin(); it != streams.cend(); ++it )
+    {
+        if ( it->vertexBuffer == vertexBuffer )
+            return &( *it );
+    }
+
+    return nullptr;
+}
+
+const XMFLOAT3* SkinnedVertexCache::GetPositions( size_t mesh, uint32_t vertexBuffer ) const
+{
+    auto stream = FindStream( mesh, vertexBuffer );
+    if ( !stream || !m_meshes[ mesh ].skinned )
+        return nullptr;
+
+    return m_arena.get() + stream->positions;
+}
+
+const XMFLOAT3* SkinnedVertexCache::GetNormals( size_t mesh, uint32_t vertexBuffer ) const
+{
+    auto stream = FindStream( mesh, vertexBuffer );
+    if ( !stream || !m_meshes[ mesh ].skinned || stream->normals == NO_NORMALS )
+        return nullptr;
+
+    return m_arena.get() + stream->normals;
+}
+
+
+//--------------------------------------------------------------------------------------
+void SkinnedVertexCache::ResetStats()
+{
+    memset( &m_stats, 0, sizeof(m_stats) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+void BenchmarkSkinnedVertexCache( const ModelData& data, size_t iterations )
+{
+    if ( !iterations )
+        return;
+
+    SkinnedVertexCache cache( data );
+
+    const size_t boneCount = IEffectSkinning::MaxBones;
+    XMMATRIX bones[ boneCount ];
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency( &freq );
+
+    // A new pose every iteration, so nothing is skipped
+    LARGE_INTEGER start, stop;
+    QueryPerformanceCounter( &start );
+
+    for( size_t i = 0; i < iterations; ++i )
+    {
+        for( size_t j = 0; j < boneCount; ++j )
+        {
+            bones[ j ] = XMMatrixMultiply( XMMatrixRotationY( float( i + j ) * 0.01f ), XMMatrixTranslation( 0.f, float( i ) * 0.001f, 0.f ) );
+        }
+
+        for( size_t mesh = 0; mesh < data.meshes.size(); ++mesh )
+        {
+            if ( cache.IsSkinned( mesh ) )
+                cache.Update( mesh, bones, boneCount );
+        }
+    }
+
+    QueryPerformanceCounter( &stop );
+    double skinSeconds = double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+    size_t vertices = cache.GetStats().verticesSkinned;
+
+    // The same pose again, which only costs the hash
+    cache.ResetStats();
+    QueryPerformanceCounter( &start );
+
+    for( size_t i = 0; i < iterations; ++i )
+    {
+        for( size_t mesh = 0; mesh < data.meshes.size(); ++mesh )
+        {
+            if ( cache.IsSkinned( mesh ) )
+                cache.Update( mesh, bones, boneCount );
+        }
+    }
+
+    QueryPerformanceCounter( &stop );
+    double skipSeconds = double( stop.QuadPart - start.QuadPart ) / double( freq.QuadPart );
+    size_t skipped = cache.GetStats().skipped;
+
+    BenchmarkTrace( "CPU skinning: %ls, %Iu KB arena, %Iu iterations\n", data.name.c_str(), cache.GetArenaBytes() / 1024, iterations );
+    BenchmarkTrace( "    new pose: %8.3f ms per iteration, %.2f M vertices/s\n",
+                    skinSeconds * 1000.0 / double( iterations ), double( vertices ) / skinSeconds / 1000000.0 );
+    BenchmarkTrace( "    same pose: %8.3f us per iteration, %Iu updates skipped\n",
+                    skipSeconds * 1000000.0 / double( iterations ), skipped );
+}
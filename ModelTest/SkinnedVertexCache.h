@@ -0,0 +1,117 @@
+//--------------------------------------------------------------------------------------
+// File: SkinnedVertexCache.h
+//
+// Skins model vertices on the CPU, for uses that need skinned positions without a device
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "ModelData.h"
+
+#include <memory>
+#include <vector>
+
+// Where the skinning inputs sit within a vertex
+struct SkinnedVertexFormat
+{
+    static const uint32_t NO_ELEMENT = uint32_t( -1 );
+
+    uint32_t        stride;
+    uint32_t        position;           // R32G32B32_FLOAT or R32G32B32A32_FLOAT
+    uint32_t        normal;             // As position, or NO_ELEMENT
+    uint32_t        blendIndices;       // R8G8B8A8_UINT
+    uint32_t        blendWeights;
+    DXGI_FORMAT     blendWeightFormat;  // R8G8B8A8_UNORM or R32G32B32A32_FLOAT
+};
+
+// Finds the skinning inputs in a vertex buffer's layout, as produced by the SDKMESH and CMO
+// parsers. Fails for buffers without blend indices and weights, or with them in other formats.
+HRESULT GetSkinnedVertexFormat( const ModelDataVertexBuffer& vb, _Out_ SkinnedVertexFormat& format );
+
+// Skins vertices the way SkinnedEffect does with four weights per vertex: the palette
+// matrices are blended by weight and applied to the position and normal. 'bones' is the
+// palette IEffectSkinning::SetBoneTransforms takes; influences past 'boneCount' are ignored.
+// 'normals' may be null.
+void SkinVertices( _In_reads_bytes_(vertexCount * format.stride) const uint8_t* vertices, size_t vertexCount, const SkinnedVertexFormat& format,
+                   _In_reads_(boneCount) const DirectX::XMMATRIX* bones, size_t boneCount,
+                   _Out_writes_(vertexCount) DirectX::XMFLOAT3* positions, _Out_writes_opt_(vertexCount) DirectX::XMFLOAT3* normals );
+
+
+struct SkinnedVertexCacheStats
+{
+    size_t  updates;
+    size_t  skipped;            // Updates whose pose hashed the same as the mesh's last one
+    size_t  verticesSkinned;
+};
+
+// Holds the skinned positions and normals of every skinned mesh of a ModelData in one
+// arena, allocated up front and reused by every update. Each mesh remembers a hash of the
+// palette it was last skinned with, and an update with a palette hashing the same is
+// skipped; an unchanged pose is not skinned again however often it is asked for.
+class SkinnedVertexCache
+{
+public:
+    // 'data' must outlive the cache. Meshes drawing from vertex buffers without blend
+    // indices and weights are left out.
+    explicit SkinnedVertexCache( const ModelData& data );
+
+    SkinnedVertexCache( const SkinnedVertexCache& ) = delete;
+    SkinnedVertexCache& operator=( const SkinnedVertexCache& ) = delete;
+
+    bool IsSkinned( size_t mesh ) const { return !m_meshes[ mesh ].streams.empty(); }
+
+    // Skins 'mesh' with its palette, as passed to IEffectSkinning::SetBoneTransforms.
+    // Returns false when the update was skipped.
+    bool Update( size_t mesh, _In_reads_(count) const DirectX::XMMATRIX* bones, size_t count );
+
+    // The skinned vertices of one of the vertex buffers 'mesh' draws from, indexed as the
+    // vertex buffer is. Null when the mesh does not skin that buffer, or for normals when
+    // it has none. Valid until the mesh's next update.
+    const DirectX::XMFLOAT3* GetPositions( size_t mesh, uint32_t vertexBuffer ) const;
+    const DirectX::XMFLOAT3* GetNormals( size_t mesh, uint32_t vertexBuffer ) const;
+
+    size_t GetArenaBytes() const { return m_arenaSize * sizeof(DirectX::XMFLOAT3); }
+
+    const SkinnedVertexCacheStats& GetStats() const { return m_stats; }
+    void ResetStats();
+
+private:
+    static const size_t NO_NORMALS = size_t( -1 );
+
+    struct Stream
+    {
+        uint32_t                vertexBuffer;
+        SkinnedVertexFormat     format;
+        size_t                  positions;      // Offsets into m_arena
+        size_t                  normals;
+    };
+
+    struct Mesh
+    {
+        std::vector<Stream>     streams;
+        uint64_t                poseHash;
+        bool                    skinned;
+    };
+
+    const Stream* FindStream( size_t mesh, uint32_t vertexBuffer ) const;
+
+    const ModelData&                        m_data;
+    std::vector<Mesh>                       m_meshes;
+    std::unique_ptr<DirectX::XMFLOAT3[]>    m_arena;
+    size_t                                  m_arenaSize;
+    SkinnedVertexCacheStats                 m_stats;
+};
+
+// Skins every skinned mesh of 'data' with a new pose each iteration, then again with an
+// unchanged one, and reports vertices per second and the cost of a skipped update. Needs
+// no device.
+void BenchmarkSkinnedVertexCache( const ModelData& data, size_t iterations );